@@ -0,0 +1,70 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+
+#include "repo.h"
+
+/*
+Reachability bitmaps file (objects/info/bitmaps) stores, for a selection of commits, the
+set of every object reachable from them, so marking from such a commit is an OR of its
+bitmap instead of inflating every commit and tree below it. There are no packs, so bit
+positions index an object table in the file itself. All numbers are big-endian:
+- header: "GBMP", version, number of objects N, number of bitmaps M, number of bitmap
+  words W (4 bytes each)
+- fanout: 256 counts, entry i is the number of objects whose hash starts with a byte <= i
+- hashes: N sorted 20 byte object hashes, an object's bit is its index here
+- index: M rows sorted by commit, position of the commit (4) and end of its bitmap in
+  bitmap words (4), its bitmap starts where the previous row's ends
+- bitmaps: W 8 byte EWAH words (see ewah.h)
+- SHA1 of everything above (20)
+Tips of refs and HEAD and every BITMAP_COMMIT_INTERVAL-th commit in date order get a
+bitmap, so a walk from any commit reaches one after a few commits. A commit's bitmap never
+changes, so the file stays valid as new commits are made, only less useful.
+*/
+
+#define BITMAPS_SIG "GBMP"
+#define BITMAPS_VERSION 1
+#define BITMAPS_FILE "info/bitmaps" // relative to objects folder
+
+#define BITMAP_COMMIT_INTERVAL 64
+
+typedef struct reach_bitmaps {
+    unsigned char *map;
+    size_t map_size;
+    uint32_t num_objects;
+    uint32_t num_bitmaps;
+    uint32_t num_words;
+    const unsigned char *fanout;
+    const unsigned char *hashes;
+    const unsigned char *index;
+    const unsigned char *words;
+} reach_bitmaps;
+
+// Maps repo's bitmaps file.
+// @return bitmaps or NULL if repo has none or it is invalid
+reach_bitmaps *reach_bitmaps_open(const git_repo *);
+
+void reach_bitmaps_close(reach_bitmaps *);
+
+// @return position of object in the object table, -1 if it is not in it
+int64_t reach_bitmaps_find(const reach_bitmaps *, const obj_hash);
+
+void reach_bitmaps_hash(const reach_bitmaps *, uint32_t pos, obj_hash *out);
+
+// @return 1 if commit has a bitmap, 0 otherwise
+int reach_bitmaps_has(const reach_bitmaps *, const obj_hash commit);
+
+// ORs every object reachable from `commit` into `bits`, keyed by object table position.
+// @param bits (num_objects + 63) / 64 words
+// @return 1 if commit has a bitmap, 0 if not, -1 if its bitmap is malformed
+int reach_bitmaps_or(const reach_bitmaps *, const obj_hash commit, uint64_t *bits);
+
+// Writes bitmaps of commits reachable from refs and HEAD. The object table is every object
+// reachable from refs, HEAD, MERGE_HEAD and the index. Bitmaps are computed oldest first, so
+// each one starts from the bitmaps of its nearest selected ancestors and only walks the
+// commits and trees in between.
+// @return 0 on success, -1 on failure
+int write_reach_bitmaps(const git_repo *);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef BULKIO_H
+#define BULKIO_H
+
+#include "repo.h"
+
+/*
+Batched stat, read and hash of many files in a repo. On Linux, statx, openat, read
+and close are submitted through io_uring in large batches so per-syscall latency
+(network filesystems, container overlays) overlaps. Completed buffers are hashed on
+a thread pool. Without io_uring, each file is handled by a thread pool task.
+*/
+
+// set to 0 to always use the thread pool
+#ifndef BULK_USE_IO_URING
+    #define BULK_USE_IO_URING 1
+#endif
+
+typedef struct bulk_file {
+    const char *name; // relative to repo root
+    fs_statinfo stat;
+    obj_hash hash;
+    int status; // 0 on success, -1 if file could not be stat-ed, read or stored
+} bulk_file;
+
+// Fills `stat` of every file. Symlinks are not followed, like `lstat`, so a symlink is never
+// taken for the file it points to.
+// @return number of files that failed
+int bulk_stat_files(const git_repo *, bulk_file *files, int num_files);
+
+// Reads and hashes files as blobs. `stat` must already be filled in.
+// Files that are shorter than their stat size when read fail.
+// @param write if 1, blobs are also stored in repo's objects folder
+// @return number of files that failed
+int bulk_hash_files(const git_repo *, bulk_file *files, int num_files, int write);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CHECKOUT_H
+#define CHECKOUT_H
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Moves the working tree and index to a tree. The index the tree would give is merged from
+the current index by `unpack_trees`, then matched against it in sorted order, and only
+paths whose blob or mode changed are touched; every other entry keeps its stat info.
+1. paths that would be overwritten are checked first: tracked files with local changes, or
+   untracked files in the way, also where a new folder must go, stop the checkout before
+   anything is written
+2. files no longer in the tree are removed, along with folders left empty
+3. folders of files to write are created up front, in index order
+4. blobs are inflated and written by a thread pool, each with a few large writes
+5. written files are stat-ed through their open descriptor, so the new index records
+   them as they are on disk
+*/
+
+// files written by one thread pool task
+#define CHECKOUT_CHUNK 32
+
+// overwrite local changes and untracked files
+#define CHECKOUT_FORCE 1
+
+typedef struct checkout_stats {
+    int written;
+    int removed;
+    int failed; // files that could not be written or removed
+} checkout_stats;
+
+// Updates working tree and `dircache` to `target`, taking over its entries. Paths in merge
+// conflict in `target` are left as they are in working tree. The index file is not written.
+// Files that could not be written are reported and counted, and still move to `target` in the
+// index, so they show up as changed.
+// @param flags 0 or `CHECKOUT_FORCE`
+// @param stats if not NULL, filled with number of files written, removed and failed
+// @return 0 on success, 1 if local changes would be overwritten. Nothing is changed unless 0
+// is returned.
+int checkout_index(const git_repo *, git_dircache *, git_dircache *target, int flags, checkout_stats *stats);
+
+// Switches working tree and `dircache` from `head_tree` to `tree`, keeping staged changes
+// to paths that are the same in both. Forced checkouts reset the index to `tree` instead.
+// @param head_tree NULL if there is no current commit
+// @return 0 on success, 1 if local or staged changes would be overwritten, -1 if a tree could
+// not be read. Nothing is changed unless 0 is returned.
+int checkout_tree(const git_repo *, git_dircache *, const char *head_tree, const obj_hash tree, int flags, checkout_stats *stats);
+
+#endif
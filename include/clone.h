@@ -0,0 +1,33 @@
+#ifndef CLONE_H
+#define CLONE_H
+
+#include "repo.h"
+#include "transfer.h"
+#include "checkout.h"
+
+/*
+Clones a repo on the same host:
+1. a new repo is created at the destination
+2. every loose object is hardlinked, or copied across filesystems (see transfer.h), along
+   with the commit-graph and bitmaps files, which stay valid as the objects are the same
+3. branches of the source become remote-tracking refs under refs/remotes/origin, tags are
+   kept as they are, and the branch HEAD points to is created locally
+4. the source is added to config as remote "origin"
+5. HEAD's tree is checked out into the empty working tree in a single parallel pass
+*/
+
+typedef struct clone_stats {
+    int num_objects;
+    transfer_stats objects;
+    int num_refs;
+    checkout_stats checkout;
+} clone_stats;
+
+// @param src_path root of an existing repo
+// @param dest_path folder to clone into, created if it does not exist
+// @param stats if not NULL, filled with objects transferred, refs written and files checked out
+// @return 0 on success, 1 if `dest_path` is not an empty folder or `src_path` is not a repo,
+// -1 on failure
+int clone_repo(const char *src_path, const char *dest_path, clone_stats *stats);
+
+#endif
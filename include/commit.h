@@ -0,0 +1,62 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include <time.h>
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Commits the index. Folder trees of the index are hashed in memory, then compared
+against the parent commit's trees: a tree with the same hash as the parent's is
+reused as is, so only trees along changed paths are read, checked and written.
+Blobs are already stored by `add`.
+*/
+
+// used for author and committer when set, otherwise $USER and <$USER@localhost>
+#define AUTHOR_NAME_ENV "GORDIT_AUTHOR_NAME"
+#define AUTHOR_EMAIL_ENV "GORDIT_AUTHOR_EMAIL"
+
+typedef struct commit_info {
+    obj_hash tree;
+    int num_parents;
+    obj_hash *parents;
+    time_t timestamp; // committer time
+} commit_info;
+
+// Parses header lines of a commit object's content, without its object header.
+// @return 0 on success, -1 if content is not a valid commit
+int parse_commit_info(const char *content, size_t size, commit_info *out);
+
+// Reads tree, parents and committer time of a commit file.
+// @return 0 on success, -1 if could not read commit
+int read_commit_info(const git_repo *, const obj_hash, commit_info *out);
+
+void free_commit_info(commit_info *);
+
+// Writes trees of the index that are not in `parent_tree`.
+// @param parent_tree tree of parent commit, NULL if there is none
+// @return 0 on success, -1 on failure
+int write_index_trees(const git_repo *, const git_dircache *, const index_tree *, const char *parent_tree);
+
+// Writes commit object for `tree_hash`.
+// @param parents first parent first, none for a root commit
+// @return 0 on success, -1 on failure
+int write_commit(const git_repo *, const obj_hash tree_hash, const obj_hash *parents, int num_parents, const char *msg, obj_hash *out);
+
+// Writes a commit for `tree_hash` with the author and message of `original`, and the
+// current user as committer, like a replayed commit.
+// @return 0 on success, -1 if `original` could not be read or commit could not be written
+int write_commit_copy(const git_repo *, const obj_hash tree_hash, const obj_hash *parents, int num_parents,
+    const obj_hash original, obj_hash *out);
+
+// Creates commit from the index on top of HEAD and moves the ref HEAD points to onto it.
+// If MERGE_HEAD exists, it becomes the second parent and is removed.
+// @return 0 on success, 1 if index has nothing new to commit, -1 on failure
+int commit_index(const git_repo *, const git_dircache *, const char *msg, obj_hash *out);
+
+// Prints commit like `git log`, or its short hash and subject if `oneline` is 1.
+// @return 0 on success, -1 if could not read commit
+int print_commit(const git_repo *, const obj_hash, int oneline);
+
+#endif
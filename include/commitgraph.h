@@ -0,0 +1,123 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "repo.h"
+#include "commit.h"
+
+/*
+Commit-graph file (objects/info/commit-graph) caches what history walks need from
+each commit, so they never inflate commit objects. All numbers are big-endian:
+- header: "CGPH", version, number of commits N, number of extra edges E,
+  size of bloom filter data B (4 bytes each)
+- fanout: 256 counts, entry i is the number of commits whose hash starts with a byte <= i
+- hashes: N sorted 20 byte commit hashes, a commit's position is its index here
+- data: N fixed-width rows of 36 bytes:
+    - tree hash (20)
+    - 1st parent position (4), GRAPH_PARENT_NONE if root
+    - 2nd parent position (4), GRAPH_PARENT_NONE if none, or GRAPH_EXTRA_EDGES | index into
+      edges where the rest of the parents of an octopus merge are listed
+    - generation << 2 | top 2 bits of commit time (4)
+    - low 32 bits of commit time (4)
+- edges: E parent positions, the last parent of each commit has GRAPH_LAST_EDGE set
+- bloom index: N offsets into bloom data where each commit's filter ends (4 each)
+- bloom data: B bytes of changed-path bloom filters
+- SHA1 of everything above (20)
+A commit's generation is 1 if it has no parents, otherwise 1 + max generation of its parents,
+so a commit can never be an ancestor of one with a lower generation.
+
+A commit's bloom filter holds every path that changed against its first parent (or the
+empty tree for root commits), including the folders above them. A path missing from the
+filter definitely did not change, so path-limited walks can skip diffing that commit.
+Filters use BLOOM_BITS_PER_ENTRY bits per path and BLOOM_NUM_HASHES murmur3 hashes. Commits
+with more than BLOOM_MAX_PATHS changed paths get a single 0xff byte, which matches any path.
+*/
+
+#define COMMIT_GRAPH_SIG "CGPH"
+#define COMMIT_GRAPH_VERSION 2
+#define COMMIT_GRAPH_FILE "info/commit-graph" // relative to objects folder
+
+#define GRAPH_PARENT_NONE 0x70000000
+#define GRAPH_EXTRA_EDGES 0x80000000
+#define GRAPH_LAST_EDGE 0x80000000
+
+#define BLOOM_BITS_PER_ENTRY 10
+#define BLOOM_NUM_HASHES 7
+#define BLOOM_MAX_PATHS 512
+
+// generation of commits that are not in commit-graph
+#define GENERATION_INFINITY 0xffffffff
+
+// how far commit times may go backwards along history before walks of commits missing
+// from commit-graph, which can only go by commit time, give wrong answers
+#define COMMIT_CLOCK_SKEW (24 * 60 * 60)
+
+typedef struct commit_graph {
+    unsigned char *map;
+    size_t map_size;
+    uint32_t num_commits;
+    uint32_t num_edges;
+    const unsigned char *fanout;
+    const unsigned char *hashes;
+    const unsigned char *data;
+    const unsigned char *edges;
+    const unsigned char *bloom_index;
+    const unsigned char *bloom_data;
+    uint32_t bloom_size;
+} commit_graph;
+
+// hashes of a path, computed once and tested against many filters
+typedef struct bloom_key {
+    uint32_t hashes[BLOOM_NUM_HASHES];
+} bloom_key;
+
+// Maps repo's commit-graph file.
+// @return graph or NULL if repo has none or it is invalid
+commit_graph *commit_graph_open(const git_repo *);
+
+void commit_graph_close(commit_graph *);
+
+// Looks up position of commit with a fanout lookup and binary search.
+// @return 1 if found, 0 otherwise
+int commit_graph_find(const commit_graph *, const obj_hash, uint32_t *pos);
+
+// Same as `commit_graph_find` for a 20 byte binary hash.
+int commit_graph_find_bytes(const commit_graph *, const unsigned char *hash, uint32_t *pos);
+
+// @return 20 byte binary hash of commit, pointing into the graph
+const unsigned char *commit_graph_hash_bytes(const commit_graph *, uint32_t pos);
+
+void commit_graph_hash(const commit_graph *, uint32_t pos, obj_hash *out);
+
+void commit_graph_tree(const commit_graph *, uint32_t pos, obj_hash *out);
+
+uint32_t commit_graph_generation(const commit_graph *, uint32_t pos);
+
+time_t commit_graph_timestamp(const commit_graph *, uint32_t pos);
+
+// Fills `out` with positions of up to `max` parents.
+// @return number of parents, which may be more than `max`
+int commit_graph_parents(const commit_graph *, uint32_t pos, uint32_t *out, int max);
+
+// @param path relative to repo root, without leading or trailing '/'
+void bloom_key_init(bloom_key *, const char *path);
+
+// @return 0 if commit's filter rules out that key's path changed against its first parent,
+// 1 if it may have changed
+int commit_graph_bloom_maybe(const commit_graph *, uint32_t pos, const bloom_key *);
+
+// Gets commit's info from commit-graph, or parses its commit file if it is not in it.
+// @param graph may be NULL
+// @param generation if not NULL, set to commit's generation, or `GENERATION_INFINITY`
+// @return 0 on success, -1 if could not read commit
+int load_commit_info(const git_repo *, const commit_graph *graph, const obj_hash, commit_info *out, uint32_t *generation);
+
+// Writes commit-graph of all commits reachable from HEAD and refs. Commits already in
+// the current commit-graph, and their bloom filters, are copied from it instead of being
+// read again. Filters of new commits are computed on a thread pool.
+// @return 0 on success, -1 on failure
+int write_commit_graph(const git_repo *);
+
+#endif
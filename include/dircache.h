@@ -18,17 +18,46 @@ typedef struct {
     int stage_num;
     int git_mode;
     int namelen; 
-    char name[PATH_MAX]; // path relative to repo root
+    int fsm_valid; // 1 if fsmonitor reports no change since stat info was recorded
+    char name[]; // path relative to repo root, allocated with entry
 } git_index_entry;
 
+#define FSMONITOR_TOKEN_SIZE 64
+
+// tree id of one folder of the index, as last hashed by `hash_index_trees`
+typedef struct cached_tree {
+    char *path; // folder path including trailing '/', "" for root
+    int num_entries; // entries under folder when hashed, -1 once any of them changed
+    obj_hash hash;
+} cached_tree;
+
+// Tree ids kept in the index file, so folders whose entries did not change since they were
+// last hashed are not hashed again. Every change to an entry drops the ids of its folders.
+typedef struct tree_cache {
+    cached_tree *trees; // sorted by path
+    int num_trees;
+} tree_cache;
+
 typedef struct {
     int num_entries;
     int capacity;
     git_index_entry **entries; // sorted by name in memcmp() order, entries with same name are sorted by stage_num
+    char fsmonitor_token[FSMONITOR_TOKEN_SIZE]; // last fsmonitor token seen, empty if none
+    time_t index_mtime; // mtime of index file when read, 0 if there was none
+    tree_cache *trees; // NULL if tree ids are not cached, as in dircaches not read by `create_dircache`
 } git_dircache;
 
 void free_dircache(git_dircache *);
 
+// frees entries of a dircache that was not allocated by `create_dircache`, leaving it empty
+void clear_dircache(git_dircache *);
+
+// frees entries of `dircache` and its cached tree ids, then moves entries of `from` into it
+void replace_dircache_entries(git_dircache *dircache, git_dircache *from);
+
+// drops cached tree ids of every folder holding entry `name`, after it was added, changed or removed
+void invalidate_cached_trees(git_dircache *, const char *name);
+
 void print_dircache(git_dircache *);
 
 // parse contents of repo's index into struct
@@ -38,7 +67,19 @@ git_dircache *create_dircache(const git_repo *);
 // if file is aready in index, updates it only if stat info has changed
 int add_file_to_dc(git_dircache *, const fileinfo *);
 
-// adds entry to repo's index. entry must be of a blob!
+// @return 1 if entry's stat info matches `stat` and entry was recorded before the index was
+// last written, so a change in the same second could not have been missed
+int is_entry_clean(const git_dircache *, const git_index_entry *, const fs_statinfo *stat);
+
+// adds files to repo's index and stores their blobs. files are stat-ed, read and hashed in bulk,
+// and only files whose stat info differs from their index entry are read.
+// @param names paths relative to repo root
+// @return number of files that could not be added
+int add_files_to_dc(const git_repo *, git_dircache *, char **names, int num_names);
+
+// adds entry to repo's index with no stat info, replacing any entries of its path.
+// @param tree_entry blob whose name is a path relative to repo root
+// @return 0 on success, -1 if entry is not a blob
 int add_tree_entry_to_dc(const git_repo *, git_dircache *, git_tree_entry *);
 
 // removes file's entries from repo's index.
@@ -46,8 +87,49 @@ int add_tree_entry_to_dc(const git_repo *, git_dircache *, git_tree_entry *);
 // @return 0 if removed, -1 if not in index
 int remove_file_from_dc(git_dircache *, const fileinfo *);
 
+// removes entries of all files in one pass over the index.
+// @param names sorted paths relative to repo root
+// @return number of entries removed
+int remove_files_from_dc(git_dircache *, char **names, int num_names);
+
 int write_index(const git_repo *, git_dircache *);
 
+// compares entry names in index order
+int index_sort_cmp(const char *name1, const char *name2);
+
+// @return position of first entry whose name is not smaller than `name`
+int index_lower_bound(const git_dircache *, const char *name);
+
+// @return first entry (lowest stage) named `name`, or NULL if not in index
+git_index_entry *find_index_entry(const git_dircache *, const char *name);
+
 git_obj_tree *build_tree_from_index(git_dircache *);
 
+// tree of one folder of the index, computed without building tree structs
+typedef struct index_tree_node {
+    int lo, hi; // entries under this folder
+    int prefix_len; // length of folder's path including trailing '/', 0 for root
+    int end; // nodes in [this + 1, end) are under this folder
+    obj_hash hash;
+} index_tree_node;
+
+typedef struct index_tree {
+    index_tree_node *nodes; // pre-order, nodes[0] is root
+    int num_nodes;
+    int capacity;
+    int num_hashed; // nodes whose tree was hashed, the rest were taken from the tree cache
+} index_tree;
+
+// Hashes the tree of every folder in the index, bottom-up. Trees hash the same as
+// ones from `build_tree_from_index`. Entries in merge conflict are left out.
+// Folders with a valid cached tree id are not hashed, and the cache is updated after.
+// @return 0 on success
+int hash_index_trees(const git_dircache *, index_tree *out);
+
+// Serializes tree of node `k` without its object header.
+// @return malloc-ed tree content
+unsigned char *index_tree_content(const git_dircache *, const index_tree *, int k, size_t *size);
+
+void free_index_tree(index_tree *);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef EWAH_H
+#define EWAH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+EWAH compressed bitmaps. A bitmap of 64-bit words is stored as a sequence of big-endian
+marker words, each followed by literal words:
+- bit 0: value of the clean words (all 0 or all 1)
+- bits 1-32: number of clean words
+- bits 33-63: number of literal words that follow, copied as is
+Sparse and dense stretches of a reachability bitmap collapse into single markers, and
+decoding is one pass over the words, so OR-ing a bitmap into a plain bitset is cheap.
+*/
+
+#define EWAH_MAX_CLEAN 0xffffffffULL
+#define EWAH_MAX_LITERALS 0x7fffffffULL
+
+// Compresses `num_words` words of a plain bitset. Trailing zero words are left out.
+// @param out filled with malloc-ed big-endian words
+// @return size of `out` in bytes
+size_t ewah_encode(const uint64_t *bits, size_t num_words, unsigned char **out);
+
+// ORs a compressed bitmap into a plain bitset of `num_words` words.
+// @return 0 on success, -1 if it is malformed or longer than the bitset
+int ewah_or_into(const unsigned char *data, size_t size, uint64_t *bits, size_t num_words);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include "repo.h"
+#include "transfer.h"
+
+/*
+Fetches from a repo on the same host:
+1. wants are the remote's branch, tag and HEAD tips the receiver does not have; haves are
+   the receiver's ref and HEAD tips, and the ones the remote also has are common
+2. commits reachable from the remote's tips but not from common haves are walked in the
+   remote, using its commit-graph, so an incremental fetch only reads the commits made since.
+   Only refs prove the receiver has everything below a commit, so commits and tags it has
+   outside of them are walked too, in case a failed fetch left them behind on their own
+3. trees of those commits are walked, skipping any tree or blob the receiver already has
+   without reading it, since having a tree means having everything below it. When the
+   remote has reachability bitmaps, the bitmaps of common haves are ORed together first, and
+   an object they list is known to be in the receiver without a stat there
+4. the missing objects are linked or copied into the receiver (see transfer.h) before any
+   ref is moved, so refs never point to objects that are not there yet. They go in phases,
+   blobs, then trees from the deepest up, then commits and tags, each phase only starting
+   once the one before it succeeded, so a tree never arrives before what it points to
+5. branches of the remote are written to refs/remotes/<remote>, new tags are added, and
+   every fetched branch is listed in FETCH_HEAD
+There are no packs, so objects arrive as loose files and need no index.
+*/
+
+#define FETCH_HEAD_NAME "FETCH_HEAD"
+
+typedef struct fetch_stats {
+    int num_wants;
+    int num_common; // haves the remote also has
+    int num_commits; // commits missing in the receiver
+    int num_objects; // objects missing in the receiver, commits included
+    int num_known; // objects found in the receiver through the remote's bitmaps
+    transfer_stats objects;
+    int num_refs; // refs created or moved
+} fetch_stats;
+
+// @param remote name or path of remote, NULL for DEFAULT_REMOTE. Remote-tracking refs are
+// only written for remotes in config, fetching from any other path only writes FETCH_HEAD.
+// @param stats if not NULL, filled with negotiation and transfer counts
+// @return 0 on success, 1 if remote is not a repo, -1 on failure
+int fetch_remote(const git_repo *, const char *remote, fetch_stats *stats);
+
+#endif
@@ -11,14 +11,15 @@ typedef struct fileinfo {
 } fileinfo;
 
 
-int is_file_args_valid(const git_repo *repo, char **args, int num_args);
-
 // assume path is a valid file inside repo root
 struct fileinfo *start_fileinfo(const git_repo *repo, const char *path, const char *mode);
 
 // closes file stream
 void end_fileinfo(struct fileinfo *info);
 
-int is_file_ignored(const git_repo *repo, struct fileinfo *info);
+// checks .gorditignore files of every folder from root down to the file's parent, through
+// the repo's ignore cache as of its last `ignore_cache_refresh`
+// @param path absolute path of file inside repo
+int is_file_ignored(const git_repo *repo, const char *path);
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <unistd.h>
     
@@ -39,18 +40,50 @@ typedef struct fs_statinfo {
 
 #define FS_ISFILE 1
 #define FS_ISDIR 0
+#define FS_ISOTHER 2
+
+// Open directory stream. Entries are stat-ed relative to it only when asked.
+typedef struct fs_dir {
+    DIR *dir;
+    int fd;
+#ifdef _WIN32
+    char *path;
+#endif
+} fs_dir;
 
 typedef struct fs_dirent {
-    char de_name[PATH_MAX];
-    char de_path[PATH_MAX];
-    long de_ino;
-    unsigned int de_mode;
-    size_t de_size;
-    int de_type; // `FS_FILE` or `FS_ISDIR`
+    const char *de_name; // valid until next `fs_dir_next` on same stream
+    size_t de_namelen;
+    ino_t de_ino;
+    int de_type; // `FS_ISFILE`, `FS_ISDIR` or `FS_ISOTHER`
 } fs_dirent;
 
-// Wrapper around `readdir` that has more guaranteed fields.
-fs_dirent *fs_readdir(DIR *, const char *directory_path);
+// @return directory stream or NULL on failure
+fs_dir *fs_dir_open(const char *path);
+
+// Opens subdirectory `name` of an open directory without building its path.
+// @return directory stream or NULL on failure
+fs_dir *fs_dir_openat(const fs_dir *parent, const char *name);
+
+// Reads next entry, skipping "." and "..". Uses `d_type` when filesystem provides it.
+// Reentrant: all state lives in the stream.
+// @return 1 if `out` was filled, 0 at end of directory, -1 on error
+int fs_dir_next(fs_dir *, fs_dirent *out);
+
+// Same as `fs_getinfo` for an entry of `dir`, relative to its descriptor.
+// @return 0 on success, otherwise -1
+int fs_dir_getinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo);
+
+// Same as `fs_dir_getinfo`, except a symlink is described itself instead of its target,
+// like `lstat`.
+// @return 0 on success, otherwise -1
+int fs_dir_lgetinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo);
+
+// Opens file entry of `dir` as a stream.
+// @return NULL on failure
+FILE *fs_dir_fopen(const fs_dir *dir, const char *name, const char *mode);
+
+void fs_dir_close(fs_dir *);
 
 // Same as `mkdir` in POSIX. Note: mode is ignored on Win32.
 // @return 1 if folder already exists, 0 on success, otherwise -1
@@ -63,6 +96,9 @@ DIR * fs_opendir(const char *);
 // @return 0 on success, otherwise -1
 int fs_getinfo(const char *path, struct fs_statinfo *statinfo);
 
+// Converts result of `stat()` or `fstat()`.
+void fill_statinfo(const struct stat *st, struct fs_statinfo *statinfo);
+
 // @brief Gets path in absolute form.  
 // @return 0 on success, otherwise -1.
 int fs_path_abs(const char *path, char *out);
@@ -82,4 +118,8 @@ void fs_path_join(const char *path1, const char *path2, char *out);
 // @return 1 if path exists, 0 otherwise
 int fs_file_exists(const char *);
 
+// Sets access and modification times of an existing file to now.
+// @return 0 on success, otherwise -1
+int fs_touch(const char *path);
+
 #endif
\ No newline at end of file
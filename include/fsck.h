@@ -0,0 +1,32 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include "repo.h"
+
+/*
+Verifies every loose object, one fan-out folder per task on a thread pool:
+1. the file is inflated a chunk at a time straight into its hash, so blobs are never held
+   whole; the size in its header must match the bytes inflated, and the contents must hash
+   back to the file's name
+2. trees must parse, be in tree order without duplicate names, and point to existing
+   objects; commits must have a tree and existing parents; tags an existing object
+3. each object records which types it is used as, so once all tasks finish a single pass
+   reports objects used as the wrong type, and dangling objects that no object, ref, HEAD,
+   MERGE_HEAD or index entry points to
+Each object is read exactly once, so the check is bound by how fast the files can be read.
+Problems are printed grouped by fan-out folder, in hash order.
+*/
+
+typedef struct fsck_stats {
+    int num_objects;
+    int num_corrupt; // could not be read, inflated, hashed back to its name or parsed
+    int num_missing; // pointed to by an object or ref, but not stored
+    int num_bad_type; // used as a different type than it is
+    int num_dangling;
+} fsck_stats;
+
+// @return 0 if no object is corrupt, missing or of the wrong type, 1 if some are, -1 if
+// objects could not be listed
+int fsck_objects(const git_repo *, fsck_stats *out);
+
+#endif
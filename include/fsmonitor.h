@@ -0,0 +1,45 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Optional filesystem monitor daemon. Watches the working tree with inotify and keeps
+a set of paths changed since a monotonic token. Commands query it over a UNIX socket
+in the git folder and only need to lstat the paths it reports.
+
+Tokens look like "<daemon instance>:<sequence number>". A token from another daemon
+instance, or one older than the last inotify queue overflow, makes the query report
+that a full scan is needed.
+*/
+
+#define FSMONITOR_SOCK_NAME "fsmonitor.sock"
+
+typedef struct fsmonitor_changes {
+    char token[FSMONITOR_TOKEN_SIZE]; // token to pass to next query
+    int full_scan; // 1 if changes are unknown and every path must be checked
+    int num_paths;
+    char **paths; // relative to repo root, directories end in '/' and cover everything below them
+} fsmonitor_changes;
+
+// Runs the daemon in the foreground until stopped or the repo root is removed.
+// @return 0 on clean shutdown, -1 if daemon could not start
+int fsmonitor_run(const git_repo *);
+
+// Asks a running daemon to shut down.
+// @return 0 on success, -1 if no daemon is running
+int fsmonitor_stop(const git_repo *);
+
+// Gets paths changed since `since_token` (may be empty) from the running daemon.
+// @return 0 on success, -1 if no daemon is running
+int fsmonitor_query(const git_repo *, const char *since_token, fsmonitor_changes *out);
+
+void free_fsmonitor_changes(fsmonitor_changes *);
+
+// Clears `fsm_valid` of index entries the daemon reports as changed and records new token.
+// If no daemon is running, clears token and all `fsm_valid` flags.
+// @return 1 if `fsm_valid` flags can be trusted, 0 otherwise
+int fsmonitor_refresh_dircache(const git_repo *, git_dircache *);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "repo.h"
+
+/*
+Garbage collection of loose objects.
+1. every loose object is listed once, one fan-out folder per task, into a sorted array, so
+   an object's position in it is its key
+2. objects reachable from refs, HEAD, MERGE_HEAD and the index are marked in a bitset keyed
+   by that position. Commits, trees and tags are read on a thread pool, each object is queued
+   by whoever sets its bit first, and blobs are marked from tree entries without being read.
+   Commits with a reachability bitmap are not read at all, their bitmap is OR-ed in
+3. unmarked objects not modified within the grace period are deleted, one fan-out folder
+   per task
+Objects written after listing are never candidates, and writing an object that is already
+stored touches its file, so an old unreachable object a concurrent command starts using
+again counts as recent and is kept.
+*/
+
+// unreachable objects modified in the last two weeks are kept
+#define GC_DEFAULT_GRACE (14 * 24 * 60 * 60)
+
+typedef struct loose_object {
+    obj_hash hash;
+    time_t mtime;
+} loose_object;
+
+typedef struct loose_objects {
+    loose_object *objects; // sorted by hash
+    int num_objects;
+    int fanout[257]; // objects whose hash starts with byte b are in [fanout[b], fanout[b + 1])
+} loose_objects;
+
+// @return 0 on success, -1 if the objects folder could not be read
+int list_loose_objects(const git_repo *, loose_objects *out);
+
+// @return position of `hash` in `objects`, -1 if it is not a loose object
+int find_loose_object(const loose_objects *, const char *hash);
+
+void free_loose_objects(loose_objects *);
+
+// one bit per object position, set atomically so several workers can mark at once
+typedef _Atomic uint64_t reach_word;
+#define REACH_WORDS(num_objects) (((num_objects) + 63) / 64)
+
+// @return 1 if the object at `pos` is marked, 0 otherwise
+int is_reachable(const reach_word *bits, int pos);
+
+// Marks every object reachable from `tips`. A commit with a reachability bitmap (see
+// bitmap.h) has its bitmap OR-ed in instead of being read.
+// @param bits REACH_WORDS(num_objects) words, objects already marked are not walked again
+// @return 0 on success, -1 if a reachable object is missing or could not be read
+int mark_reachable_from(const git_repo *, const loose_objects *, const obj_hash *tips, int num_tips, reach_word *bits);
+
+// Same as `mark_reachable_from` with refs, HEAD, MERGE_HEAD and the index as tips.
+int mark_reachable_objects(const git_repo *, const loose_objects *, reach_word *bits);
+
+typedef struct gc_stats {
+    int num_objects;
+    int num_reachable;
+    int num_recent; // unreachable, but modified within the grace period
+    int num_pruned;
+} gc_stats;
+
+// Deletes unreachable loose objects last modified before `expire`.
+// @return 0 on success, -1 if marking failed, so nothing was deleted, or some objects could not
+// be deleted
+int gc_prune(const git_repo *, time_t expire, gc_stats *out);
+
+#endif
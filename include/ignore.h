@@ -0,0 +1,41 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include "repo.h"
+
+/*
+Matches paths against .gorditignore files. Each directory's ignore file is read and
+compiled once, the first time a path under it is checked, and kept in a cache shared
+by all threads. Supported syntax, as in git:
+    # comment      blank lines and lines starting with '#' are skipped
+    name           matches a file or directory with that name at any depth
+    dir/name       contains a '/', so is anchored to the ignore file's directory
+    /name          anchored to the ignore file's directory
+    name/          only matches directories
+    !name          re-includes a path excluded by an earlier or shallower pattern
+    *, ?, [a-z]    match within one path component
+    **             as a whole path component, matches any number of directories
+The last matching pattern wins and deeper ignore files win over shallower ones.
+Paths inside an ignored directory are always ignored.
+Literal patterns are looked up by hash. Glob patterns are compiled into a list of states
+that is run over a path in a single pass, without backtracking.
+*/
+
+typedef struct ignore_cache ignore_cache;
+
+ignore_cache *ignore_cache_create(const git_repo *);
+
+// Safe to call from multiple threads at once.
+// @param path '/' seperated path relative to repo root
+// @param is_dir 1 if path is a directory
+// @return 1 if path is ignored
+int ignore_cache_check(ignore_cache *, const char *path, int is_dir);
+
+// Reloads the cache if an ignore file it read was changed, added or removed since.
+// Checks do not look for changes themselves, so callers refresh once before each walk.
+// Must not run while other threads check paths against the cache.
+void ignore_cache_refresh(ignore_cache *);
+
+void ignore_cache_free(ignore_cache *);
+
+#endif
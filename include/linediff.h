@@ -0,0 +1,90 @@
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include <stddef.h>
+
+#include "repo.h"
+#include "objects.h"
+
+/*
+Diffs two buffers line by line.
+1. every line is hashed once and interned, so both sides become arrays of integer tokens
+   and lines are compared by token from then on
+2. lines shared at the start and end are trimmed, and lines that do not appear on the
+   other side at all are marked changed up front and left out of the search
+3. the rest goes to one of:
+   - Myers: greedy search for the shortest edit script from both ends at once, splitting
+     at the middle snake in linear space. After a cost proportional to the square root
+     of the input, the furthest reaching split is taken instead, so large files with
+     little in common cannot make it quadratic.
+   - histogram: splits at the longest common run around the line that occurs least
+     often in the old side, recursing on both sides, which keeps moved blocks and
+     repeated lines (braces, blank lines) from anchoring the diff. Ranges with no line
+     rare enough fall back to Myers.
+4. changed lines are grouped into changes, and printed as unified hunks
+*/
+
+#define LINE_DIFF_MYERS 0
+#define LINE_DIFF_HISTOGRAM 1
+
+// lines of unchanged context printed around each change
+#define DIFF_CONTEXT_LINES 3
+
+typedef struct diff_line {
+    const char *start;
+    size_t len; // including its '\n', if it has one
+} diff_line;
+
+typedef struct line_change {
+    int old_pos, old_len; // lines [old_pos, old_pos + old_len) of old side are removed
+    int new_pos, new_len; // lines [new_pos, new_pos + new_len) of new side are added
+} line_change;
+
+typedef struct line_diff {
+    diff_line *old_lines, *new_lines; // pointing into the diffed buffers
+    int num_old, num_new;
+    line_change *changes; // in order, separated by at least one unchanged line
+    int num_changes;
+    int capacity;
+} line_diff;
+
+// @param algorithm `LINE_DIFF_MYERS` or `LINE_DIFF_HISTOGRAM`
+// @return 0 on success. The buffers must outlive `out`.
+int diff_lines(const char *old, size_t old_size, const char *new, size_t new_size, int algorithm, line_diff *out);
+
+// Prints changes as unified hunks, merging changes whose context would overlap. Each hunk
+// header ends with the closest line above it that starts with a letter, like a function name.
+void print_unified_diff(const line_diff *, int context);
+
+void free_line_diff(line_diff *);
+
+typedef struct diff_options {
+    int algorithm;
+    int context;
+} diff_options;
+
+// one side of a file diff
+typedef struct diff_file {
+    unsigned int mode; // 0 if file is missing on this side
+    obj_hash hash; // "" if file is missing
+    git_obj_blob *blob; // NULL if file is missing
+} diff_file;
+
+// Reads one side of a file diff, from the objects folder or from working tree.
+// @param mode 0 for a missing file, which needs no `hash` or `name`
+// @param name if not NULL, file is read from working tree at this path relative to repo root
+// @return 0 on success, -1 if file could not be read
+int read_diff_file(const git_repo *, unsigned int mode, const char *hash, const char *name, diff_file *out);
+
+void free_diff_file(diff_file *);
+
+// Prints a git-style patch of one file: its header, then hunks, or a line saying the
+// files differ if either side is binary. Nothing is printed if both sides are the same.
+void print_file_diff(const char *path, const diff_file *old, const diff_file *new, const diff_options *);
+
+// Prints a patch of a file renamed or copied from `old_path`, with its similarity in the
+// header. Only the header is printed if contents did not change.
+void print_moved_file_diff(const char *old_path, const char *new_path, int copied, int score,
+    const diff_file *old, const diff_file *new, const diff_options *);
+
+#endif
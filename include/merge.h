@@ -0,0 +1,76 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stddef.h>
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Merges three trees entirely in memory and in the objects folder, without touching the
+index or the working tree.
+1. the trees are walked together one folder at a time, and a path or folder that one side
+   did not change is taken from the other side by hash, so only folders both sides
+   changed are read and written again
+2. each file both sides changed is merged by content: base is diffed against ours and
+   against theirs, changes that do not overlap are both taken, and overlapping ones that
+   differ become a conflict hunk between markers, trimmed of lines both sides share
+3. files that cannot be merged by content (binary files, symlinks, modify/delete) keep
+   ours, or the side that still has them, and are reported
+So the cost of a merge follows what the two sides changed, not the size of the tree.
+*/
+
+// length of "<<<<<<<", "=======" and ">>>>>>>"
+#define MERGE_MARKER_SIZE 7
+
+typedef enum merge_conflict_kind {
+    MERGE_CONFLICT_CONTENT, // both sides changed a file, result holds conflict markers
+    MERGE_CONFLICT_ADD_ADD, // both sides added a file, result holds conflict markers
+    MERGE_CONFLICT_MODIFY_DELETE, // one side changed a file the other deleted, result keeps it
+    MERGE_CONFLICT_BINARY, // both sides changed a file that cannot be merged by lines, result keeps ours
+    MERGE_CONFLICT_FILE_DIRECTORY, // one side has a file where the other has a folder, result keeps the folder
+} merge_conflict_kind;
+
+typedef struct merge_conflict {
+    char *path;
+    merge_conflict_kind kind;
+    unsigned int modes[3]; // base, ours, theirs, 0 if missing on that side
+    obj_hash hashes[3]; // "" if missing on that side
+} merge_conflict;
+
+typedef struct merge_result {
+    obj_hash tree; // merged tree, files in conflict as described by their kind
+    merge_conflict *conflicts; // in index order
+    int num_conflicts;
+    int capacity;
+} merge_result;
+
+typedef struct merge_options {
+    const char *ours_label, *theirs_label; // written after conflict markers
+    int algorithm; // `LINE_DIFF_MYERS` or `LINE_DIFF_HISTOGRAM`
+} merge_options;
+
+// Merges `ours` and `theirs` from their common `base`, writing merged blobs and trees.
+// @param base, ours, theirs tree hashes, NULL for an empty tree
+// @param options NULL for "ours" and "theirs" labels and Myers diffs
+// @return 0 if merged cleanly, 1 if there are conflicts, -1 if an object could not be read
+// or written. `out` is filled unless -1 is returned.
+int merge_trees(const git_repo *, const char *base, const char *ours, const char *theirs,
+    const merge_options *options, merge_result *out);
+
+void free_merge_result(merge_result *);
+
+// Merges three versions of a text file.
+// @param out filled with malloc-ed merged contents
+// @return number of conflict hunks written with markers
+int merge_contents(const char *base, size_t base_size, const char *ours, size_t ours_size,
+    const char *theirs, size_t theirs_size, const merge_options *options, char **out, size_t *out_size);
+
+// Replaces entries of conflicted paths in the index with their base, ours and theirs
+// versions as stages 1-3, so they are listed as unmerged until added again.
+void add_merge_conflicts_to_dc(git_dircache *, const merge_result *);
+
+// Prints a "CONFLICT" line for each conflict, naming sides with the labels.
+void print_merge_conflicts(const merge_result *, const char *ours_label, const char *theirs_label);
+
+#endif
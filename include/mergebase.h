@@ -0,0 +1,39 @@
+#ifndef MERGE_BASE_H
+#define MERGE_BASE_H
+
+#include "repo.h"
+
+/*
+Merge bases are the best common ancestors of commits: common ancestors that are not an
+ancestor of another common ancestor. Criss-cross histories can have several.
+
+Commits are painted with flag bits from each side while walking down from them, newest
+generation first. A commit painted from both sides is a merge base, and everything below
+it is marked stale; the walk stops once only stale commits are left. Flags are kept in one
+byte per commit in a slab indexed by commit-graph position, with commits missing from the
+commit-graph appended after it. Those commits have no generation number, so they are
+walked by commit time, and results are checked against each other afterwards.
+
+Ancestry checks only go down to the generation of the would-be ancestor, so checking a
+fast-forward walks just the commits between the two, however long the branches are.
+*/
+
+typedef struct merge_base_list {
+    obj_hash *bases; // newest first
+    int num_bases;
+} merge_base_list;
+
+// Finds merge bases of `one` and a merge of all `twos`.
+// @return 0 on success, -1 if a commit could not be read
+int find_merge_bases(const git_repo *, const obj_hash one, const obj_hash *twos, int num_twos, merge_base_list *out);
+
+// Finds common ancestors of all `commits` that no other common ancestor of them descends from.
+// @return 0 on success, -1 if a commit could not be read
+int find_octopus_bases(const git_repo *, const obj_hash *commits, int num_commits, merge_base_list *out);
+
+// @return 1 if `ancestor` is `commit` or one of its ancestors, 0 if not, -1 if a commit could not be read
+int is_ancestor(const git_repo *, const obj_hash ancestor, const obj_hash commit);
+
+void free_merge_bases(merge_base_list *);
+
+#endif
@@ -11,6 +11,9 @@
 #define O_TYPE_COMMIT "commit"
 #define O_TYPE_TAG "tag"
 
+// objects never change once written, so their files are read-only, like git's
+#define OBJ_FILE_MODE 0444
+
 typedef struct git_obj {
     obj_hash hash;
     const char *type;
@@ -57,6 +60,10 @@ void hash_from_bytes(const unsigned char *bytes, obj_hash *out_hash);
 
 void hash_to_bytes(const obj_hash hash, unsigned char *out_bytes);
 
+// Fills `obj` with header and `file_contents` of an object of `type`, and its hash.
+// `obj->data` must be freed by caller.
+void create_git_obj(const unsigned char *file_contents, size_t size, const char *type, git_obj *obj);
+
 void free_blob(git_obj_blob *);
 
 // prints tree and children head recursively
@@ -66,10 +73,38 @@ void print_tree(git_obj_tree *);
 // @return pointer to blob or NULL on failure
 git_obj_blob *create_blob_from_file(const fileinfo *);
 
+// files at least this large are hashed from a mapping instead of read into heap buffers
+#define BLOB_MMAP_THRESHOLD (1 << 20)
+
+// Inits blob struct from file contents. Line endings of text files are normalized in place.
+// @return pointer to blob
+git_obj_blob *create_blob_from_buffer(unsigned char *buf, size_t size);
+
 // Creates blob struct from blob file. 
 // @return pointer to blob or NULL if could not read file.
 git_obj_blob *create_blob_from_disk(const git_repo * repo, obj_hash);
 
+// Reads and inflates object file, including its header.
+// @return malloc-ed object data or NULL if could not read file
+unsigned char *create_obj_from_disk(const git_repo *repo, const obj_hash hash, size_t *size);
+
+// Reads object file without inflating it.
+// @return malloc-ed file contents or NULL if could not read file
+unsigned char *read_raw_data(const char *path, size_t *raw_size);
+
+// Inflates contents of an object file, checking the size in its header.
+// @return malloc-ed object data or NULL if it is corrupted
+unsigned char *inflate_obj(const unsigned char *raw_bytes, size_t raw_size, size_t *size);
+
+// Hashes file as a blob straight from a read-only mapping, without copying its contents.
+// If `repo` is not NULL, each chunk is deflated into the objects folder in the same pass,
+// so the stored object always holds the bytes it is named after.
+// Text with CRLF line endings is normalized a chunk at a time, so it is read twice but
+// never held in memory whole. On Windows, where files are not mapped, the file is read
+// into a buffer instead.
+// @return 0 on success, -1 on failure, including when file was truncated while being read
+int hash_blob_from_fd(const git_repo *repo, int fd, size_t size, obj_hash *out);
+
 // Creates blob file in objects folder, if it does not already exist.
 // @return 0 if successful, -1 otherwise.
 int write_blob_to_disk(const git_repo *, const git_obj_blob *);
@@ -79,6 +114,17 @@ int write_blob_to_disk(const git_repo *, const git_obj_blob *);
 // @return 0 if successful, -1 if folder doesnt exist or other errors.
 int create_file_from_blob(const char *filepath, const git_obj_blob *);
 
+// @return start of blob's contents after its header, or NULL if blob is malformed
+const unsigned char *blob_contents(const git_obj_blob *, size_t *size);
+
+// @return 1 if buffer looks like binary data, from a NUL byte near its start
+int is_like_binary(const unsigned char *buf, size_t size);
+
+// Writes blob's contents to an open file in large writes. On Windows, LF is turned back
+// into CRLF in text files, undoing the conversion done when hashing.
+// @return 0 on success, -1 on failure
+int write_blob_to_fd(int fd, const git_obj_blob *);
+
 void free_tree(git_obj_tree *);
 
 void free_tree_entry(git_tree_entry *);
@@ -87,13 +133,58 @@ void free_tree_entry(git_tree_entry *);
 // @return pointer to tree or NULL if could not read file.
 git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash);
 
+// Reads only the tree file itself. Blobs and subtrees of its entries are stubs holding
+// just their hash, so they must not be rehashed or written.
+// @return pointer to tree or NULL if could not read file.
+git_obj_tree *create_tree_from_disk_shallow(const git_repo *repo, const obj_hash hash);
+
+// one entry of a tree file, pointing into the file's data
+typedef struct tree_iter_entry {
+    unsigned int git_mode;
+    enum obj_type type;
+    obj_hash hash;
+    const char *name; // not null-terminated
+    size_t name_len;
+} tree_iter_entry;
+
+typedef struct tree_iter {
+    unsigned char *data;
+    const char *pos, *end;
+} tree_iter;
+
+// Reads tree file to iterate over its entries without allocating any.
+// @param hash NULL to iterate over an empty tree
+// @return 0 on success, -1 if could not read tree
+int tree_iter_open(const git_repo *, const char *hash, tree_iter *out);
+
+// @return 1 if `out` was filled, 0 at end of tree, -1 if tree is malformed
+int tree_iter_next(tree_iter *, tree_iter_entry *out);
+
+void tree_iter_close(tree_iter *);
+
+// Reads tree hash of a commit file, without parsing the rest of it.
+// @return 0 on success, -1 if could not read commit
+int read_commit_tree(const git_repo *repo, const obj_hash commit_hash, obj_hash *tree_hash);
+
 git_obj_tree *init_tree();
 
+// length of a tree file line without entry name:
+// 6 (mode) + 4 (type) + 40 (hash) + 4 (seperators)
+#define TREE_ENTRY_LINE_FIXED 54
+
 // calculates object hash for tree struct and its subtree.
 void hash_tree_full(git_obj_tree *tree);
 
 int add_tree_entry(git_tree_entry *entry, git_obj_tree *tree);
 
+// compares names in tree order, where folders sort as if their name ends in '/'
+int tree_order_cmp(const char *a, size_t a_len, int a_dir, const char *b, size_t b_len, int b_dir);
+
+// Stores object in objects folder, if it does not already exist.
+// @param data object contents including header
+// @return 0 if obj was successfully stored, -1 if unable to
+int write_obj_to_disk(const git_repo *, const obj_hash, const unsigned char *data, size_t size);
+
 // Creates tree file and files for all of its sub-trees and blobs in objects folder.
 // Skips trees and blobs that already exist in objects folder.
 // @return 0 if successful, -1 otherwise.
@@ -117,10 +208,12 @@ int tree_cmp(git_obj_tree *, git_obj_tree *, const char *);
 
 // Deletes object in objects folder. 
 // @warning Only delete an object if nothing else (trees, commits, refs, HEAD) points to it!
-// @return 0 on success, -1 otherwise.
-int delete_obj_from_disk(obj_hash hash);
+// @return 0 on success or if it was already gone, -1 otherwise.
+int delete_obj_from_disk(const git_repo *, const obj_hash hash);
 
 // Inits tree struct representing `folderpath`. Recursively creates tree for subfolders and blobs for files.
+// Directories are listed and files read and hashed on a work-stealing thread pool.
+// Empty folders, the git folder and paths ignored by .gorditignore files are skipped.
 // @return pointer to tree or NULL if failure
 git_obj_tree *create_tree_from_path(const git_repo *, const char *folderpath);
 
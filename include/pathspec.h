@@ -0,0 +1,40 @@
+#ifndef PATHSPEC_H
+#define PATHSPEC_H
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Resolves command line paths into a sorted list of paths relative to repo root.
+An argument can be a file, a directory (everything under it) or a glob such as
+'*.c'. Like git pathspecs, '*' in a glob also matches '/', so '*.h' matches
+headers in every subfolder too.
+Arguments are canonicalized once without touching the filesystem, then every
+directory and glob is expanded by a single walk over the union of their roots.
+*/
+
+typedef struct pathspec_list {
+    char **paths; // sorted in index order, no duplicates
+    int num_paths;
+} pathspec_list;
+
+// Resolves arguments against files in the working tree, skipping ignored files.
+// @param cwd folder that relative arguments are relative to
+// @param dircache if not NULL, arguments that name an index entry are taken to be files without a stat
+// @return 0 on success, -1 if an argument is outside of repo or matches nothing
+int pathspec_resolve_worktree(const git_repo *, const char *cwd, const git_dircache *dircache,
+    char **args, int num_args, pathspec_list *out);
+
+// Resolves arguments against entries in the index, so files that no longer exist still match.
+// @return 0 on success, -1 if an argument is outside of repo or matches nothing
+int pathspec_resolve_index(const git_repo *, const char *cwd, const git_dircache *dircache,
+    char **args, int num_args, pathspec_list *out);
+
+// Joins `arg` onto `cwd` and removes ".", ".." and repeated '/' without resolving symlinks.
+// @param out path relative to repo root, "" for root
+// @return 0 on success, -1 if path is outside of repo or inside of git folder
+int pathspec_canonicalize(const git_repo *, const char *cwd, const char *arg, char *out);
+
+void free_pathspec_list(pathspec_list *);
+
+#endif
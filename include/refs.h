@@ -0,0 +1,95 @@
+#ifndef REFS_H
+#define REFS_H
+
+#include "repo.h"
+
+/*
+Refs are files under the git folder holding a commit hash, e.g. .gordit/refs/heads/main.
+HEAD either holds "ref: <ref name>" to point at a branch, or a commit hash when detached.
+
+Refs under refs/ can also be kept in the packed refs file (packed-refs in git folder), one
+line per ref, sorted by name so a single ref is found by binary search:
+# pack-refs with: peeled sorted
+<hash> <ref name>
+^<hash>         (only after annotated tags, the commit or object the tag peels to)
+A loose ref file overrides a packed ref of the same name, so refs are still updated by
+writing their loose file. `pack_refs` folds loose refs into the file, and deleting a ref
+removes it from both.
+*/
+
+#define HEAD_REF_PREFIX "ref: "
+#define DEFAULT_BRANCH_REF "refs/heads/main"
+#define PACKED_REFS_NAME "packed-refs"
+#define PACKED_REFS_HEADER "# pack-refs with: peeled sorted \n"
+
+// Reads loose ref, or packed ref if there is no loose one.
+// @param ref_name path relative to git folder, e.g. "refs/heads/main"
+// @return 0 if found, 1 if ref does not exist, -1 if it exists but is not a valid hash
+int read_ref(const git_repo *, const char *ref_name, obj_hash *out);
+
+// Resolves HEAD to the commit it points to.
+// @param ref_name if not NULL, filled with name of ref HEAD points to, or "" if HEAD is detached
+// @return 0 if found, 1 if HEAD points to a branch with no commits yet, -1 on failure
+int resolve_head(const git_repo *, obj_hash *out, char *ref_name);
+
+// Resolves a revision: "HEAD", a ref name ("refs/heads/main", "heads/main", "main" or
+// "origin/main" for refs/remotes/origin/main), or a full or abbreviated hash of at least MIN_ABBREV_LEN characters. "~N" or "^" after it moves to
+// the first parent N or 1 times.
+// @return 0 on success, -1 if it does not name an existing object
+int resolve_rev(const git_repo *, const char *rev, obj_hash *out);
+
+// Resolves a revision naming a tree, or a commit whose tree is taken.
+// @return 0 on success, -1 if it does not name a tree or commit
+int resolve_tree(const git_repo *, const char *rev, obj_hash *out);
+
+#define MIN_ABBREV_LEN 4
+
+typedef struct ref_entry {
+    char *name; // e.g. "refs/heads/main"
+    obj_hash hash;
+    obj_hash peeled; // what an annotated tag peels to if packed refs record it, "" otherwise
+} ref_entry;
+
+typedef struct ref_list {
+    ref_entry *refs; // sorted by name
+    int num_refs;
+    int capacity;
+} ref_list;
+
+// Lists every loose ref under refs folder, merged with packed refs they do not override.
+// Refs that are not valid hashes are skipped.
+// @return 0 on success, -1 if refs folder or packed refs could not be read
+int list_refs(const git_repo *, ref_list *out);
+
+void free_ref_list(ref_list *);
+
+// Gets the commit a ref names, following annotated tags, or the peeled hash packed refs
+// recorded for them.
+// @return 0 if `out` holds a commit, 1 if ref names a tree or blob, -1 if an object could not be read
+int peel_ref_to_commit(const git_repo *, const ref_entry *, obj_hash *out);
+
+// Points ref at `new_hash`. The ref is written to "<ref>.lock" and renamed over the old file,
+// so readers never see a partially written ref. Folders of the ref are created as needed.
+// @param ref_name path relative to git folder, "HEAD" to update a detached HEAD
+// @param old_hash if not NULL, ref must still hold it, or not exist yet if it is ""
+// @return 0 on success, -1 if ref is locked, has changed or could not be written
+int update_ref(const git_repo *, const char *ref_name, const obj_hash new_hash, const char *old_hash);
+
+// Removes a ref, e.g. MERGE_HEAD once a merge is committed, from packed refs first so it
+// cannot show up again, then its loose file.
+// @return 0 if removed or already missing, -1 if it could not be removed
+int delete_ref(const git_repo *, const char *ref_name);
+
+// Writes every ref into packed refs, with the objects annotated tags peel to, then removes
+// the loose files that still hold the packed hash. Each loose ref is locked while it is
+// removed, so a ref updated in the meantime keeps its new loose file.
+// @param num_packed if not NULL, set to number of refs in packed refs
+// @return 0 on success, -1 if packed refs is locked or could not be written
+int pack_refs(const git_repo *, int *num_packed);
+
+// Points HEAD at a branch, or detaches it at a commit.
+// @param ref_name e.g. "refs/heads/main", or NULL to detach HEAD at `hash`
+// @return 0 on success, -1 if HEAD is locked or could not be written
+int set_head(const git_repo *, const char *ref_name, const obj_hash hash);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include "repo.h"
+
+/*
+Remotes are kept in the config file in the git folder, in the same format as git's:
+[remote "origin"]
+	url = /path/to/repo
+[branch "main"]
+	remote = origin
+	merge = refs/heads/main
+along with a fetch line mapping the remote's branches to refs/remotes/origin. Only local
+paths are supported as urls.
+*/
+
+#define CONFIG_NAME "config"
+#define DEFAULT_REMOTE "origin"
+#define HEADS_REF_PREFIX "refs/heads/"
+#define TAGS_REF_PREFIX "refs/tags/"
+#define REMOTES_REF_PREFIX "refs/remotes/"
+
+// Adds remote `name` to repo's config, with `branch` following the same branch of it.
+// @param branch e.g. "main", or NULL to not add a branch
+// @return 0 on success, -1 if config could not be written
+int add_remote(const git_repo *, const char *name, const char *url, const char *branch);
+
+// Finds a remote by name, or by url when `remote` is a path.
+// @param remote name or path of remote, NULL for DEFAULT_REMOTE
+// @param name filled with name of remote, or "" if `remote` is a path no remote has as url
+// @param url filled with absolute path of remote's repo
+// @return 0 on success, -1 if `remote` is neither a remote of repo nor an existing path
+int resolve_remote(const git_repo *, const char *remote, char *name, char *url);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef RENAME_H
+#define RENAME_H
+
+#include "repo.h"
+#include "treediff.h"
+
+/*
+Finds renamed and copied files among the changes between two trees.
+1. exact: added blobs whose hash matches a deleted one are paired through a hash table,
+   preferring the same file name, without reading either blob
+2. every other added blob and candidate source is read once and reduced to a sketch: the
+   hashes of its lines (64 byte chunks in binary files) with the bytes each covers, and a
+   MinHash signature of that set
+3. signatures are cut into bands, and only pairs sharing a band's bucket are compared, so
+   files with little in common are never scored. Small sets of files skip this and
+   compare every pair.
+4. candidates are scored exactly, as bytes in common / size of the larger file, and taken
+   best first, each added file once and each deleted file in at most one rename
+*/
+
+// least similarity, in percent, of a rename when none is given
+#define RENAME_DEFAULT_SCORE 50
+
+// also detect copies, from deleted files already renamed and from modified files
+#define RENAME_COPIES 1
+
+// Replaces deleted and added pairs in `changes` with renames, and with `RENAME_COPIES` turns
+// added files similar to a deleted or modified one into copies. Changes stay sorted by path.
+// @param min_score least similarity in percent
+// @return number of renames and copies found, -1 if a blob could not be read
+int detect_renames(const git_repo *, tree_change_list *changes, int min_score, int flags);
+
+#endif
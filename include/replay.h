@@ -0,0 +1,35 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "repo.h"
+#include "merge.h"
+
+/*
+Replays commits onto a new base, for rebase and cherry-pick, without an index or working
+tree. Each commit is merged into the current tip in memory, with its parent's tree as the
+base (`merge_trees`), so only folders the commit changed are read, and only the new trees
+and a commit keeping its author and message are written. A commit whose parent already is
+the tip is reused as is. Commits that were empty to begin with are kept, while merge
+commits and commits whose changes are already in the tip are skipped with a note. The
+caller moves refs and checks out the final tip once.
+*/
+
+typedef struct replay_result {
+    obj_hash tip; // last commit written or reused, `onto` if there was none
+    int num_replayed;
+    int num_skipped; // merge commits, and commits whose changes are already in the tip
+    int stopped; // position of the commit that conflicted, -1 if all commits were replayed
+    merge_result conflict; // merge of the commit that conflicted onto `tip`
+} replay_result;
+
+// @param commits oldest first
+// @param options labels and diff algorithm of content merges, NULL for the defaults. Without
+// a label for theirs, conflicts are labelled with the abbreviated hash of the commit.
+// @return 0 if every commit was replayed, 1 if one conflicted and replay stopped before it,
+// -1 if an object could not be read or written
+int replay_commits(const git_repo *, const obj_hash onto, const obj_hash *commits, int num_commits,
+    const merge_options *options, replay_result *out);
+
+void free_replay_result(replay_result *);
+
+#endif
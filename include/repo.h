@@ -14,6 +14,7 @@ typedef char obj_hash[OBJ_HASH_SIZE];
 #define REFS_NAME "refs"
 #define OBJS_NAME "objects"
 #define HEAD_NAME "HEAD"
+#define MERGE_HEAD_NAME "MERGE_HEAD"
 #define INDEX_NAME "index"
 
 #define REFS_FOLDER GIT_FOLDER "/" REFS_NAME
@@ -23,12 +24,15 @@ typedef char obj_hash[OBJ_HASH_SIZE];
 
 #define GIT_IGNORE_NAME ".gorditignore"
 
+struct ignore_cache;
+
 typedef struct {
     char root_path[PATH_MAX];
     char ref_path[PATH_MAX];
     char objects_path[PATH_MAX];
     char index_path[PATH_MAX];
     char head_path[PATH_MAX];
+    struct ignore_cache *ignores; // compiled .gorditignore files, refreshed once before each walk
 } git_repo;
 
 // NOTE: only supports files and folders. symlinks and gitlinks just return 0.
@@ -40,13 +44,20 @@ unsigned int git_mode_to_stat(unsigned int git_mode);
 // gets repo context 
 const git_repo *get_working_repo(const char *cwd);
 
+// frees repo context from `get_working_repo`, with the ignore files it compiled
+void free_repo(const git_repo *);
+
 // If git folder exists in cwd do nothing.
 // Otherwise create git folder in cwd, including subfolders, index and HEAD.
 // @returns 0 on success, 1 if git folder already in cwd, -1 otherwise. 
 int git_init_repo(const char *cwd);
 
-// gets path of object in repo's objects folder
-// @return 1 if object already in git folder, 0 if new, -1 if could not create dir
+// gets path of object in repo's objects folder, without checking it exists
+void obj_path(const git_repo *, const obj_hash, char *out);
+
+// gets path of object in repo's objects folder, creating its folder if needed
+// @return 1 if object already in git folder (its modification time is set to now), 0 if new,
+// -1 if could not create dir
 int obj_store_path(const git_repo *, const obj_hash, char *out);
 
 // @return 1 if path is inside of repo and not in git folder
@@ -0,0 +1,53 @@
+#ifndef REVWALK_H
+#define REVWALK_H
+
+#include <time.h>
+
+#include "repo.h"
+
+/*
+Streams commits reachable from pushed commits but not from hidden ones, newest first.
+Commits wait in a binary heap, so each call to `revwalk_next` only reads the parents of
+the commit it returns. Commits are taken from the commit-graph when they are in it, and
+otherwise only their header lines are parsed.
+- date order: by commit time
+- topo order: by generation number, then commit time, so no commit comes before one of
+  its children. Generations of commits missing from the commit-graph are computed from
+  their parents.
+Hidden commits (the A in A..B) are walked in a second heap. Before a commit is returned,
+every hidden commit that could be its descendant is walked first, so with generation
+numbers ranges are exact even when commit times are skewed. Without them, a hidden commit
+is taken as a possible descendant if it is at most a day older.
+*/
+
+typedef enum revwalk_order {
+    REVWALK_DATE_ORDER,
+    REVWALK_TOPO_ORDER,
+} revwalk_order;
+
+typedef struct revwalk revwalk;
+
+// @param first_parent if 1, only first parents of commits are followed, while hidden commits
+// still hide all of their parents
+revwalk *revwalk_create(const git_repo *, revwalk_order order, int first_parent);
+
+// Adds commit to start walking from.
+// @return 0 on success, -1 if it is not a commit
+int revwalk_push(revwalk *, const obj_hash);
+
+// Hides commit and all of its ancestors.
+// @return 0 on success, -1 if it is not a commit
+int revwalk_hide(revwalk *, const obj_hash);
+
+// Only returns commits that changed `path` against their first parent. Commits whose
+// bloom filter rules the path out are skipped without diffing trees.
+// @param path relative to repo root
+void revwalk_limit_path(revwalk *, const char *path);
+
+// @param timestamp if not NULL, set to commit time of returned commit
+// @return 1 if `out` was filled, 0 when there are no commits left, -1 on failure
+int revwalk_next(revwalk *, obj_hash *out, time_t *timestamp);
+
+void revwalk_free(revwalk *);
+
+#endif
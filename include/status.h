@@ -0,0 +1,61 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Compares HEAD's tree, the index and the working tree.
+- index vs HEAD: folder trees of the index are hashed without reading any file, reusing
+  tree ids cached in the index for folders whose entries did not change, and HEAD's trees
+  are only read where their hash differs, so unchanged subtrees are skipped.
+- working tree vs index: files are stat-ed in bulk and only files whose stat info
+  differs from their entry (or that changed within a second of the index being
+  written) are rehashed, on a thread pool. Entries fsmonitor reports as unchanged
+  are not even stat-ed, and entries found clean are marked so for the next status.
+- untracked files come from one walk that skips ignored paths. Files met there are looked
+  up in the index without copying their paths, and a folder holding no tracked files is
+  only read up to its first file, as it is listed once.
+- paths with conflict stages are listed as unmerged until they are added again.
+*/
+
+typedef enum status_kind {
+    STATUS_ADDED,
+    STATUS_MODIFIED,
+    STATUS_DELETED,
+    STATUS_UNTRACKED,
+    STATUS_UNMERGED,
+} status_kind;
+
+typedef struct status_change {
+    char *path; // relative to repo root, folders end in '/'
+    status_kind kind;
+} status_change;
+
+typedef struct status_list {
+    status_change *changes; // sorted by path
+    int num_changes;
+    int capacity;
+} status_list;
+
+typedef struct git_status {
+    char branch[PATH_MAX]; // ref HEAD points to, "" if detached
+    status_list staged; // index vs HEAD
+    status_list unstaged; // working tree vs index
+    status_list untracked; // folders holding no tracked files are listed once
+    status_list unmerged; // paths in merge conflict, left out of `staged`
+    int index_refreshed; // 1 if stat info of entries found unchanged after rehashing, or cached tree ids, were updated
+} git_status;
+
+// @return 0 on success, -1 on failure
+int collect_status(const git_repo *, git_dircache *, git_status *out);
+
+// Fills only `unstaged` of a zeroed status, for callers that only compare working tree to index.
+// @return 0 on success, -1 on failure
+int status_unstaged(const git_repo *, git_dircache *, git_status *st);
+
+void print_status(const git_status *);
+
+void free_status(git_status *);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*
+Fixed-size worker pool with a deque per worker. Workers pop their own newest task
+and steal the oldest task of another worker when they run out, so tasks that
+submit more tasks (e.g. one task per directory) spread across all threads.
+*/
+
+typedef void (*tp_task_fn)(void *arg);
+
+typedef struct threadpool threadpool;
+
+// @param num_threads number of workers, or 0 to use one per online CPU
+// @return pool or NULL if no worker could be started
+threadpool *threadpool_create(int num_threads);
+
+// Queues task. Safe to call from inside a running task.
+void threadpool_submit(threadpool *, tp_task_fn fn, void *arg);
+
+// Blocks until every submitted task, including ones submitted by tasks, has finished.
+void threadpool_wait(threadpool *);
+
+// Waits for remaining tasks and joins all workers.
+void threadpool_destroy(threadpool *);
+
+int threadpool_size(const threadpool *);
+
+// @return index of calling worker in [0, threadpool_size), or -1 if not called from a worker
+int threadpool_worker_id(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "repo.h"
+
+/*
+Moves loose objects between two repos on the same host. Objects never change once written,
+so the destination can share the source's file through a hardlink instead of a copy. When
+the repos are on different filesystems, or links are not allowed, the compressed file is
+copied as is, a chunk at a time and without inflating it, and is made read-only like every
+other object. Objects are spread over a thread pool in chunks.
+*/
+
+// objects handled by one thread pool task
+#define TRANSFER_CHUNK 64
+
+typedef struct transfer_stats {
+    int linked;
+    int copied;
+    int existing; // already in destination
+    int failed;
+} transfer_stats;
+
+// Links or copies objects from `src` into `dest`, skipping ones `dest` already has.
+// @param stats if not NULL, filled with how each object was transferred
+// @return 0 if every object is now in `dest`, -1 otherwise
+int transfer_objects(const git_repo *src, const git_repo *dest, const obj_hash *hashes, int num_hashes, transfer_stats *stats);
+
+// Links or copies a file of `src`'s objects folder, e.g. BITMAPS_FILE, replacing the one in `dest`.
+// Only for files that are replaced by rename instead of being written in place.
+// @return 0 on success, 1 if `src` has no such file, -1 on failure
+int transfer_objects_file(const git_repo *src, const git_repo *dest, const char *name);
+
+#endif
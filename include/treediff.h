@@ -0,0 +1,62 @@
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include "repo.h"
+#include "dircache.h"
+
+typedef enum tree_change_kind {
+    TREE_ADDED,
+    TREE_DELETED,
+    TREE_MODIFIED,
+    TREE_RENAMED,
+    TREE_COPIED,
+} tree_change_kind;
+
+typedef struct tree_change {
+    char *path; // relative to repo root
+    char *old_path; // source of a rename or copy, NULL otherwise
+    tree_change_kind kind;
+    int score; // similarity of a rename or copy to its source, in percent
+    unsigned int old_mode, new_mode; // 0 if added or deleted
+    obj_hash old_hash, new_hash; // "" if added or deleted
+} tree_change;
+
+typedef struct tree_change_list {
+    tree_change *changes; // in tree order, or by path after `detect_renames`
+    int num_changes;
+    int capacity;
+} tree_change_list;
+
+// Lists blobs that differ between two trees. Subtrees with the same hash on both
+// sides are skipped without being read. A path that is a blob on one side and a
+// folder on the other is listed as deleted and added.
+// @param old_tree, new_tree NULL for an empty tree
+// @param limit if not NULL, only paths equal to or under `limit` are listed, and only
+// folders leading to it are read
+// @return 0 on success, -1 if a tree could not be read
+int diff_trees(const git_repo *, const char *old_tree, const char *new_tree, const char *limit, tree_change_list *out);
+
+// Lists blobs that differ between a tree and the index, from the tree's side. Paths in
+// merge conflict are left out.
+// @param tree NULL for an empty tree
+// @return 0 on success, -1 if a tree could not be read
+int diff_tree_index(const git_repo *, const char *tree, const git_dircache *, tree_change_list *out);
+
+// Lists files that differ between a tree and the working tree, from the tree's side. Only
+// paths in the tree or the index are compared. Files whose stat info matches their index
+// entry are taken to hold its blob, the rest are read and hashed without being stored, so
+// their new side must be read from the working tree. Paths in merge conflict are left out.
+// @param tree NULL for an empty tree
+// @param index_refreshed set to 1 if stat info of entries found unchanged was updated, so
+// the index is worth writing
+// @return 0 on success, -1 if a tree could not be read
+int diff_tree_worktree(const git_repo *, const char *tree, git_dircache *, tree_change_list *out, int *index_refreshed);
+
+// Appends a change, copying `path`.
+// @param old_hash, new_hash NULL if missing on that side
+void tree_change_push(tree_change_list *, const char *path, tree_change_kind kind,
+    unsigned int old_mode, const char *old_hash, unsigned int new_mode, const char *new_hash);
+
+void free_tree_changes(tree_change_list *);
+
+#endif
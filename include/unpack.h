@@ -0,0 +1,36 @@
+#ifndef UNPACK_H
+#define UNPACK_H
+
+#include "repo.h"
+#include "dircache.h"
+
+/*
+Merges up to three trees with the index into a new index. The trees and the index are
+walked together one folder at a time, in sorted order, so each path is decided once from
+all of its versions. A folder whose trees make every path below it keep its index entry
+(e.g. the same subtree in HEAD and the target) is copied over without being read, so the
+work done follows the size of the difference.
+
+- 1 tree: the index becomes the tree. Entries that already hold the same blob and mode
+  keep their stat info. Folders are skipped when the index's own tree hash matches.
+- 2 trees (current, target): like switching branches. A path takes the target's version
+  when the index matches the current tree, and keeps its index entry when the current
+  and target trees agree or the index already matches the target. Staged changes to a
+  path both trees disagree on stop the merge.
+- 3 trees (base, ours, theirs): a path changed on one side only takes that side, and a
+  path changed differently on both sides gets entries for stage 1 (base), 2 (ours) and
+  3 (theirs), leaving out versions that are missing. The index must match ours on every
+  path the merge changes. A file on one side where the other has a folder of the same
+  name is reported as a conflict and stops the merge.
+*/
+
+#define UNPACK_MAX_TREES 3
+
+// Builds the merged index in `out`, to be freed with `clear_dircache`. Fsmonitor token and
+// index mtime are copied from `index`.
+// @param trees tree hashes, NULL for an empty tree
+// @return 0 on success, 1 if staged changes or unresolved conflicts stop the merge (each
+// path is reported), -1 if a tree could not be read. `out` is only filled if 0 is returned.
+int unpack_trees(const git_repo *, const git_dircache *index, const char **trees, int num_trees, git_dircache *out);
+
+#endif
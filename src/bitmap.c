@@ -0,0 +1,520 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "refs.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "revwalk.h"
+#include "gc.h"
+#include "ewah.h"
+#include "bitmap.h"
+
+#define BITMAPS_HEADER_SIZE 20
+#define BITMAPS_FANOUT_SIZE (256 * 4)
+#define BITMAPS_HASH_LEN SHA_DIGEST_LENGTH
+#define BITMAPS_ROW_SIZE 8
+
+uint32_t bitmaps_get_u32(const unsigned char *buf) {
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+void bitmaps_put_u32(unsigned char *buf, uint32_t in) {
+    buf[0] = in >> 24;
+    buf[1] = in >> 16;
+    buf[2] = in >> 8;
+    buf[3] = in;
+}
+
+reach_bitmaps *reach_bitmaps_open(const git_repo *repo) {
+    char path[PATH_MAX];
+    fs_path_join(repo->objects_path, BITMAPS_FILE, path);
+
+    int fd;
+    fs_statinfo info;
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    if (fs_getinfo(path, &info) != 0 || info.fi_size < BITMAPS_HEADER_SIZE + BITMAPS_FANOUT_SIZE + BITMAPS_HASH_LEN) {
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char *map;
+#ifndef _WIN32
+    map = mmap(NULL, info.fi_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+    }
+#else
+    map = malloc(info.fi_size);
+    if (read(fd, map, info.fi_size) != (int)info.fi_size) {
+        free(map);
+        map = NULL;
+    }
+#endif
+    close(fd);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    reach_bitmaps *bitmaps = malloc(sizeof(*bitmaps));
+    bitmaps->map = map;
+    bitmaps->map_size = info.fi_size;
+    bitmaps->num_objects = bitmaps_get_u32(map + 8);
+    bitmaps->num_bitmaps = bitmaps_get_u32(map + 12);
+    bitmaps->num_words = bitmaps_get_u32(map + 16);
+    bitmaps->fanout = map + BITMAPS_HEADER_SIZE;
+    bitmaps->hashes = bitmaps->fanout + BITMAPS_FANOUT_SIZE;
+    bitmaps->index = bitmaps->hashes + (size_t)bitmaps->num_objects * BITMAPS_HASH_LEN;
+    bitmaps->words = bitmaps->index + (size_t)bitmaps->num_bitmaps * BITMAPS_ROW_SIZE;
+
+    // bitmaps of other versions are rewritten by the next write
+    if (bitmaps_get_u32(map + 4) != BITMAPS_VERSION) {
+        reach_bitmaps_close(bitmaps);
+        return NULL;
+    }
+
+    size_t expected = BITMAPS_HEADER_SIZE + BITMAPS_FANOUT_SIZE + (size_t)bitmaps->num_objects * BITMAPS_HASH_LEN
+        + (size_t)bitmaps->num_bitmaps * BITMAPS_ROW_SIZE + (size_t)bitmaps->num_words * 8 + BITMAPS_HASH_LEN;
+    if (memcmp(map, BITMAPS_SIG, 4) != 0 || expected != info.fi_size
+        || bitmaps_get_u32(bitmaps->fanout + 255 * 4) != bitmaps->num_objects
+        || (bitmaps->num_bitmaps > 0
+            && bitmaps_get_u32(bitmaps->index + (size_t)(bitmaps->num_bitmaps - 1) * BITMAPS_ROW_SIZE + 4) != bitmaps->num_words)) {
+        printf("ERROR: bitmaps file is corrupted, ignoring it\n");
+        reach_bitmaps_close(bitmaps);
+        return NULL;
+    }
+
+    return bitmaps;
+}
+
+void reach_bitmaps_close(reach_bitmaps *bitmaps) {
+#ifndef _WIN32
+    munmap(bitmaps->map, bitmaps->map_size);
+#else
+    free(bitmaps->map);
+#endif
+    free(bitmaps);
+}
+
+int64_t reach_bitmaps_find(const reach_bitmaps *bitmaps, const obj_hash hash) {
+    unsigned char raw[BITMAPS_HASH_LEN];
+    hash_to_bytes(hash, raw);
+    uint32_t lo = raw[0] == 0 ? 0 : bitmaps_get_u32(bitmaps->fanout + (raw[0] - 1) * 4);
+    uint32_t hi = bitmaps_get_u32(bitmaps->fanout + raw[0] * 4);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int res = memcmp(bitmaps->hashes + (size_t)mid * BITMAPS_HASH_LEN, raw, BITMAPS_HASH_LEN);
+        if (res == 0) {
+            return mid;
+        }
+        if (res < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+void reach_bitmaps_hash(const reach_bitmaps *bitmaps, uint32_t pos, obj_hash *out) {
+    hash_from_bytes(bitmaps->hashes + (size_t)pos * BITMAPS_HASH_LEN, out);
+}
+
+// @return row of commit's bitmap in the index, -1 if it has none
+int64_t bitmaps_row(const reach_bitmaps *bitmaps, const obj_hash commit) {
+    int64_t pos = reach_bitmaps_find(bitmaps, commit);
+    if (pos < 0) {
+        return -1;
+    }
+
+    uint32_t lo = 0, hi = bitmaps->num_bitmaps;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t row_pos = bitmaps_get_u32(bitmaps->index + (size_t)mid * BITMAPS_ROW_SIZE);
+        if (row_pos == pos) {
+            return mid;
+        }
+        if (row_pos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+int reach_bitmaps_has(const reach_bitmaps *bitmaps, const obj_hash commit) {
+    return bitmaps_row(bitmaps, commit) >= 0;
+}
+
+int reach_bitmaps_or(const reach_bitmaps *bitmaps, const obj_hash commit, uint64_t *bits) {
+    int64_t row = bitmaps_row(bitmaps, commit);
+    if (row < 0) {
+        return 0;
+    }
+
+    uint32_t start = row == 0 ? 0 : bitmaps_get_u32(bitmaps->index + (size_t)(row - 1) * BITMAPS_ROW_SIZE + 4);
+    uint32_t end = bitmaps_get_u32(bitmaps->index + (size_t)row * BITMAPS_ROW_SIZE + 4);
+    if (end < start || end > bitmaps->num_words) {
+        return -1;
+    }
+    return ewah_or_into(bitmaps->words + (size_t)start * 8, (size_t)(end - start) * 8,
+        bits, ((size_t)bitmaps->num_objects + 63) / 64) == 0 ? 1 : -1;
+}
+
+// bitmap computed while writing, `pos` is its commit's position in the object table
+typedef struct built_bitmap {
+    uint32_t pos;
+    unsigned char *data;
+    size_t size;
+} built_bitmap;
+
+typedef struct bitmap_builder {
+    const git_repo *repo;
+    commit_graph *graph;
+    const loose_objects *objects;
+    int *loose_to_table; // -1 for objects left out of the table
+    uint32_t num_objects;
+    built_bitmap *built;
+    int *built_of; // index into `built` by table position, -1 if none
+    int num_built;
+} bitmap_builder;
+
+// @return table position of `hash`, -1 if it is not in the table
+int64_t builder_find(const bitmap_builder *builder, const char *hash) {
+    int pos = find_loose_object(builder->objects, hash);
+    return pos < 0 ? -1 : builder->loose_to_table[pos];
+}
+
+// @return 1 if bit of `pos` was already set, 0 if it was just set
+int builder_test_and_set(uint64_t *bits, int64_t pos) {
+    uint64_t bit = (uint64_t)1 << (pos % 64);
+    int was_set = (bits[pos / 64] & bit) != 0;
+    bits[pos / 64] |= bit;
+    return was_set;
+}
+
+// Fills `bits` with every object reachable from `commit`, OR-ing in bitmaps of ancestors
+// already built before walking any tree, so trees they share are skipped.
+// @return 0 on success, -1 if an object is missing or could not be read
+int build_commit_bitmap(bitmap_builder *builder, const obj_hash commit, uint64_t *bits) {
+    size_t num_words = ((size_t)builder->num_objects + 63) / 64;
+    int rc = 0, num_stack = 1, stack_capacity = 16, num_trees = 0, trees_capacity = 16;
+    obj_hash *stack = malloc(stack_capacity * sizeof(obj_hash));
+    obj_hash *trees = malloc(trees_capacity * sizeof(obj_hash));
+    snprintf(stack[0], OBJ_HASH_SIZE, "%s", commit);
+
+    while (rc == 0 && num_stack > 0) {
+        obj_hash hash;
+        memcpy(hash, stack[--num_stack], OBJ_HASH_SIZE);
+        int64_t pos = builder_find(builder, hash);
+        if (pos < 0) {
+            rc = -1;
+            break;
+        }
+        if (bits[pos / 64] & ((uint64_t)1 << (pos % 64))) {
+            continue;
+        }
+        if (strcmp(hash, commit) != 0 && builder->built_of[pos] >= 0) {
+            const built_bitmap *built = &builder->built[builder->built_of[pos]];
+            rc = ewah_or_into(built->data, built->size, bits, num_words);
+            continue;
+        }
+        builder_test_and_set(bits, pos);
+
+        commit_info info;
+        if (load_commit_info(builder->repo, builder->graph, hash, &info, NULL) != 0) {
+            rc = -1;
+            break;
+        }
+        if (num_stack + info.num_parents > stack_capacity) {
+            stack_capacity = (num_stack + info.num_parents) * 2;
+            stack = realloc(stack, stack_capacity * sizeof(obj_hash));
+        }
+        for (int i = 0; i < info.num_parents; i++) {
+            memcpy(stack[num_stack++], info.parents[i], OBJ_HASH_SIZE);
+        }
+        if (num_trees == trees_capacity) {
+            trees_capacity *= 2;
+            trees = realloc(trees, trees_capacity * sizeof(obj_hash));
+        }
+        memcpy(trees[num_trees++], info.tree, OBJ_HASH_SIZE);
+        free_commit_info(&info);
+    }
+
+    while (rc == 0 && num_trees > 0) {
+        obj_hash hash;
+        memcpy(hash, trees[--num_trees], OBJ_HASH_SIZE);
+        int64_t pos = builder_find(builder, hash);
+        if (pos < 0) {
+            rc = -1;
+            break;
+        }
+        if (builder_test_and_set(bits, pos)) {
+            continue;
+        }
+
+        tree_iter iter;
+        tree_iter_entry entry;
+        int res;
+        if (tree_iter_open(builder->repo, hash, &iter) != 0) {
+            rc = -1;
+            break;
+        }
+        while ((res = tree_iter_next(&iter, &entry)) == 1) {
+            if (entry.type == BLOB_OBJ) {
+                int64_t blob_pos = builder_find(builder, entry.hash);
+                if (blob_pos < 0) {
+                    res = -1;
+                    break;
+                }
+                builder_test_and_set(bits, blob_pos);
+                continue;
+            }
+            if (num_trees == trees_capacity) {
+                trees_capacity *= 2;
+                trees = realloc(trees, trees_capacity * sizeof(obj_hash));
+            }
+            memcpy(trees[num_trees++], entry.hash, OBJ_HASH_SIZE);
+        }
+        tree_iter_close(&iter);
+        rc = res == -1 ? -1 : rc;
+    }
+
+    free(stack);
+    free(trees);
+    return rc;
+}
+
+// Lists commits reachable from refs and HEAD newest first, and picks the ones to build
+// bitmaps for: every ref tip and every BITMAP_COMMIT_INTERVAL-th commit.
+// @return number of selected commits, filled into `out` oldest first, -1 on failure
+int select_bitmap_commits(const git_repo *repo, obj_hash **out) {
+    ref_list refs;
+    if (list_refs(repo, &refs) != 0) {
+        return -1;
+    }
+    revwalk *walk = revwalk_create(repo, REVWALK_DATE_ORDER, 0);
+    if (walk == NULL) {
+        free_ref_list(&refs);
+        return -1;
+    }
+
+    int rc = 0;
+    obj_hash head, hash;
+    if (resolve_head(repo, &head, NULL) == 0) {
+        rc = revwalk_push(walk, head);
+    } else {
+        head[0] = '\0';
+    }
+
+    // annotated tags are taken at the commit they peel to, tips that are not commits are left out
+    obj_hash *tips = malloc((refs.num_refs + 1) * sizeof(obj_hash));
+    int num_tips = 0;
+    for (int i = 0; i < refs.num_refs && rc == 0; i++) {
+        int res = peel_ref_to_commit(repo, &refs.refs[i], &tips[num_tips]);
+        if (res == -1) {
+            printf("ERROR: could not read %s\n", refs.refs[i].name);
+            rc = -1;
+        } else if (res == 0) {
+            rc = revwalk_push(walk, tips[num_tips++]);
+        }
+    }
+
+    int num_selected = 0, capacity = 16, count = 0, res = 0;
+    *out = malloc(capacity * sizeof(obj_hash));
+    while (rc == 0 && (res = revwalk_next(walk, &hash, NULL)) == 1) {
+        int selected = count++ % BITMAP_COMMIT_INTERVAL == 0 || strcmp(hash, head) == 0;
+        for (int i = 0; i < num_tips && !selected; i++) {
+            selected = strcmp(hash, tips[i]) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        if (num_selected == capacity) {
+            capacity *= 2;
+            *out = realloc(*out, capacity * sizeof(obj_hash));
+        }
+        memcpy((*out)[num_selected++], hash, OBJ_HASH_SIZE);
+    }
+    revwalk_free(walk);
+    free_ref_list(&refs);
+    free(tips);
+    if (rc != 0 || res == -1) {
+        free(*out);
+        *out = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < num_selected / 2; i++) {
+        obj_hash tmp;
+        memcpy(tmp, (*out)[i], OBJ_HASH_SIZE);
+        memcpy((*out)[i], (*out)[num_selected - 1 - i], OBJ_HASH_SIZE);
+        memcpy((*out)[num_selected - 1 - i], tmp, OBJ_HASH_SIZE);
+    }
+    return num_selected;
+}
+
+int cmp_built_bitmap(const void *a, const void *b) {
+    uint32_t pos_a = ((const built_bitmap *)a)->pos, pos_b = ((const built_bitmap *)b)->pos;
+    return pos_a < pos_b ? -1 : pos_a > pos_b;
+}
+
+// @return malloc-ed bitmaps file contents
+unsigned char *bitmaps_serialize(const bitmap_builder *builder, size_t *size) {
+    size_t num_words = 0;
+    for (int i = 0; i < builder->num_built; i++) {
+        num_words += builder->built[i].size / 8;
+    }
+
+    uint32_t n = builder->num_objects;
+    *size = BITMAPS_HEADER_SIZE + BITMAPS_FANOUT_SIZE + (size_t)n * BITMAPS_HASH_LEN
+        + (size_t)builder->num_built * BITMAPS_ROW_SIZE + num_words * 8 + BITMAPS_HASH_LEN;
+    unsigned char *buf = calloc(1, *size);
+    memcpy(buf, BITMAPS_SIG, 4);
+    bitmaps_put_u32(buf + 4, BITMAPS_VERSION);
+    bitmaps_put_u32(buf + 8, n);
+    bitmaps_put_u32(buf + 12, builder->num_built);
+    bitmaps_put_u32(buf + 16, (uint32_t)num_words);
+
+    unsigned char *fanout = buf + BITMAPS_HEADER_SIZE;
+    unsigned char *hashes = fanout + BITMAPS_FANOUT_SIZE;
+    unsigned char *index = hashes + (size_t)n * BITMAPS_HASH_LEN;
+    unsigned char *words = index + (size_t)builder->num_built * BITMAPS_ROW_SIZE;
+
+    // table positions follow loose object order, which is sorted by hash
+    uint32_t counts[256] = { 0 };
+    for (int i = 0; i < builder->objects->num_objects; i++) {
+        int pos = builder->loose_to_table[i];
+        if (pos >= 0) {
+            unsigned char *raw = hashes + (size_t)pos * BITMAPS_HASH_LEN;
+            hash_to_bytes(builder->objects->objects[i].hash, raw);
+            counts[raw[0]]++;
+        }
+    }
+    uint32_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += counts[i];
+        bitmaps_put_u32(fanout + i * 4, total);
+    }
+
+    size_t end = 0;
+    for (int i = 0; i < builder->num_built; i++) {
+        const built_bitmap *built = &builder->built[i];
+        memcpy(words + end * 8, built->data, built->size);
+        end += built->size / 8;
+        bitmaps_put_u32(index + (size_t)i * BITMAPS_ROW_SIZE, built->pos);
+        bitmaps_put_u32(index + (size_t)i * BITMAPS_ROW_SIZE + 4, (uint32_t)end);
+    }
+
+    SHA1(buf, *size - BITMAPS_HASH_LEN, buf + *size - BITMAPS_HASH_LEN);
+    return buf;
+}
+
+// writes to a temporary file first so readers never map partial bitmaps
+int bitmaps_write_file(const git_repo *repo, const unsigned char *buf, size_t size) {
+    char info_path[PATH_MAX], path[PATH_MAX], tmp_path[PATH_MAX + 16];
+    fs_path_join(repo->objects_path, BITMAPS_FILE, path);
+    fs_path_dirname(path, info_path);
+    if (fs_mkdir(info_path, 0755) == -1) {
+        return -1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmpXXXXXX", path);
+
+    int fd;
+    if ((fd = mkstemp(tmp_path)) == -1) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t res = write(fd, buf + written, size - written);
+        if (res <= 0) {
+            break;
+        }
+        written += res;
+    }
+    if (close(fd) != 0 || written != size || fs_rename(tmp_path, path) != 0) {
+        fs_remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int write_reach_bitmaps(const git_repo *repo) {
+    // marking uses the current bitmaps, so rewriting them does not walk history again
+    loose_objects objects;
+    if (list_loose_objects(repo, &objects) != 0) {
+        return -1;
+    }
+    reach_word *reachable = calloc(REACH_WORDS(objects.num_objects) + 1, sizeof(reach_word));
+    if (mark_reachable_objects(repo, &objects, reachable) != 0) {
+        free(reachable);
+        free_loose_objects(&objects);
+        return -1;
+    }
+
+    bitmap_builder builder = { repo, commit_graph_open(repo), &objects, NULL, 0, NULL, NULL, 0 };
+    builder.loose_to_table = malloc((objects.num_objects + 1) * sizeof(int));
+    for (int i = 0; i < objects.num_objects; i++) {
+        builder.loose_to_table[i] = is_reachable(reachable, i) ? (int)builder.num_objects++ : -1;
+    }
+    free(reachable);
+
+    obj_hash *commits = NULL;
+    int num_commits = select_bitmap_commits(repo, &commits), rc = num_commits < 0 ? -1 : 0;
+    builder.built = malloc((num_commits > 0 ? num_commits : 1) * sizeof(built_bitmap));
+    builder.built_of = malloc((builder.num_objects + 1) * sizeof(int));
+    memset(builder.built_of, 0xff, (builder.num_objects + 1) * sizeof(int));
+
+    size_t num_words = ((size_t)builder.num_objects + 63) / 64;
+    uint64_t *bits = malloc((num_words + 1) * sizeof(uint64_t));
+    for (int i = 0; i < num_commits && rc == 0; i++) {
+        memset(bits, 0, (num_words + 1) * sizeof(uint64_t));
+        int64_t pos = builder_find(&builder, commits[i]);
+        if (pos < 0 || (rc = build_commit_bitmap(&builder, commits[i], bits)) != 0) {
+            printf("ERROR: could not build bitmap of %s\n", commits[i]);
+            rc = -1;
+            break;
+        }
+        built_bitmap *built = &builder.built[builder.num_built];
+        built->pos = (uint32_t)pos;
+        built->size = ewah_encode(bits, num_words, &built->data);
+        builder.built_of[pos] = builder.num_built++;
+    }
+    free(bits);
+    free(commits);
+
+    if (rc == 0) {
+        qsort(builder.built, builder.num_built, sizeof(built_bitmap), cmp_built_bitmap);
+        size_t size;
+        unsigned char *buf = bitmaps_serialize(&builder, &size);
+        if ((rc = bitmaps_write_file(repo, buf, size)) != 0) {
+            printf("ERROR: could not write bitmaps\n");
+        }
+        free(buf);
+    }
+
+    for (int i = 0; i < builder.num_built; i++) {
+        free(builder.built[i].data);
+    }
+    free(builder.built);
+    free(builder.built_of);
+    free(builder.loose_to_table);
+    if (builder.graph != NULL) {
+        commit_graph_close(builder.graph);
+    }
+    free_loose_objects(&objects);
+    return rc;
+}
@@ -0,0 +1,576 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "threadpool.h"
+#include "bulkio.h"
+
+// files stat-ed per thread pool task
+#define BULK_STAT_CHUNK 64
+
+typedef struct bulk_ctx {
+    const git_repo *repo;
+    fs_dir *root; // relative paths are resolved against its descriptor
+    int write;
+    atomic_int failed;
+    bulk_file *files;
+    unsigned char *pending; // 1 for each file still to be handled, so the ring can leave files to the thread pool
+} bulk_ctx;
+
+typedef struct bulk_task {
+    bulk_ctx *ctx;
+    bulk_file *files;
+    int num_files;
+    unsigned char *buf; // contents already read, owned by task
+} bulk_task;
+
+void bulk_fail(bulk_ctx *ctx, bulk_file *file) {
+    file->status = -1;
+    atomic_fetch_add(&ctx->failed, 1);
+}
+
+// hashing stage: takes ownership of `buf`
+void bulk_hash_buffer(bulk_ctx *ctx, bulk_file *file, unsigned char *buf) {
+    git_obj_blob *blob = create_blob_from_buffer(buf, file->stat.fi_size);
+    free(buf);
+
+    snprintf(file->hash, OBJ_HASH_SIZE, "%s", blob->obj.hash);
+    if (ctx->write && write_blob_to_disk(ctx->repo, blob) != 0) {
+        bulk_fail(ctx, file);
+    }
+    free_blob(blob);
+}
+
+void bulk_hash_task(void *arg) {
+    bulk_task *task = arg;
+    bulk_hash_buffer(task->ctx, task->files, task->buf);
+    free(task);
+}
+
+void bulk_stat_task(void *arg) {
+    bulk_task *task = arg;
+    for (int i = 0; i < task->num_files; i++) {
+        bulk_file *file = &task->files[i];
+        if (!task->ctx->pending[file - task->ctx->files]) {
+            continue;
+        }
+        file->status = 0;
+        if (fs_dir_lgetinfo(task->ctx->root, file->name, &file->stat) != 0) {
+            bulk_fail(task->ctx, file);
+        }
+    }
+    free(task);
+}
+
+void bulk_read_hash_task(void *arg) {
+    bulk_task *task = arg;
+    bulk_file *file = task->files;
+    size_t size = file->stat.fi_size;
+
+    FILE *fptr;
+    if ((fptr = fs_dir_fopen(task->ctx->root, file->name, "rb")) == NULL) {
+        bulk_fail(task->ctx, file);
+        free(task);
+        return;
+    }
+
+    unsigned char *buf = malloc(size > 0 ? size : 1);
+    size_t read = fs_readbytes(buf, 1, size, fptr);
+    fs_fclose(fptr);
+
+    if (read != size) {
+        free(buf);
+        bulk_fail(task->ctx, file);
+    } else {
+        bulk_hash_buffer(task->ctx, file, buf);
+    }
+    free(task);
+}
+
+// @return 1 if file is large enough to be hashed from a mapping instead of a read buffer
+int bulk_should_map(const bulk_file *file) {
+#ifndef _WIN32
+    return file->stat.fi_size >= BLOB_MMAP_THRESHOLD;
+#else
+    return 0;
+#endif
+}
+
+void bulk_map_hash_task(void *arg) {
+    bulk_task *task = arg;
+    bulk_file *file = task->files;
+
+    FILE *fptr;
+    if ((fptr = fs_dir_fopen(task->ctx->root, file->name, "rb")) == NULL) {
+        bulk_fail(task->ctx, file);
+        free(task);
+        return;
+    }
+
+    int rc = hash_blob_from_fd(task->ctx->write ? task->ctx->repo : NULL,
+        fileno(fptr), file->stat.fi_size, &file->hash);
+    fs_fclose(fptr);
+
+    if (rc != 0) {
+        bulk_fail(task->ctx, file);
+    }
+    free(task);
+}
+
+void bulk_submit(bulk_ctx *ctx, threadpool *pool, tp_task_fn fn, bulk_file *files, int num_files, unsigned char *buf) {
+    bulk_task *task = malloc(sizeof(*task));
+    task->ctx = ctx;
+    task->files = files;
+    task->num_files = num_files;
+    task->buf = buf;
+    threadpool_submit(pool, fn, task);
+}
+
+int bulk_ctx_init(bulk_ctx *ctx, const git_repo *repo, bulk_file *files, int num_files, int write) {
+    ctx->repo = repo;
+    ctx->write = write;
+    atomic_init(&ctx->failed, 0);
+    if ((ctx->root = fs_dir_open(repo->root_path)) == NULL) {
+        perror("could not open repo root");
+        return -1;
+    }
+    ctx->files = files;
+    ctx->pending = calloc(num_files + 1, 1);
+    return 0;
+}
+
+void bulk_ctx_end(bulk_ctx *ctx) {
+    fs_dir_close(ctx->root);
+    free(ctx->pending);
+}
+
+#if BULK_USE_IO_URING && defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#define BULK_RING_ENTRIES 256
+
+typedef struct bulk_ring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+
+    unsigned to_submit; // sqes filled but not yet passed to kernel
+    unsigned inflight; // sqes submitted or to be submitted, not yet completed
+} bulk_ring;
+
+int ring_supports_ops(int fd) {
+    const unsigned char ops[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+
+    int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(ops); i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    return ok;
+}
+
+void ring_free(bulk_ring *ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+// @return 0 on success, -1 if io_uring or one of the needed ops is unavailable
+int ring_init(bulk_ring *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    if ((ring->fd = syscall(__NR_io_uring_setup, BULK_RING_ENTRIES, &params)) < 0) {
+        return -1;
+    }
+    if (!ring_supports_ops(ring->fd)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_len > ring->sq_len) {
+        ring->sq_len = ring->cq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->cq_ptr = single_mmap ? ring->sq_ptr : mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (!single_mmap) {
+            munmap(ring->cq_ptr, ring->cq_len);
+        }
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+// callers never queue more than BULK_RING_ENTRIES operations at once, so a slot is always free
+struct io_uring_sqe *ring_get_sqe(bulk_ring *ring, unsigned char opcode, int fd, unsigned long long user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    ring->inflight++;
+    return sqe;
+}
+
+typedef void (*ring_handler)(bulk_ring *, void *ctx, unsigned long long user_data, int res);
+
+// submits queued operations and dispatches completions until none are in flight
+// @return 0 on success, -1 if io_uring_enter failed
+int ring_run(bulk_ring *ring, ring_handler handler, void *ctx) {
+    while (ring->inflight > 0) {
+        int submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno != EINTR && errno != EBUSY) {
+                return -1;
+            }
+            // completion queue is full, reaping below makes room to try again
+            submitted = 0;
+        }
+        ring->to_submit -= submitted;
+
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            unsigned long long user_data = cqe->user_data;
+            int res = cqe->res;
+
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            ring->inflight--;
+            handler(ring, ctx, user_data, res);
+        }
+    }
+    return 0;
+}
+
+typedef struct ring_batch {
+    bulk_ctx *ctx;
+    bulk_file *files;
+    unsigned char *pending;
+    struct statx *stx;
+    int *fds;
+    unsigned char **bufs;
+    size_t *done;
+} ring_batch;
+
+void ring_on_statx(bulk_ring *ring, void *arg, unsigned long long i, int res) {
+    (void)ring;
+    ring_batch *batch = arg;
+    bulk_file *file = &batch->files[i];
+    batch->pending[i] = 0;
+    if (res < 0) {
+        bulk_fail(batch->ctx, file);
+        return;
+    }
+
+    const struct statx *stx = &batch->stx[i];
+    file->stat.fi_size = stx->stx_size;
+    file->stat.fi_mode = stx->stx_mode;
+    file->stat.fi_atime = stx->stx_atime.tv_sec;
+    file->stat.fi_mtime = stx->stx_mtime.tv_sec;
+    file->stat.fi_ctime = stx->stx_ctime.tv_sec;
+    file->stat.fi_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    file->stat.fi_ino = stx->stx_ino;
+    file->stat.fi_uid = stx->stx_uid;
+    file->stat.fi_gid = stx->stx_gid;
+}
+
+void ring_on_open(bulk_ring *ring, void *arg, unsigned long long i, int res) {
+    (void)ring;
+    ring_batch *batch = arg;
+    batch->fds[i] = res;
+    if (res < 0) {
+        batch->pending[i] = 0;
+        bulk_fail(batch->ctx, &batch->files[i]);
+    }
+}
+
+void ring_queue_read(bulk_ring *ring, ring_batch *batch, unsigned long long i) {
+    size_t done = batch->done[i];
+    struct io_uring_sqe *sqe = ring_get_sqe(ring, IORING_OP_READ, batch->fds[i], i);
+    sqe->addr = (unsigned long long)(uintptr_t)(batch->bufs[i] + done);
+    sqe->len = batch->files[i].stat.fi_size - done;
+    sqe->off = done;
+}
+
+void ring_on_read(bulk_ring *ring, void *arg, unsigned long long i, int res) {
+    ring_batch *batch = arg;
+    bulk_file *file = &batch->files[i];
+
+    // error, or file was truncated after it was stat-ed
+    if (res <= 0) {
+        batch->pending[i] = 0;
+        bulk_fail(batch->ctx, file);
+        return;
+    }
+
+    batch->done[i] += res;
+    if (batch->done[i] < file->stat.fi_size) {
+        ring_queue_read(ring, batch, i);
+    }
+}
+
+void ring_on_close(bulk_ring *ring, void *arg, unsigned long long i, int res) {
+    (void)ring;
+    (void)arg;
+    (void)i;
+    (void)res;
+}
+
+// Gives up on the files of a batch the ring did not finish, which stay pending for the thread pool.
+// A read may still be in flight once the ring failed, so its buffer is left allocated.
+void ring_abandon(ring_batch *batch, int n) {
+    for (int i = 0; i < n; i++) {
+        if (batch->fds[i] >= 0) {
+            close(batch->fds[i]);
+        }
+        if (!batch->pending[i] || batch->done[i] == batch->files[i].stat.fi_size) {
+            free(batch->bufs[i]);
+        }
+    }
+}
+
+// stats pending files until all are done or the ring fails, without following symlinks
+// @param stx buffer for `BULK_RING_ENTRIES` results, only freed by the caller once the ring is closed
+// @return 0 on success, -1 if the ring failed
+int ring_stat_files(bulk_ring *ring, bulk_ctx *ctx, bulk_file *files, int num_files, struct statx *stx) {
+    for (int base = 0; base < num_files; base += BULK_RING_ENTRIES) {
+        int n = num_files - base < BULK_RING_ENTRIES ? num_files - base : BULK_RING_ENTRIES;
+        ring_batch batch = { .ctx = ctx, .files = files + base, .pending = ctx->pending + base, .stx = stx };
+
+        for (int i = 0; i < n; i++) {
+            batch.files[i].status = 0;
+            struct io_uring_sqe *sqe = ring_get_sqe(ring, IORING_OP_STATX, ctx->root->fd, i);
+            sqe->addr = (unsigned long long)(uintptr_t)batch.files[i].name;
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long long)(uintptr_t)&stx[i];
+        }
+        if (ring_run(ring, ring_on_statx, &batch) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// reads pending files that are not mapped, and queues their hashing, until all are done or the ring fails
+// @return 0 on success, -1 if the ring failed
+int ring_hash_files(bulk_ring *ring, bulk_ctx *ctx, threadpool *pool, bulk_file *files, int num_files) {
+    int fds[BULK_RING_ENTRIES];
+    unsigned char *bufs[BULK_RING_ENTRIES];
+    size_t done[BULK_RING_ENTRIES];
+
+    for (int base = 0; base < num_files; base += BULK_RING_ENTRIES) {
+        int n = num_files - base < BULK_RING_ENTRIES ? num_files - base : BULK_RING_ENTRIES;
+        ring_batch batch = { .ctx = ctx, .files = files + base, .pending = ctx->pending + base,
+            .fds = fds, .bufs = bufs, .done = done };
+
+        for (int i = 0; i < n; i++) {
+            fds[i] = -1;
+            bufs[i] = NULL;
+            done[i] = 0;
+            if (!batch.pending[i]) {
+                continue;
+            }
+            struct io_uring_sqe *sqe = ring_get_sqe(ring, IORING_OP_OPENAT, ctx->root->fd, i);
+            sqe->addr = (unsigned long long)(uintptr_t)batch.files[i].name;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        if (ring_run(ring, ring_on_open, &batch) != 0) {
+            ring_abandon(&batch, n);
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (fds[i] < 0) {
+                continue;
+            }
+            size_t size = batch.files[i].stat.fi_size;
+            bufs[i] = malloc(size > 0 ? size : 1);
+            if (size > 0) {
+                ring_queue_read(ring, &batch, i);
+            }
+        }
+        if (ring_run(ring, ring_on_read, &batch) != 0) {
+            ring_abandon(&batch, n);
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (fds[i] >= 0) {
+                ring_get_sqe(ring, IORING_OP_CLOSE, fds[i], i);
+            }
+        }
+        int rc = ring_run(ring, ring_on_close, &batch);
+
+        // hash while the next batch is read
+        for (int i = 0; i < n; i++) {
+            if (bufs[i] != NULL && batch.pending[i]) {
+                batch.pending[i] = 0;
+                bulk_submit(ctx, pool, bulk_hash_task, &batch.files[i], 1, bufs[i]);
+            } else {
+                free(bufs[i]);
+            }
+        }
+        if (rc != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
+int bulk_stat_files(const git_repo *repo, bulk_file *files, int num_files) {
+    bulk_ctx ctx;
+    if (bulk_ctx_init(&ctx, repo, files, num_files, 0) != 0) {
+        return num_files;
+    }
+    memset(ctx.pending, 1, num_files);
+
+#if BULK_USE_IO_URING && defined(__linux__)
+    bulk_ring ring;
+    if (ring_init(&ring) == 0) {
+        struct statx *stx = malloc(BULK_RING_ENTRIES * sizeof(struct statx));
+        int rc = ring_stat_files(&ring, &ctx, files, num_files, stx);
+        // closing the ring cancels any statx still in flight, so the results can go
+        ring_free(&ring);
+        free(stx);
+        if (rc == 0) {
+            bulk_ctx_end(&ctx);
+            return atomic_load(&ctx.failed);
+        }
+    }
+#endif
+
+    // files the ring did not get to are stat-ed on the thread pool
+    threadpool *pool;
+    if ((pool = threadpool_create(0)) == NULL) {
+        bulk_ctx_end(&ctx);
+        return num_files;
+    }
+
+    for (int base = 0; base < num_files; base += BULK_STAT_CHUNK) {
+        int n = num_files - base < BULK_STAT_CHUNK ? num_files - base : BULK_STAT_CHUNK;
+        bulk_submit(&ctx, pool, bulk_stat_task, files + base, n, NULL);
+    }
+    threadpool_destroy(pool);
+
+    bulk_ctx_end(&ctx);
+    return atomic_load(&ctx.failed);
+}
+
+int bulk_hash_files(const git_repo *repo, bulk_file *files, int num_files, int write) {
+    bulk_ctx ctx;
+    if (bulk_ctx_init(&ctx, repo, files, num_files, write) != 0) {
+        return num_files;
+    }
+
+    threadpool *pool;
+    if ((pool = threadpool_create(0)) == NULL) {
+        bulk_ctx_end(&ctx);
+        return num_files;
+    }
+
+    // large files are mapped rather than read, so they never go through the ring
+    for (int i = 0; i < num_files; i++) {
+        if (files[i].status == 0 && bulk_should_map(&files[i])) {
+            bulk_submit(&ctx, pool, bulk_map_hash_task, &files[i], 1, NULL);
+        } else {
+            ctx.pending[i] = files[i].status == 0;
+        }
+    }
+
+#if BULK_USE_IO_URING && defined(__linux__)
+    bulk_ring ring;
+    if (ring_init(&ring) == 0) {
+        ring_hash_files(&ring, &ctx, pool, files, num_files);
+        ring_free(&ring);
+    }
+#endif
+
+    // files the ring did not get to, or all of them without it, are read by their own task
+    for (int i = 0; i < num_files; i++) {
+        if (ctx.pending[i]) {
+            bulk_submit(&ctx, pool, bulk_read_hash_task, &files[i], 1, NULL);
+        }
+    }
+    threadpool_destroy(pool);
+
+    bulk_ctx_end(&ctx);
+    return atomic_load(&ctx.failed);
+}
@@ -0,0 +1,381 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "bulkio.h"
+#include "threadpool.h"
+#include "unpack.h"
+#include "checkout.h"
+
+typedef struct checkout_ctx {
+    const git_repo *repo;
+    atomic_int failed;
+} checkout_ctx;
+
+typedef struct checkout_task {
+    checkout_ctx *ctx;
+    git_index_entry **entries;
+    int num_entries;
+} checkout_task;
+
+// path in working tree that must hold `old_hash` or `new_hash` to be overwritten
+typedef struct checkout_check {
+    const char *old_hash; // "" if path is untracked
+    const char *new_hash; // "" if path is removed
+} checkout_check;
+
+typedef struct entry_list {
+    git_index_entry **entries;
+    int num_entries;
+    int capacity;
+} entry_list;
+
+void entry_list_add(entry_list *list, git_index_entry *entry) {
+    if (list->num_entries == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->entries = realloc(list->entries, list->capacity * sizeof(git_index_entry *));
+    }
+    list->entries[list->num_entries++] = entry;
+}
+
+// @return number of paths whose file in working tree holds neither of their expected blobs
+int checkout_verify(const git_repo *repo, const git_dircache *dircache, bulk_file *files, checkout_check *checks, int num_files) {
+    bulk_stat_files(repo, files, num_files);
+
+    // only files whose stat info differs from their entry need to be read
+    int num_read = 0;
+    int *read_ids = malloc((num_files + 1) * sizeof(int));
+    bulk_file *read_files = calloc(num_files + 1, sizeof(bulk_file));
+    for (int i = 0; i < num_files; i++) {
+        if (files[i].status != 0) {
+            continue; // missing files can be replaced
+        }
+        if (S_ISDIR(files[i].stat.fi_mode)) {
+            if (checks[i].old_hash[0] == '\0') {
+                printf("error: %s is an untracked folder where checkout needs a file\n", files[i].name);
+                files[i].status = -2;
+            }
+            continue;
+        }
+        git_index_entry *entry = checks[i].old_hash[0] != '\0' ? find_index_entry(dircache, files[i].name) : NULL;
+        if (entry == NULL || !is_entry_clean(dircache, entry, &files[i].stat)) {
+            read_ids[num_read] = i;
+            read_files[num_read++] = files[i];
+        }
+    }
+    bulk_hash_files(repo, read_files, num_read, 0);
+
+    int num_dirty = 0;
+    for (int i = 0; i < num_files; i++) {
+        num_dirty += files[i].status == -2;
+    }
+    for (int k = 0; k < num_read; k++) {
+        const bulk_file *file = &read_files[k];
+        const checkout_check *check = &checks[read_ids[k]];
+        if (file->status == 0 && (strcmp(file->hash, check->old_hash) == 0 || strcmp(file->hash, check->new_hash) == 0)) {
+            continue;
+        }
+        if (check->old_hash[0] != '\0') {
+            printf("error: your local changes to %s would be overwritten by checkout\n", file->name);
+        } else {
+            printf("error: untracked file %s would be overwritten by checkout\n", file->name);
+        }
+        num_dirty++;
+    }
+
+    free(read_ids);
+    free(read_files);
+    return num_dirty;
+}
+
+// finds untracked files standing where a folder of an entry to be written must be created
+// @return number of such files
+int checkout_verify_dirs(const git_repo *repo, const git_dircache *dircache, git_index_entry **entries, int num_entries) {
+    char path[PATH_MAX];
+    size_t root_len = snprintf(path, sizeof(path), "%s/", repo->root_path);
+
+    int num_blocked = 0;
+    for (int i = 0; i < num_entries; i++) {
+        const char *name = entries[i]->name;
+        const char *prev = i > 0 ? entries[i - 1]->name : "";
+        if (root_len + entries[i]->namelen + 1 > PATH_MAX) {
+            continue; // checkout_mkdirs fails on it
+        }
+
+        // tracked files in the way are removed by checkout, and were verified as such
+        for (size_t len = 1; len < (size_t)entries[i]->namelen; len++) {
+            if (name[len] != '/' || strncmp(prev, name, len + 1) == 0) {
+                continue;
+            }
+            memcpy(path + root_len, name, len);
+            path[root_len + len] = '\0';
+            fs_statinfo stat;
+            if (fs_getinfo(path, &stat) == 0 && !S_ISDIR(stat.fi_mode) && find_index_entry(dircache, path + root_len) == NULL) {
+                printf("error: untracked file %s would be overwritten by checkout\n", path + root_len);
+                num_blocked++;
+                break;
+            }
+        }
+    }
+    return num_blocked;
+}
+
+// sorts children before their parent folders
+int cmp_dirs_desc(const void *a, const void *b) {
+    return strcmp(*(char * const *)b, *(char * const *)a);
+}
+
+// removes files and then the folders they leave empty, deepest first
+// @return number of files that could not be removed
+int checkout_remove(const git_repo *repo, git_index_entry **entries, int num_entries) {
+    int failed = 0;
+    char path[PATH_MAX];
+    char **dirs = NULL;
+    int num_dirs = 0, capacity = 0;
+    for (int i = 0; i < num_entries; i++) {
+        const char *name = entries[i]->name;
+        fs_path_join(repo->root_path, name, path);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            printf("ERROR: could not remove %s\n", name);
+            failed++;
+        }
+
+        // folders shared with the previous entry were recorded for it
+        const char *prev = i > 0 ? entries[i - 1]->name : "";
+        for (size_t len = entries[i]->namelen; len > 0; len--) {
+            if (name[len - 1] != '/') {
+                continue;
+            }
+            if (strncmp(prev, name, len) == 0) {
+                break;
+            }
+            if (num_dirs == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                dirs = realloc(dirs, capacity * sizeof(char *));
+            }
+            dirs[num_dirs++] = strndup(name, len - 1);
+        }
+    }
+
+    if (num_dirs > 0) {
+        qsort(dirs, num_dirs, sizeof(char *), cmp_dirs_desc);
+    }
+    for (int i = 0; i < num_dirs; i++) {
+        if (i == 0 || strcmp(dirs[i], dirs[i - 1]) != 0) {
+            fs_path_join(repo->root_path, dirs[i], path);
+            rmdir(path); // fails on folders still holding files, which is fine
+        }
+    }
+    for (int i = 0; i < num_dirs; i++) {
+        free(dirs[i]);
+    }
+    free(dirs);
+    return failed;
+}
+
+// creates folders of all entries, skipping ones shared with the previous entry
+// @return 0 on success, -1 if a folder could not be created
+int checkout_mkdirs(const git_repo *repo, git_index_entry **entries, int num_entries) {
+    char path[PATH_MAX];
+    size_t root_len = snprintf(path, sizeof(path), "%s/", repo->root_path);
+
+    for (int i = 0; i < num_entries; i++) {
+        const char *name = entries[i]->name;
+        const char *prev = i > 0 ? entries[i - 1]->name : "";
+        if (root_len + entries[i]->namelen + 1 > PATH_MAX) {
+            return -1;
+        }
+
+        // every folder on the way to the file, from the top, that the previous entry was not in
+        for (size_t len = 1; len < (size_t)entries[i]->namelen; len++) {
+            if (name[len] != '/' || strncmp(prev, name, len + 1) == 0) {
+                continue;
+            }
+            memcpy(path + root_len, name, len);
+            path[root_len + len] = '\0';
+            if (fs_mkdir(path, 0755) == -1) {
+                printf("ERROR: could not create folder %s\n", path + root_len);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// writes one file and records its stat info in its entry
+// @return 0 on success, -1 on failure
+int checkout_write_file(const git_repo *repo, git_index_entry *entry) {
+    char path[PATH_MAX];
+    fs_path_join(repo->root_path, entry->name, path);
+
+    git_obj_blob *blob;
+    if ((blob = create_blob_from_disk(repo, entry->hash)) == NULL) {
+        return -1;
+    }
+
+    // replaced rather than truncated, so a file hard linked elsewhere is left alone
+    if (unlink(path) != 0 && errno != ENOENT) {
+        free_blob(blob);
+        return -1;
+    }
+    int fd;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, entry->git_mode == GIT_MODE_FILE_X ? 0755 : 0644)) == -1) {
+        free_blob(blob);
+        return -1;
+    }
+
+    struct stat st;
+    int rc = write_blob_to_fd(fd, blob);
+    if (rc == 0 && fstat(fd, &st) == 0) {
+        fill_statinfo(&st, &entry->info);
+    } else {
+        rc = -1;
+    }
+    if (close(fd) != 0) {
+        rc = -1;
+    }
+    free_blob(blob);
+    return rc;
+}
+
+void checkout_write_task(void *arg) {
+    checkout_task *task = arg;
+    for (int i = 0; i < task->num_entries; i++) {
+        if (checkout_write_file(task->ctx->repo, task->entries[i]) != 0) {
+            printf("ERROR: could not write %s\n", task->entries[i]->name);
+            memset(&task->entries[i]->info, 0, sizeof(fs_statinfo));
+            atomic_fetch_add(&task->ctx->failed, 1);
+        }
+    }
+    free(task);
+}
+
+// @return number of files that could not be written
+int checkout_write(const git_repo *repo, git_index_entry **entries, int num_entries) {
+    checkout_ctx ctx;
+    ctx.repo = repo;
+    atomic_init(&ctx.failed, 0);
+
+    threadpool *pool = num_entries > CHECKOUT_CHUNK ? threadpool_create(0) : NULL;
+    for (int i = 0; i < num_entries; i += CHECKOUT_CHUNK) {
+        checkout_task *task = malloc(sizeof(*task));
+        task->ctx = &ctx;
+        task->entries = entries + i;
+        task->num_entries = num_entries - i < CHECKOUT_CHUNK ? num_entries - i : CHECKOUT_CHUNK;
+        if (pool != NULL) {
+            threadpool_submit(pool, checkout_write_task, task);
+        } else {
+            checkout_write_task(task);
+        }
+    }
+    if (pool != NULL) {
+        threadpool_destroy(pool);
+    }
+    return atomic_load(&ctx.failed);
+}
+
+int checkout_index(const git_repo *repo, git_dircache *dircache, git_dircache *target, int flags, checkout_stats *stats) {
+    // both indexes are sorted, so one pass finds every path that changes
+    entry_list to_write = { NULL, 0, 0 }, to_remove = { NULL, 0, 0 };
+    int num_checks = 0;
+    bulk_file *files = calloc(dircache->num_entries + target->num_entries + 1, sizeof(bulk_file));
+    checkout_check *checks = malloc((dircache->num_entries + target->num_entries + 1) * sizeof(checkout_check));
+
+    int i = 0, j = 0;
+    while (i < dircache->num_entries || j < target->num_entries) {
+        git_index_entry *old = i < dircache->num_entries ? dircache->entries[i] : NULL;
+        git_index_entry *new = j < target->num_entries ? target->entries[j] : NULL;
+        int cmp = old == NULL ? 1 : new == NULL ? -1 : index_sort_cmp(old->name, new->name);
+
+        // skips other stages of paths in merge conflict
+        if (cmp <= 0) {
+            while (i + 1 < dircache->num_entries && index_sort_cmp(dircache->entries[i + 1]->name, old->name) == 0) {
+                i++;
+            }
+            i++;
+        }
+        if (cmp >= 0) {
+            while (j + 1 < target->num_entries && index_sort_cmp(target->entries[j + 1]->name, new->name) == 0) {
+                j++;
+            }
+            j++;
+        }
+
+        if (cmp >= 0 && new->stage_num != 0) {
+            continue; // conflicts keep the file in working tree as it is
+        }
+        if (cmp == 0 && old->stage_num == 0 && old->git_mode == new->git_mode && strcmp(old->hash, new->hash) == 0) {
+            continue;
+        }
+        if (cmp >= 0 && new->git_mode != GIT_MODE_FILE_R && new->git_mode != GIT_MODE_FILE_X) {
+            printf("WARNING: skipping %s, symlinks and gitlinks are not supported\n", new->name);
+            continue;
+        }
+        if (cmp >= 0) {
+            entry_list_add(&to_write, new);
+        } else {
+            entry_list_add(&to_remove, old);
+        }
+        files[num_checks].name = cmp > 0 ? new->name : old->name;
+        checks[num_checks].old_hash = cmp > 0 || old->stage_num != 0 ? "" : old->hash;
+        checks[num_checks].new_hash = cmp < 0 ? "" : new->hash;
+        num_checks++;
+    }
+
+    int rc = 0;
+    if (!(flags & CHECKOUT_FORCE) && (checkout_verify(repo, dircache, files, checks, num_checks)
+        + checkout_verify_dirs(repo, dircache, to_write.entries, to_write.num_entries)) > 0) {
+        rc = 1;
+    }
+
+    int num_failed = 0;
+    if (rc == 0) {
+        num_failed += checkout_remove(repo, to_remove.entries, to_remove.num_entries);
+        if (checkout_mkdirs(repo, to_write.entries, to_write.num_entries) != 0) {
+            num_failed += to_write.num_entries;
+        } else {
+            num_failed += checkout_write(repo, to_write.entries, to_write.num_entries);
+        }
+
+        replace_dircache_entries(dircache, target);
+    }
+
+    if (stats != NULL) {
+        stats->written = rc == 0 ? to_write.num_entries : 0;
+        stats->removed = rc == 0 ? to_remove.num_entries : 0;
+        stats->failed = num_failed;
+    }
+    free(to_write.entries);
+    free(to_remove.entries);
+    free(files);
+    free(checks);
+    return rc;
+}
+
+int checkout_tree(const git_repo *repo, git_dircache *dircache, const char *head_tree, const obj_hash tree, int flags, checkout_stats *stats) {
+    // forced checkouts take the tree as it is, others keep staged changes the switch does not touch
+    const char *trees[2] = { head_tree, tree };
+    git_dircache target;
+    int rc;
+    if (flags & CHECKOUT_FORCE) {
+        rc = unpack_trees(repo, dircache, trees + 1, 1, &target);
+    } else {
+        rc = unpack_trees(repo, dircache, trees, 2, &target);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = checkout_index(repo, dircache, &target, flags, stats);
+    clear_dircache(&target);
+    return rc;
+}
@@ -0,0 +1,156 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "objects.h"
+#include "dircache.h"
+#include "refs.h"
+#include "gc.h"
+#include "commitgraph.h"
+#include "bitmap.h"
+#include "checkout.h"
+#include "transfer.h"
+#include "remote.h"
+#include "clone.h"
+
+// @return 1 if folder has no entries, 0 otherwise
+int clone_is_empty_dir(const char *path) {
+    fs_dir *dir = fs_dir_open(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    fs_dirent entry;
+    int res = fs_dir_next(dir, &entry);
+    fs_dir_close(dir);
+    return res == 0;
+}
+
+// links or copies every loose object, and the files derived from them
+// @return 0 on success, -1 otherwise
+int clone_objects(const git_repo *src, const git_repo *dest, clone_stats *stats) {
+    loose_objects objects;
+    if (list_loose_objects(src, &objects) != 0) {
+        return -1;
+    }
+    obj_hash *hashes = malloc((objects.num_objects + 1) * sizeof(obj_hash));
+    for (int i = 0; i < objects.num_objects; i++) {
+        memcpy(hashes[i], objects.objects[i].hash, OBJ_HASH_SIZE);
+    }
+    stats->num_objects = objects.num_objects;
+    int res = transfer_objects(src, dest, (const obj_hash *)hashes, objects.num_objects, &stats->objects);
+    free(hashes);
+    free_loose_objects(&objects);
+
+    if (res != 0 || transfer_objects_file(src, dest, COMMIT_GRAPH_FILE) == -1 ||
+        transfer_objects_file(src, dest, BITMAPS_FILE) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+// branches become remote-tracking refs of DEFAULT_REMOTE, tags are kept, other refs are skipped
+// @return 0 on success, -1 otherwise
+int clone_refs(const git_repo *src, const git_repo *dest, clone_stats *stats) {
+    ref_list refs;
+    if (list_refs(src, &refs) != 0) {
+        return -1;
+    }
+
+    char name[PATH_MAX];
+    int res = 0;
+    for (int i = 0; res == 0 && i < refs.num_refs; i++) {
+        const char *ref = refs.refs[i].name;
+        if (strncmp(ref, HEADS_REF_PREFIX, strlen(HEADS_REF_PREFIX)) == 0) {
+            snprintf(name, PATH_MAX, REMOTES_REF_PREFIX DEFAULT_REMOTE "/%s", ref + strlen(HEADS_REF_PREFIX));
+        } else if (strncmp(ref, TAGS_REF_PREFIX, strlen(TAGS_REF_PREFIX)) == 0) {
+            snprintf(name, PATH_MAX, "%s", ref);
+        } else {
+            continue;
+        }
+        if ((res = update_ref(dest, name, refs.refs[i].hash, "")) == 0) {
+            stats->num_refs++;
+        }
+    }
+    free_ref_list(&refs);
+    return res;
+}
+
+// points HEAD at the source's branch, or detaches it at the same commit, and checks it out
+// @return 0 on success, -1 otherwise
+int clone_head(const git_repo *src, const git_repo *dest, clone_stats *stats) {
+    obj_hash head;
+    char head_ref[PATH_MAX];
+    int head_res = resolve_head(src, &head, head_ref);
+    if (head_res == -1) {
+        return -1;
+    }
+
+    const char *branch = NULL;
+    if (strncmp(head_ref, HEADS_REF_PREFIX, strlen(HEADS_REF_PREFIX)) == 0) {
+        branch = head_ref + strlen(HEADS_REF_PREFIX);
+        if ((head_res == 0 && update_ref(dest, head_ref, head, "") != 0) || set_head(dest, head_ref, NULL) != 0) {
+            return -1;
+        }
+    } else if (head_res == 0 && set_head(dest, NULL, head) != 0) {
+        return -1;
+    }
+    if (add_remote(dest, DEFAULT_REMOTE, src->root_path, branch) != 0) {
+        return -1;
+    }
+    // branch has no commits yet, nothing to check out
+    if (head_res == 1) {
+        return 0;
+    }
+
+    obj_hash tree;
+    git_dircache *dircache = create_dircache(dest);
+    int res = dircache == NULL || read_commit_tree(dest, head, &tree) != 0 ||
+        checkout_tree(dest, dircache, NULL, tree, CHECKOUT_FORCE, &stats->checkout) != 0 ||
+        write_index(dest, dircache) != 0 ? -1 : 0;
+    if (dircache != NULL) {
+        free_dircache(dircache);
+    }
+    return res == 0 && stats->checkout.failed == 0 ? 0 : -1;
+}
+
+int clone_repo(const char *src_path, const char *dest_path, clone_stats *stats) {
+    clone_stats local_stats;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    // a folder inside a repo is not a repo of its own
+    char src_root[PATH_MAX], dest_root[PATH_MAX];
+    const git_repo *src = NULL, *dest = NULL;
+    if (fs_path_abs(src_path, src_root) != 0 || (src = get_working_repo(src_root)) == NULL ||
+        strcmp(src->root_path, src_root) != 0) {
+        printf("ERROR: %s is not a repository\n", src_path);
+        free_repo(src);
+        return 1;
+    }
+
+    int res = fs_mkdir(dest_path, 0755);
+    if (res == 1 && !clone_is_empty_dir(dest_path)) {
+        printf("ERROR: %s already exists and is not an empty folder\n", dest_path);
+        free_repo(src);
+        return 1;
+    }
+    if (res == -1 || fs_path_abs(dest_path, dest_root) != 0 || git_init_repo(dest_root) != 0 ||
+        (dest = get_working_repo(dest_root)) == NULL) {
+        printf("ERROR: could not create repository in %s\n", dest_path);
+        free_repo(src);
+        return -1;
+    }
+
+    res = clone_objects(src, dest, stats) != 0 || clone_refs(src, dest, stats) != 0 ||
+        clone_head(src, dest, stats) != 0 ? -1 : 0;
+    if (res != 0) {
+        printf("ERROR: could not clone %s into %s\n", src_path, dest_path);
+    }
+    free_repo(src);
+    free_repo(dest);
+    return res;
+}
@@ -0,0 +1,388 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "refs.h"
+#include "commit.h"
+
+// @return length of header line starting at `line` if it is `key` followed by a hash, otherwise 0
+size_t commit_hash_line(const char *line, const char *end, const char *key, obj_hash *out) {
+    size_t key_len = strlen(key);
+    size_t len = key_len + 1 + OBJ_HASH_SIZE - 1;
+    if ((size_t)(end - line) < len + 1 || strncmp(line, key, key_len) != 0 || line[key_len] != ' ' || line[len] != '\n') {
+        return 0;
+    }
+    snprintf(*out, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, line + key_len + 1);
+    return len + 1;
+}
+
+int parse_commit_info(const char *content, size_t size, commit_info *out) {
+    const char *line = content, *end = content + size;
+    out->num_parents = 0;
+    out->parents = NULL;
+    out->timestamp = 0;
+
+    size_t len;
+    if ((len = commit_hash_line(line, end, "tree", &out->tree)) == 0) {
+        return -1;
+    }
+    line += len;
+
+    obj_hash parent;
+    while ((len = commit_hash_line(line, end, "parent", &parent)) != 0) {
+        out->parents = realloc(out->parents, (out->num_parents + 1) * sizeof(obj_hash));
+        memcpy(out->parents[out->num_parents++], parent, OBJ_HASH_SIZE);
+        line += len;
+    }
+
+    // committer time comes after the closing '>' of its email
+    while (line < end && *line != '\n') {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            break;
+        }
+        if (strncmp(line, "committer ", 10) == 0) {
+            const char *gt = line;
+            for (const char *p = line; p < eol; p++) {
+                if (*p == '>') {
+                    gt = p;
+                }
+            }
+            out->timestamp = (time_t)strtoll(gt + 1, NULL, 10);
+        }
+        line = eol + 1;
+    }
+
+    return 0;
+}
+
+int read_commit_info(const git_repo *repo, const obj_hash hash, commit_info *out) {
+    size_t size;
+    unsigned char *data;
+    if ((data = create_obj_from_disk(repo, hash, &size)) == NULL) {
+        return -1;
+    }
+
+    size_t header_size = strlen((char *)data) + 1;
+    int rc = -1;
+    if (strncmp((char *)data, O_TYPE_COMMIT " ", strlen(O_TYPE_COMMIT) + 1) == 0 && header_size <= size) {
+        rc = parse_commit_info((char *)data + header_size, size - header_size, out);
+    }
+    if (rc != 0) {
+        printf("ERROR: %s is not a commit\n", hash);
+    }
+
+    free(data);
+    return rc;
+}
+
+void free_commit_info(commit_info *info) {
+    free(info->parents);
+    info->parents = NULL;
+    info->num_parents = 0;
+}
+
+// @return child of `tree` for folder `name`, or NULL if it has none
+// @param pos position in `tree` to search from, moved past the returned entry
+git_tree_entry *find_subtree(const git_obj_tree *tree, int *pos, const char *name, size_t name_len) {
+    while (*pos < tree->size) {
+        git_tree_entry *entry = tree->entries[*pos];
+        int res = tree_order_cmp(entry->name, strlen(entry->name), entry->type == TREE_OBJ, name, name_len, 1);
+        if (res > 0) {
+            return NULL;
+        }
+        (*pos)++;
+        if (res == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// writes tree of node `k` and every subtree that differs from `parent_hash`'s tree
+int write_index_tree_node(const git_repo *repo, const git_dircache *dircache, const index_tree *itree,
+    int k, const char *parent_hash) {
+
+    const index_tree_node *node = &itree->nodes[k];
+    if (parent_hash != NULL && strcmp(node->hash, parent_hash) == 0) {
+        return 0;
+    }
+
+    git_obj_tree *parent = NULL;
+    if (parent_hash != NULL && (parent = create_tree_from_disk_shallow(repo, parent_hash)) == NULL) {
+        return -1;
+    }
+
+    int rc = 0, pos = 0;
+    for (int child = k + 1; child < node->end && rc == 0; child = itree->nodes[child].end) {
+        const index_tree_node *sub = &itree->nodes[child];
+        const char *name = dircache->entries[sub->lo]->name + node->prefix_len;
+        size_t name_len = sub->prefix_len - node->prefix_len - 1;
+
+        git_tree_entry *match = parent != NULL ? find_subtree(parent, &pos, name, name_len) : NULL;
+        const char *match_hash = match != NULL && match->type == TREE_OBJ ? match->u.tree->obj.hash : NULL;
+        rc = write_index_tree_node(repo, dircache, itree, child, match_hash);
+    }
+    if (parent != NULL) {
+        free_tree(parent);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    size_t size;
+    unsigned char *content = index_tree_content(dircache, itree, k, &size);
+    git_obj obj;
+    create_git_obj(content, size, O_TYPE_TREE, &obj);
+    rc = write_obj_to_disk(repo, obj.hash, obj.data, obj.size);
+    free(obj.data);
+    free(content);
+
+    return rc;
+}
+
+int write_index_trees(const git_repo *repo, const git_dircache *dircache, const index_tree *itree, const char *parent_tree) {
+    return write_index_tree_node(repo, dircache, itree, 0, parent_tree);
+}
+
+// fills `out` with "name <email> <timestamp> <timezone>"
+void commit_identity(time_t now, char *out, size_t size) {
+    const char *name = getenv(AUTHOR_NAME_ENV);
+    const char *email = getenv(AUTHOR_EMAIL_ENV);
+    const char *user = getenv("USER");
+    if (user == NULL || user[0] == '\0') {
+        user = "unknown";
+    }
+
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+    long offset = 0;
+#else
+    localtime_r(&now, &local);
+    long offset = local.tm_gmtoff / 60;
+#endif
+    char sign = offset < 0 ? '-' : '+';
+    offset = offset < 0 ? -offset : offset;
+
+    if (email != NULL && email[0] != '\0') {
+        snprintf(out, size, "%s <%s> %lld %c%02ld%02ld", name != NULL && name[0] != '\0' ? name : user,
+            email, (long long)now, sign, offset / 60, offset % 60);
+    } else {
+        snprintf(out, size, "%s <%s@localhost> %lld %c%02ld%02ld", name != NULL && name[0] != '\0' ? name : user,
+            user, (long long)now, sign, offset / 60, offset % 60);
+    }
+}
+
+// writes commit with `author` ("name <email> time zone") and the current time's committer
+int write_commit_object(const git_repo *repo, const obj_hash tree_hash, const obj_hash *parents, int num_parents,
+    const char *author, size_t author_len, const char *msg, size_t msg_len, obj_hash *out) {
+
+    char identity[PATH_MAX];
+    commit_identity(time(NULL), identity, sizeof(identity));
+
+    size_t capacity = (num_parents + 2) * (OBJ_HASH_SIZE + 8) + author_len + strlen(identity) + msg_len + 64;
+    char *content = malloc(capacity);
+    size_t used = snprintf(content, capacity, "tree %s\n", tree_hash);
+    for (int i = 0; i < num_parents; i++) {
+        used += snprintf(content + used, capacity - used, "parent %s\n", parents[i]);
+    }
+    used += snprintf(content + used, capacity - used, "author %.*s\ncommitter %s\n\n%.*s%s",
+        (int)author_len, author, identity, (int)msg_len, msg, msg_len > 0 && msg[msg_len - 1] == '\n' ? "" : "\n");
+
+    git_obj obj;
+    create_git_obj((unsigned char *)content, used, O_TYPE_COMMIT, &obj);
+    int rc = write_obj_to_disk(repo, obj.hash, obj.data, obj.size);
+    if (rc == 0) {
+        snprintf(*out, OBJ_HASH_SIZE, "%s", obj.hash);
+    }
+
+    free(obj.data);
+    free(content);
+    return rc;
+}
+
+int write_commit(const git_repo *repo, const obj_hash tree_hash, const obj_hash *parents, int num_parents, const char *msg, obj_hash *out) {
+    char identity[PATH_MAX];
+    commit_identity(time(NULL), identity, sizeof(identity));
+    return write_commit_object(repo, tree_hash, parents, num_parents, identity, strlen(identity), msg, strlen(msg), out);
+}
+
+int write_commit_copy(const git_repo *repo, const obj_hash tree_hash, const obj_hash *parents, int num_parents,
+    const obj_hash original, obj_hash *out) {
+
+    size_t size;
+    unsigned char *data;
+    if ((data = create_obj_from_disk(repo, original, &size)) == NULL) {
+        return -1;
+    }
+    size_t header_size = strlen((char *)data) + 1;
+    if (strncmp((char *)data, O_TYPE_COMMIT " ", strlen(O_TYPE_COMMIT) + 1) != 0 || header_size > size) {
+        printf("ERROR: %s is not a commit\n", original);
+        free(data);
+        return -1;
+    }
+
+    const char *line = (char *)data + header_size, *end = (char *)data + size;
+    const char *author = "", *author_eol = author;
+    while (line < end && *line != '\n') {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            eol = end;
+        }
+        if (strncmp(line, "author ", 7) == 0) {
+            author = line + 7;
+            author_eol = eol;
+        }
+        line = eol + 1;
+    }
+    const char *msg = line < end ? line + 1 : end;
+
+    int rc = write_commit_object(repo, tree_hash, parents, num_parents, author, author_eol - author, msg, end - msg, out);
+    free(data);
+    return rc;
+}
+
+int commit_index(const git_repo *repo, const git_dircache *dircache, const char *msg, obj_hash *out) {
+    for (int i = 0; i < dircache->num_entries; i++) {
+        if (dircache->entries[i]->stage_num != 0) {
+            printf("ERROR: cannot commit, %s has merge conflicts\n", dircache->entries[i]->name);
+            return -1;
+        }
+    }
+
+    obj_hash parents[2], parent_tree;
+    char ref_name[PATH_MAX];
+    int head_rc = resolve_head(repo, &parents[0], ref_name);
+    if (head_rc == -1 || (head_rc == 0 && read_commit_tree(repo, parents[0], &parent_tree) != 0)) {
+        return -1;
+    }
+    int merging = head_rc == 0 && read_ref(repo, MERGE_HEAD_NAME, &parents[1]) == 0;
+    if (head_rc == 1 && dircache->num_entries == 0) {
+        return 1;
+    }
+
+    index_tree itree;
+    hash_index_trees(dircache, &itree);
+
+    int rc = 0;
+    if (head_rc == 0 && !merging && strcmp(itree.nodes[0].hash, parent_tree) == 0) {
+        rc = 1;
+    } else if (write_index_trees(repo, dircache, &itree, head_rc == 0 ? parent_tree : NULL) != 0
+        || write_commit(repo, itree.nodes[0].hash, parents, head_rc == 0 ? 1 + merging : 0, msg, out) != 0) {
+        rc = -1;
+    } else {
+        // detached HEAD is updated in place
+        rc = update_ref(repo, ref_name[0] != '\0' ? ref_name : HEAD_NAME, *out, head_rc == 0 ? parents[0] : "");
+        if (rc == 0 && merging) {
+            rc = delete_ref(repo, MERGE_HEAD_NAME);
+        }
+    }
+
+    free_index_tree(&itree);
+    return rc;
+}
+
+// fills `out` with author date in the author's timezone, like "Mon Oct 19 12:00:00 2026 +0200"
+void commit_format_date(const char *line, const char *eol, char *out, size_t size) {
+    const char *gt = NULL;
+    for (const char *p = line; p < eol; p++) {
+        if (*p == '>') {
+            gt = p;
+        }
+    }
+    out[0] = '\0';
+    if (gt == NULL) {
+        return;
+    }
+
+    char *tz;
+    time_t when = (time_t)strtoll(gt + 1, &tz, 10);
+    while (*tz == ' ') {
+        tz++;
+    }
+    long zone = tz < eol ? strtol(tz, NULL, 10) : 0;
+    long offset = (zone < 0 ? -1 : 1) * ((labs(zone) / 100) * 60 + labs(zone) % 100);
+    time_t shifted = when + offset * 60;
+
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &shifted);
+#else
+    gmtime_r(&shifted, &tm);
+#endif
+    char date[64];
+    strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Y", &tm);
+    snprintf(out, size, "%s %c%04ld", date, zone < 0 ? '-' : '+', labs(zone));
+}
+
+int print_commit(const git_repo *repo, const obj_hash hash, int oneline) {
+    size_t size;
+    unsigned char *data;
+    if ((data = create_obj_from_disk(repo, hash, &size)) == NULL) {
+        return -1;
+    }
+    size_t header_size = strlen((char *)data) + 1;
+    if (strncmp((char *)data, O_TYPE_COMMIT " ", strlen(O_TYPE_COMMIT) + 1) != 0 || header_size > size) {
+        printf("ERROR: %s is not a commit\n", hash);
+        free(data);
+        return -1;
+    }
+
+    const char *line = (char *)data + header_size, *end = (char *)data + size;
+    const char *author = NULL, *author_eol = NULL;
+    char merge_line[128] = "";
+    int num_parents = 0;
+    while (line < end && *line != '\n') {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            eol = end;
+        }
+        if (strncmp(line, "parent ", 7) == 0 && strlen(merge_line) + 9 < sizeof(merge_line)) {
+            // merges list abbreviated parents, like "Merge: 1a2b3c4 5d6e7f8"
+            size_t len = strlen(merge_line);
+            snprintf(merge_line + len, sizeof(merge_line) - len, " %.7s", line + 7);
+            num_parents++;
+        } else if (strncmp(line, "author ", 7) == 0) {
+            author = line + 7;
+            author_eol = eol;
+        }
+        line = eol + 1;
+    }
+    const char *msg = line < end ? line + 1 : end;
+
+    if (oneline) {
+        const char *eol = memchr(msg, '\n', end - msg);
+        printf("%.7s %.*s\n", hash, (int)((eol != NULL ? eol : end) - msg), msg);
+        free(data);
+        return 0;
+    }
+
+    printf("commit %s\n", hash);
+    if (num_parents > 1) {
+        printf("Merge:%s\n", merge_line);
+    }
+    if (author != NULL) {
+        const char *gt = memchr(author, '>', author_eol - author);
+        char date[128];
+        commit_format_date(author, author_eol, date, sizeof(date));
+        printf("Author: %.*s\nDate:   %s\n", (int)((gt != NULL ? gt + 1 : author_eol) - author), author, date);
+    }
+    printf("\n");
+    while (msg < end) {
+        const char *eol = memchr(msg, '\n', end - msg);
+        if (eol == NULL) {
+            eol = end;
+        }
+        printf("    %.*s\n", (int)(eol - msg), msg);
+        msg = eol + 1;
+    }
+    printf("\n");
+    free(data);
+    return 0;
+}
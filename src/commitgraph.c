@@ -0,0 +1,767 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "refs.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "treediff.h"
+#include "threadpool.h"
+
+#define GRAPH_HEADER_SIZE 20
+#define GRAPH_FANOUT_SIZE (256 * 4)
+#define GRAPH_HASH_LEN SHA_DIGEST_LENGTH
+#define GRAPH_ROW_SIZE (GRAPH_HASH_LEN + 16)
+
+uint32_t graph_get_u32(const unsigned char *buf) {
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+void graph_put_u32(unsigned char *buf, uint32_t in) {
+    buf[0] = in >> 24;
+    buf[1] = in >> 16;
+    buf[2] = in >> 8;
+    buf[3] = in;
+}
+
+commit_graph *commit_graph_open(const git_repo *repo) {
+    char path[PATH_MAX];
+    fs_path_join(repo->objects_path, COMMIT_GRAPH_FILE, path);
+
+    int fd;
+    fs_statinfo info;
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    if (fs_getinfo(path, &info) != 0 || info.fi_size < GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + GRAPH_HASH_LEN) {
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char *map;
+#ifndef _WIN32
+    map = mmap(NULL, info.fi_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+    }
+#else
+    map = malloc(info.fi_size);
+    if (read(fd, map, info.fi_size) != (int)info.fi_size) {
+        free(map);
+        map = NULL;
+    }
+#endif
+    close(fd);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    commit_graph *graph = malloc(sizeof(*graph));
+    graph->map = map;
+    graph->map_size = info.fi_size;
+    graph->num_commits = graph_get_u32(map + 8);
+    graph->num_edges = graph_get_u32(map + 12);
+    graph->bloom_size = graph_get_u32(map + 16);
+    graph->fanout = map + GRAPH_HEADER_SIZE;
+    graph->hashes = graph->fanout + GRAPH_FANOUT_SIZE;
+    graph->data = graph->hashes + (size_t)graph->num_commits * GRAPH_HASH_LEN;
+    graph->edges = graph->data + (size_t)graph->num_commits * GRAPH_ROW_SIZE;
+    graph->bloom_index = graph->edges + (size_t)graph->num_edges * 4;
+    graph->bloom_data = graph->bloom_index + (size_t)graph->num_commits * 4;
+
+    // graphs of older versions are rewritten by the next write
+    if (graph_get_u32(map + 4) != COMMIT_GRAPH_VERSION) {
+        commit_graph_close(graph);
+        return NULL;
+    }
+
+    size_t expected = GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)graph->num_commits * (GRAPH_HASH_LEN + GRAPH_ROW_SIZE + 4)
+        + (size_t)graph->num_edges * 4 + graph->bloom_size + GRAPH_HASH_LEN;
+    if (memcmp(map, COMMIT_GRAPH_SIG, 4) != 0 || expected != info.fi_size
+        || graph_get_u32(graph->fanout + 255 * 4) != graph->num_commits
+        || (graph->num_commits > 0 && graph_get_u32(graph->bloom_index + (size_t)(graph->num_commits - 1) * 4) != graph->bloom_size)) {
+        printf("ERROR: commit-graph is corrupted, ignoring it\n");
+        commit_graph_close(graph);
+        return NULL;
+    }
+
+    return graph;
+}
+
+void commit_graph_close(commit_graph *graph) {
+#ifndef _WIN32
+    munmap(graph->map, graph->map_size);
+#else
+    free(graph->map);
+#endif
+    free(graph);
+}
+
+int commit_graph_find(const commit_graph *graph, const obj_hash hash, uint32_t *pos) {
+    unsigned char raw[GRAPH_HASH_LEN];
+    hash_to_bytes(hash, raw);
+    return commit_graph_find_bytes(graph, raw, pos);
+}
+
+int commit_graph_find_bytes(const commit_graph *graph, const unsigned char *raw, uint32_t *pos) {
+    uint32_t lo = raw[0] == 0 ? 0 : graph_get_u32(graph->fanout + (raw[0] - 1) * 4);
+    uint32_t hi = graph_get_u32(graph->fanout + raw[0] * 4);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int res = memcmp(graph->hashes + (size_t)mid * GRAPH_HASH_LEN, raw, GRAPH_HASH_LEN);
+        if (res == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (res < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+const unsigned char *commit_graph_hash_bytes(const commit_graph *graph, uint32_t pos) {
+    return graph->hashes + (size_t)pos * GRAPH_HASH_LEN;
+}
+
+void commit_graph_hash(const commit_graph *graph, uint32_t pos, obj_hash *out) {
+    hash_from_bytes(graph->hashes + (size_t)pos * GRAPH_HASH_LEN, out);
+}
+
+void commit_graph_tree(const commit_graph *graph, uint32_t pos, obj_hash *out) {
+    hash_from_bytes(graph->data + (size_t)pos * GRAPH_ROW_SIZE, out);
+}
+
+uint32_t commit_graph_generation(const commit_graph *graph, uint32_t pos) {
+    return graph_get_u32(graph->data + (size_t)pos * GRAPH_ROW_SIZE + GRAPH_HASH_LEN + 8) >> 2;
+}
+
+time_t commit_graph_timestamp(const commit_graph *graph, uint32_t pos) {
+    const unsigned char *row = graph->data + (size_t)pos * GRAPH_ROW_SIZE + GRAPH_HASH_LEN;
+    uint64_t high = graph_get_u32(row + 8) & 0x3;
+    return (time_t)((high << 32) | graph_get_u32(row + 12));
+}
+
+int commit_graph_parents(const commit_graph *graph, uint32_t pos, uint32_t *out, int max) {
+    const unsigned char *row = graph->data + (size_t)pos * GRAPH_ROW_SIZE + GRAPH_HASH_LEN;
+    uint32_t first = graph_get_u32(row), second = graph_get_u32(row + 4);
+    if (first == GRAPH_PARENT_NONE) {
+        return 0;
+    }
+    if (max > 0) {
+        out[0] = first;
+    }
+    if (second == GRAPH_PARENT_NONE) {
+        return 1;
+    }
+    if (!(second & GRAPH_EXTRA_EDGES)) {
+        if (max > 1) {
+            out[1] = second;
+        }
+        return 2;
+    }
+
+    int count = 1;
+    for (uint32_t i = second & ~GRAPH_EXTRA_EDGES; i < graph->num_edges; i++) {
+        uint32_t edge = graph_get_u32(graph->edges + (size_t)i * 4);
+        if (count < max) {
+            out[count] = edge & ~GRAPH_LAST_EDGE;
+        }
+        count++;
+        if (edge & GRAPH_LAST_EDGE) {
+            break;
+        }
+    }
+    return count;
+}
+
+uint32_t murmur3_32(uint32_t seed, const unsigned char *data, size_t len) {
+    const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+    uint32_t hash = seed;
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t k = (uint32_t)data[i] | ((uint32_t)data[i + 1] << 8) | ((uint32_t)data[i + 2] << 16) | ((uint32_t)data[i + 3] << 24);
+        k *= c1;
+        k = (k << 15) | (k >> 17);
+        k *= c2;
+        hash ^= k;
+        hash = (hash << 13) | (hash >> 19);
+        hash = hash * 5 + 0xe6546b64;
+    }
+
+    uint32_t k = 0;
+    switch (len & 3) {
+        case 3: k ^= (uint32_t)data[i + 2] << 16; // fallthrough
+        case 2: k ^= (uint32_t)data[i + 1] << 8; // fallthrough
+        case 1:
+            k ^= data[i];
+            k *= c1;
+            k = (k << 15) | (k >> 17);
+            k *= c2;
+            hash ^= k;
+    }
+
+    hash ^= (uint32_t)len;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+void bloom_key_init(bloom_key *key, const char *path) {
+    size_t len = strlen(path);
+    uint32_t hash0 = murmur3_32(0x293ae76f, (const unsigned char *)path, len);
+    uint32_t hash1 = murmur3_32(0x7e646e2c, (const unsigned char *)path, len);
+    for (int i = 0; i < BLOOM_NUM_HASHES; i++) {
+        key->hashes[i] = hash0 + i * hash1;
+    }
+}
+
+void bloom_add(unsigned char *filter, size_t filter_len, const bloom_key *key) {
+    uint64_t bits = (uint64_t)filter_len * 8;
+    for (int i = 0; i < BLOOM_NUM_HASHES; i++) {
+        uint64_t bit = key->hashes[i] % bits;
+        filter[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+int commit_graph_bloom_maybe(const commit_graph *graph, uint32_t pos, const bloom_key *key) {
+    uint32_t start = pos == 0 ? 0 : graph_get_u32(graph->bloom_index + (size_t)(pos - 1) * 4);
+    uint32_t end = graph_get_u32(graph->bloom_index + (size_t)pos * 4);
+    if (end <= start) {
+        return 1;
+    }
+
+    const unsigned char *filter = graph->bloom_data + start;
+    uint64_t bits = (uint64_t)(end - start) * 8;
+    for (int i = 0; i < BLOOM_NUM_HASHES; i++) {
+        uint64_t bit = key->hashes[i] % bits;
+        if (!(filter[bit / 8] & (1 << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int load_commit_info(const git_repo *repo, const commit_graph *graph, const obj_hash hash, commit_info *out, uint32_t *generation) {
+    uint32_t pos;
+    if (graph == NULL || !commit_graph_find(graph, hash, &pos)) {
+        if (generation != NULL) {
+            *generation = GENERATION_INFINITY;
+        }
+        return read_commit_info(repo, hash, out);
+    }
+
+    commit_graph_tree(graph, pos, &out->tree);
+    out->timestamp = commit_graph_timestamp(graph, pos);
+    out->num_parents = commit_graph_parents(graph, pos, NULL, 0);
+    out->parents = NULL;
+    if (out->num_parents > 0) {
+        uint32_t *parents = malloc(out->num_parents * sizeof(uint32_t));
+        commit_graph_parents(graph, pos, parents, out->num_parents);
+        out->parents = malloc(out->num_parents * sizeof(obj_hash));
+        for (int i = 0; i < out->num_parents; i++) {
+            commit_graph_hash(graph, parents[i], &out->parents[i]);
+        }
+        free(parents);
+    }
+    if (generation != NULL) {
+        *generation = commit_graph_generation(graph, pos);
+    }
+    return 0;
+}
+
+// commit found while writing graph, parents are indexes into the same list
+typedef struct graph_commit {
+    unsigned char hash[GRAPH_HASH_LEN];
+    unsigned char tree[GRAPH_HASH_LEN];
+    time_t timestamp;
+    uint32_t parents_start; // into list of parent hashes, later of parent indexes
+    uint32_t num_parents;
+    uint32_t generation;
+    uint32_t pos; // position in graph file
+    unsigned char *filter; // changed-path bloom filter
+    uint32_t filter_len;
+} graph_commit;
+
+typedef struct graph_builder {
+    graph_commit *commits;
+    uint32_t num_commits;
+    uint32_t capacity;
+    unsigned char *parent_hashes; // GRAPH_HASH_LEN bytes per parent
+    uint32_t *parents;
+    uint32_t num_parents;
+    uint32_t parents_capacity;
+    uint32_t *table; // open addressing, commit index + 1, 0 if empty
+    uint32_t table_size;
+} graph_builder;
+
+uint32_t graph_slot(const graph_builder *builder, const unsigned char *hash) {
+    uint32_t slot = graph_get_u32(hash) & (builder->table_size - 1);
+    while (builder->table[slot] != 0 && memcmp(builder->commits[builder->table[slot] - 1].hash, hash, GRAPH_HASH_LEN) != 0) {
+        slot = (slot + 1) & (builder->table_size - 1);
+    }
+    return slot;
+}
+
+void graph_table_grow(graph_builder *builder) {
+    uint32_t *old = builder->table;
+    uint32_t old_size = builder->table_size;
+    builder->table_size = old_size ? old_size * 2 : 1024;
+    builder->table = calloc(builder->table_size, sizeof(uint32_t));
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (old[i] != 0) {
+            builder->table[graph_slot(builder, builder->commits[old[i] - 1].hash)] = old[i];
+        }
+    }
+    free(old);
+}
+
+// @return index of commit, or -1 if it is not in builder
+int64_t graph_lookup(const graph_builder *builder, const unsigned char *hash) {
+    uint32_t idx = builder->table[graph_slot(builder, hash)];
+    return idx == 0 ? -1 : (int64_t)idx - 1;
+}
+
+// adds commit, keeping hashes of its parents
+void graph_add_commit(graph_builder *builder, const unsigned char *hash, const commit_info *info) {
+    if ((builder->num_commits + 1) * 2 > builder->table_size) {
+        graph_table_grow(builder);
+    }
+    if (builder->num_commits == builder->capacity) {
+        builder->capacity = builder->capacity ? builder->capacity * 2 : 1024;
+        builder->commits = realloc(builder->commits, builder->capacity * sizeof(graph_commit));
+    }
+    if (builder->num_parents + info->num_parents > builder->parents_capacity) {
+        builder->parents_capacity = (builder->num_parents + info->num_parents) * 2 + 1024;
+        builder->parent_hashes = realloc(builder->parent_hashes, (size_t)builder->parents_capacity * GRAPH_HASH_LEN);
+    }
+
+    graph_commit *commit = &builder->commits[builder->num_commits];
+    memcpy(commit->hash, hash, GRAPH_HASH_LEN);
+    hash_to_bytes(info->tree, commit->tree);
+    commit->timestamp = info->timestamp;
+    commit->parents_start = builder->num_parents;
+    commit->num_parents = info->num_parents;
+    commit->generation = 0;
+    commit->filter = NULL;
+    commit->filter_len = 0;
+    for (int i = 0; i < info->num_parents; i++) {
+        hash_to_bytes(info->parents[i], builder->parent_hashes + (size_t)builder->num_parents++ * GRAPH_HASH_LEN);
+    }
+
+    builder->table[graph_slot(builder, hash)] = ++builder->num_commits;
+}
+
+// collects every commit reachable from commits on `stack`, which is freed
+int graph_collect(const git_repo *repo, const commit_graph *old, graph_builder *builder, unsigned char *stack, uint32_t num_stack) {
+    uint32_t stack_capacity = num_stack;
+    while (num_stack > 0) {
+        unsigned char hash[GRAPH_HASH_LEN];
+        memcpy(hash, stack + (size_t)--num_stack * GRAPH_HASH_LEN, GRAPH_HASH_LEN);
+        if (graph_lookup(builder, hash) != -1) {
+            continue;
+        }
+
+        obj_hash hex;
+        commit_info info;
+        hash_from_bytes(hash, &hex);
+        if (load_commit_info(repo, old, hex, &info, NULL) != 0) {
+            free(stack);
+            return -1;
+        }
+
+        if (num_stack + info.num_parents > stack_capacity) {
+            stack_capacity = (num_stack + info.num_parents) * 2;
+            stack = realloc(stack, (size_t)stack_capacity * GRAPH_HASH_LEN);
+        }
+        for (int i = 0; i < info.num_parents; i++) {
+            hash_to_bytes(info.parents[i], stack + (size_t)num_stack++ * GRAPH_HASH_LEN);
+        }
+        graph_add_commit(builder, hash, &info);
+        free_commit_info(&info);
+    }
+    free(stack);
+    return 0;
+}
+
+// sets generation of every commit, visiting parents before their children
+void graph_generations(graph_builder *builder) {
+    uint32_t n = builder->num_commits;
+    uint32_t *child_start = calloc(n + 1, sizeof(uint32_t));
+    uint32_t *children = malloc((builder->num_parents + 1) * sizeof(uint32_t));
+    uint32_t *waiting = malloc((n + 1) * sizeof(uint32_t)); // parents without a generation yet
+    uint32_t *queue = malloc((n + 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < builder->num_parents; i++) {
+        child_start[builder->parents[i] + 1]++;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        child_start[i + 1] += child_start[i];
+    }
+    uint32_t num_queue = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        graph_commit *commit = &builder->commits[i];
+        for (uint32_t p = 0; p < commit->num_parents; p++) {
+            children[child_start[builder->parents[commit->parents_start + p]]++] = i;
+        }
+        waiting[i] = commit->num_parents;
+        commit->generation = 1;
+        if (commit->num_parents == 0) {
+            queue[num_queue++] = i;
+        }
+    }
+    // filling moved each start to the next commit's start
+    for (uint32_t i = n; i > 0; i--) {
+        child_start[i] = child_start[i - 1];
+    }
+    child_start[0] = 0;
+
+    for (uint32_t q = 0; q < num_queue; q++) {
+        graph_commit *commit = &builder->commits[queue[q]];
+        for (uint32_t c = child_start[queue[q]]; c < child_start[queue[q] + 1]; c++) {
+            graph_commit *child = &builder->commits[children[c]];
+            if (commit->generation + 1 > child->generation) {
+                child->generation = commit->generation + 1;
+            }
+            if (--waiting[children[c]] == 0) {
+                queue[num_queue++] = children[c];
+            }
+        }
+    }
+
+    free(child_start);
+    free(children);
+    free(waiting);
+    free(queue);
+}
+
+int cmp_path_ptr(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// sets filter of commit from its changes against first parent, or copies it from `old`
+// @return 0 on success, -1 if a tree could not be read
+int graph_commit_filter(const git_repo *repo, const commit_graph *old, graph_builder *builder, uint32_t idx) {
+    graph_commit *commit = &builder->commits[idx];
+    obj_hash hash, tree, parent_tree;
+    uint32_t pos;
+    hash_from_bytes(commit->hash, &hash);
+    if (old != NULL && old->bloom_size > 0 && commit_graph_find(old, hash, &pos)) {
+        uint32_t start = pos == 0 ? 0 : graph_get_u32(old->bloom_index + (size_t)(pos - 1) * 4);
+        commit->filter_len = graph_get_u32(old->bloom_index + (size_t)pos * 4) - start;
+        commit->filter = malloc(commit->filter_len + 1);
+        memcpy(commit->filter, old->bloom_data + start, commit->filter_len);
+        return 0;
+    }
+
+    hash_from_bytes(commit->tree, &tree);
+    if (commit->num_parents > 0) {
+        hash_from_bytes(builder->commits[builder->parents[commit->parents_start]].tree, &parent_tree);
+    }
+    tree_change_list changes;
+    if (diff_trees(repo, commit->num_parents > 0 ? parent_tree : NULL, tree, NULL, &changes) != 0) {
+        free_tree_changes(&changes);
+        return -1;
+    }
+
+    // every changed path and the folders above it, each counted once
+    int num_paths = 0, capacity = changes.num_changes * 2 + 1;
+    char **paths = malloc(capacity * sizeof(char *));
+    for (int i = 0; i < changes.num_changes; i++) {
+        char *path = changes.changes[i].path;
+        for (char *slash = strchr(path, '/'); ; slash = strchr(slash + 1, '/')) {
+            if (num_paths == capacity) {
+                capacity *= 2;
+                paths = realloc(paths, capacity * sizeof(char *));
+            }
+            paths[num_paths++] = slash != NULL ? strndup(path, slash - path) : strdup(path);
+            if (slash == NULL) {
+                break;
+            }
+        }
+    }
+    qsort(paths, num_paths, sizeof(char *), cmp_path_ptr);
+    int num_unique = 0;
+    for (int i = 0; i < num_paths; i++) {
+        if (num_unique == 0 || strcmp(paths[num_unique - 1], paths[i]) != 0) {
+            paths[num_unique++] = paths[i];
+        } else {
+            free(paths[i]);
+        }
+    }
+
+    if (num_unique > BLOOM_MAX_PATHS) {
+        commit->filter_len = 1;
+        commit->filter = malloc(1);
+        commit->filter[0] = 0xff;
+    } else {
+        commit->filter_len = (num_unique * BLOOM_BITS_PER_ENTRY + 7) / 8;
+        commit->filter_len = commit->filter_len > 0 ? commit->filter_len : 1;
+        commit->filter = calloc(1, commit->filter_len);
+        for (int i = 0; i < num_unique; i++) {
+            bloom_key key;
+            bloom_key_init(&key, paths[i]);
+            bloom_add(commit->filter, commit->filter_len, &key);
+        }
+    }
+
+    for (int i = 0; i < num_unique; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free_tree_changes(&changes);
+    return 0;
+}
+
+#define BLOOM_JOB_SIZE 256
+
+typedef struct bloom_job {
+    const git_repo *repo;
+    const commit_graph *old;
+    graph_builder *builder;
+    uint32_t lo, hi;
+    int failed;
+} bloom_job;
+
+void bloom_job_run(void *arg) {
+    bloom_job *job = arg;
+    for (uint32_t i = job->lo; i < job->hi && !job->failed; i++) {
+        job->failed = graph_commit_filter(job->repo, job->old, job->builder, i) != 0;
+    }
+}
+
+// computes filters of all commits, diffing trees of new commits in parallel
+// @return 0 on success, -1 if a tree could not be read
+int graph_filters(const git_repo *repo, const commit_graph *old, graph_builder *builder) {
+    uint32_t num_jobs = (builder->num_commits + BLOOM_JOB_SIZE - 1) / BLOOM_JOB_SIZE;
+    bloom_job *jobs = calloc(num_jobs + 1, sizeof(bloom_job));
+    threadpool *pool = threadpool_create(0);
+
+    for (uint32_t j = 0; j < num_jobs; j++) {
+        jobs[j] = (bloom_job){ repo, old, builder, j * BLOOM_JOB_SIZE, (j + 1) * BLOOM_JOB_SIZE, 0 };
+        if (jobs[j].hi > builder->num_commits) {
+            jobs[j].hi = builder->num_commits;
+        }
+        if (pool != NULL) {
+            threadpool_submit(pool, bloom_job_run, &jobs[j]);
+        } else {
+            bloom_job_run(&jobs[j]);
+        }
+    }
+    if (pool != NULL) {
+        threadpool_destroy(pool);
+    }
+
+    int rc = 0;
+    for (uint32_t j = 0; j < num_jobs; j++) {
+        rc = jobs[j].failed ? -1 : rc;
+    }
+    free(jobs);
+    return rc;
+}
+
+int cmp_graph_commit(const void *a, const void *b) {
+    return memcmp(((const graph_commit *)a)->hash, ((const graph_commit *)b)->hash, GRAPH_HASH_LEN);
+}
+
+// @return malloc-ed graph file contents
+unsigned char *graph_serialize(graph_builder *builder, size_t *size) {
+    uint32_t n = builder->num_commits;
+    graph_commit **sorted = malloc((n + 1) * sizeof(graph_commit *));
+    for (uint32_t i = 0; i < n; i++) {
+        sorted[i] = &builder->commits[i];
+    }
+    // positions come from sorting a copy, so parent indexes stay valid
+    graph_commit *copy = malloc((n + 1) * sizeof(graph_commit));
+    memcpy(copy, builder->commits, n * sizeof(graph_commit));
+    for (uint32_t i = 0; i < n; i++) {
+        copy[i].pos = i;
+    }
+    qsort(copy, n, sizeof(graph_commit), cmp_graph_commit);
+    for (uint32_t i = 0; i < n; i++) {
+        builder->commits[copy[i].pos].pos = i;
+        sorted[i] = &builder->commits[copy[i].pos];
+    }
+    free(copy);
+
+    uint32_t num_edges = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (builder->commits[i].num_parents > 2) {
+            num_edges += builder->commits[i].num_parents - 1;
+        }
+    }
+
+    uint32_t bloom_size = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        bloom_size += builder->commits[i].filter_len;
+    }
+
+    *size = GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)n * (GRAPH_HASH_LEN + GRAPH_ROW_SIZE + 4)
+        + (size_t)num_edges * 4 + bloom_size + GRAPH_HASH_LEN;
+    unsigned char *buf = calloc(1, *size);
+    memcpy(buf, COMMIT_GRAPH_SIG, 4);
+    graph_put_u32(buf + 4, COMMIT_GRAPH_VERSION);
+    graph_put_u32(buf + 8, n);
+    graph_put_u32(buf + 12, num_edges);
+    graph_put_u32(buf + 16, bloom_size);
+
+    unsigned char *fanout = buf + GRAPH_HEADER_SIZE;
+    unsigned char *hashes = fanout + GRAPH_FANOUT_SIZE;
+    unsigned char *data = hashes + (size_t)n * GRAPH_HASH_LEN;
+    unsigned char *edges = data + (size_t)n * GRAPH_ROW_SIZE;
+    unsigned char *bloom_index = edges + (size_t)num_edges * 4;
+    unsigned char *bloom_data = bloom_index + (size_t)n * 4;
+
+    uint32_t counts[256] = { 0 };
+    uint32_t edge = 0, bloom_end = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        graph_commit *commit = sorted[i];
+        memcpy(bloom_data + bloom_end, commit->filter, commit->filter_len);
+        bloom_end += commit->filter_len;
+        graph_put_u32(bloom_index + (size_t)i * 4, bloom_end);
+
+        counts[commit->hash[0]]++;
+        memcpy(hashes + (size_t)i * GRAPH_HASH_LEN, commit->hash, GRAPH_HASH_LEN);
+
+        unsigned char *row = data + (size_t)i * GRAPH_ROW_SIZE;
+        const uint32_t *parents = builder->parents + commit->parents_start;
+        memcpy(row, commit->tree, GRAPH_HASH_LEN);
+        graph_put_u32(row + GRAPH_HASH_LEN, commit->num_parents > 0 ? builder->commits[parents[0]].pos : GRAPH_PARENT_NONE);
+        if (commit->num_parents <= 1) {
+            graph_put_u32(row + GRAPH_HASH_LEN + 4, GRAPH_PARENT_NONE);
+        } else if (commit->num_parents == 2) {
+            graph_put_u32(row + GRAPH_HASH_LEN + 4, builder->commits[parents[1]].pos);
+        } else {
+            graph_put_u32(row + GRAPH_HASH_LEN + 4, GRAPH_EXTRA_EDGES | edge);
+            for (uint32_t p = 1; p < commit->num_parents; p++) {
+                uint32_t value = builder->commits[parents[p]].pos;
+                graph_put_u32(edges + (size_t)edge++ * 4, p == commit->num_parents - 1 ? value | GRAPH_LAST_EDGE : value);
+            }
+        }
+
+        uint64_t timestamp = commit->timestamp < 0 ? 0 : (uint64_t)commit->timestamp;
+        graph_put_u32(row + GRAPH_HASH_LEN + 8, (commit->generation << 2) | (uint32_t)((timestamp >> 32) & 0x3));
+        graph_put_u32(row + GRAPH_HASH_LEN + 12, (uint32_t)timestamp);
+    }
+
+    uint32_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += counts[i];
+        graph_put_u32(fanout + i * 4, total);
+    }
+
+    SHA1(buf, *size - GRAPH_HASH_LEN, buf + *size - GRAPH_HASH_LEN);
+    free(sorted);
+    return buf;
+}
+
+// writes to a temporary file first so readers never map a partial graph
+int graph_write_file(const git_repo *repo, const unsigned char *buf, size_t size) {
+    char info_path[PATH_MAX], path[PATH_MAX], tmp_path[PATH_MAX + 16];
+    fs_path_join(repo->objects_path, COMMIT_GRAPH_FILE, path);
+    fs_path_dirname(path, info_path);
+    if (fs_mkdir(info_path, 0755) == -1) {
+        return -1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmpXXXXXX", path);
+
+    int fd;
+    if ((fd = mkstemp(tmp_path)) == -1) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t res = write(fd, buf + written, size - written);
+        if (res <= 0) {
+            break;
+        }
+        written += res;
+    }
+    if (close(fd) != 0 || written != size || fs_rename(tmp_path, path) != 0) {
+        fs_remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int write_commit_graph(const git_repo *repo) {
+    ref_list refs;
+    if (list_refs(repo, &refs) != 0) {
+        return -1;
+    }
+
+    obj_hash head;
+    uint32_t num_stack = 0;
+    unsigned char *stack = malloc((size_t)(refs.num_refs + 1) * GRAPH_HASH_LEN);
+    if (resolve_head(repo, &head, NULL) == 0) {
+        hash_to_bytes(head, stack + (size_t)num_stack++ * GRAPH_HASH_LEN);
+    }
+    // annotated tags are taken at the commit they peel to, tips that are not commits are left out
+    for (int i = 0; i < refs.num_refs; i++) {
+        obj_hash tip;
+        int res = peel_ref_to_commit(repo, &refs.refs[i], &tip);
+        if (res == -1) {
+            printf("ERROR: could not read %s\n", refs.refs[i].name);
+            free_ref_list(&refs);
+            free(stack);
+            return -1;
+        }
+        if (res == 0) {
+            hash_to_bytes(tip, stack + (size_t)num_stack++ * GRAPH_HASH_LEN);
+        }
+    }
+    free_ref_list(&refs);
+
+    graph_builder builder = { 0 };
+    graph_table_grow(&builder);
+    commit_graph *old = commit_graph_open(repo);
+    int rc = graph_collect(repo, old, &builder, stack, num_stack);
+
+    if (rc == 0) {
+        // parent hashes are all collected commits now, swap them for indexes
+        builder.parents = malloc((builder.num_parents + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < builder.num_parents; i++) {
+            builder.parents[i] = (uint32_t)graph_lookup(&builder, builder.parent_hashes + (size_t)i * GRAPH_HASH_LEN);
+        }
+        graph_generations(&builder);
+        if ((rc = graph_filters(repo, old, &builder)) != 0) {
+            printf("ERROR: could not diff trees for commit-graph\n");
+        }
+    }
+    if (old != NULL) {
+        commit_graph_close(old);
+    }
+
+    if (rc == 0) {
+        size_t size;
+        unsigned char *buf = graph_serialize(&builder, &size);
+        if ((rc = graph_write_file(repo, buf, size)) != 0) {
+            printf("ERROR: could not write commit-graph\n");
+        }
+        free(buf);
+    }
+
+    for (uint32_t i = 0; i < builder.num_commits; i++) {
+        free(builder.commits[i].filter);
+    }
+    free(builder.commits);
+    free(builder.parent_hashes);
+    free(builder.parents);
+    free(builder.table);
+    return rc;
+}
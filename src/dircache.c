@@ -10,10 +10,18 @@
 
 #include "filesystem.h"
 #include "dircache.h"
+#include "bulkio.h"
 
 #define INDEX_HEADER_SIG "DIRC"
 #define INDEX_HEADER_SIZE 12
 
+// fsmonitor extension: <token>\0 followed by a bitmap of entries with `fsm_valid` set
+#define INDEX_EXT_FSMONITOR "FSMN"
+#define INDEX_EXT_HEADER_SIZE 8
+// tree cache extension: <folder path>\0<number of entries><tree hash> for every valid cached tree
+#define INDEX_EXT_TREE "TREE"
+#define INDEX_EXT_TREE_FIXED 25
+
 unsigned int read_u32_big_endian(unsigned char **buf_ptr) {
     unsigned int ret = 0;
     memcpy(&ret, *buf_ptr, 4);
@@ -27,14 +35,83 @@ void write_u32_big_endian(unsigned char **buf_ptr, unsigned int in) {
     *buf_ptr += 4;
 }
 
-void free_dircache(git_dircache *dircache) {
+void clear_tree_cache(tree_cache *cache) {
+    for (int i = 0; i < cache->num_trees; i++) {
+        free(cache->trees[i].path);
+    }
+    free(cache->trees);
+    cache->trees = NULL;
+    cache->num_trees = 0;
+}
+
+void clear_dircache(git_dircache *dircache) {
     for (int i = 0; i < dircache->num_entries; i++) {
         free(dircache->entries[i]);
     }
     free(dircache->entries);
+    dircache->entries = NULL;
+    dircache->num_entries = 0;
+    dircache->capacity = 0;
+    if (dircache->trees != NULL) {
+        clear_tree_cache(dircache->trees);
+    }
+}
+
+void free_dircache(git_dircache *dircache) {
+    clear_dircache(dircache);
+    free(dircache->trees);
     free(dircache);
 }
 
+void replace_dircache_entries(git_dircache *dircache, git_dircache *from) {
+    clear_dircache(dircache);
+    dircache->entries = from->entries;
+    dircache->num_entries = from->num_entries;
+    dircache->capacity = from->capacity;
+    from->entries = NULL;
+    from->num_entries = 0;
+    from->capacity = 0;
+}
+
+// @return position of cached tree of folder `path` of length `len`, or -1 if not cached
+int find_cached_tree(const tree_cache *cache, const char *path, size_t len) {
+    int lo = 0, hi = cache->num_trees;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const char *mid_path = cache->trees[mid].path;
+        int cmp = strncmp(mid_path, path, len);
+        if (cmp == 0) {
+            cmp = mid_path[len] != '\0';
+        }
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+void invalidate_cached_trees(git_dircache *dircache, const char *name) {
+    if (dircache->trees == NULL || dircache->trees->num_trees == 0) {
+        return;
+    }
+
+    size_t len = 0;
+    const char *slash = name;
+    do {
+        int pos = find_cached_tree(dircache->trees, name, len);
+        if (pos >= 0) {
+            dircache->trees->trees[pos].num_entries = -1;
+        }
+        if ((slash = strchr(slash, '/')) != NULL) {
+            len = ++slash - name;
+        }
+    } while (slash != NULL);
+}
+
 void print_dircache(git_dircache *dircache) {
     printf("num of entries: %d\n", dircache->num_entries);
     for (int i = 0; i < dircache->num_entries; i++) {
@@ -46,7 +123,8 @@ void print_dircache(git_dircache *dircache) {
 
 git_index_entry *parse_index_entry(unsigned char **buf_entry_start) {
     unsigned char *buf_ptr = *buf_entry_start;
-    git_index_entry *entry = malloc(sizeof(*entry));
+    size_t namelen = strnlen((char *)buf_ptr + 62, PATH_MAX - 1);
+    git_index_entry *entry = malloc(sizeof(*entry) + namelen + 1);
     
     entry->info.fi_ctime = read_u32_big_endian(&buf_ptr);
     read_u32_big_endian(&buf_ptr); // ctime ns
@@ -63,23 +141,62 @@ git_index_entry *parse_index_entry(unsigned char **buf_entry_start) {
     buf_ptr += 20;
 
     short flags = ((*buf_ptr) << 8) | (*(buf_ptr + 1));
-    entry->stage_num = flags & 0x3000;
-    entry->namelen = flags & 0x0FFF;
+    entry->stage_num = (flags >> 12) & 0x3;
+    entry->namelen = namelen;
     buf_ptr += 2;
 
-    snprintf(entry->name, entry->namelen + 1, "%s", buf_ptr);
-    buf_ptr += entry->namelen + 1;
+    memcpy(entry->name, buf_ptr, namelen);
+    entry->name[namelen] = '\0';
+    buf_ptr += namelen + 1;
+    entry->fsm_valid = 0;
 
     *buf_entry_start = buf_ptr;
     return entry;
 }
 
+int remove_files_from_dc(git_dircache *dircache, char **names, int num_names) {
+    int n = 0, next = 0, removed = 0;
+    for (int i = 0; i < dircache->num_entries; i++) {
+        git_index_entry *entry = dircache->entries[i];
+        while (next < num_names && index_sort_cmp(names[next], entry->name) < 0) {
+            next++;
+        }
+
+        if (next < num_names && index_sort_cmp(names[next], entry->name) == 0) {
+            invalidate_cached_trees(dircache, entry->name);
+            free(entry);
+            removed++;
+            continue;
+        }
+        dircache->entries[n++] = entry;
+    }
+    dircache->num_entries = n;
+
+    return removed;
+}
+
 int write_index(const git_repo *repo, git_dircache *dircache) {
     size_t buf_size = INDEX_HEADER_SIZE;
     for (int i = 0; i < dircache->num_entries; i++) {
         buf_size += 62 + dircache->entries[i]->namelen + 9;
     }
 
+    size_t token_len = strlen(dircache->fsmonitor_token);
+    if (token_len > 0) {
+        buf_size += INDEX_EXT_HEADER_SIZE + token_len + 1 + (dircache->num_entries + 7) / 8;
+    }
+
+    size_t trees_size = 0;
+    for (int i = 0; dircache->trees != NULL && i < dircache->trees->num_trees; i++) {
+        const cached_tree *tree = &dircache->trees->trees[i];
+        if (tree->num_entries >= 0) {
+            trees_size += strlen(tree->path) + INDEX_EXT_TREE_FIXED;
+        }
+    }
+    if (trees_size > 0) {
+        buf_size += INDEX_EXT_HEADER_SIZE + trees_size;
+    }
+
     unsigned char *buf = malloc(buf_size);
 
     snprintf((char *)buf, INDEX_HEADER_SIZE, "%s", INDEX_HEADER_SIG);
@@ -116,6 +233,41 @@ int write_index(const git_repo *repo, git_dircache *dircache) {
         buf_ptr += padding;
     }
 
+    if (token_len > 0) {
+        size_t bitmap_size = (dircache->num_entries + 7) / 8;
+        memcpy(buf_ptr, INDEX_EXT_FSMONITOR, 4);
+        buf_ptr += 4;
+        write_u32_big_endian(&buf_ptr, token_len + 1 + bitmap_size);
+        memcpy(buf_ptr, dircache->fsmonitor_token, token_len + 1);
+        buf_ptr += token_len + 1;
+
+        memset(buf_ptr, 0, bitmap_size);
+        for (int i = 0; i < dircache->num_entries; i++) {
+            if (dircache->entries[i]->fsm_valid) {
+                buf_ptr[i >> 3] |= 1 << (i & 0b111);
+            }
+        }
+        buf_ptr += bitmap_size;
+    }
+
+    if (trees_size > 0) {
+        memcpy(buf_ptr, INDEX_EXT_TREE, 4);
+        buf_ptr += 4;
+        write_u32_big_endian(&buf_ptr, trees_size);
+        for (int i = 0; i < dircache->trees->num_trees; i++) {
+            const cached_tree *tree = &dircache->trees->trees[i];
+            if (tree->num_entries < 0) {
+                continue;
+            }
+            size_t path_len = strlen(tree->path);
+            memcpy(buf_ptr, tree->path, path_len + 1);
+            buf_ptr += path_len + 1;
+            write_u32_big_endian(&buf_ptr, tree->num_entries);
+            hash_to_bytes(tree->hash, buf_ptr);
+            buf_ptr += 20;
+        }
+    }
+
     size_t actual_size = buf_ptr - buf;
     assert(actual_size <= buf_size);
 
@@ -135,12 +287,66 @@ int write_index(const git_repo *repo, git_dircache *dircache) {
 
 
 
+// reads tree cache extension, dropping it whole if it is malformed
+void parse_tree_cache(tree_cache *cache, unsigned char *buf_ptr, const unsigned char *buf_end) {
+    int capacity = 0;
+    while (buf_ptr < buf_end) {
+        size_t path_len = strnlen((char *)buf_ptr, buf_end - buf_ptr);
+        if ((size_t)(buf_end - buf_ptr) < path_len + INDEX_EXT_TREE_FIXED) {
+            clear_tree_cache(cache);
+            return;
+        }
+
+        if (cache->num_trees == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            cache->trees = realloc(cache->trees, capacity * sizeof(cached_tree));
+        }
+        cached_tree *tree = &cache->trees[cache->num_trees++];
+        tree->path = strndup((char *)buf_ptr, path_len);
+        buf_ptr += path_len + 1;
+        tree->num_entries = read_u32_big_endian(&buf_ptr);
+        hash_from_bytes(buf_ptr, &tree->hash);
+        buf_ptr += 20;
+    }
+}
+
+// reads optional extensions following the index entries. unknown extensions are skipped.
+void parse_index_extensions(git_dircache *dircache, unsigned char *buf_ptr, const unsigned char *buf_end) {
+    while (buf_end - buf_ptr >= INDEX_EXT_HEADER_SIZE) {
+        unsigned char *sig = buf_ptr;
+        buf_ptr += 4;
+        size_t ext_size = read_u32_big_endian(&buf_ptr);
+        if ((size_t)(buf_end - buf_ptr) < ext_size) {
+            return;
+        }
+
+        if (memcmp(sig, INDEX_EXT_FSMONITOR, 4) == 0) {
+            size_t token_len = strnlen((char *)buf_ptr, ext_size);
+            size_t bitmap_size = (dircache->num_entries + 7) / 8;
+            if (token_len < FSMONITOR_TOKEN_SIZE && ext_size == token_len + 1 + bitmap_size) {
+                memcpy(dircache->fsmonitor_token, buf_ptr, token_len + 1);
+                const unsigned char *bitmap = buf_ptr + token_len + 1;
+                for (int i = 0; i < dircache->num_entries; i++) {
+                    dircache->entries[i]->fsm_valid = (bitmap[i >> 3] >> (i & 0b111)) & 1;
+                }
+            }
+        } else if (memcmp(sig, INDEX_EXT_TREE, 4) == 0) {
+            parse_tree_cache(dircache->trees, buf_ptr, buf_ptr + ext_size);
+        }
+
+        buf_ptr += ext_size;
+    }
+}
+
 git_dircache *create_dircache(const git_repo * repo) {
     if (!fs_file_exists(repo->index_path)) {
         git_dircache *dircache = malloc(sizeof(*dircache));
         dircache->num_entries = 0;
         dircache->capacity = 1;
         dircache->entries = calloc(1, sizeof(git_index_entry *));
+        dircache->fsmonitor_token[0] = '\0';
+        dircache->index_mtime = 0;
+        dircache->trees = calloc(1, sizeof(tree_cache));
         return dircache;
     }
 
@@ -173,8 +379,13 @@ git_dircache *create_dircache(const git_repo * repo) {
     
     git_dircache *dircache = malloc(sizeof(*dircache));
     dircache->num_entries = read_u32_big_endian(&buf_ptr);
+    dircache->fsmonitor_token[0] = '\0';
+    dircache->index_mtime = info.fi_mtime;
+    dircache->trees = calloc(1, sizeof(tree_cache));
     if (info.fi_size <= INDEX_HEADER_SIZE || dircache->num_entries == 0) {
-        dircache->entries = NULL;
+        dircache->num_entries = 0;
+        dircache->capacity = 1;
+        dircache->entries = calloc(1, sizeof(git_index_entry *));
         fs_fclose(fptr);
         return dircache;
     }
@@ -188,6 +399,7 @@ git_dircache *create_dircache(const git_repo * repo) {
         fs_fclose(fptr);
         free(buf);
         free(dircache->entries);
+        free(dircache->trees);
         free(dircache);
         return NULL;
     }
@@ -203,11 +415,15 @@ git_dircache *create_dircache(const git_repo * repo) {
 
         if (entry_start > buf + buf_size) {
             fs_fclose(fptr);
+            free(buf);
+            dircache->num_entries = i;
             free_dircache(dircache);
             return NULL;
         }
     }
 
+    parse_index_extensions(dircache, entry_start, buf + buf_size);
+
     fs_fclose(fptr);
     free(buf);
     return dircache;
@@ -227,14 +443,31 @@ int index_sort_cmp(const char *name1, const char *name2) {
     return res == 0 ? (int)(size1 - size2) : res;
 }
 
-int add_index_entry(git_dircache *dircache, git_index_entry *entry) {
-    // TODO: if entry->name is currently in merge conflict, replace its 3 entries with this one
-    int first_not_smaller = 0;
-    while (first_not_smaller < dircache->num_entries
-        && index_sort_cmp(dircache->entries[first_not_smaller]->name, entry->name) < 0 ) {
+int index_lower_bound(const git_dircache *dircache, const char *name) {
+    int lo = 0, hi = dircache->num_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (index_sort_cmp(dircache->entries[mid]->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
 
-        first_not_smaller++;
+git_index_entry *find_index_entry(const git_dircache *dircache, const char *name) {
+    int pos = index_lower_bound(dircache, name);
+    if (pos < dircache->num_entries && index_sort_cmp(dircache->entries[pos]->name, name) == 0) {
+        return dircache->entries[pos];
     }
+    return NULL;
+}
+
+int add_index_entry(git_dircache *dircache, git_index_entry *entry) {
+    // TODO: if entry->name is currently in merge conflict, replace its 3 entries with this one
+    int first_not_smaller = index_lower_bound(dircache, entry->name);
+    invalidate_cached_trees(dircache, entry->name);
 
     int num_same = 0;
     while (first_not_smaller + num_same < dircache->num_entries 
@@ -277,43 +510,97 @@ int add_index_entry(git_dircache *dircache, git_index_entry *entry) {
     return 0;
 }
 
-int add_file_to_dc(git_dircache *dircache, const fileinfo *finfo) {
-    git_index_entry *entry = malloc(sizeof(*entry));
-    entry->info = finfo->stat;
+int is_stat_unchanged(const git_index_entry *entry, const fs_statinfo *stat) {
+    return entry->info.fi_size == stat->fi_size
+        && entry->info.fi_mtime == stat->fi_mtime
+        && entry->info.fi_ctime == stat->fi_ctime;
+}
+
+int is_entry_clean(const git_dircache *dircache, const git_index_entry *entry, const fs_statinfo *stat) {
+    return is_stat_unchanged(entry, stat) && entry->info.fi_mtime < dircache->index_mtime;
+}
+
+int add_blob_entry(git_dircache *dircache, const char *name, const fs_statinfo *stat, const obj_hash hash) {
+    size_t namelen = strlen(name);
+    git_index_entry *entry = malloc(sizeof(*entry) + namelen + 1);
+    entry->info = *stat;
     entry->stage_num = 0;
-    entry->git_mode = stat_mode_to_git(finfo->stat.fi_mode);
-    snprintf(entry->name, PATH_MAX, "%s", finfo->name);
-    entry->namelen = strlen(entry->name);
-
-    git_index_entry **found_entry = (git_index_entry **)bsearch(&entry, 
-        dircache->entries, dircache->num_entries, 
-        sizeof(git_index_entry *), cmp_index_entry);
-
-    if (found_entry != NULL) {
-        int same = 1;
-        same &= (*found_entry)->info.fi_size == finfo->stat.fi_size;
-        same &= (*found_entry)->info.fi_mtime == finfo->stat.fi_mtime;
-        same &= (*found_entry)->info.fi_ctime == finfo->stat.fi_ctime;
-        if (same) {
-            return 0;
+    entry->git_mode = stat_mode_to_git(stat->fi_mode);
+    memcpy(entry->name, name, namelen + 1);
+    entry->namelen = namelen;
+    entry->fsm_valid = 0;
+    snprintf(entry->hash, OBJ_HASH_SIZE, "%s", hash);
+
+    if (add_index_entry(dircache, entry) != 0) {
+        free(entry);
+        return -1;
+    }
+
+    return 0;
+}
+
+int add_file_to_dc(git_dircache *dircache, const fileinfo *finfo) {
+    git_index_entry *found_entry = find_index_entry(dircache, finfo->name);
+    if (found_entry != NULL && is_entry_clean(dircache, found_entry, &finfo->stat)) {
+        return 0;
+    }
+
+    // large files are only hashed, straight from a mapping
+    if (finfo->stat.fi_size >= BLOB_MMAP_THRESHOLD) {
+        obj_hash hash;
+        if (hash_blob_from_fd(NULL, fileno(finfo->fptr), finfo->stat.fi_size, &hash) != 0) {
+            return -1;
         }
+        return add_blob_entry(dircache, finfo->name, &finfo->stat, hash);
     }
 
     git_obj_blob *blob = create_blob_from_file(finfo);
     if (blob == NULL) {
-        free(entry);
         return -1;
     }
 
-    snprintf(entry->hash, OBJ_HASH_SIZE, "%s", blob->obj.hash);
+    int rc = add_blob_entry(dircache, finfo->name, &finfo->stat, blob->obj.hash);
     free_blob(blob);
 
-    if (add_index_entry(dircache, entry) != 0) {
-        free(entry);
-        return -1;
+    return rc;
+}
+
+int add_files_to_dc(const git_repo *repo, git_dircache *dircache, char **names, int num_names) {
+    bulk_file *files = calloc(num_names, sizeof(bulk_file));
+    for (int i = 0; i < num_names; i++) {
+        files[i].name = names[i];
     }
 
-    return 0;
+    int failed = 0;
+    bulk_stat_files(repo, files, num_names);
+
+    // only files whose stat info differs from their entry are read, in one batch
+    int num_changed = 0;
+    for (int i = 0; i < num_names; i++) {
+        // only files and folders are stored, so a symlink is not hashed as the file it points to
+        if (files[i].status != 0 || !S_ISREG(files[i].stat.fi_mode)) {
+            printf("ERROR: could not add file: %s\n", files[i].name);
+            failed++;
+            continue;
+        }
+
+        git_index_entry *entry = find_index_entry(dircache, files[i].name);
+        if (entry == NULL || !is_entry_clean(dircache, entry, &files[i].stat)) {
+            files[num_changed++] = files[i];
+        }
+    }
+
+    bulk_hash_files(repo, files, num_changed, 1);
+
+    for (int i = 0; i < num_changed; i++) {
+        if (files[i].status != 0 || add_blob_entry(dircache, files[i].name, &files[i].stat, files[i].hash) != 0) {
+            printf("ERROR: could not add file: %s\n", files[i].name);
+            failed++;
+        }
+    }
+
+    free(files);
+    return failed;
 }
 
 int remove_file_from_dc(git_dircache *dircache, const fileinfo *finfo) {
@@ -333,6 +620,7 @@ int remove_file_from_dc(git_dircache *dircache, const fileinfo *finfo) {
     }
 
     if (found >= 0) {
+        invalidate_cached_trees(dircache, finfo->name);
         memmove(dircache->entries + found, 
             dircache->entries + found + count_match, 
             sizeof(git_index_entry *) * (dircache->num_entries - found - count_match));
@@ -345,8 +633,23 @@ int remove_file_from_dc(git_dircache *dircache, const fileinfo *finfo) {
 
 int add_tree_entry_to_dc(const git_repo *repo, git_dircache *dircache, git_tree_entry *tree_entry) {
     (void)repo;
-    (void)dircache;
-    (void)tree_entry;
+    if (tree_entry->type != BLOB_OBJ) {
+        return -1;
+    }
+
+    // no stat info, so the file is hashed the next time it is compared
+    size_t namelen = strlen(tree_entry->name);
+    git_index_entry *entry = calloc(1, sizeof(git_index_entry) + namelen + 1);
+    memcpy(entry->name, tree_entry->name, namelen + 1);
+    entry->namelen = namelen;
+    entry->git_mode = tree_entry->git_mode;
+    entry->unix_perm = tree_entry->git_mode & 0777;
+    memcpy(entry->hash, tree_entry->u.blob->obj.hash, sizeof(obj_hash));
+
+    if (add_index_entry(dircache, entry) != 0) {
+        free(entry);
+        return -1;
+    }
     return 0;
 }
 
@@ -366,12 +669,12 @@ git_obj_tree *build_tree_from_index(git_dircache *dircache) {
         while (part != NULL) {
             int is_new_tree = 1;
 
-            for (int j = 0; j < parent_tree->size; j++) {
-                git_tree_entry *t_entry = parent_tree->entries[j];        
+            // entries under a folder are contiguous in index order, so its tree can only be the last one added
+            if (parent_tree->size > 0) {
+                git_tree_entry *t_entry = parent_tree->entries[parent_tree->size - 1];
                 if (t_entry->type == TREE_OBJ && strcmp(part, t_entry->name) == 0) {
                     parent_tree = t_entry->u.tree;
                     is_new_tree = 0;
-                    break;
                 }
             }
 
@@ -418,4 +721,123 @@ git_obj_tree *build_tree_from_index(git_dircache *dircache) {
     hash_tree_full(tree); 
         
     return tree;
-}
\ No newline at end of file
+}
+
+// @return index of node pushed for folder holding entries [lo, hi)
+int build_index_tree_nodes(const git_dircache *dircache, index_tree *itree, int lo, int hi, int prefix_len) {
+    if (itree->num_nodes == itree->capacity) {
+        itree->capacity = itree->capacity ? itree->capacity * 2 : 64;
+        itree->nodes = realloc(itree->nodes, itree->capacity * sizeof(index_tree_node));
+    }
+    int k = itree->num_nodes++;
+    itree->nodes[k].lo = lo;
+    itree->nodes[k].hi = hi;
+    itree->nodes[k].prefix_len = prefix_len;
+
+    int i = lo;
+    while (i < hi) {
+        const char *name = dircache->entries[i]->name + prefix_len;
+        const char *slash = strchr(name, '/');
+        if (slash == NULL) {
+            i++;
+            continue;
+        }
+
+        // entries under a folder are contiguous in index order
+        int dir_len = slash - name + 1;
+        int j = i + 1;
+        while (j < hi && strncmp(dircache->entries[j]->name + prefix_len, name, dir_len) == 0) {
+            j++;
+        }
+        build_index_tree_nodes(dircache, itree, i, j, prefix_len + dir_len);
+        i = j;
+    }
+    itree->nodes[k].end = itree->num_nodes;
+
+    const char *prefix = prefix_len > 0 ? dircache->entries[lo]->name : "";
+    int cached = dircache->trees != NULL ? find_cached_tree(dircache->trees, prefix, prefix_len) : -1;
+    if (cached >= 0 && dircache->trees->trees[cached].num_entries == hi - lo) {
+        memcpy(itree->nodes[k].hash, dircache->trees->trees[cached].hash, sizeof(obj_hash));
+        return k;
+    }
+
+    size_t size;
+    unsigned char *content = index_tree_content(dircache, itree, k, &size);
+    git_obj obj;
+    create_git_obj(content, size, O_TYPE_TREE, &obj);
+    snprintf(itree->nodes[k].hash, OBJ_HASH_SIZE, "%s", obj.hash);
+    free(obj.data);
+    free(content);
+    itree->num_hashed++;
+
+    return k;
+}
+
+int hash_index_trees(const git_dircache *dircache, index_tree *out) {
+    out->nodes = NULL;
+    out->num_nodes = 0;
+    out->capacity = 0;
+    out->num_hashed = 0;
+    build_index_tree_nodes(dircache, out, 0, dircache->num_entries, 0);
+
+    // nodes are in pre-order, which sorts folders by path, so they replace the cache as they are
+    if (dircache->trees != NULL && out->num_hashed > 0) {
+        tree_cache *cache = dircache->trees;
+        clear_tree_cache(cache);
+        cache->trees = malloc(out->num_nodes * sizeof(cached_tree));
+        cache->num_trees = out->num_nodes;
+        for (int k = 0; k < out->num_nodes; k++) {
+            const index_tree_node *node = &out->nodes[k];
+            cache->trees[k].path = node->prefix_len > 0 ? strndup(dircache->entries[node->lo]->name, node->prefix_len) : strdup("");
+            cache->trees[k].num_entries = node->hi - node->lo;
+            memcpy(cache->trees[k].hash, node->hash, sizeof(obj_hash));
+        }
+    }
+    return 0;
+}
+
+unsigned char *index_tree_content(const git_dircache *dircache, const index_tree *itree, int k, size_t *size) {
+    const index_tree_node *node = &itree->nodes[k];
+    size_t capacity = 256, used = 0;
+    unsigned char *buf = malloc(capacity);
+
+    int i = node->lo, child = k + 1;
+    while (i < node->hi) {
+        const git_index_entry *entry = dircache->entries[i];
+        const char *name = entry->name + node->prefix_len;
+        const char *slash = strchr(name, '/');
+        if (slash == NULL && entry->stage_num != 0) {
+            i++;
+            continue;
+        }
+
+        size_t name_len = slash != NULL ? (size_t)(slash - name) : strlen(name);
+        size_t line_max = TREE_ENTRY_LINE_FIXED + name_len + 1;
+        if (used + line_max > capacity) {
+            capacity = (used + line_max) * 2;
+            buf = realloc(buf, capacity);
+        }
+
+        if (slash != NULL) {
+            const index_tree_node *sub = &itree->nodes[child];
+            used += snprintf((char *)buf + used, capacity - used, "%06o %s %s %.*s\n",
+                GIT_MODE_DIR, O_TYPE_TREE, sub->hash, (int)name_len, name);
+            i = sub->hi;
+            child = sub->end;
+        } else {
+            used += snprintf((char *)buf + used, capacity - used, "%06o %s %s %s\n",
+                entry->git_mode, O_TYPE_BLOB, entry->hash, name);
+            i++;
+        }
+    }
+
+    *size = used;
+    return buf;
+}
+
+void free_index_tree(index_tree *itree) {
+    free(itree->nodes);
+    itree->nodes = NULL;
+    itree->num_nodes = 0;
+    itree->capacity = 0;
+}
@@ -0,0 +1,74 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "ewah.h"
+
+void ewah_put_u64(unsigned char *buf, uint64_t in) {
+    for (int i = 7; i >= 0; i--) {
+        buf[i] = (unsigned char)in;
+        in >>= 8;
+    }
+}
+
+uint64_t ewah_get_u64(const unsigned char *buf) {
+    uint64_t out = 0;
+    for (int i = 0; i < 8; i++) {
+        out = (out << 8) | buf[i];
+    }
+    return out;
+}
+
+size_t ewah_encode(const uint64_t *bits, size_t num_words, unsigned char **out) {
+    // a marker per clean stretch, so never more words than the bitset plus one
+    *out = malloc((num_words + 1) * 8);
+    size_t size = 0, i = 0;
+    while (i < num_words) {
+        uint64_t clean_bit = bits[i] == ~(uint64_t)0;
+        uint64_t clean_word = clean_bit ? ~(uint64_t)0 : 0;
+        uint64_t num_clean = 0, num_literals = 0;
+        while (i < num_words && bits[i] == clean_word && num_clean < EWAH_MAX_CLEAN) {
+            num_clean++;
+            i++;
+        }
+        size_t literals_start = i;
+        while (i < num_words && bits[i] != 0 && bits[i] != ~(uint64_t)0 && num_literals < EWAH_MAX_LITERALS) {
+            num_literals++;
+            i++;
+        }
+        if (i == num_words && num_literals == 0 && clean_bit == 0) {
+            break;
+        }
+
+        ewah_put_u64(*out + size, clean_bit | (num_clean << 1) | (num_literals << 33));
+        size += 8;
+        for (size_t k = literals_start; k < i; k++) {
+            ewah_put_u64(*out + size, bits[k]);
+            size += 8;
+        }
+    }
+    return size;
+}
+
+int ewah_or_into(const unsigned char *data, size_t size, uint64_t *bits, size_t num_words) {
+    if (size % 8 != 0) {
+        return -1;
+    }
+
+    size_t pos = 0, i = 0, total = size / 8;
+    while (i < total) {
+        uint64_t marker = ewah_get_u64(data + i++ * 8);
+        uint64_t num_clean = (marker >> 1) & EWAH_MAX_CLEAN;
+        uint64_t num_literals = marker >> 33;
+        if (num_clean > num_words - pos || num_literals > num_words - pos - num_clean || num_literals > total - i) {
+            return -1;
+        }
+        if (marker & 1) {
+            memset(bits + pos, 0xff, num_clean * 8);
+        }
+        pos += num_clean;
+        for (uint64_t k = 0; k < num_literals; k++) {
+            bits[pos++] |= ewah_get_u64(data + i++ * 8);
+        }
+    }
+    return 0;
+}
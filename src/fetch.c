@@ -0,0 +1,416 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "objects.h"
+#include "refs.h"
+#include "revwalk.h"
+#include "transfer.h"
+#include "remote.h"
+#include "bitmap.h"
+#include "fetch.h"
+
+// transfer phase of commits and tags, after every tree
+#define FETCH_PHASE_COMMITS INT_MAX
+
+// objects to send, with an open addressing table to add each only once
+typedef struct fetch_set {
+    obj_hash *hashes;
+    int *phases; // transfer phase of each object: 0 for blobs, then trees, which only refer to earlier phases
+    int num_hashes;
+    int capacity;
+    int *table; // index + 1, 0 if empty
+    uint32_t table_size;
+} fetch_set;
+
+typedef struct fetch_ctx {
+    const git_repo *src;
+    const git_repo *dest;
+    fetch_set send;
+    fetch_set pushed; // commits pushed as wants and tags the receiver has, so tips shared by refs are followed once
+    reach_bitmaps *bitmaps; // remote's, NULL if it has none
+    uint64_t *have_bits; // objects reachable from common haves with a bitmap, NULL if none have one
+    int num_known; // objects found in `have_bits`
+} fetch_ctx;
+
+uint32_t fetch_slot(const fetch_set *set, const char *hash) {
+    uint32_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = (key << 4) | (uint32_t)(hash[i] <= '9' ? hash[i] - '0' : hash[i] - 'a' + 10);
+    }
+    uint32_t slot = key & (set->table_size - 1);
+    while (set->table[slot] != 0 && strcmp(set->hashes[set->table[slot] - 1], hash) != 0) {
+        slot = (slot + 1) & (set->table_size - 1);
+    }
+    return slot;
+}
+
+int fetch_set_has(const fetch_set *set, const char *hash) {
+    return set->table[fetch_slot(set, hash)] != 0;
+}
+
+// @return index of hash in set, -1 if it is not in it
+int fetch_set_find(const fetch_set *set, const char *hash) {
+    return set->table[fetch_slot(set, hash)] - 1;
+}
+
+void fetch_set_add(fetch_set *set, const char *hash, int phase) {
+    uint32_t slot = fetch_slot(set, hash);
+    if (set->table[slot] != 0) {
+        return;
+    }
+    if (set->num_hashes == set->capacity) {
+        set->capacity *= 2;
+        set->hashes = realloc(set->hashes, set->capacity * sizeof(obj_hash));
+        set->phases = realloc(set->phases, set->capacity * sizeof(int));
+    }
+    memcpy(set->hashes[set->num_hashes], hash, OBJ_HASH_SIZE);
+    set->phases[set->num_hashes] = phase;
+    set->table[slot] = ++set->num_hashes;
+
+    if ((uint32_t)set->num_hashes * 2 > set->table_size) {
+        free(set->table);
+        set->table_size *= 2;
+        set->table = calloc(set->table_size, sizeof(int));
+        for (int i = 0; i < set->num_hashes; i++) {
+            set->table[fetch_slot(set, set->hashes[i])] = i + 1;
+        }
+    }
+}
+
+int fetch_has(const git_repo *repo, const char *hash) {
+    char path[PATH_MAX];
+    obj_path(repo, hash, path);
+    return fs_file_exists(path);
+}
+
+// @return 1 if receiver has object, found through the bitmaps of common haves without a stat
+// when it is reachable from one of them
+int fetch_dest_has(fetch_ctx *ctx, const char *hash) {
+    if (ctx->have_bits != NULL) {
+        int64_t pos = reach_bitmaps_find(ctx->bitmaps, hash);
+        if (pos >= 0 && (ctx->have_bits[pos >> 6] >> (pos & 63) & 1)) {
+            ctx->num_known++;
+            return 1;
+        }
+    }
+    return fetch_has(ctx->dest, hash);
+}
+
+// Adds tree and everything below it that is neither sent nor in the receiver already. Trees
+// are sent after their subtrees, so receiver having a tree means it has everything below it.
+// @param phase set to transfer phase of tree, one more than its highest sent subtree, 0 if not sent
+// @return 0 on success, -1 if a tree could not be read
+int fetch_walk_tree(fetch_ctx *ctx, const char *hash, int *phase) {
+    int pos = fetch_set_find(&ctx->send, hash);
+    *phase = pos >= 0 ? ctx->send.phases[pos] : 0;
+    if (pos >= 0 || fetch_dest_has(ctx, hash)) {
+        return 0;
+    }
+
+    tree_iter iter;
+    if (tree_iter_open(ctx->src, hash, &iter) != 0) {
+        return -1;
+    }
+    tree_iter_entry entry;
+    int res, highest = 0;
+    while ((res = tree_iter_next(&iter, &entry)) == 1) {
+        if (entry.type == TREE_OBJ) {
+            int sub_phase;
+            if (fetch_walk_tree(ctx, entry.hash, &sub_phase) != 0) {
+                res = -1;
+                break;
+            }
+            highest = sub_phase > highest ? sub_phase : highest;
+        } else if (!fetch_set_has(&ctx->send, entry.hash) && !fetch_dest_has(ctx, entry.hash)) {
+            fetch_set_add(&ctx->send, entry.hash, 0);
+        }
+    }
+    tree_iter_close(&iter);
+    *phase = highest + 1;
+    fetch_set_add(&ctx->send, hash, *phase);
+    if (res == -1) {
+        printf("ERROR: could not read tree %s of remote\n", hash);
+    }
+    return res;
+}
+
+// Peels tags at `tip`, adding the ones the receiver lacks, and pushes the commit they lead to.
+// Commits and tags the receiver has are followed anyway, as a fetch that failed half way may
+// have left them without what they point to. Ones reachable from its refs are hidden later.
+// @return 1 if tip is a new want, 0 if receiver has it or it was wanted already, -1 if it could not be read
+int fetch_want(fetch_ctx *ctx, revwalk *walk, const char *tip) {
+    obj_hash hash;
+    snprintf(hash, OBJ_HASH_SIZE, "%s", tip);
+    int is_want = 0;
+    while (!fetch_set_has(&ctx->send, hash) && !fetch_set_has(&ctx->pushed, hash)) {
+        size_t size;
+        unsigned char *data = create_obj_from_disk(ctx->src, hash, &size);
+        if (data == NULL) {
+            return -1;
+        }
+
+        const char *header = (const char *)data;
+        const char *body = header + strlen(header) + 1;
+        int missing = !fetch_has(ctx->dest, hash), res = 1, phase;
+        if (strncmp(header, O_TYPE_COMMIT " ", 7) == 0) {
+            fetch_set_add(&ctx->pushed, hash, FETCH_PHASE_COMMITS);
+            res = revwalk_push(walk, hash) == 0 ? 1 : -1;
+        } else if (strncmp(header, O_TYPE_TREE " ", 5) == 0) {
+            res = fetch_walk_tree(ctx, hash, &phase) == 0 ? 1 : -1;
+        } else if (strncmp(header, O_TYPE_TAG " ", 4) == 0 && strncmp(body, "object ", 7) == 0 &&
+            size - (body - header) > 7 + OBJ_HASH_SIZE - 1) {
+            // continue with the tag's target, which is sent before the tag
+            fetch_set_add(missing ? &ctx->send : &ctx->pushed, hash, FETCH_PHASE_COMMITS);
+            snprintf(hash, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, body + 7);
+            res = 0;
+        } else if (strncmp(header, O_TYPE_BLOB " ", 5) == 0) {
+            if (missing) {
+                fetch_set_add(&ctx->send, hash, 0);
+            }
+        } else {
+            res = -1;
+        }
+        free(data);
+        is_want |= missing;
+        if (res != 0) {
+            return res == -1 ? -1 : is_want;
+        }
+    }
+    return is_want;
+}
+
+// Hides a tip of the receiver if the remote has it too. Refs prove the receiver has everything
+// below them, so everything the remote's bitmap of the tip lists is marked as present. A
+// malformed bitmap drops the bitmaps, and every object is looked up in the receiver instead.
+// @return 1 if tip was hidden and had a bitmap, 0 otherwise
+int fetch_hide_have(fetch_ctx *ctx, revwalk *walk, const char *have, fetch_stats *stats) {
+    if (!fetch_has(ctx->src, have) || revwalk_hide(walk, have) != 0) {
+        return 0;
+    }
+    stats->num_common++;
+    int res = ctx->have_bits != NULL ? reach_bitmaps_or(ctx->bitmaps, have, ctx->have_bits) : 0;
+    if (res == -1) {
+        free(ctx->have_bits);
+        ctx->have_bits = NULL;
+    }
+    return res == 1;
+}
+
+// Pushes remote's tips the receiver lacks, hides the receiver's tips the remote has, then
+// adds every commit in between, with the parts of their trees the receiver lacks.
+// @return 0 on success, -1 on failure
+int fetch_negotiate(fetch_ctx *ctx, revwalk *walk, const ref_list *remote_refs, fetch_stats *stats) {
+    obj_hash hash;
+    for (int i = 0; i < remote_refs->num_refs; i++) {
+        const char *remote_ref = remote_refs->refs[i].name;
+        if (strncmp(remote_ref, HEADS_REF_PREFIX, strlen(HEADS_REF_PREFIX)) != 0 &&
+            strncmp(remote_ref, TAGS_REF_PREFIX, strlen(TAGS_REF_PREFIX)) != 0) {
+            continue;
+        }
+        int res = fetch_want(ctx, walk, remote_refs->refs[i].hash);
+        if (res == -1) {
+            printf("ERROR: could not read %s of remote\n", remote_ref);
+            return -1;
+        }
+        stats->num_wants += res;
+    }
+    if (resolve_head(ctx->src, &hash, NULL) == 0) {
+        int res = fetch_want(ctx, walk, hash);
+        if (res == -1) {
+            return -1;
+        }
+        stats->num_wants += res;
+    }
+
+    // annotated tags are hidden through the commit packed refs say they peel to, other tips
+    // that are not commits are left out of the haves
+    ref_list refs;
+    if (list_refs(ctx->dest, &refs) != 0) {
+        return -1;
+    }
+    if ((ctx->bitmaps = reach_bitmaps_open(ctx->src)) != NULL) {
+        ctx->have_bits = calloc((ctx->bitmaps->num_objects + 63) / 64 + 1, sizeof(uint64_t));
+    }
+    int num_bitmapped = 0;
+    for (int i = 0; i < refs.num_refs; i++) {
+        const char *have = refs.refs[i].peeled[0] != '\0' ? refs.refs[i].peeled : refs.refs[i].hash;
+        num_bitmapped += fetch_hide_have(ctx, walk, have, stats);
+    }
+    free_ref_list(&refs);
+    if (resolve_head(ctx->dest, &hash, NULL) == 0) {
+        num_bitmapped += fetch_hide_have(ctx, walk, hash, stats);
+    }
+    if (num_bitmapped == 0) {
+        free(ctx->have_bits);
+        ctx->have_bits = NULL;
+    }
+
+    // commits the receiver has outside of its refs still have their trees walked, which stops
+    // at the first tree it has
+    int res, phase;
+    while ((res = revwalk_next(walk, &hash, NULL)) == 1) {
+        obj_hash tree;
+        if (!fetch_dest_has(ctx, hash)) {
+            fetch_set_add(&ctx->send, hash, FETCH_PHASE_COMMITS);
+            stats->num_commits++;
+        }
+        if (read_commit_tree(ctx->src, hash, &tree) != 0 || fetch_walk_tree(ctx, tree, &phase) != 0) {
+            return -1;
+        }
+    }
+    return res == 0 ? 0 : -1;
+}
+
+int cmp_fetch_phase(const void *a, const void *b) {
+    const int *pa = a, *pb = b;
+    return pa[0] != pb[0] ? (pa[0] < pb[0] ? -1 : 1) : pa[1] - pb[1];
+}
+
+// Links or copies sent objects into the receiver a phase at a time, blobs first, then trees
+// from the deepest up, then commits and tags, stopping at the first phase that fails. So even
+// after a failed fetch the receiver never has a tree without everything below it.
+// @return 0 on success, -1 if an object could not be transferred
+int fetch_transfer(fetch_ctx *ctx, transfer_stats *stats) {
+    int num_hashes = ctx->send.num_hashes;
+    int (*order)[2] = malloc((num_hashes + 1) * sizeof(*order));
+    for (int i = 0; i < num_hashes; i++) {
+        order[i][0] = ctx->send.phases[i];
+        order[i][1] = i;
+    }
+    qsort(order, num_hashes, sizeof(*order), cmp_fetch_phase);
+    obj_hash *hashes = malloc((num_hashes + 1) * sizeof(obj_hash));
+    for (int i = 0; i < num_hashes; i++) {
+        memcpy(hashes[i], ctx->send.hashes[order[i][1]], OBJ_HASH_SIZE);
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    int rc = 0;
+    for (int start = 0, end; start < num_hashes && rc == 0; start = end) {
+        end = start + 1;
+        while (end < num_hashes && order[end][0] == order[start][0]) {
+            end++;
+        }
+        transfer_stats phase;
+        rc = transfer_objects(ctx->src, ctx->dest, (const obj_hash *)hashes + start, end - start, &phase);
+        stats->linked += phase.linked;
+        stats->copied += phase.copied;
+        stats->existing += phase.existing;
+        stats->failed += phase.failed;
+    }
+
+    free(order);
+    free(hashes);
+    return rc;
+}
+
+// Moves remote-tracking refs of remote `name`, adds new tags and writes FETCH_HEAD.
+// @return 0 on success, -1 if a ref could not be written
+int fetch_update_refs(const git_repo *repo, const ref_list *remote_refs, const char *name, const char *url, fetch_stats *stats) {
+    char path[PATH_MAX], git_path[PATH_MAX], ref[PATH_MAX];
+    fs_path_join(repo->root_path, GIT_FOLDER, git_path);
+    fs_path_join(git_path, FETCH_HEAD_NAME, path);
+    FILE *fetch_head = fs_fopen(path, "wb");
+    if (fetch_head == NULL) {
+        printf("ERROR: could not write %s\n", path);
+        return -1;
+    }
+
+    int res = 0;
+    for (int i = 0; res == 0 && i < remote_refs->num_refs; i++) {
+        const char *remote_ref = remote_refs->refs[i].name;
+        const char *hash = remote_refs->refs[i].hash;
+        obj_hash old;
+        if (strncmp(remote_ref, HEADS_REF_PREFIX, strlen(HEADS_REF_PREFIX)) == 0) {
+            const char *branch = remote_ref + strlen(HEADS_REF_PREFIX);
+            fprintf(fetch_head, "%s\t\tbranch '%s' of %s\n", hash, branch, url);
+            if (name[0] == '\0') {
+                continue;
+            }
+            snprintf(ref, PATH_MAX, REMOTES_REF_PREFIX "%s/%s", name, branch);
+        } else if (strncmp(remote_ref, TAGS_REF_PREFIX, strlen(TAGS_REF_PREFIX)) == 0) {
+            snprintf(ref, PATH_MAX, "%s", remote_ref);
+        } else {
+            continue;
+        }
+
+        int found = read_ref(repo, ref, &old);
+        if (found == 0 && strcmp(old, hash) == 0) {
+            continue;
+        }
+        // tags never move once fetched
+        if (found == 0 && strncmp(ref, TAGS_REF_PREFIX, strlen(TAGS_REF_PREFIX)) == 0) {
+            printf(" ! [rejected] %s (would clobber existing tag)\n", ref);
+            continue;
+        }
+        if ((res = update_ref(repo, ref, hash, found == 1 ? "" : NULL)) == 0) {
+            stats->num_refs++;
+        }
+    }
+    fs_fclose(fetch_head);
+    return res;
+}
+
+int fetch_remote(const git_repo *repo, const char *remote, fetch_stats *stats) {
+    fetch_stats local_stats;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    char name[PATH_MAX], url[PATH_MAX];
+    if (resolve_remote(repo, remote, name, url) != 0) {
+        return 1;
+    }
+    const git_repo *src = get_working_repo(url);
+    if (src == NULL || strcmp(src->root_path, url) != 0) {
+        printf("ERROR: %s is not a repository\n", url);
+        free_repo(src);
+        return 1;
+    }
+
+    ref_list remote_refs;
+    revwalk *walk = NULL;
+    fetch_ctx ctx = { src, repo, { NULL, NULL, 0, 64, NULL, 128 }, { NULL, NULL, 0, 64, NULL, 128 }, NULL, NULL, 0 };
+    ctx.send.hashes = malloc(ctx.send.capacity * sizeof(obj_hash));
+    ctx.send.phases = malloc(ctx.send.capacity * sizeof(int));
+    ctx.send.table = calloc(ctx.send.table_size, sizeof(int));
+    ctx.pushed.hashes = malloc(ctx.pushed.capacity * sizeof(obj_hash));
+    ctx.pushed.phases = malloc(ctx.pushed.capacity * sizeof(int));
+    ctx.pushed.table = calloc(ctx.pushed.table_size, sizeof(int));
+    int res = -1;
+    if (list_refs(src, &remote_refs) != 0) {
+        goto end;
+    }
+    if ((walk = revwalk_create(src, REVWALK_DATE_ORDER, 0)) != NULL &&
+        fetch_negotiate(&ctx, walk, &remote_refs, stats) == 0) {
+        // objects go first, so no ref points to one that is not there yet
+        stats->num_objects = ctx.send.num_hashes;
+        stats->num_known = ctx.num_known;
+        if (fetch_transfer(&ctx, &stats->objects) == 0) {
+            res = fetch_update_refs(repo, &remote_refs, name, url, stats);
+        }
+    }
+    free_ref_list(&remote_refs);
+
+end:
+    if (walk != NULL) {
+        revwalk_free(walk);
+    }
+    free(ctx.send.hashes);
+    free(ctx.send.phases);
+    free(ctx.send.table);
+    free(ctx.pushed.hashes);
+    free(ctx.pushed.phases);
+    free(ctx.pushed.table);
+    free(ctx.have_bits);
+    if (ctx.bitmaps != NULL) {
+        reach_bitmaps_close(ctx.bitmaps);
+    }
+    free_repo(src);
+    return res;
+}
@@ -7,11 +7,15 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "filesystem.h"
     
 #ifdef _WIN32
     #include <windows.h>
+    #include <sys/utime.h>
+#else
+    #include <utime.h>
 #endif
 
 int fs_mkdir(const char *path, mode_t mode) {
@@ -43,52 +47,179 @@ DIR *fs_opendir(const char *path) {
     return opendir(copy); 
 }
 
-static fs_dirent ret;
-static struct stat st;
+void fill_statinfo(const struct stat *st, struct fs_statinfo *statinfo) {
+    statinfo->fi_atime = st->st_atime;
+    statinfo->fi_mtime = st->st_mtime;
+    statinfo->fi_ctime = st->st_ctime;
+    statinfo->fi_dev = st->st_dev;
+    statinfo->fi_gid = st->st_gid;
+    statinfo->fi_ino = st->st_ino;
+    statinfo->fi_mode = st->st_mode;
+    statinfo->fi_size = st->st_size;
+    statinfo->fi_uid = st->st_uid;
+}
 
-fs_dirent *fs_readdir(DIR *dir, const char *foldername){
-    struct dirent *ent;
-    if ((ent = readdir(dir)) == NULL) {
+#ifdef _WIN32
+
+fs_dir *fs_dir_open(const char *path) {
+    DIR *d;
+    if ((d = fs_opendir(path)) == NULL) {
         return NULL;
     }
 
+    fs_dir *dir = malloc(sizeof(*dir));
+    dir->dir = d;
+    dir->fd = -1;
+    dir->path = strdup(path);
+    return dir;
+}
+
+fs_dir *fs_dir_openat(const fs_dir *parent, const char *name) {
     char path[PATH_MAX];
-    fs_path_join(foldername, ent->d_name, path);
-    
-    memset(&ret, 0, sizeof(ret));
-    ret.de_ino = ent->d_ino;
-    snprintf(ret.de_name, PATH_MAX, "%s", ent->d_name);
-    snprintf(ret.de_path, PATH_MAX, "%s", path);
-
-    if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
-        if (stat(path, &st) != 0) {
-            perror("stat");
-            return NULL;
+    fs_path_join(parent->path, name, path);
+    return fs_dir_open(path);
+}
+
+int fs_dir_getinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo) {
+    char path[PATH_MAX];
+    fs_path_join(dir->path, name, path);
+    return fs_getinfo(path, statinfo);
+}
+
+// no symlinks on Win32
+int fs_dir_lgetinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo) {
+    return fs_dir_getinfo(dir, name, statinfo);
+}
+
+FILE *fs_dir_fopen(const fs_dir *dir, const char *name, const char *mode) {
+    char path[PATH_MAX];
+    fs_path_join(dir->path, name, path);
+    return fs_fopen(path, mode);
+}
+
+void fs_dir_close(fs_dir *dir) {
+    fs_closedir(dir->dir);
+    free(dir->path);
+    free(dir);
+}
+
+#else
+
+fs_dir *fs_dir_open(const char *path) {
+    DIR *d;
+    if ((d = opendir(path)) == NULL) {
+        return NULL;
+    }
+
+    fs_dir *dir = malloc(sizeof(*dir));
+    dir->dir = d;
+    dir->fd = dirfd(d);
+    return dir;
+}
+
+fs_dir *fs_dir_openat(const fs_dir *parent, const char *name) {
+    int fd;
+    if ((fd = openat(parent->fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        return NULL;
+    }
+
+    DIR *d;
+    if ((d = fdopendir(fd)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    fs_dir *dir = malloc(sizeof(*dir));
+    dir->dir = d;
+    dir->fd = fd;
+    return dir;
+}
+
+int fs_dir_getinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo) {
+    struct stat st;
+    if (fstatat(dir->fd, name, &st, 0) != 0) {
+        return -1;
+    }
+
+    fill_statinfo(&st, statinfo);
+    return 0;
+}
+
+int fs_dir_lgetinfo(const fs_dir *dir, const char *name, struct fs_statinfo *statinfo) {
+    struct stat st;
+    if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return -1;
+    }
+
+    fill_statinfo(&st, statinfo);
+    return 0;
+}
+
+FILE *fs_dir_fopen(const fs_dir *dir, const char *name, const char *mode) {
+    int flags = strchr(mode, 'w') != NULL ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+    int fd;
+    if ((fd = openat(dir->fd, name, flags | O_CLOEXEC, 0666)) == -1) {
+        return NULL;
+    }
+
+    FILE *fptr;
+    if ((fptr = fdopen(fd, mode)) == NULL) {
+        close(fd);
+    }
+    return fptr;
+}
+
+void fs_dir_close(fs_dir *dir) {
+    closedir(dir->dir);
+    free(dir);
+}
+
+#endif
+
+int fs_dir_next(fs_dir *dir, fs_dirent *out) {
+    struct dirent *ent;
+
+    do {
+        errno = 0;
+        if ((ent = readdir(dir->dir)) == NULL) {
+            return errno == 0 ? 0 : -1;
         }
+    } while (ent->d_name[0] == '.' && 
+        (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')));
+
+    out->de_name = ent->d_name;
+    out->de_namelen = strlen(ent->d_name);
+    out->de_ino = ent->d_ino;
+    out->de_type = FS_ISOTHER;
+
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(DT_DIR)
+    switch (ent->d_type) {
+        case DT_REG:
+            out->de_type = FS_ISFILE;
+            return 1;
+        case DT_DIR:
+            out->de_type = FS_ISDIR;
+            return 1;
+        case DT_UNKNOWN:
+        case DT_LNK:
+            break;
+        default:
+            return 1;
+    }
+#endif
 
-        ret.de_type = S_ISDIR(st.st_mode) ? FS_ISDIR : FS_ISFILE;
-        ret.de_size = st.st_size;
-        ret.de_mode = st.st_mode;
-    } else {
-        ret.de_type = FS_ISDIR;
+    // filesystem does not report type, or entry is a symlink that needs following
+    fs_statinfo info;
+    if (fs_dir_getinfo(dir, ent->d_name, &info) == 0) {
+        out->de_type = S_ISDIR(info.fi_mode) ? FS_ISDIR : S_ISREG(info.fi_mode) ? FS_ISFILE : FS_ISOTHER;
     }
-    
-    return &ret;
+    return 1;
 }
 
 int fs_getinfo(const char *path, struct fs_statinfo *statinfo) {
     struct stat st;
     int result = stat(path, &st);
-
-    statinfo->fi_atime = st.st_atime;
-    statinfo->fi_mtime = st.st_mtime;
-    statinfo->fi_ctime = st.st_ctime;
-    statinfo->fi_dev = st.st_dev;
-    statinfo->fi_gid = st.st_gid;
-    statinfo->fi_ino = st.st_ino;
-    statinfo->fi_mode = st.st_mode;
-    statinfo->fi_size = st.st_size;
-    statinfo->fi_uid = st.st_uid;
+    fill_statinfo(&st, statinfo);
 
     return result;
 }
@@ -116,6 +247,10 @@ int fs_file_exists(const char *filename) {
     return 1;
 }
 
+int fs_touch(const char *path) {
+    return utime(path, NULL) == 0 ? 0 : -1;
+}
+
 void fs_path_join(const char *path1, const char *path2, char *out) {
     char *sep = "/";
 
@@ -0,0 +1,392 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <zlib.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "objects.h"
+#include "dircache.h"
+#include "refs.h"
+#include "threadpool.h"
+#include "gc.h"
+#include "fsck.h"
+
+// bits of the types an object is or is used as
+#define FSCK_BLOB 1
+#define FSCK_TREE 2
+#define FSCK_COMMIT 4
+#define FSCK_TAG 8
+
+#define FSCK_CHUNK (1 << 16)
+#define FSCK_HEADER_MAX 32 // longest type, a space, a 64-bit size and NUL
+
+typedef struct fsck_ctx {
+    const git_repo *repo;
+    const loose_objects *objects;
+    unsigned char *types; // type of each object, 0 if corrupt, each written by one task only
+    _Atomic unsigned char *used_as; // types each object is used as by other objects
+    atomic_int num_corrupt, num_missing;
+} fsck_ctx;
+
+// objects of one fan-out folder, problems are kept to be printed in order
+typedef struct fsck_task {
+    fsck_ctx *ctx;
+    int byte;
+    char *report;
+    size_t report_len, report_capacity;
+    unsigned char *chunk; // one chunk read and one inflated
+} fsck_task;
+
+// object as far as it is inflated
+typedef struct fsck_inflated {
+    char header[FSCK_HEADER_MAX];
+    size_t header_len;
+    int header_done, type;
+    size_t size, body_len; // body size header gives and body bytes inflated so far
+    unsigned char *body; // NULL for blobs
+} fsck_inflated;
+
+void fsck_report(fsck_task *task, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (task->report_len + len + 1 > task->report_capacity) {
+        task->report_capacity = (task->report_len + len + 1) * 2;
+        task->report = realloc(task->report, task->report_capacity);
+    }
+    va_start(args, format);
+    vsnprintf(task->report + task->report_len, len + 1, format, args);
+    va_end(args);
+    task->report_len += len;
+}
+
+const char *fsck_type_name(int type) {
+    return type == FSCK_BLOB ? O_TYPE_BLOB : type == FSCK_TREE ? O_TYPE_TREE : type == FSCK_COMMIT ? O_TYPE_COMMIT : O_TYPE_TAG;
+}
+
+int fsck_type_of(const char *name, size_t len) {
+    if (len == 4 && strncmp(name, O_TYPE_BLOB, 4) == 0) {
+        return FSCK_BLOB;
+    } else if (len == 4 && strncmp(name, O_TYPE_TREE, 4) == 0) {
+        return FSCK_TREE;
+    } else if (len == 6 && strncmp(name, O_TYPE_COMMIT, 6) == 0) {
+        return FSCK_COMMIT;
+    } else if (len == 3 && strncmp(name, O_TYPE_TAG, 3) == 0) {
+        return FSCK_TAG;
+    }
+    return 0;
+}
+
+// Records that `from` uses `hash` as `type`.
+// @return 0 if it exists, -1 if it is missing
+int fsck_link(fsck_task *task, const char *from, const char *hash, int type) {
+    int pos = find_loose_object(task->ctx->objects, hash);
+    if (pos < 0) {
+        fsck_report(task, "missing %s %s (in %s)\n", fsck_type_name(type), hash, from);
+        atomic_fetch_add(&task->ctx->num_missing, 1);
+        return -1;
+    }
+    atomic_fetch_or(&task->ctx->used_as[pos], type);
+    return 0;
+}
+
+// @return first header line starting with `key`, NULL if there is none
+const char *fsck_header_line(const char *body, const char *end, const char *key) {
+    size_t key_len = strlen(key);
+    const char *line = body;
+    while (line < end && *line != '\n') {
+        if ((size_t)(end - line) > key_len && strncmp(line, key, key_len) == 0) {
+            return line;
+        }
+        const char *eol = memchr(line, '\n', end - line);
+        line = eol != NULL ? eol + 1 : end;
+    }
+    return NULL;
+}
+
+// checks that header lines starting with `key` hold an existing object of `type`
+// @return number of such lines
+int fsck_header_links(fsck_task *task, const char *hash, const char *body, const char *end, const char *key, int type) {
+    size_t key_len = strlen(key);
+    int count = 0;
+    const char *line = body;
+    while (line < end && *line != '\n') {
+        const char *eol = memchr(line, '\n', end - line);
+        eol = eol != NULL ? eol : end;
+        if (strncmp(line, key, key_len) == 0 && eol - line == (long)(key_len + OBJ_HASH_SIZE - 1)) {
+            obj_hash target;
+            snprintf(target, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, line + key_len);
+            fsck_link(task, hash, target, type);
+            count++;
+        }
+        line = eol + 1;
+    }
+    return count;
+}
+
+// @return 0 if tree parses and is sorted, -1 otherwise
+int fsck_tree(fsck_task *task, const char *hash, const char *body, const char *end) {
+    tree_iter iter = { NULL, body, end };
+    tree_iter_entry entry, prev;
+    int res, first = 1;
+    while ((res = tree_iter_next(&iter, &entry)) == 1) {
+        if (!first && tree_order_cmp(prev.name, prev.name_len, prev.type == TREE_OBJ,
+            entry.name, entry.name_len, entry.type == TREE_OBJ) >= 0) {
+            fsck_report(task, "ERROR: tree %s is not sorted or has duplicate entry %.*s\n", hash, (int)entry.name_len, entry.name);
+            return -1;
+        }
+        fsck_link(task, hash, entry.hash, entry.type == TREE_OBJ ? FSCK_TREE : FSCK_BLOB);
+        prev = entry;
+        first = 0;
+    }
+    if (res == -1) {
+        fsck_report(task, "ERROR: tree %s is malformed\n", hash);
+        return -1;
+    }
+    return 0;
+}
+
+// Takes `len` inflated bytes of an object, completing its header first and then counting
+// its body, which is kept for trees, commits and tags only as those are checked further.
+// @return 0 on success, -1 if header is malformed
+int fsck_take(fsck_inflated *obj, const unsigned char *data, size_t len) {
+    for (; len > 0 && !obj->header_done; data++, len--) {
+        if (obj->header_len == FSCK_HEADER_MAX) {
+            return -1;
+        }
+        obj->header[obj->header_len++] = *data;
+        if (*data != '\0') {
+            continue;
+        }
+        char *sep = memchr(obj->header, ' ', obj->header_len), *size_end;
+        if (sep == NULL || sep[1] < '0' || sep[1] > '9') {
+            return -1;
+        }
+        obj->size = strtoull(sep + 1, &size_end, 10);
+        if (size_end != obj->header + obj->header_len - 1) {
+            return -1;
+        }
+        obj->type = fsck_type_of(obj->header, sep - obj->header);
+        if ((obj->type & (FSCK_TREE | FSCK_COMMIT | FSCK_TAG)) != 0 && (obj->body = malloc(obj->size + 1)) == NULL) {
+            return -1;
+        }
+        obj->header_done = 1;
+    }
+    if (obj->body != NULL && obj->body_len < obj->size) {
+        memcpy(obj->body + obj->body_len, data, len < obj->size - obj->body_len ? len : obj->size - obj->body_len);
+    }
+    obj->body_len += len;
+    return 0;
+}
+
+// Inflates object a chunk at a time into its hash, so blobs are never held whole.
+// @return NULL on success, otherwise what could not be done to it
+const char *fsck_inflate(fsck_task *task, const char *hash, fsck_inflated *obj, obj_hash *actual) {
+    char path[PATH_MAX];
+    obj_path(task->ctx->repo, hash, path);
+    FILE *file = fs_fopen(path, "rb");
+    if (file == NULL) {
+        return "read";
+    }
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit(&strm) != Z_OK) {
+        fs_fclose(file);
+        return "inflated";
+    }
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(md, EVP_sha1(), NULL);
+
+    unsigned char *in = task->chunk, *out = task->chunk + FSCK_CHUNK;
+    const char *failure = NULL;
+    int ret = Z_OK;
+    size_t n;
+    while (failure == NULL && ret != Z_STREAM_END && (n = fs_readbytes(in, 1, FSCK_CHUNK, file)) > 0) {
+        strm.next_in = in;
+        strm.avail_in = n;
+        do {
+            strm.next_out = out;
+            strm.avail_out = FSCK_CHUNK;
+            ret = inflate(&strm, Z_NO_FLUSH);
+            size_t have = FSCK_CHUNK - strm.avail_out;
+            if ((ret != Z_OK && ret != Z_STREAM_END) || fsck_take(obj, out, have) != 0) {
+                failure = "inflated";
+                break;
+            }
+            EVP_DigestUpdate(md, out, have);
+        } while (strm.avail_out == 0 && ret != Z_STREAM_END);
+    }
+    if (failure == NULL && ferror(file)) {
+        failure = "read";
+    } else if (failure == NULL && (ret != Z_STREAM_END || !obj->header_done)) {
+        failure = "inflated";
+    }
+    inflateEnd(&strm);
+    fs_fclose(file);
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    EVP_DigestFinal_ex(md, digest, NULL);
+    EVP_MD_CTX_free(md);
+    hash_from_bytes(digest, actual);
+    return failure;
+}
+
+// @return type of object, 0 if it is corrupt
+int fsck_object(fsck_task *task, const char *hash) {
+    fsck_inflated obj = { 0 };
+    obj_hash actual;
+    const char *failure = fsck_inflate(task, hash, &obj, &actual);
+    if (failure != NULL) {
+        fsck_report(task, "ERROR: %s could not be %s\n", hash, failure);
+        free(obj.body);
+        return 0;
+    } else if (obj.body_len != obj.size) {
+        fsck_report(task, "ERROR: %s has %zu bytes, but its header says %zu\n", hash, obj.body_len, obj.size);
+        free(obj.body);
+        return 0;
+    } else if (strcmp(actual, hash) != 0) {
+        fsck_report(task, "ERROR: %s hashes to %s\n", hash, actual);
+        free(obj.body);
+        return 0;
+    }
+
+    const char *header = obj.header;
+    const char *body = (const char *)obj.body;
+    const char *end = body != NULL ? body + obj.size : NULL;
+    int type = obj.type;
+    if (type == FSCK_TREE && fsck_tree(task, hash, body, end) != 0) {
+        type = 0;
+    } else if (type == FSCK_COMMIT && (strncmp(body, "tree ", 5) != 0
+        || fsck_header_links(task, hash, body, end, "tree ", FSCK_TREE) != 1)) {
+        fsck_report(task, "ERROR: commit %s has no tree\n", hash);
+        type = 0;
+    } else if (type == FSCK_COMMIT) {
+        fsck_header_links(task, hash, body, end, "parent ", FSCK_COMMIT);
+    } else if (type == FSCK_TAG) {
+        const char *type_line = fsck_header_line(body, end, "type ");
+        const char *type_end = type_line != NULL ? memchr(type_line, '\n', end - type_line) : NULL;
+        int target_type = type_end != NULL ? fsck_type_of(type_line + 5, type_end - type_line - 5) : 0;
+        if (target_type == 0 || fsck_header_links(task, hash, body, end, "object ", target_type) != 1) {
+            fsck_report(task, "ERROR: tag %s has no object or type\n", hash);
+            type = 0;
+        }
+    } else if (type == 0) {
+        fsck_report(task, "ERROR: %s has unknown type %.*s\n", hash, (int)strcspn(header, " "), header);
+    }
+    free(obj.body);
+    return type;
+}
+
+void fsck_task_run(void *arg) {
+    fsck_task *task = arg;
+    fsck_ctx *ctx = task->ctx;
+    task->chunk = malloc(2 * FSCK_CHUNK);
+    for (int i = ctx->objects->fanout[task->byte]; i < ctx->objects->fanout[task->byte + 1]; i++) {
+        if ((ctx->types[i] = fsck_object(task, ctx->objects->objects[i].hash)) == 0) {
+            atomic_fetch_add(&ctx->num_corrupt, 1);
+        }
+    }
+    free(task->chunk);
+}
+
+// marks an object named by a ref, HEAD or the index as used
+// @return 0 if it exists, -1 if it is missing
+int fsck_root(fsck_ctx *ctx, unsigned char *is_root, const char *name, const char *hash) {
+    int pos = find_loose_object(ctx->objects, hash);
+    if (pos < 0) {
+        printf("missing %s (pointed to by %s)\n", hash, name);
+        atomic_fetch_add(&ctx->num_missing, 1);
+        return -1;
+    }
+    is_root[pos] = 1;
+    return 0;
+}
+
+int fsck_objects(const git_repo *repo, fsck_stats *out) {
+    memset(out, 0, sizeof(*out));
+    loose_objects objects;
+    if (list_loose_objects(repo, &objects) != 0) {
+        return -1;
+    }
+    threadpool *pool = threadpool_create(0);
+    if (pool == NULL) {
+        free_loose_objects(&objects);
+        return -1;
+    }
+
+    fsck_ctx ctx = { repo, &objects, NULL, NULL, 0, 0 };
+    ctx.types = calloc(objects.num_objects + 1, 1);
+    ctx.used_as = calloc(objects.num_objects + 1, sizeof(*ctx.used_as));
+    atomic_init(&ctx.num_corrupt, 0);
+    atomic_init(&ctx.num_missing, 0);
+    fsck_task *tasks = calloc(256, sizeof(fsck_task));
+    for (int b = 0; b < 256; b++) {
+        tasks[b].ctx = &ctx;
+        tasks[b].byte = b;
+        threadpool_submit(pool, fsck_task_run, &tasks[b]);
+    }
+    threadpool_destroy(pool);
+    for (int b = 0; b < 256; b++) {
+        if (tasks[b].report != NULL) {
+            fputs(tasks[b].report, stdout);
+            free(tasks[b].report);
+        }
+    }
+    free(tasks);
+
+    unsigned char *is_root = calloc(objects.num_objects + 1, 1);
+    ref_list refs;
+    obj_hash hash;
+    if (list_refs(repo, &refs) == 0) {
+        for (int i = 0; i < refs.num_refs; i++) {
+            fsck_root(&ctx, is_root, refs.refs[i].name, refs.refs[i].hash);
+        }
+        free_ref_list(&refs);
+    }
+    if (resolve_head(repo, &hash, NULL) == 0) {
+        fsck_root(&ctx, is_root, HEAD_NAME, hash);
+    }
+    if (read_ref(repo, MERGE_HEAD_NAME, &hash) == 0) {
+        fsck_root(&ctx, is_root, MERGE_HEAD_NAME, hash);
+    }
+    git_dircache *dircache = create_dircache(repo);
+    for (int i = 0; dircache != NULL && i < dircache->num_entries; i++) {
+        if (fsck_root(&ctx, is_root, INDEX_NAME, dircache->entries[i]->hash) == 0) {
+            atomic_fetch_or(&ctx.used_as[find_loose_object(&objects, dircache->entries[i]->hash)], FSCK_BLOB);
+        }
+    }
+    if (dircache != NULL) {
+        free_dircache(dircache);
+    }
+
+    for (int i = 0; i < objects.num_objects; i++) {
+        int type = ctx.types[i], used_as = atomic_load(&ctx.used_as[i]);
+        if (type == 0) {
+            continue;
+        }
+        if ((used_as & ~type) != 0) {
+            int wrong = used_as & ~type;
+            printf("ERROR: %s is a %s, but is used as a %s\n", objects.objects[i].hash, fsck_type_name(type),
+                fsck_type_name(wrong & -wrong));
+            out->num_bad_type++;
+        } else if (used_as == 0 && !is_root[i]) {
+            printf("dangling %s %s\n", fsck_type_name(type), objects.objects[i].hash);
+            out->num_dangling++;
+        }
+    }
+
+    out->num_objects = objects.num_objects;
+    out->num_corrupt = atomic_load(&ctx.num_corrupt);
+    out->num_missing = atomic_load(&ctx.num_missing);
+    free(is_root);
+    free(ctx.types);
+    free(ctx.used_as);
+    free_loose_objects(&objects);
+    return out->num_corrupt > 0 || out->num_missing > 0 || out->num_bad_type > 0 ? 1 : 0;
+}
@@ -0,0 +1,638 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "dircache.h"
+#include "fsmonitor.h"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define FSM_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE \
+    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// past this many dirty paths the daemon forgets them and asks for a full scan instead
+#define FSM_MAX_DIRTY (1 << 20)
+#define FSM_EVENT_BUF_SIZE (64 * 1024)
+// time a client gets to send its request and take its answer, so a stalled one cannot hold up the others
+#define FSM_CLIENT_TIMEOUT_MS 1000
+
+typedef struct fsm_node {
+    char *path;
+    unsigned long long seq; // sequence number of last change
+    struct fsm_node *next;
+} fsm_node;
+
+typedef struct {
+    char root[PATH_MAX];
+    char instance[32];
+    unsigned long long seq;
+    unsigned long long overflow_seq; // tokens older than this need a full scan
+    int degraded; // set when a watch could not be added, every query is a full scan
+
+    fsm_node **buckets;
+    size_t num_buckets;
+    size_t num_dirty;
+
+    char **wd_paths; // indexed by watch descriptor, relative dir path ending in '/' ("" for root)
+    int wd_capacity;
+    int root_wd;
+    int inotify_fd;
+} fsm_state;
+
+int fsm_sock_path(const git_repo *repo, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    int len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/" GIT_FOLDER "/" FSMONITOR_SOCK_NAME, repo->root_path);
+    if (len < 0 || (size_t)len >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "ERROR: fsmonitor socket path too long: %s/" GIT_FOLDER "/" FSMONITOR_SOCK_NAME "\n", repo->root_path);
+        return -1;
+    }
+    return 0;
+}
+
+int fsm_sock_connect(const git_repo *repo) {
+    struct sockaddr_un addr;
+    if (fsm_sock_path(repo, &addr) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int fsm_write_all(int fd, const char *buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+unsigned long fsm_hash_path(const char *path) {
+    unsigned long h = 5381;
+    while (*path) {
+        h = (h * 33) ^ (unsigned char)*path++;
+    }
+    return h;
+}
+
+void fsm_clear_dirty(fsm_state *st) {
+    for (size_t i = 0; i < st->num_buckets; i++) {
+        fsm_node *node = st->buckets[i];
+        while (node != NULL) {
+            fsm_node *next = node->next;
+            free(node->path);
+            free(node);
+            node = next;
+        }
+        st->buckets[i] = NULL;
+    }
+    st->num_dirty = 0;
+}
+
+void fsm_overflow(fsm_state *st) {
+    fsm_clear_dirty(st);
+    st->overflow_seq = st->seq;
+}
+
+void fsm_grow_buckets(fsm_state *st) {
+    size_t new_size = st->num_buckets * 2;
+    fsm_node **new_buckets = calloc(new_size, sizeof(fsm_node *));
+    for (size_t i = 0; i < st->num_buckets; i++) {
+        fsm_node *node = st->buckets[i];
+        while (node != NULL) {
+            fsm_node *next = node->next;
+            size_t b = fsm_hash_path(node->path) % new_size;
+            node->next = new_buckets[b];
+            new_buckets[b] = node;
+            node = next;
+        }
+    }
+    free(st->buckets);
+    st->buckets = new_buckets;
+    st->num_buckets = new_size;
+}
+
+void fsm_mark_dirty(fsm_state *st, const char *path) {
+    size_t b = fsm_hash_path(path) % st->num_buckets;
+    for (fsm_node *node = st->buckets[b]; node != NULL; node = node->next) {
+        if (strcmp(node->path, path) == 0) {
+            node->seq = st->seq;
+            return;
+        }
+    }
+
+    if (st->num_dirty >= FSM_MAX_DIRTY) {
+        fsm_overflow(st);
+        return;
+    }
+
+    fsm_node *node = malloc(sizeof(*node));
+    node->path = strdup(path);
+    node->seq = st->seq;
+    node->next = st->buckets[b];
+    st->buckets[b] = node;
+
+    if (++st->num_dirty > st->num_buckets) {
+        fsm_grow_buckets(st);
+    }
+}
+
+void fsm_set_wd_path(fsm_state *st, int wd, const char *rel_dir) {
+    if (wd >= st->wd_capacity) {
+        int new_cap = st->wd_capacity;
+        while (new_cap <= wd) {
+            new_cap *= 2;
+        }
+        st->wd_paths = realloc(st->wd_paths, new_cap * sizeof(char *));
+        memset(st->wd_paths + st->wd_capacity, 0, (new_cap - st->wd_capacity) * sizeof(char *));
+        st->wd_capacity = new_cap;
+    }
+    free(st->wd_paths[wd]);
+    st->wd_paths[wd] = strdup(rel_dir);
+}
+
+// @param rel_dir relative path of directory ending in '/', or "" for root
+void fsm_watch_recursive(fsm_state *st, const char *rel_dir) {
+    char abs_dir[PATH_MAX];
+    fs_path_join(st->root, rel_dir, abs_dir);
+
+    int wd = inotify_add_watch(st->inotify_fd, abs_dir, FSM_WATCH_MASK);
+    if (wd == -1) {
+        if (errno != ENOENT && errno != ENOTDIR) {
+            fprintf(stderr, "WARNING: fsmonitor could not watch %s, falling back to full scans\n", abs_dir);
+            st->degraded = 1;
+        }
+        return;
+    }
+    fsm_set_wd_path(st, wd, rel_dir);
+
+    fs_dir *dir;
+    if ((dir = fs_dir_open(abs_dir)) == NULL) {
+        return;
+    }
+
+    fs_dirent ent;
+    char sub_dir[PATH_MAX];
+    while (fs_dir_next(dir, &ent) == 1) {
+        if (ent.de_type != FS_ISDIR) {
+            continue;
+        }
+        if (rel_dir[0] == '\0' && strcmp(ent.de_name, GIT_FOLDER) == 0) {
+            continue;
+        }
+        snprintf(sub_dir, PATH_MAX, "%s%s/", rel_dir, ent.de_name);
+        fsm_watch_recursive(st, sub_dir);
+    }
+    fs_dir_close(dir);
+}
+
+void fsm_handle_event(fsm_state *st, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        fsm_overflow(st);
+        return;
+    }
+    if (ev->wd < 0 || ev->wd >= st->wd_capacity || st->wd_paths[ev->wd] == NULL) {
+        return;
+    }
+
+    const char *rel_dir = st->wd_paths[ev->wd];
+    if (ev->mask & IN_IGNORED) {
+        free(st->wd_paths[ev->wd]);
+        st->wd_paths[ev->wd] = NULL;
+        return;
+    }
+    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        fsm_mark_dirty(st, rel_dir);
+        return;
+    }
+    if (ev->len == 0) {
+        return;
+    }
+    if (rel_dir[0] == '\0' && strcmp(ev->name, GIT_FOLDER) == 0) {
+        return;
+    }
+
+    char path[PATH_MAX];
+    if (ev->mask & IN_ISDIR) {
+        snprintf(path, PATH_MAX, "%s%s/", rel_dir, ev->name);
+        // contents may have been created before the watch is added, dir entry covers them
+        fsm_mark_dirty(st, path);
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            fsm_watch_recursive(st, path);
+        }
+    } else {
+        snprintf(path, PATH_MAX, "%s%s", rel_dir, ev->name);
+        fsm_mark_dirty(st, path);
+    }
+}
+
+// reads all queued inotify events
+// @return -1 if repo root is gone, 0 otherwise
+int fsm_drain_events(fsm_state *st) {
+    char buf[FSM_EVENT_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int bumped = 0;
+
+    for (;;) {
+        ssize_t n = read(st->inotify_fd, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        if (!bumped) {
+            st->seq++;
+            bumped = 1;
+        }
+
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->wd == st->root_wd && (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))) {
+                return -1;
+            }
+            fsm_handle_event(st, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    return 0;
+}
+
+int fsm_parse_token(const fsm_state *st, const char *token, unsigned long long *seq) {
+    const char *sep = strrchr(token, ':');
+    if (sep == NULL || (size_t)(sep - token) != strlen(st->instance)
+        || memcmp(token, st->instance, sep - token) != 0) {
+        return -1;
+    }
+    char *end;
+    *seq = strtoull(sep + 1, &end, 10);
+    return (*end == '\0' && *seq <= st->seq) ? 0 : -1;
+}
+
+void fsm_answer_query(fsm_state *st, int client, const char *since) {
+    char header[FSMONITOR_TOKEN_SIZE + 8];
+    unsigned long long since_seq;
+    int full = st->degraded || fsm_parse_token(st, since, &since_seq) != 0 || since_seq < st->overflow_seq;
+
+    snprintf(header, sizeof(header), "%s:%llu\n%s\n", st->instance, st->seq, full ? "F" : "P");
+    if (fsm_write_all(client, header, strlen(header)) != 0 || full) {
+        return;
+    }
+
+    for (size_t i = 0; i < st->num_buckets; i++) {
+        for (fsm_node *node = st->buckets[i]; node != NULL; node = node->next) {
+            if (node->seq > since_seq && fsm_write_all(client, node->path, strlen(node->path) + 1) != 0) {
+                return;
+            }
+        }
+    }
+}
+
+long long fsm_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Reads request line of a client, giving up once `FSM_CLIENT_TIMEOUT_MS` has passed. Writes
+// of the answer time out the same way.
+// @return 1 if daemon was asked to stop, 0 otherwise
+int fsm_handle_client(fsm_state *st, int client) {
+    struct timeval send_timeout = { FSM_CLIENT_TIMEOUT_MS / 1000, (FSM_CLIENT_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    char req[FSMONITOR_TOKEN_SIZE + 16];
+    size_t len = 0;
+    long long deadline = fsm_now_ms() + FSM_CLIENT_TIMEOUT_MS;
+    while (len < sizeof(req) - 1) {
+        struct pollfd pfd = { .fd = client, .events = POLLIN };
+        long long left = deadline - fsm_now_ms();
+        int ready = left > 0 ? poll(&pfd, 1, (int)left) : 0;
+        if (ready == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            break;
+        }
+        ssize_t n = read(client, req + len, sizeof(req) - 1 - len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        if (memchr(req, '\n', len) != NULL) {
+            break;
+        }
+    }
+    req[len] = '\0';
+
+    char *nl;
+    if ((nl = strchr(req, '\n')) == NULL) {
+        return 0;
+    }
+    *nl = '\0';
+
+    if (strcmp(req, "stop") == 0) {
+        return 1;
+    }
+    if (strncmp(req, "query ", 6) == 0) {
+        if (fsm_drain_events(st) == 0) {
+            fsm_answer_query(st, client, req + 6);
+        }
+    }
+    return 0;
+}
+
+int fsm_bind_socket(const git_repo *repo) {
+    struct sockaddr_un addr;
+    if (fsm_sock_path(repo, &addr) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (errno != EADDRINUSE) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+
+        int other;
+        if ((other = fsm_sock_connect(repo)) != -1) {
+            fprintf(stderr, "ERROR: fsmonitor is already running\n");
+            close(other);
+            close(fd);
+            return -1;
+        }
+
+        // stale socket left by a daemon that did not shut down cleanly
+        unlink(addr.sun_path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, 16) != 0) {
+        perror("listen");
+        close(fd);
+        unlink(addr.sun_path);
+        return -1;
+    }
+    return fd;
+}
+
+int fsmonitor_run(const git_repo *repo) {
+    int listen_fd = fsm_bind_socket(repo);
+    if (listen_fd == -1) {
+        return -1;
+    }
+
+    fsm_state st;
+    memset(&st, 0, sizeof(st));
+    snprintf(st.root, PATH_MAX, "%s", repo->root_path);
+    snprintf(st.instance, sizeof(st.instance), "%lx%x", (unsigned long)time(NULL), (unsigned int)getpid());
+    st.num_buckets = 1024;
+    st.buckets = calloc(st.num_buckets, sizeof(fsm_node *));
+    st.wd_capacity = 64;
+    st.wd_paths = calloc(st.wd_capacity, sizeof(char *));
+
+    if ((st.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        perror("inotify_init1");
+        close(listen_fd);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    st.root_wd = inotify_add_watch(st.inotify_fd, st.root, FSM_WATCH_MASK);
+    fsm_watch_recursive(&st, "");
+    printf("fsmonitor: watching %s\n", st.root);
+    fflush(stdout);
+
+    struct pollfd fds[2] = {
+        { .fd = st.inotify_fd, .events = POLLIN },
+        { .fd = listen_fd, .events = POLLIN },
+    };
+
+    int stop = 0;
+    while (!stop) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if ((fds[0].revents & POLLIN) && fsm_drain_events(&st) != 0) {
+            printf("fsmonitor: repository root removed, exiting\n");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client != -1) {
+                stop = fsm_handle_client(&st, client);
+                close(client);
+            }
+        }
+    }
+
+    struct sockaddr_un addr;
+    fsm_sock_path(repo, &addr);
+    unlink(addr.sun_path);
+    close(listen_fd);
+    close(st.inotify_fd);
+
+    fsm_clear_dirty(&st);
+    free(st.buckets);
+    for (int i = 0; i < st.wd_capacity; i++) {
+        free(st.wd_paths[i]);
+    }
+    free(st.wd_paths);
+
+    return 0;
+}
+
+int fsmonitor_stop(const git_repo *repo) {
+    int fd;
+    if ((fd = fsm_sock_connect(repo)) == -1) {
+        return -1;
+    }
+    int rc = fsm_write_all(fd, "stop\n", 5);
+    close(fd);
+    return rc;
+}
+
+int fsmonitor_query(const git_repo *repo, const char *since_token, fsmonitor_changes *out) {
+    int fd;
+    if ((fd = fsm_sock_connect(repo)) == -1) {
+        return -1;
+    }
+
+    char req[FSMONITOR_TOKEN_SIZE + 16];
+    snprintf(req, sizeof(req), "query %s\n", since_token);
+    if (fsm_write_all(fd, req, strlen(req)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap);
+    for (;;) {
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    close(fd);
+
+    // "<token>\n<F|P>\n" followed by NUL terminated paths
+    char *token_end = memchr(buf, '\n', len);
+    if (token_end == NULL || token_end - buf >= FSMONITOR_TOKEN_SIZE
+        || (size_t)(token_end - buf) + 3 > len || token_end[2] != '\n') {
+        free(buf);
+        return -1;
+    }
+
+    memcpy(out->token, buf, token_end - buf);
+    out->token[token_end - buf] = '\0';
+    out->full_scan = token_end[1] == 'F';
+    out->num_paths = 0;
+    out->paths = NULL;
+
+    int capacity = 0;
+    char *p = token_end + 3;
+    while (p < buf + len) {
+        char *end = memchr(p, '\0', buf + len - p);
+        if (end == NULL) {
+            break;
+        }
+        if (out->num_paths >= capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            out->paths = realloc(out->paths, capacity * sizeof(char *));
+        }
+        out->paths[out->num_paths++] = strdup(p);
+        p = end + 1;
+    }
+
+    free(buf);
+    return 0;
+}
+
+#else
+
+int fsmonitor_run(const git_repo *repo) {
+    (void)repo;
+    fprintf(stderr, "ERROR: fsmonitor is only supported on Linux\n");
+    return -1;
+}
+
+int fsmonitor_stop(const git_repo *repo) {
+    (void)repo;
+    return -1;
+}
+
+int fsmonitor_query(const git_repo *repo, const char *since_token, fsmonitor_changes *out) {
+    (void)repo;
+    (void)since_token;
+    (void)out;
+    return -1;
+}
+
+#endif
+
+void free_fsmonitor_changes(fsmonitor_changes *changes) {
+    for (int i = 0; i < changes->num_paths; i++) {
+        free(changes->paths[i]);
+    }
+    free(changes->paths);
+    changes->paths = NULL;
+    changes->num_paths = 0;
+}
+
+void fsm_invalidate_all(git_dircache *dircache) {
+    for (int i = 0; i < dircache->num_entries; i++) {
+        dircache->entries[i]->fsm_valid = 0;
+    }
+}
+
+int fsmonitor_refresh_dircache(const git_repo *repo, git_dircache *dircache) {
+    fsmonitor_changes changes;
+    if (fsmonitor_query(repo, dircache->fsmonitor_token, &changes) != 0) {
+        dircache->fsmonitor_token[0] = '\0';
+        fsm_invalidate_all(dircache);
+        return 0;
+    }
+
+    if (changes.full_scan) {
+        fsm_invalidate_all(dircache);
+    }
+
+    for (int i = 0; i < changes.num_paths; i++) {
+        const char *path = changes.paths[i];
+        size_t len = strlen(path);
+        int is_dir = len > 0 && path[len - 1] == '/';
+
+        // root directory itself changed, e.g. it was moved
+        if (len == 0) {
+            fsm_invalidate_all(dircache);
+            break;
+        }
+
+        int pos = index_lower_bound(dircache, path);
+        while (pos < dircache->num_entries) {
+            git_index_entry *entry = dircache->entries[pos];
+            if (is_dir ? strncmp(entry->name, path, len) != 0 : strcmp(entry->name, path) != 0) {
+                break;
+            }
+            entry->fsm_valid = 0;
+            pos++;
+        }
+    }
+
+    snprintf(dircache->fsmonitor_token, FSMONITOR_TOKEN_SIZE, "%s", changes.token);
+    free_fsmonitor_changes(&changes);
+    return 1;
+}
@@ -0,0 +1,426 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "objects.h"
+#include "dircache.h"
+#include "refs.h"
+#include "threadpool.h"
+#include "bitmap.h"
+#include "gc.h"
+
+#define HEX_DIGITS "0123456789abcdef"
+
+// objects of one fan-out folder, listed by one task
+typedef struct list_task {
+    const git_repo *repo;
+    int byte;
+    loose_object *objects;
+    int num_objects;
+    int capacity;
+    atomic_int *failed;
+} list_task;
+
+int loose_object_cmp(const void *a, const void *b) {
+    return strcmp(((const loose_object *)a)->hash, ((const loose_object *)b)->hash);
+}
+
+void list_task_run(void *arg) {
+    list_task *task = arg;
+    char prefix[3], path[PATH_MAX];
+    snprintf(prefix, sizeof(prefix), "%02x", task->byte);
+    fs_path_join(task->repo->objects_path, prefix, path);
+
+    // no folder means no objects with this prefix
+    fs_dir *dir = fs_dir_open(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    fs_dirent entry;
+    int res;
+    while ((res = fs_dir_next(dir, &entry)) == 1) {
+        // temporary files of objects being written are skipped
+        if (entry.de_namelen != OBJ_HASH_SIZE - 3 || strspn(entry.de_name, HEX_DIGITS) != entry.de_namelen) {
+            continue;
+        }
+        fs_statinfo st;
+        if (fs_dir_getinfo(dir, entry.de_name, &st) != 0) {
+            continue;
+        }
+        if (task->num_objects == task->capacity) {
+            task->capacity = task->capacity == 0 ? 64 : task->capacity * 2;
+            task->objects = realloc(task->objects, task->capacity * sizeof(loose_object));
+        }
+        loose_object *object = &task->objects[task->num_objects++];
+        snprintf(object->hash, OBJ_HASH_SIZE, "%s%s", prefix, entry.de_name);
+        object->mtime = st.fi_mtime;
+    }
+    if (res == -1) {
+        printf("ERROR: could not read %s\n", path);
+        atomic_store(task->failed, 1);
+    }
+    fs_dir_close(dir);
+
+    if (task->num_objects > 1) {
+        qsort(task->objects, task->num_objects, sizeof(loose_object), loose_object_cmp);
+    }
+}
+
+int list_loose_objects(const git_repo *repo, loose_objects *out) {
+    memset(out, 0, sizeof(*out));
+    threadpool *pool = threadpool_create(0);
+    if (pool == NULL) {
+        return -1;
+    }
+
+    atomic_int failed;
+    atomic_init(&failed, 0);
+    list_task *tasks = calloc(256, sizeof(list_task));
+    for (int b = 0; b < 256; b++) {
+        tasks[b].repo = repo;
+        tasks[b].byte = b;
+        tasks[b].failed = &failed;
+        threadpool_submit(pool, list_task_run, &tasks[b]);
+    }
+    threadpool_destroy(pool);
+
+    // folders are listed in hash order, so joining them keeps objects sorted
+    int total = 0;
+    for (int b = 0; b < 256; b++) {
+        total += tasks[b].num_objects;
+    }
+    out->objects = malloc((total > 0 ? total : 1) * sizeof(loose_object));
+    for (int b = 0; b < 256; b++) {
+        out->fanout[b] = out->num_objects;
+        if (tasks[b].num_objects > 0) {
+            memcpy(out->objects + out->num_objects, tasks[b].objects, tasks[b].num_objects * sizeof(loose_object));
+        }
+        out->num_objects += tasks[b].num_objects;
+        free(tasks[b].objects);
+    }
+    out->fanout[256] = out->num_objects;
+    free(tasks);
+
+    if (atomic_load(&failed)) {
+        free_loose_objects(out);
+        return -1;
+    }
+    return 0;
+}
+
+int find_loose_object(const loose_objects *objects, const char *hash) {
+    char prefix[3] = { hash[0], hash[0] != '\0' ? hash[1] : '\0', '\0' };
+    if (strlen(prefix) != 2 || strspn(prefix, HEX_DIGITS) != 2) {
+        return -1;
+    }
+
+    int byte = (int)strtol(prefix, NULL, 16);
+    int left = objects->fanout[byte], right = objects->fanout[byte + 1];
+    while (left < right) {
+        int mid = left + (right - left) / 2;
+        int cmp = strcmp(objects->objects[mid].hash, hash);
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return -1;
+}
+
+void free_loose_objects(loose_objects *objects) {
+    free(objects->objects);
+    objects->objects = NULL;
+    objects->num_objects = 0;
+}
+
+int is_reachable(const reach_word *bits, int pos) {
+    return (atomic_load(&bits[pos / 64]) >> (pos % 64)) & 1;
+}
+
+typedef struct mark_ctx {
+    const git_repo *repo;
+    const loose_objects *objects;
+    reach_word *bits;
+    threadpool *pool;
+    atomic_int failed;
+    reach_bitmaps *bitmaps; // NULL if repo has none
+    int *bitmap_to_loose; // loose position of each bitmap object, -1 if it is gone
+} mark_ctx;
+
+typedef struct mark_task {
+    mark_ctx *ctx;
+    int pos;
+} mark_task;
+
+void mark_task_run(void *arg);
+
+// Marks every object in the bitmap of `hash`, which hold everything reachable from it.
+// @return 1 if `hash` has a bitmap, 0 if it has to be read
+int mark_from_bitmap(mark_ctx *ctx, const char *hash) {
+    if (!reach_bitmaps_has(ctx->bitmaps, hash)) {
+        return 0;
+    }
+    size_t num_words = ((size_t)ctx->bitmaps->num_objects + 63) / 64;
+    uint64_t *bitmap = calloc(num_words + 1, sizeof(uint64_t));
+    if (reach_bitmaps_or(ctx->bitmaps, hash, bitmap) != 1) {
+        free(bitmap);
+        return 0;
+    }
+
+    for (size_t w = 0; w < num_words; w++) {
+        for (uint64_t word = bitmap[w]; word != 0; word &= word - 1) {
+            int pos = ctx->bitmap_to_loose[w * 64 + __builtin_ctzll(word)];
+            if (pos >= 0) {
+                atomic_fetch_or(&ctx->bits[pos / 64], (uint64_t)1 << (pos % 64));
+            }
+        }
+    }
+    free(bitmap);
+    return 1;
+}
+
+// Sets bit of `hash`, and queues it to be read if it was not set yet and may point to more objects.
+void mark_object(mark_ctx *ctx, const char *hash, int is_blob) {
+    int pos = find_loose_object(ctx->objects, hash);
+    if (pos < 0) {
+        printf("ERROR: reachable object %s is missing\n", hash);
+        atomic_store(&ctx->failed, 1);
+        return;
+    }
+
+    uint64_t bit = (uint64_t)1 << (pos % 64);
+    if ((atomic_fetch_or(&ctx->bits[pos / 64], bit) & bit) != 0 || is_blob
+        || (ctx->bitmaps != NULL && mark_from_bitmap(ctx, hash))) {
+        return;
+    }
+    mark_task *task = malloc(sizeof(*task));
+    task->ctx = ctx;
+    task->pos = pos;
+    threadpool_submit(ctx->pool, mark_task_run, task);
+}
+
+// marks hashes following `key` on header lines of a commit or tag, up to the blank line
+void mark_header_lines(mark_ctx *ctx, const char *body, const char *end, const char *key) {
+    size_t key_len = strlen(key);
+    const char *line = body;
+    while (line < end && *line != '\n') {
+        const char *eol = memchr(line, '\n', end - line);
+        eol = eol != NULL ? eol : end;
+        if ((size_t)(eol - line) >= key_len + OBJ_HASH_SIZE - 1 && strncmp(line, key, key_len) == 0) {
+            obj_hash hash;
+            snprintf(hash, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, line + key_len);
+            mark_object(ctx, hash, 0);
+        }
+        line = eol + 1;
+    }
+}
+
+void mark_task_run(void *arg) {
+    mark_task *task = arg;
+    mark_ctx *ctx = task->ctx;
+    const char *hash = ctx->objects->objects[task->pos].hash;
+    free(task);
+    if (atomic_load(&ctx->failed)) {
+        return;
+    }
+
+    size_t size;
+    unsigned char *data = create_obj_from_disk(ctx->repo, hash, &size);
+    if (data == NULL) {
+        atomic_store(&ctx->failed, 1);
+        return;
+    }
+
+    const char *body = (const char *)data + strlen((char *)data) + 1;
+    const char *end = (const char *)data + size;
+    if (strncmp((char *)data, O_TYPE_COMMIT " ", 7) == 0) {
+        mark_header_lines(ctx, body, end, "tree ");
+        mark_header_lines(ctx, body, end, "parent ");
+    } else if (strncmp((char *)data, O_TYPE_TREE " ", 5) == 0) {
+        // the object is already read, so the iterator only points into it
+        tree_iter iter = { NULL, body, end };
+        tree_iter_entry entry;
+        int res;
+        while ((res = tree_iter_next(&iter, &entry)) == 1) {
+            mark_object(ctx, entry.hash, entry.type == BLOB_OBJ);
+        }
+        if (res == -1) {
+            printf("ERROR: tree %s is malformed\n", hash);
+            atomic_store(&ctx->failed, 1);
+        }
+    } else if (strncmp((char *)data, O_TYPE_TAG " ", 4) == 0) {
+        mark_header_lines(ctx, body, end, "object ");
+    }
+    free(data);
+}
+
+// @return 0 on success, -1 if the thread pool could not be started
+int mark_ctx_init(mark_ctx *ctx, const git_repo *repo, const loose_objects *objects, reach_word *bits) {
+    ctx->repo = repo;
+    ctx->objects = objects;
+    ctx->bits = bits;
+    atomic_init(&ctx->failed, 0);
+    ctx->bitmap_to_loose = NULL;
+    if ((ctx->pool = threadpool_create(0)) == NULL) {
+        return -1;
+    }
+
+    // both lists are sorted by hash, so one merge pass maps bitmap positions to loose ones
+    if ((ctx->bitmaps = reach_bitmaps_open(repo)) != NULL) {
+        ctx->bitmap_to_loose = malloc(((size_t)ctx->bitmaps->num_objects + 1) * sizeof(int));
+        int pos = 0;
+        for (uint32_t i = 0; i < ctx->bitmaps->num_objects; i++) {
+            obj_hash hash;
+            reach_bitmaps_hash(ctx->bitmaps, i, &hash);
+            while (pos < objects->num_objects && strcmp(objects->objects[pos].hash, hash) < 0) {
+                pos++;
+            }
+            ctx->bitmap_to_loose[i] = pos < objects->num_objects && strcmp(objects->objects[pos].hash, hash) == 0 ? pos : -1;
+        }
+    }
+    return 0;
+}
+
+// @return 0 if every object was marked, -1 otherwise
+int mark_ctx_finish(mark_ctx *ctx) {
+    threadpool_destroy(ctx->pool);
+    if (ctx->bitmaps != NULL) {
+        reach_bitmaps_close(ctx->bitmaps);
+    }
+    free(ctx->bitmap_to_loose);
+    return atomic_load(&ctx->failed) ? -1 : 0;
+}
+
+int mark_reachable_from(const git_repo *repo, const loose_objects *objects, const obj_hash *tips, int num_tips, reach_word *bits) {
+    mark_ctx ctx;
+    if (mark_ctx_init(&ctx, repo, objects, bits) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < num_tips; i++) {
+        mark_object(&ctx, tips[i], 0);
+    }
+    return mark_ctx_finish(&ctx);
+}
+
+int mark_reachable_objects(const git_repo *repo, const loose_objects *objects, reach_word *bits) {
+    mark_ctx ctx;
+    if (mark_ctx_init(&ctx, repo, objects, bits) != 0) {
+        return -1;
+    }
+
+    ref_list refs;
+    obj_hash hash;
+    if (list_refs(repo, &refs) != 0) {
+        atomic_store(&ctx.failed, 1);
+    } else {
+        for (int i = 0; i < refs.num_refs; i++) {
+            mark_object(&ctx, refs.refs[i].hash, 0);
+        }
+        free_ref_list(&refs);
+    }
+    int res = resolve_head(repo, &hash, NULL);
+    if (res == 0) {
+        mark_object(&ctx, hash, 0);
+    } else if (res == -1) {
+        atomic_store(&ctx.failed, 1);
+    }
+    if (read_ref(repo, MERGE_HEAD_NAME, &hash) == 0) {
+        mark_object(&ctx, hash, 0);
+    }
+
+    // staged blobs, including conflict stages, are not in any tree yet
+    git_dircache *dircache = create_dircache(repo);
+    if (dircache == NULL) {
+        atomic_store(&ctx.failed, 1);
+    } else {
+        for (int i = 0; i < dircache->num_entries; i++) {
+            mark_object(&ctx, dircache->entries[i]->hash, 1);
+        }
+        free_dircache(dircache);
+    }
+
+    return mark_ctx_finish(&ctx);
+}
+
+typedef struct sweep_task {
+    const git_repo *repo;
+    const loose_objects *objects;
+    const reach_word *bits;
+    int byte;
+    time_t expire;
+    atomic_int *num_recent, *num_pruned, *failed;
+} sweep_task;
+
+void sweep_task_run(void *arg) {
+    sweep_task *task = arg;
+    const loose_objects *objects = task->objects;
+    for (int i = objects->fanout[task->byte]; i < objects->fanout[task->byte + 1]; i++) {
+        if (is_reachable(task->bits, i)) {
+            continue;
+        }
+        // checked again right before deleting, in case it was written again since listing
+        char path[PATH_MAX];
+        fs_statinfo st;
+        obj_path(task->repo, objects->objects[i].hash, path);
+        if (objects->objects[i].mtime >= task->expire
+            || (fs_getinfo(path, &st) == 0 && st.fi_mtime >= task->expire)) {
+            atomic_fetch_add(task->num_recent, 1);
+        } else if (delete_obj_from_disk(task->repo, objects->objects[i].hash) == 0) {
+            atomic_fetch_add(task->num_pruned, 1);
+        } else {
+            atomic_store(task->failed, 1);
+        }
+    }
+}
+
+int gc_prune(const git_repo *repo, time_t expire, gc_stats *out) {
+    memset(out, 0, sizeof(*out));
+    loose_objects objects;
+    if (list_loose_objects(repo, &objects) != 0) {
+        return -1;
+    }
+    out->num_objects = objects.num_objects;
+
+    reach_word *bits = calloc(REACH_WORDS(objects.num_objects) + 1, sizeof(reach_word));
+    if (mark_reachable_objects(repo, &objects, bits) != 0) {
+        printf("ERROR: could not mark reachable objects, nothing was pruned\n");
+        free(bits);
+        free_loose_objects(&objects);
+        return -1;
+    }
+    for (int i = 0; i < objects.num_objects; i++) {
+        out->num_reachable += is_reachable(bits, i);
+    }
+
+    threadpool *pool = threadpool_create(0);
+    if (pool == NULL) {
+        free(bits);
+        free_loose_objects(&objects);
+        return -1;
+    }
+    atomic_int num_recent, num_pruned, failed;
+    atomic_init(&num_recent, 0);
+    atomic_init(&num_pruned, 0);
+    atomic_init(&failed, 0);
+    sweep_task *tasks = malloc(256 * sizeof(sweep_task));
+    for (int b = 0; b < 256; b++) {
+        sweep_task task = { repo, &objects, bits, b, expire, &num_recent, &num_pruned, &failed };
+        tasks[b] = task;
+        threadpool_submit(pool, sweep_task_run, &tasks[b]);
+    }
+    threadpool_destroy(pool);
+    free(tasks);
+    free(bits);
+    free_loose_objects(&objects);
+
+    out->num_recent = atomic_load(&num_recent);
+    out->num_pruned = atomic_load(&num_pruned);
+    return atomic_load(&failed) ? -1 : 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
 #include <zlib.h>
 
 #include "filesystem.h"
@@ -9,6 +10,26 @@
 #include "repo.h"
 #include "dircache.h"
 #include "filespec.h"
+#include "fsmonitor.h"
+#include "pathspec.h"
+#include "status.h"
+#include "refs.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "revwalk.h"
+#include "mergebase.h"
+#include "unpack.h"
+#include "checkout.h"
+#include "treediff.h"
+#include "linediff.h"
+#include "rename.h"
+#include "merge.h"
+#include "replay.h"
+#include "gc.h"
+#include "bitmap.h"
+#include "fsck.h"
+#include "clone.h"
+#include "fetch.h"
 
 int main(int argc, char* argv[]) {
     if (argc <= 1) {
@@ -39,6 +60,21 @@ int main(int argc, char* argv[]) {
         return 0;
     }
     
+    if (strcmp(command, "clone") == 0) {
+        if (argc != 4) {
+            printf("usage: gordit clone <repository> <directory>\n");
+            return 1;
+        }
+        clone_stats stats;
+        int res = clone_repo(argv[2], argv[3], &stats);
+        if (res != 0) {
+            return res < 0 ? 128 : 1;
+        }
+        printf("Cloned %d objects (%d linked, %d copied), %d refs, checked out %d files\n", stats.num_objects,
+            stats.objects.linked, stats.objects.copied, stats.num_refs, stats.checkout.written);
+        return 0;
+    }
+
     int ret_code = 0;
 
     const git_repo *repo = get_working_repo(cwd);
@@ -53,40 +89,49 @@ int main(int argc, char* argv[]) {
             goto end;
         }
         int num_args = argc - 2;
-        if (!is_file_args_valid(repo, argv + 2, num_args)) { 
-            ret_code = 1;
-            goto end;
-        }
 
         git_dircache *dircache = create_dircache(repo);
-        for (int i = 0; i < num_args; i++) {
-            struct fileinfo *info;
-            if ((info = start_fileinfo(repo, argv[2 + i], "rb")) == NULL) {
+        pathspec_list spec;
+        if (strcmp(command, "add") == 0) {
+            if (pathspec_resolve_worktree(repo, cwd, dircache, argv + 2, num_args, &spec) != 0) {
                 ret_code = 1;
-                printf("ERROR: could not open file: %s\n", argv[2 + i]);
                 goto add_end;
             }
 
-            if (strcmp(command, "add") == 0 && is_file_ignored(repo, info)) {
-                printf("NOTE: file is ignored: %s\n", argv[2 + i]);
-                continue;
-            }
-            
-            if (strcmp(command, "add") == 0) {
-                if (add_file_to_dc(dircache, info) != 0) {
-                    printf("ERROR: could not add file: %s\n", argv[2 + i]);
-                    end_fileinfo(info);
-                    goto add_end;
+            int fsm_active = fsmonitor_refresh_dircache(repo, dircache);
+            char **names = malloc((spec.num_paths + 1) * sizeof(char *));
+            int num_names = 0;
+
+            for (int i = 0; i < spec.num_paths; i++) {
+                git_index_entry *entry;
+                // fsmonitor saw no change since entry's stat info was recorded, skip stat and hashing
+                if (fsm_active && (entry = find_index_entry(dircache, spec.paths[i])) != NULL && entry->fsm_valid) {
+                    continue;
                 }
-            } else {
-                if (remove_file_from_dc(dircache, info) != 0) {
-                    printf("ERROR: could not find file: %s\n", argv[2 + i]);
-                    end_fileinfo(info);
-                    goto add_end;
+                names[num_names++] = spec.paths[i];
+            }
+
+            int failed = add_files_to_dc(repo, dircache, names, num_names);
+            for (int i = 0; !failed && fsm_active && i < num_names; i++) {
+                git_index_entry *entry;
+                if ((entry = find_index_entry(dircache, names[i])) != NULL) {
+                    entry->fsm_valid = 1;
                 }
             }
+            free(names);
+            free_pathspec_list(&spec);
 
-            end_fileinfo(info);
+            if (failed) {
+                ret_code = 1;
+                goto add_end;
+            }
+        } else {
+            if (pathspec_resolve_index(repo, cwd, dircache, argv + 2, num_args, &spec) != 0) {
+                ret_code = 1;
+                goto add_end;
+            }
+            remove_files_from_dc(dircache, spec.paths, spec.num_paths);
+            free_pathspec_list(&spec);
         }
 
         write_index(repo, dircache); 
@@ -94,13 +139,797 @@ int main(int argc, char* argv[]) {
 
 add_end:;  
         free_dircache(dircache);  
+    } else if (strcmp(command, "fsmonitor") == 0) {
+        if (argc > 2 && strcmp(argv[2], "stop") == 0) {
+            if (fsmonitor_stop(repo) != 0) {
+                printf("fsmonitor is not running.\n");
+            }
+        } else if (fsmonitor_run(repo) != 0) {
+            ret_code = 1;
+        }
+    } else if (strcmp(command, "status") == 0) {
+        git_dircache *dircache = create_dircache(repo);
+        git_status status;
+        if (dircache == NULL || collect_status(repo, dircache, &status) != 0) {
+            printf("ERROR: could not get status\n");
+            ret_code = 1;
+        } else {
+            print_status(&status);
+            // saves rehashing the same files next time
+            if (status.index_refreshed) {
+                write_index(repo, dircache);
+            }
+            free_status(&status);
+        }
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
     } else if (strcmp(command, "commit") == 0) {
+        if (argc <= 3 || strcmp(argv[2], "-m") != 0) {
+            printf("usage: gordit commit -m <message>\n");
+            ret_code = 1;
+            goto end;
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        obj_hash commit_hash;
+        int res = dircache != NULL ? commit_index(repo, dircache, argv[3], &commit_hash) : -1;
+        if (res == 1) {
+            printf("nothing to commit\n");
+            ret_code = 1;
+        } else if (res == -1) {
+            printf("ERROR: could not create commit\n");
+            ret_code = 1;
+        } else {
+            obj_hash head;
+            char ref_name[PATH_MAX];
+            resolve_head(repo, &head, ref_name);
+            const char *branch = strrchr(ref_name, '/');
+            printf("[%s %.7s] %.*s\n", branch != NULL ? branch + 1 : "detached HEAD", commit_hash,
+                (int)strcspn(argv[3], "\n"), argv[3]);
+        }
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
+    } else if (strcmp(command, "commit-graph") == 0) {
+        if (argc <= 2 || strcmp(argv[2], "write") != 0) {
+            printf("usage: gordit commit-graph write\n");
+            ret_code = 1;
+        } else if (write_commit_graph(repo) != 0) {
+            ret_code = 1;
+        }
+    } else if (strcmp(command, "bitmap") == 0) {
+        if (argc <= 2 || strcmp(argv[2], "write") != 0) {
+            printf("usage: gordit bitmap write\n");
+            ret_code = 1;
+        } else if (write_reach_bitmaps(repo) != 0) {
+            ret_code = 1;
+        }
+    } else if (strcmp(command, "log") == 0) {
+        long max_count = -1;
+        int first_parent = 0, oneline = 0, num_revs = 0;
+        revwalk_order order = REVWALK_DATE_ORDER;
+        const char *path = NULL;
+        char **revs = malloc(argc * sizeof(char *));
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+                max_count = strtol(argv[++i], NULL, 10);
+            } else if (strncmp(argv[i], "--max-count=", 12) == 0) {
+                max_count = strtol(argv[i] + 12, NULL, 10);
+            } else if (strcmp(argv[i], "--first-parent") == 0) {
+                first_parent = 1;
+            } else if (strcmp(argv[i], "--topo-order") == 0) {
+                order = REVWALK_TOPO_ORDER;
+            } else if (strcmp(argv[i], "--date-order") == 0) {
+                order = REVWALK_DATE_ORDER;
+            } else if (strcmp(argv[i], "--oneline") == 0) {
+                oneline = 1;
+            } else if (strcmp(argv[i], "--") == 0 && i + 2 == argc) {
+                path = argv[++i];
+            } else if (argv[i][0] != '-') {
+                revs[num_revs++] = argv[i];
+            } else {
+                printf("usage: gordit log [-n <count>] [--first-parent] [--topo-order | --date-order] "
+                    "[--oneline] [<rev> | <rev>..<rev>]... [-- <path>]\n");
+                free(revs);
+                ret_code = 1;
+                goto end;
+            }
+        }
+
+        revwalk *walk = revwalk_create(repo, order, first_parent);
+        int num_pushed = 0;
+        for (int i = 0; i < num_revs && ret_code == 0; i++) {
+            char *dots = strstr(revs[i], "..");
+            obj_hash hash;
+            if (dots != NULL) {
+                // A..B is B without what is reachable from A, either side defaults to HEAD
+                *dots = '\0';
+                const char *from = revs[i][0] != '\0' ? revs[i] : HEAD_NAME;
+                const char *to = dots[2] != '\0' ? dots + 2 : HEAD_NAME;
+                if (resolve_rev(repo, from, &hash) != 0 || revwalk_hide(walk, hash) != 0
+                    || resolve_rev(repo, to, &hash) != 0 || revwalk_push(walk, hash) != 0) {
+                    ret_code = 1;
+                }
+                num_pushed++;
+            } else if (revs[i][0] == '^') {
+                if (resolve_rev(repo, revs[i] + 1, &hash) != 0 || revwalk_hide(walk, hash) != 0) {
+                    ret_code = 1;
+                }
+            } else {
+                if (resolve_rev(repo, revs[i], &hash) != 0 || revwalk_push(walk, hash) != 0) {
+                    ret_code = 1;
+                }
+                num_pushed++;
+            }
+            if (ret_code != 0) {
+                printf("fatal: bad revision '%s'\n", revs[i]);
+            }
+        }
+        free(revs);
+
+        if (ret_code == 0 && num_pushed == 0) {
+            obj_hash head;
+            char ref_name[PATH_MAX];
+            int res = resolve_head(repo, &head, ref_name);
+            if (res == 1) {
+                printf("fatal: your current branch does not have any commits yet\n");
+                ret_code = 1;
+            } else if (res == -1 || revwalk_push(walk, head) != 0) {
+                ret_code = 1;
+            }
+        }
+        if (ret_code == 0 && path != NULL) {
+            // relative to cwd, like the paths given to add and rm
+            char limit[PATH_MAX];
+            if (pathspec_canonicalize(repo, cwd, path, limit) != 0) {
+                printf("ERROR: file is not part of repo: %s\n", path);
+                ret_code = 1;
+            } else if (limit[0] != '\0') {
+                revwalk_limit_path(walk, limit);
+            }
+        }
+
+        // commits are printed as they come out of the walk, so the first ones show up immediately
+        obj_hash hash;
+        int res = 0;
+        for (long count = 0; ret_code == 0 && count != max_count && (res = revwalk_next(walk, &hash, NULL)) == 1; count++) {
+            if (print_commit(repo, hash, oneline) != 0) {
+                ret_code = 1;
+            }
+        }
+        if (res == -1) {
+            printf("ERROR: could not walk history\n");
+            ret_code = 1;
+        }
+        revwalk_free(walk);
+    } else if (strcmp(command, "merge-base") == 0) {
+        int all = 0, octopus = 0, ancestor = 0, num_commits = 0;
+        obj_hash *commits = malloc(argc * sizeof(obj_hash));
+        for (int i = 2; i < argc && ret_code == 0; i++) {
+            if (strcmp(argv[i], "--all") == 0) {
+                all = 1;
+            } else if (strcmp(argv[i], "--octopus") == 0) {
+                octopus = 1;
+            } else if (strcmp(argv[i], "--is-ancestor") == 0) {
+                ancestor = 1;
+            } else if (resolve_rev(repo, argv[i], &commits[num_commits++]) != 0) {
+                printf("fatal: not a valid object name %s\n", argv[i]);
+                ret_code = 1;
+            }
+        }
+        if (ret_code == 0 && (ancestor ? num_commits != 2 : num_commits < (octopus ? 1 : 2))) {
+            printf("usage: gordit merge-base [--all | --octopus] <commit> <commit>...\n"
+                "       gordit merge-base --is-ancestor <commit> <commit>\n");
+            ret_code = 1;
+        }
+
+        merge_base_list bases;
+        if (ret_code == 0 && ancestor) {
+            // answered by exit code only, like git
+            int res = is_ancestor(repo, commits[0], commits[1]);
+            ret_code = res == 1 ? 0 : res == 0 ? 1 : 128;
+        } else if (ret_code == 0) {
+            int res = octopus ? find_octopus_bases(repo, commits, num_commits, &bases)
+                : find_merge_bases(repo, commits[0], commits + 1, num_commits - 1, &bases);
+            if (res != 0) {
+                ret_code = 128;
+            } else {
+                for (int i = 0; i < bases.num_bases && (all || i == 0); i++) {
+                    printf("%s\n", bases.bases[i]);
+                }
+                ret_code = bases.num_bases > 0 ? 0 : 1;
+                free_merge_bases(&bases);
+            }
+        }
+        free(commits);
+    } else if (strcmp(command, "checkout") == 0) {
+        int flags = 0;
+        const char *rev = NULL, *new_branch = NULL;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--force") == 0) {
+                flags |= CHECKOUT_FORCE;
+            } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc && new_branch == NULL) {
+                new_branch = argv[++i];
+            } else if (argv[i][0] != '-' && rev == NULL) {
+                rev = argv[i];
+            } else {
+                rev = NULL;
+                new_branch = NULL;
+                break;
+            }
+        }
+        if (rev == NULL && new_branch == NULL) {
+            printf("usage: gordit checkout [-f] [-b <new-branch>] <branch | commit>\n");
+            ret_code = 1;
+            goto end;
+        }
+
+        // a branch name attaches HEAD to it, anything else detaches HEAD
+        char branch_ref[PATH_MAX] = "";
+        obj_hash commit, tree;
+        if (new_branch != NULL) {
+            snprintf(branch_ref, sizeof(branch_ref), "refs/heads/%s", new_branch);
+            if (read_ref(repo, branch_ref, &commit) != 1) {
+                printf("fatal: a branch named '%s' already exists\n", new_branch);
+                ret_code = 1;
+                goto end;
+            }
+        } else if (strncmp(rev, "refs/heads/", 11) == 0 && read_ref(repo, rev, &commit) == 0) {
+            snprintf(branch_ref, sizeof(branch_ref), "%s", rev);
+        } else {
+            snprintf(branch_ref, sizeof(branch_ref), "refs/heads/%s", rev);
+            if (read_ref(repo, branch_ref, &commit) != 0) {
+                branch_ref[0] = '\0';
+            }
+        }
+        if (resolve_rev(repo, rev != NULL ? rev : HEAD_NAME, &commit) != 0 || read_commit_tree(repo, commit, &tree) != 0) {
+            printf("fatal: invalid reference: %s\n", rev != NULL ? rev : HEAD_NAME);
+            ret_code = 1;
+            goto end;
+        }
+
+        obj_hash head, head_tree;
+        const char *current = NULL;
+        if (resolve_head(repo, &head, NULL) == 0 && read_commit_tree(repo, head, &head_tree) == 0) {
+            current = head_tree;
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        checkout_stats stats;
+        int res = dircache != NULL ? checkout_tree(repo, dircache, current, tree, flags, &stats) : -1;
+        if (res == 1) {
+            printf("Please commit your changes before you switch branches.\nAborting\n");
+            ret_code = 1;
+        } else if (res == -1) {
+            printf("ERROR: could not check out %s\n", commit);
+            ret_code = 1;
+        } else if (write_index(repo, dircache) != 0
+            || (new_branch != NULL && update_ref(repo, branch_ref, commit, "") != 0)
+            || set_head(repo, branch_ref[0] != '\0' ? branch_ref : NULL, commit) != 0) {
+            ret_code = 1;
+        } else {
+            if (stats.failed > 0) {
+                printf("%d files could not be written\n", stats.failed);
+                ret_code = 1;
+            }
+            if (new_branch != NULL) {
+                printf("Switched to a new branch '%s'\n", new_branch);
+            } else if (branch_ref[0] != '\0') {
+                printf("Switched to branch '%s'\n", branch_ref + 11);
+            } else {
+                printf("HEAD is now at %.7s\n", commit);
+            }
+        }
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
+    } else if (strcmp(command, "read-tree") == 0) {
+        int merge = 0, update = 0, num_trees = 0;
+        obj_hash trees[UNPACK_MAX_TREES];
+        const char *tree_ptrs[UNPACK_MAX_TREES];
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-m") == 0) {
+                merge = 1;
+            } else if (strcmp(argv[i], "-u") == 0) {
+                update = 1;
+            } else if (argv[i][0] != '-' && num_trees < UNPACK_MAX_TREES) {
+                if (resolve_tree(repo, argv[i], &trees[num_trees]) != 0) {
+                    printf("fatal: not a tree object: %s\n", argv[i]);
+                    ret_code = 128;
+                    goto end;
+                }
+                tree_ptrs[num_trees] = trees[num_trees];
+                num_trees++;
+            } else {
+                num_trees = 0;
+                break;
+            }
+        }
+        if (num_trees == 0 || (update && !merge) || (num_trees > 1 && !merge)) {
+            printf("usage: gordit read-tree [-m [-u]] <tree-ish> [<tree-ish> [<tree-ish>]]\n");
+            ret_code = 1;
+            goto end;
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        git_dircache target;
+        int res = dircache != NULL ? unpack_trees(repo, dircache, tree_ptrs, num_trees, &target) : -1;
+        if (res == 0) {
+            // without -u the merged index replaces the old one as it is
+            checkout_stats stats = { 0, 0, 0 };
+            if (update) {
+                res = checkout_index(repo, dircache, &target, 0, &stats);
+            } else {
+                replace_dircache_entries(dircache, &target);
+            }
+            clear_dircache(&target);
+
+            if (stats.failed > 0) {
+                printf("%d files could not be written\n", stats.failed);
+                ret_code = 1;
+            }
+        }
+        if (res != 0 || write_index(repo, dircache) != 0) {
+            ret_code = 128;
+        }
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
+    } else if (strcmp(command, "merge") == 0) {
+        merge_options options = { HEAD_NAME, NULL, LINE_DIFF_MYERS };
+        const char *rev = NULL;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--histogram") == 0) {
+                options.algorithm = LINE_DIFF_HISTOGRAM;
+            } else if (argv[i][0] != '-' && rev == NULL) {
+                rev = argv[i];
+            } else {
+                rev = NULL;
+                break;
+            }
+        }
+        if (rev == NULL) {
+            printf("usage: gordit merge [--histogram] <commit>\n");
+            ret_code = 1;
+            goto end;
+        }
+        options.theirs_label = rev;
+
+        obj_hash head, theirs, merge_head, head_tree, theirs_tree, base_tree;
+        char ref_name[PATH_MAX];
+        if (read_ref(repo, MERGE_HEAD_NAME, &merge_head) == 0) {
+            printf("fatal: You have not concluded your merge (MERGE_HEAD exists).\n");
+            ret_code = 128;
+            goto end;
+        }
+        if (resolve_head(repo, &head, ref_name) != 0 || read_commit_tree(repo, head, &head_tree) != 0) {
+            printf("fatal: HEAD does not point to a commit\n");
+            ret_code = 128;
+            goto end;
+        }
+        if (resolve_rev(repo, rev, &theirs) != 0 || read_commit_tree(repo, theirs, &theirs_tree) != 0) {
+            printf("merge: %s - not something we can merge\n", rev);
+            ret_code = 1;
+            goto end;
+        }
+        if (is_ancestor(repo, theirs, head) == 1) {
+            printf("Already up to date.\n");
+            goto end;
+        }
+        merge_base_list bases;
+        if (find_merge_bases(repo, head, &theirs, 1, &bases) != 0) {
+            ret_code = 128;
+            goto end;
+        }
+        if (bases.num_bases == 0) {
+            printf("fatal: refusing to merge unrelated histories\n");
+            free_merge_bases(&bases);
+            ret_code = 128;
+            goto end;
+        }
+        // with several bases from criss-cross merges, the newest is used
+        int fast_forward = strcmp(bases.bases[0], head) == 0;
+        int res = read_commit_tree(repo, bases.bases[0], &base_tree);
+        free_merge_bases(&bases);
+
+        // the merge is done in memory first, the working tree is only updated with its result
+        merge_result result = { "", NULL, 0, 0 };
+        if (res == 0 && !fast_forward) {
+            res = merge_trees(repo, base_tree, head_tree, theirs_tree, &options, &result);
+        }
+        if (res < 0) {
+            printf("ERROR: could not merge %s\n", rev);
+            ret_code = 128;
+            goto end;
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        checkout_stats stats;
+        int checkout_res = dircache != NULL ? checkout_tree(repo, dircache, head_tree, fast_forward ? theirs_tree : result.tree, 0, &stats) : -1;
+        const char *update_to = fast_forward ? theirs : NULL;
+        obj_hash merge_commit;
+        if (checkout_res == 1) {
+            printf("Please commit your changes before you merge.\nAborting\n");
+            ret_code = 1;
+        } else if (checkout_res == -1) {
+            ret_code = 128;
+        } else if (res == 0 && !fast_forward) {
+            obj_hash parents[2];
+            snprintf(parents[0], OBJ_HASH_SIZE, "%s", head);
+            snprintf(parents[1], OBJ_HASH_SIZE, "%s", theirs);
+            char msg[PATH_MAX];
+            snprintf(msg, sizeof(msg), "Merge %s", rev);
+            if (write_commit(repo, result.tree, parents, 2, msg, &merge_commit) == 0) {
+                update_to = merge_commit;
+            } else {
+                ret_code = 128;
+            }
+        } else if (res == 1) {
+            add_merge_conflicts_to_dc(dircache, &result);
+        }
+
+        if (checkout_res == 0) {
+            if (write_index(repo, dircache) != 0
+                || (update_to != NULL && update_ref(repo, ref_name[0] != '\0' ? ref_name : HEAD_NAME, update_to, head) != 0)
+                || (res == 1 && update_ref(repo, MERGE_HEAD_NAME, theirs, NULL) != 0)) {
+                ret_code = 128;
+            } else if (fast_forward) {
+                printf("Updating %.7s..%.7s\nFast-forward\n", head, theirs);
+            } else if (res == 0) {
+                printf("Merge made by the three-way strategy.\n");
+            } else {
+                print_merge_conflicts(&result, HEAD_NAME, rev);
+                printf("Automatic merge failed; fix conflicts and then commit the result.\n");
+                ret_code = 1;
+            }
+            if (stats.failed > 0) {
+                printf("%d files could not be written\n", stats.failed);
+                ret_code = 1;
+            }
+        }
+        free_merge_result(&result);
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
+    } else if (strcmp(command, "cherry-pick") == 0 || strcmp(command, "rebase") == 0) {
+        int rebase = strcmp(command, "rebase") == 0;
+        merge_options options = { HEAD_NAME, NULL, LINE_DIFF_MYERS };
+        const char *upstream = NULL, *newbase = NULL;
+        const char **picks = malloc(argc * sizeof(char *));
+        int num_picks = 0, bad_args = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--histogram") == 0) {
+                options.algorithm = LINE_DIFF_HISTOGRAM;
+            } else if (rebase && strcmp(argv[i], "--onto") == 0 && i + 1 < argc && newbase == NULL) {
+                newbase = argv[++i];
+            } else if (argv[i][0] != '-' && !rebase) {
+                picks[num_picks++] = argv[i];
+            } else if (argv[i][0] != '-' && upstream == NULL) {
+                upstream = argv[i];
+            } else {
+                bad_args = 1;
+            }
+        }
+        if (bad_args || (rebase ? upstream == NULL : num_picks == 0)) {
+            printf(rebase ? "usage: gordit rebase [--histogram] [--onto <newbase>] <upstream>\n"
+                : "usage: gordit cherry-pick [--histogram] <commit>...\n");
+            free(picks);
+            ret_code = 1;
+            goto end;
+        }
+
+        obj_hash head, merge_head, head_tree, onto, tip_tree;
+        char ref_name[PATH_MAX];
+        if (read_ref(repo, MERGE_HEAD_NAME, &merge_head) == 0) {
+            printf("fatal: You have not concluded your merge (MERGE_HEAD exists).\n");
+            free(picks);
+            ret_code = 128;
+            goto end;
+        }
+        if (resolve_head(repo, &head, ref_name) != 0 || read_commit_tree(repo, head, &head_tree) != 0) {
+            printf("fatal: HEAD does not point to a commit\n");
+            free(picks);
+            ret_code = 128;
+            goto end;
+        }
+
+        // commits to replay, oldest first
+        obj_hash *commits = NULL;
+        int num_commits = 0, res = 0;
+        snprintf(onto, OBJ_HASH_SIZE, "%s", head);
+        if (rebase) {
+            obj_hash upstream_hash;
+            if (resolve_rev(repo, upstream, &upstream_hash) != 0
+                || resolve_rev(repo, newbase != NULL ? newbase : upstream, &onto) != 0) {
+                printf("fatal: invalid upstream '%s'\n", newbase != NULL ? newbase : upstream);
+                free(picks);
+                ret_code = 128;
+                goto end;
+            }
+            revwalk *walk = revwalk_create(repo, REVWALK_TOPO_ORDER, 0);
+            int capacity = 16;
+            commits = malloc(capacity * sizeof(obj_hash));
+            if (walk == NULL || revwalk_push(walk, head) != 0 || revwalk_hide(walk, upstream_hash) != 0) {
+                res = -1;
+            }
+            obj_hash hash;
+            while (res == 0 && (res = revwalk_next(walk, &hash, NULL)) == 1) {
+                if (num_commits == capacity) {
+                    capacity *= 2;
+                    commits = realloc(commits, capacity * sizeof(obj_hash));
+                }
+                snprintf(commits[num_commits++], OBJ_HASH_SIZE, "%s", hash);
+                res = 0;
+            }
+            if (walk != NULL) {
+                revwalk_free(walk);
+            }
+            for (int i = 0; i < num_commits / 2; i++) {
+                obj_hash tmp;
+                memcpy(tmp, commits[i], OBJ_HASH_SIZE);
+                memcpy(commits[i], commits[num_commits - 1 - i], OBJ_HASH_SIZE);
+                memcpy(commits[num_commits - 1 - i], tmp, OBJ_HASH_SIZE);
+            }
+        } else {
+            commits = malloc(num_picks * sizeof(obj_hash));
+            for (; num_commits < num_picks && res == 0; num_commits++) {
+                if (resolve_rev(repo, picks[num_commits], &commits[num_commits]) != 0) {
+                    printf("fatal: bad revision '%s'\n", picks[num_commits]);
+                    res = -1;
+                }
+            }
+        }
+        free(picks);
 
+        // every commit is replayed in memory, the working tree is only updated with the final tip
+        replay_result result;
+        memset(&result, 0, sizeof(result));
+        if (res == 0) {
+            res = replay_commits(repo, onto, commits, num_commits, &options, &result);
+        }
+        if (res < 0) {
+            printf("ERROR: could not %s\n", command);
+            free_replay_result(&result);
+            free(commits);
+            ret_code = 128;
+            goto end;
+        }
+        if (res == 1) {
+            char label[8];
+            snprintf(label, sizeof(label), "%.7s", commits[result.stopped]);
+            printf("error: could not apply %s\n", label);
+            print_merge_conflicts(&result.conflict, HEAD_NAME, label);
+        }
+        free(commits);
+        if (rebase && res == 1) {
+            // nothing was written to the branch, index or working tree
+            printf("Rebase stopped, nothing was changed. Cherry-pick the commits to resolve conflicts by hand.\n");
+            free_replay_result(&result);
+            ret_code = 1;
+            goto end;
+        }
+        if (strcmp(result.tip, head) == 0 && res == 0) {
+            printf(rebase ? "Current branch %s is up to date.\n" : "Nothing to %s.\n", rebase ? (ref_name[0] != '\0' ? ref_name : HEAD_NAME) : command);
+            free_replay_result(&result);
+            goto end;
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        checkout_stats stats;
+        int checkout_res = -1;
+        if (dircache != NULL && read_commit_tree(repo, result.tip, &tip_tree) == 0) {
+            checkout_res = checkout_tree(repo, dircache, head_tree, res == 1 ? result.conflict.tree : tip_tree, 0, &stats);
+        }
+        if (checkout_res == 1) {
+            printf("Please commit your changes before you %s.\nAborting\n", command);
+            ret_code = 1;
+        } else if (checkout_res == -1) {
+            ret_code = 128;
+        } else {
+            if (res == 1) {
+                add_merge_conflicts_to_dc(dircache, &result.conflict);
+            }
+            if (write_index(repo, dircache) != 0
+                || (strcmp(result.tip, head) != 0 && update_ref(repo, ref_name[0] != '\0' ? ref_name : HEAD_NAME, result.tip, head) != 0)) {
+                ret_code = 128;
+            } else if (res == 1) {
+                printf("hint: after resolving the conflicts, mark them with \"gordit add <paths>\" and run \"gordit commit\"\n");
+                ret_code = 1;
+            } else if (rebase) {
+                printf("Successfully rebased and updated %s.\n", ref_name[0] != '\0' ? ref_name : HEAD_NAME);
+            } else {
+                printf("[%.7s] %d commits applied, %d skipped\n", result.tip, result.num_replayed, result.num_skipped);
+            }
+            if (stats.failed > 0) {
+                printf("%d files could not be written\n", stats.failed);
+                ret_code = 1;
+            }
+        }
+        free_replay_result(&result);
+        if (dircache != NULL) {
+            free_dircache(dircache);
+        }
+    } else if (strcmp(command, "gc") == 0) {
+        // unreachable objects are only pruned once they are older than the grace period
+        time_t grace = GC_DEFAULT_GRACE;
+        int bad_args = argc > 3 || (argc == 3 && strncmp(argv[2], "--prune=", 8) != 0);
+        if (!bad_args && argc == 3 && strcmp(argv[2] + 8, "now") == 0) {
+            grace = 0;
+        } else if (!bad_args && argc == 3) {
+            char *end;
+            grace = strtol(argv[2] + 8, &end, 10);
+            bad_args = *end != '\0' || end == argv[2] + 8 || grace < 0;
+        }
+        if (bad_args) {
+            printf("usage: gordit gc [--prune=<seconds> | --prune=now]\n");
+            ret_code = 1;
+            goto end;
+        }
+
+        gc_stats stats;
+        if (gc_prune(repo, time(NULL) - grace, &stats) != 0) {
+            ret_code = 128;
+        }
+        printf("%d objects, %d reachable, %d unreachable kept as recent, %d pruned\n",
+            stats.num_objects, stats.num_reachable, stats.num_recent, stats.num_pruned);
+    } else if (strcmp(command, "fsck") == 0) {
+        fsck_stats stats;
+        int res = fsck_objects(repo, &stats);
+        if (res < 0) {
+            ret_code = 128;
+            goto end;
+        }
+        printf("%d objects, %d corrupt, %d missing, %d used as the wrong type, %d dangling\n",
+            stats.num_objects, stats.num_corrupt, stats.num_missing, stats.num_bad_type, stats.num_dangling);
+        ret_code = res;
+    } else if (strcmp(command, "fetch") == 0) {
+        if (argc > 3) {
+            printf("usage: gordit fetch [<remote> | <path>]\n");
+            ret_code = 1;
+            goto end;
+        }
+        fetch_stats stats;
+        int res = fetch_remote(repo, argc == 3 ? argv[2] : NULL, &stats);
+        if (res != 0) {
+            ret_code = res < 0 ? 128 : 1;
+            goto end;
+        }
+        printf("%d new tips, %d in common: fetched %d commits, %d objects (%d linked, %d copied), updated %d refs\n",
+            stats.num_wants, stats.num_common, stats.num_commits, stats.num_objects,
+            stats.objects.linked, stats.objects.copied, stats.num_refs);
+    } else if (strcmp(command, "pack-refs") == 0) {
+        int num_packed;
+        if (pack_refs(repo, &num_packed) != 0) {
+            ret_code = 128;
+            goto end;
+        }
+        printf("packed %d refs\n", num_packed);
+    } else if (strcmp(command, "diff") == 0) {
+        diff_options options = { LINE_DIFF_MYERS, DIFF_CONTEXT_LINES };
+        int cached = 0, num_revs = 0, rename_score = -1, rename_flags = 0;
+        const char *revs[2];
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--histogram") == 0) {
+                options.algorithm = LINE_DIFF_HISTOGRAM;
+            } else if (strcmp(argv[i], "--myers") == 0) {
+                options.algorithm = LINE_DIFF_MYERS;
+            } else if (strncmp(argv[i], "-U", 2) == 0 && isdigit((unsigned char)argv[i][2])) {
+                options.context = atoi(argv[i] + 2);
+            } else if (strncmp(argv[i], "--unified=", 10) == 0) {
+                options.context = atoi(argv[i] + 10);
+            } else if (strcmp(argv[i], "--cached") == 0 || strcmp(argv[i], "--staged") == 0) {
+                cached = 1;
+            } else if (argv[i][0] == '-' && (argv[i][1] == 'M' || argv[i][1] == 'C')) {
+                rename_score = isdigit((unsigned char)argv[i][2]) ? atoi(argv[i] + 2) : RENAME_DEFAULT_SCORE;
+                rename_flags |= argv[i][1] == 'C' ? RENAME_COPIES : 0;
+            } else if (strcmp(argv[i], "--find-renames") == 0 || strcmp(argv[i], "--find-copies") == 0) {
+                rename_score = RENAME_DEFAULT_SCORE;
+                rename_flags |= argv[i][7] == 'c' ? RENAME_COPIES : 0;
+            } else if (argv[i][0] != '-' && num_revs < 2) {
+                revs[num_revs++] = argv[i];
+            } else {
+                num_revs = -1;
+                break;
+            }
+        }
+        if (num_revs < 0 || (cached && num_revs > 1) || rename_score > 100) {
+            printf("usage: gordit diff [--histogram] [-U<n>] [-M[<n>] | -C[<n>]] [--cached [<commit>] | <commit> [<commit>]]\n");
+            ret_code = 1;
+            goto end;
+        }
+
+        obj_hash trees[2];
+        const char *old_tree = NULL;
+        for (int i = 0; i < num_revs; i++) {
+            if (resolve_tree(repo, revs[i], &trees[i]) != 0) {
+                printf("fatal: bad revision '%s'\n", revs[i]);
+                ret_code = 128;
+                goto end;
+            }
+        }
+        if (cached && num_revs == 0) {
+            obj_hash head;
+            if (resolve_head(repo, &head, NULL) == 0 && read_commit_tree(repo, head, &trees[0]) == 0) {
+                old_tree = trees[0];
+            }
+        } else if (num_revs > 0) {
+            old_tree = trees[0];
+        }
+
+        git_dircache *dircache = create_dircache(repo);
+        if (dircache == NULL) {
+            ret_code = 128;
+            goto end;
+        }
+        diff_file old, new;
+        if (cached || num_revs > 0) {
+            // commit to commit or commit to index, only reading trees along changed paths. Commit
+            // to working tree goes through the index, only reading files whose stat info changed,
+            // and their new side is read from the working tree as it is not stored
+            tree_change_list changes;
+            int worktree = !cached && num_revs == 1, index_refreshed = 0;
+            int res = num_revs == 2 ? diff_trees(repo, trees[0], trees[1], NULL, &changes)
+                : worktree ? diff_tree_worktree(repo, old_tree, dircache, &changes, &index_refreshed)
+                : diff_tree_index(repo, old_tree, dircache, &changes);
+            if (res != 0 || (rename_score >= 0 && !worktree && detect_renames(repo, &changes, rename_score, rename_flags) < 0)) {
+                ret_code = 128;
+            }
+            if (index_refreshed) {
+                write_index(repo, dircache);
+            }
+            for (int i = 0; (cached || worktree) && i < dircache->num_entries; i++) {
+                const git_index_entry *entry = dircache->entries[i];
+                if (entry->stage_num != 0 && (i == 0 || strcmp(dircache->entries[i - 1]->name, entry->name) != 0)) {
+                    printf("* Unmerged path %s\n", entry->name);
+                }
+            }
+            for (int i = 0; ret_code == 0 && i < changes.num_changes; i++) {
+                const tree_change *change = &changes.changes[i];
+                if (read_diff_file(repo, change->old_mode, change->old_hash, NULL, &old) == 0
+                    && read_diff_file(repo, change->new_mode, change->new_hash, worktree ? change->path : NULL, &new) == 0) {
+                    if (change->old_path != NULL) {
+                        print_moved_file_diff(change->old_path, change->path, change->kind == TREE_COPIED, change->score,
+                            &old, &new, &options);
+                    } else {
+                        print_file_diff(change->path, &old, &new, &options);
+                    }
+                } else {
+                    ret_code = 128;
+                }
+                free_diff_file(&old);
+                free_diff_file(&new);
+            }
+            free_tree_changes(&changes);
+        } else {
+            // index to working tree, only reading files whose stat info changed
+            git_status status;
+            memset(&status, 0, sizeof(status));
+            status_unstaged(repo, dircache, &status);
+            for (int i = 0; i < status.unstaged.num_changes; i++) {
+                const status_change *change = &status.unstaged.changes[i];
+                git_index_entry *entry = find_index_entry(dircache, change->path);
+                int deleted = change->kind == STATUS_DELETED;
+                if (read_diff_file(repo, entry->git_mode, entry->hash, NULL, &old) == 0
+                    && read_diff_file(repo, deleted ? 0 : entry->git_mode, NULL, deleted ? NULL : change->path, &new) == 0) {
+                    print_file_diff(change->path, &old, &new, &options);
+                } else {
+                    ret_code = 128;
+                }
+                free_diff_file(&old);
+                free_diff_file(&new);
+            }
+            if (status.index_refreshed) {
+                write_index(repo, dircache);
+            }
+            free_status(&status);
+        }
+        free_dircache(dircache);
     } else {
         printf("%s is not a git command.", command);
     }
 
 end:;
-    free((void *)repo);
+    free_repo(repo);
     return ret_code;
 }
\ No newline at end of file
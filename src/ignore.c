@@ -0,0 +1,532 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "ignore.h"
+
+#define IGN_NEGATE   0x1
+#define IGN_DIR_ONLY 0x2
+#define IGN_ANCHORED 0x4 // matched against path relative to ignore file's folder, not basename
+
+// literal buckets per ignore file, must be a power of two
+#define IGN_LITERAL_BUCKETS 64
+// initial directory buckets of a cache, must be a power of two
+#define IGN_DIR_BUCKETS 256
+
+typedef enum {
+    GLOB_CHAR,     // one exact character
+    GLOB_ANY,      // '?', one character other than '/'
+    GLOB_CLASS,    // "[...]", one character other than '/' from a set
+    GLOB_STAR,     // '*', any characters other than '/'
+    GLOB_GLOBSTAR, // "**/", zero or more whole directories
+    GLOB_REST,     // trailing "**", one or more characters including '/'
+} glob_op;
+
+// one step of a compiled glob, a path matches if some run of steps consumes all of it
+typedef struct glob_state {
+    glob_op op;
+    unsigned char ch;
+    unsigned char class_bits[32];
+} glob_state;
+
+typedef struct ignore_pattern {
+    char *text; // without '!', leading '/' or trailing '/'
+    int flags;
+    int index; // line order, later patterns win
+    glob_state *states; // NULL for literal patterns
+    int num_states;
+    struct ignore_pattern *next; // next literal in same bucket
+} ignore_pattern;
+
+typedef struct ignore_dir {
+    char *path; // relative to repo root, "" for root
+    struct ignore_dir *parent;
+    int has_file;
+    fs_statinfo stamp; // of ignore file, to tell when it changes
+    int excluded; // folder itself is ignored, so everything under it is too
+
+    ignore_pattern *patterns;
+    int num_patterns;
+    ignore_pattern *literals[IGN_LITERAL_BUCKETS];
+    ignore_pattern **globs; // in line order
+    int num_globs;
+
+    struct ignore_dir *next; // next folder in same cache bucket
+} ignore_dir;
+
+struct ignore_cache {
+    char root_path[PATH_MAX];
+    ignore_dir *root;
+
+    pthread_mutex_t lock;
+    ignore_dir **buckets;
+    int num_buckets;
+    int num_dirs;
+};
+
+uint32_t ignore_hash(const char *str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)str[i]) * 16777619u;
+    }
+    return h;
+}
+
+// @return index after class, or 0 if class is not terminated
+size_t compile_class(const char *text, size_t i, glob_state *state) {
+    size_t j = i + 1;
+    int negate = 0;
+    if (text[j] == '!' || text[j] == '^') {
+        negate = 1;
+        j++;
+    }
+
+    memset(state->class_bits, 0, sizeof(state->class_bits));
+    int first = 1;
+    while (text[j] != '\0' && (text[j] != ']' || first)) {
+        unsigned char lo = text[j], hi;
+        if (lo == '\\' && text[j + 1] != '\0') {
+            lo = text[++j];
+        }
+        hi = lo;
+        if (text[j + 1] == '-' && text[j + 2] != ']' && text[j + 2] != '\0') {
+            hi = text[j + 2];
+            j += 2;
+        }
+        for (unsigned int c = lo; c <= hi; c++) {
+            state->class_bits[c >> 3] |= 1 << (c & 7);
+        }
+        first = 0;
+        j++;
+    }
+    if (text[j] != ']') {
+        return 0;
+    }
+
+    if (negate) {
+        for (int b = 0; b < 32; b++) {
+            state->class_bits[b] = ~state->class_bits[b];
+        }
+    }
+    state->op = GLOB_CLASS;
+    return j + 1;
+}
+
+// compiles `pat->text` into one state per character, '*' or class it matches
+void compile_glob(ignore_pattern *pat) {
+    const char *text = pat->text;
+    pat->states = malloc((strlen(text) + 1) * sizeof(glob_state));
+    pat->num_states = 0;
+
+    size_t i = 0, next;
+    while (text[i] != '\0') {
+        glob_state *state = &pat->states[pat->num_states++];
+
+        if (text[i] == '*' && text[i + 1] == '*' && (i == 0 || text[i - 1] == '/')
+            && (text[i + 2] == '/' || text[i + 2] == '\0')) {
+            state->op = text[i + 2] == '/' ? GLOB_GLOBSTAR : GLOB_REST;
+            i += text[i + 2] == '/' ? 3 : 2;
+        } else if (text[i] == '*') {
+            state->op = GLOB_STAR;
+            while (text[i] == '*') i++;
+        } else if (text[i] == '?') {
+            state->op = GLOB_ANY;
+            i++;
+        } else if (text[i] == '[' && (next = compile_class(text, i, state)) != 0) {
+            i = next;
+        } else {
+            if (text[i] == '\\' && text[i + 1] != '\0') {
+                i++;
+            }
+            state->op = GLOB_CHAR;
+            state->ch = text[i++];
+        }
+    }
+}
+
+#define GLOB_MAX_WORDS (PATH_MAX / 64 + 1)
+
+// adds states reachable without reading a character, '*' and "**/" may match nothing
+void glob_follow_empty(const glob_state *states, int num_states, uint64_t *set) {
+    for (int i = 0; i < num_states; i++) {
+        if ((set[i >> 6] >> (i & 63) & 1) && (states[i].op == GLOB_STAR || states[i].op == GLOB_GLOBSTAR)) {
+            set[(i + 1) >> 6] |= 1ull << ((i + 1) & 63);
+        }
+    }
+}
+
+// runs every possible position in the pattern at once, so each character of `str` is read
+// once and no pattern can make matching backtrack
+int glob_match(const glob_state *states, int num_states, const char *str) {
+    uint64_t cur[GLOB_MAX_WORDS], next[GLOB_MAX_WORDS];
+    int num_words = num_states / 64 + 1; // state `num_states` is the match
+    assert(num_words <= GLOB_MAX_WORDS);
+
+    memset(cur, 0, num_words * sizeof(uint64_t));
+    cur[0] = 1;
+    glob_follow_empty(states, num_states, cur);
+
+    for (; *str != '\0'; str++) {
+        unsigned char c = *str;
+        uint64_t live = 0;
+        memset(next, 0, num_words * sizeof(uint64_t));
+
+        for (int w = 0; w < num_words; w++) {
+            for (uint64_t word = cur[w]; word != 0; word &= word - 1) {
+                int i = w * 64 + __builtin_ctzll(word);
+                if (i == num_states) {
+                    continue;
+                }
+
+                const glob_state *state = &states[i];
+                int stay = 0, advance = 0;
+                switch (state->op) {
+                case GLOB_CHAR:
+                    advance = c == state->ch;
+                    break;
+                case GLOB_ANY:
+                    advance = c != '/';
+                    break;
+                case GLOB_CLASS:
+                    advance = c != '/' && (state->class_bits[c >> 3] & (1 << (c & 7)));
+                    break;
+                case GLOB_STAR:
+                    stay = c != '/';
+                    break;
+                case GLOB_GLOBSTAR:
+                    stay = 1;
+                    advance = c == '/';
+                    break;
+                case GLOB_REST:
+                    stay = advance = 1;
+                    break;
+                }
+                if (stay) {
+                    next[i >> 6] |= 1ull << (i & 63);
+                }
+                if (advance) {
+                    next[(i + 1) >> 6] |= 1ull << ((i + 1) & 63);
+                }
+            }
+        }
+
+        glob_follow_empty(states, num_states, next);
+        for (int w = 0; w < num_words; w++) {
+            cur[w] = next[w];
+            live |= next[w];
+        }
+        if (live == 0) {
+            return 0;
+        }
+    }
+    return cur[num_states >> 6] >> (num_states & 63) & 1;
+}
+
+// @return 1 if line holds a pattern, 0 if it is blank or a comment
+int parse_ignore_line(char *line, int index, ignore_pattern *pat) {
+    size_t len = strcspn(line, "\r\n");
+    while (len > 0 && line[len - 1] == ' ' && (len < 2 || line[len - 2] != '\\')) {
+        len--;
+    }
+    line[len] = '\0';
+
+    if (line[0] == '\0' || line[0] == '#') {
+        return 0;
+    }
+
+    pat->flags = 0;
+    if (line[0] == '!') {
+        pat->flags |= IGN_NEGATE;
+        line++;
+    } else if (line[0] == '\\' && (line[1] == '#' || line[1] == '!')) {
+        line++;
+    }
+
+    len = strlen(line);
+    if (len > 0 && line[len - 1] == '/') {
+        pat->flags |= IGN_DIR_ONLY;
+        line[--len] = '\0';
+    }
+    if (line[0] == '/') {
+        pat->flags |= IGN_ANCHORED;
+        line++;
+    }
+    if (strchr(line, '/') != NULL) {
+        pat->flags |= IGN_ANCHORED;
+    }
+    if (line[0] == '\0') {
+        return 0;
+    }
+
+    pat->text = strdup(line);
+    pat->index = index;
+    pat->states = NULL;
+    pat->num_states = 0;
+    pat->next = NULL;
+    if (strpbrk(pat->text, "*?[\\") != NULL) {
+        compile_glob(pat);
+    }
+    return 1;
+}
+
+// reads and compiles ignore file of folder at `path`, if it has one
+ignore_dir *load_ignore_dir(const ignore_cache *cache, const char *path, ignore_dir *parent) {
+    ignore_dir *dir = calloc(1, sizeof(*dir));
+    dir->path = strdup(path);
+    dir->parent = parent;
+
+    char folder[PATH_MAX], ignore_path[PATH_MAX];
+    if (path[0] != '\0') {
+        fs_path_join(cache->root_path, path, folder);
+    } else {
+        snprintf(folder, PATH_MAX, "%s", cache->root_path);
+    }
+    fs_path_join(folder, GIT_IGNORE_NAME, ignore_path);
+
+    FILE *fptr;
+    if (fs_getinfo(ignore_path, &dir->stamp) != 0 || (fptr = fs_fopen(ignore_path, "r")) == NULL) {
+        return dir;
+    }
+    dir->has_file = 1;
+
+    int capacity = 0, index = 0;
+    char line[PATH_MAX];
+    while (fs_readline(line, PATH_MAX, fptr) != NULL) {
+        if (dir->num_patterns == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            dir->patterns = realloc(dir->patterns, capacity * sizeof(ignore_pattern));
+        }
+        if (parse_ignore_line(line, index, &dir->patterns[dir->num_patterns])) {
+            dir->num_patterns++;
+            index++;
+        }
+    }
+    fs_fclose(fptr);
+
+    // patterns array no longer moves, so it is safe to point into it
+    dir->globs = malloc((dir->num_patterns + 1) * sizeof(ignore_pattern *));
+    for (int i = 0; i < dir->num_patterns; i++) {
+        ignore_pattern *pat = &dir->patterns[i];
+        if (pat->states != NULL) {
+            dir->globs[dir->num_globs++] = pat;
+        } else {
+            uint32_t b = ignore_hash(pat->text, strlen(pat->text)) & (IGN_LITERAL_BUCKETS - 1);
+            pat->next = dir->literals[b];
+            dir->literals[b] = pat;
+        }
+    }
+
+    return dir;
+}
+
+void free_ignore_dir(ignore_dir *dir) {
+    for (int i = 0; i < dir->num_patterns; i++) {
+        free(dir->patterns[i].text);
+        free(dir->patterns[i].states);
+    }
+    free(dir->patterns);
+    free(dir->globs);
+    free(dir->path);
+    free(dir);
+}
+
+int pattern_applies(const ignore_pattern *pat, int is_dir) {
+    return !(pat->flags & IGN_DIR_ONLY) || is_dir;
+}
+
+// @param rel path relative to `dir`
+// @param base basename of path
+// @return last pattern of `dir` that matches, or NULL if none do
+const ignore_pattern *match_ignore_dir(const ignore_dir *dir, const char *rel, const char *base, int is_dir) {
+    if (dir->num_patterns == 0) {
+        return NULL;
+    }
+
+    const ignore_pattern *best = NULL;
+    const char *keys[2] = { base, rel };
+    for (int k = 0; k < 2; k++) {
+        int anchored = k == 1 ? IGN_ANCHORED : 0;
+        uint32_t b = ignore_hash(keys[k], strlen(keys[k])) & (IGN_LITERAL_BUCKETS - 1);
+        for (const ignore_pattern *pat = dir->literals[b]; pat != NULL; pat = pat->next) {
+            if ((pat->flags & IGN_ANCHORED) == anchored && pattern_applies(pat, is_dir)
+                && (best == NULL || pat->index > best->index) && strcmp(pat->text, keys[k]) == 0) {
+                best = pat;
+            }
+        }
+    }
+
+    // globs earlier than the best literal cannot win, so stop there
+    for (int i = dir->num_globs - 1; i >= 0; i--) {
+        const ignore_pattern *pat = dir->globs[i];
+        if (best != NULL && pat->index < best->index) {
+            break;
+        }
+        if (pattern_applies(pat, is_dir)
+            && glob_match(pat->states, pat->num_states, (pat->flags & IGN_ANCHORED) ? rel : base)) {
+            return pat;
+        }
+    }
+    return best;
+}
+
+// checks patterns of `dir` and all of its parents, deepest first
+// @return 1 if path is ignored
+int match_ignore_chain(const ignore_dir *dir, const char *path, int is_dir) {
+    const char *base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+
+    for (const ignore_dir *d = dir; d != NULL; d = d->parent) {
+        const char *rel = path + (d->path[0] != '\0' ? strlen(d->path) + 1 : 0);
+        const ignore_pattern *pat;
+        if ((pat = match_ignore_dir(d, rel, base, is_dir)) != NULL) {
+            return !(pat->flags & IGN_NEGATE);
+        }
+    }
+    return 0;
+}
+
+// must hold cache lock
+ignore_dir *find_ignore_dir(const ignore_cache *cache, const char *path, size_t len, uint32_t hash) {
+    for (ignore_dir *dir = cache->buckets[hash & (cache->num_buckets - 1)]; dir != NULL; dir = dir->next) {
+        if (strncmp(dir->path, path, len) == 0 && dir->path[len] == '\0') {
+            return dir;
+        }
+    }
+    return NULL;
+}
+
+// must hold cache lock
+void insert_ignore_dir(ignore_cache *cache, ignore_dir *dir) {
+    if (cache->num_dirs >= cache->num_buckets) {
+        int num_buckets = cache->num_buckets * 2;
+        ignore_dir **buckets = calloc(num_buckets, sizeof(ignore_dir *));
+        for (int i = 0; i < cache->num_buckets; i++) {
+            ignore_dir *next;
+            for (ignore_dir *d = cache->buckets[i]; d != NULL; d = next) {
+                next = d->next;
+                uint32_t b = ignore_hash(d->path, strlen(d->path)) & (num_buckets - 1);
+                d->next = buckets[b];
+                buckets[b] = d;
+            }
+        }
+        free(cache->buckets);
+        cache->buckets = buckets;
+        cache->num_buckets = num_buckets;
+    }
+
+    uint32_t b = ignore_hash(dir->path, strlen(dir->path)) & (cache->num_buckets - 1);
+    dir->next = cache->buckets[b];
+    cache->buckets[b] = dir;
+    cache->num_dirs++;
+}
+
+// @param len length of folder's path, which is the first `len` characters of `path`
+ignore_dir *get_ignore_dir(ignore_cache *cache, const char *path, size_t len) {
+    if (len == 0) {
+        return cache->root;
+    }
+
+    uint32_t hash = ignore_hash(path, len);
+    pthread_mutex_lock(&cache->lock);
+    ignore_dir *dir = find_ignore_dir(cache, path, len, hash);
+    pthread_mutex_unlock(&cache->lock);
+    if (dir != NULL) {
+        return dir;
+    }
+
+    size_t parent_len = len;
+    while (parent_len > 0 && path[parent_len - 1] != '/') {
+        parent_len--;
+    }
+    ignore_dir *parent = get_ignore_dir(cache, path, parent_len > 0 ? parent_len - 1 : 0);
+
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, PATH_MAX, "%.*s", (int)len, path);
+    dir = load_ignore_dir(cache, dir_path, parent);
+    dir->excluded = parent->excluded || match_ignore_chain(parent, dir_path, 1);
+
+    // another thread may have loaded the same folder in the meantime
+    pthread_mutex_lock(&cache->lock);
+    ignore_dir *existing = find_ignore_dir(cache, path, len, hash);
+    if (existing == NULL) {
+        insert_ignore_dir(cache, dir);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (existing != NULL) {
+        free_ignore_dir(dir);
+        return existing;
+    }
+    return dir;
+}
+
+ignore_cache *ignore_cache_create(const git_repo *repo) {
+    ignore_cache *cache = malloc(sizeof(*cache));
+    snprintf(cache->root_path, PATH_MAX, "%s", repo->root_path);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->num_buckets = IGN_DIR_BUCKETS;
+    cache->buckets = calloc(cache->num_buckets, sizeof(ignore_dir *));
+    cache->num_dirs = 0;
+    cache->root = load_ignore_dir(cache, "", NULL);
+    return cache;
+}
+
+int ignore_cache_check(ignore_cache *cache, const char *path, int is_dir) {
+    const char *slash = strrchr(path, '/');
+    ignore_dir *dir = get_ignore_dir(cache, path, slash != NULL ? (size_t)(slash - path) : 0);
+    if (dir->excluded) {
+        return 1;
+    }
+    return match_ignore_chain(dir, path, is_dir);
+}
+
+// @return 1 if ignore file of folder is not the one that was compiled
+int ignore_dir_changed(const ignore_cache *cache, const ignore_dir *dir) {
+    char ignore_path[PATH_MAX], rel[PATH_MAX];
+    fs_statinfo stamp;
+    snprintf(rel, PATH_MAX, "%s%s%s", dir->path, dir->path[0] != '\0' ? "/" : "", GIT_IGNORE_NAME);
+    fs_path_join(cache->root_path, rel, ignore_path);
+
+    int has_file = fs_getinfo(ignore_path, &stamp) == 0;
+    return has_file != dir->has_file || (has_file && (stamp.fi_size != dir->stamp.fi_size ||
+        stamp.fi_mtime != dir->stamp.fi_mtime || stamp.fi_ctime != dir->stamp.fi_ctime || stamp.fi_ino != dir->stamp.fi_ino));
+}
+
+void free_ignore_dirs(ignore_cache *cache) {
+    for (int i = 0; i < cache->num_buckets; i++) {
+        ignore_dir *next;
+        for (ignore_dir *dir = cache->buckets[i]; dir != NULL; dir = next) {
+            next = dir->next;
+            free_ignore_dir(dir);
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->num_dirs = 0;
+    free_ignore_dir(cache->root);
+}
+
+void ignore_cache_refresh(ignore_cache *cache) {
+    // a changed folder also changes what is excluded below it, so everything is reloaded
+    int changed = ignore_dir_changed(cache, cache->root);
+    for (int i = 0; !changed && i < cache->num_buckets; i++) {
+        for (ignore_dir *dir = cache->buckets[i]; !changed && dir != NULL; dir = dir->next) {
+            changed = ignore_dir_changed(cache, dir);
+        }
+    }
+    if (changed) {
+        free_ignore_dirs(cache);
+        cache->root = load_ignore_dir(cache, "", NULL);
+    }
+}
+
+void ignore_cache_free(ignore_cache *cache) {
+    free_ignore_dirs(cache);
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
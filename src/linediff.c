@@ -0,0 +1,638 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "filesystem.h"
+#include "filespec.h"
+#include "repo.h"
+#include "objects.h"
+#include "linediff.h"
+
+// most times a line may occur in the old side of a range and still anchor a histogram split
+#define HISTOGRAM_MAX_CHAIN 64
+
+// longest part of a function line shown after a hunk's line numbers
+#define DIFF_FUNC_LINE_MAX 80
+
+// least number of steps a Myers search takes before settling for the furthest reaching split
+#define MYERS_MIN_COST 256
+
+typedef struct diff_range {
+    int lo1, hi1; // tokens of old side
+    int lo2, hi2; // tokens of new side
+} diff_range;
+
+typedef struct range_stack {
+    diff_range *ranges;
+    int size;
+    int capacity;
+} range_stack;
+
+typedef struct diff_ctx {
+    const int *a, *b; // tokens of lines left to compare on each side
+    const int *a_map, *b_map; // line each token came from
+    char *old_changed, *new_changed; // per line of each side
+    int *kvdf, *kvdb; // furthest reaching path on each diagonal, forward and backward
+    int max_cost;
+    int *head, *next, *count; // occurrences of each token in the histogram's current old range
+    long budget; // lines histogram may still scan before leaving ranges to Myers
+} diff_ctx;
+
+void range_push(range_stack *stack, int lo1, int hi1, int lo2, int hi2) {
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->ranges = realloc(stack->ranges, stack->capacity * sizeof(diff_range));
+    }
+    diff_range range = { lo1, hi1, lo2, hi2 };
+    stack->ranges[stack->size++] = range;
+}
+
+// @return number of lines, the last one may not end in '\n'
+int split_lines(const char *buf, size_t size, diff_line **out) {
+    int num_lines = 0;
+    for (const char *p = buf; p < buf + size && (p = memchr(p, '\n', buf + size - p)) != NULL; p++) {
+        num_lines++;
+    }
+    if (size > 0 && buf[size - 1] != '\n') {
+        num_lines++;
+    }
+
+    diff_line *lines = malloc((num_lines + 1) * sizeof(diff_line));
+    const char *pos = buf, *end = buf + size;
+    for (int i = 0; i < num_lines; i++) {
+        const char *eol = memchr(pos, '\n', end - pos);
+        lines[i].start = pos;
+        lines[i].len = eol != NULL ? (size_t)(eol - pos) + 1 : (size_t)(end - pos);
+        pos += lines[i].len;
+    }
+    *out = lines;
+    return num_lines;
+}
+
+uint64_t line_hash(const char *s, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Gives lines of both sides the same token iff their contents are the same.
+// @return number of distinct lines
+int intern_lines(const diff_line *old_lines, int num_old, const diff_line *new_lines, int num_new, int *old_tokens, int *new_tokens) {
+    size_t num_slots = 16;
+    while (num_slots < 2 * (size_t)(num_old + num_new)) {
+        num_slots <<= 1;
+    }
+    int *slots = malloc(num_slots * sizeof(int));
+    memset(slots, -1, num_slots * sizeof(int));
+    const diff_line **firsts = malloc((num_old + num_new + 1) * sizeof(diff_line *));
+    uint64_t *hashes = malloc((num_old + num_new + 1) * sizeof(uint64_t));
+
+    int num_tokens = 0;
+    for (int side = 0; side < 2; side++) {
+        const diff_line *lines = side == 0 ? old_lines : new_lines;
+        int *tokens = side == 0 ? old_tokens : new_tokens;
+        int num_lines = side == 0 ? num_old : num_new;
+        for (int i = 0; i < num_lines; i++) {
+            uint64_t hash = line_hash(lines[i].start, lines[i].len);
+            size_t slot = hash & (num_slots - 1);
+            int token;
+            while ((token = slots[slot]) != -1 && (hashes[token] != hash || firsts[token]->len != lines[i].len
+                || memcmp(firsts[token]->start, lines[i].start, lines[i].len) != 0)) {
+                slot = (slot + 1) & (num_slots - 1);
+            }
+            if (token == -1) {
+                token = num_tokens++;
+                slots[slot] = token;
+                firsts[token] = &lines[i];
+                hashes[token] = hash;
+            }
+            tokens[i] = token;
+        }
+    }
+
+    free(slots);
+    free(firsts);
+    free(hashes);
+    return num_tokens;
+}
+
+void mark_range(diff_ctx *ctx, const diff_range *r) {
+    for (int i = r->lo1; i < r->hi1; i++) {
+        ctx->old_changed[ctx->a_map[i]] = 1;
+    }
+    for (int i = r->lo2; i < r->hi2; i++) {
+        ctx->new_changed[ctx->b_map[i]] = 1;
+    }
+}
+
+void trim_range(const diff_ctx *ctx, diff_range *r) {
+    while (r->lo1 < r->hi1 && r->lo2 < r->hi2 && ctx->a[r->lo1] == ctx->b[r->lo2]) {
+        r->lo1++;
+        r->lo2++;
+    }
+    while (r->lo1 < r->hi1 && r->lo2 < r->hi2 && ctx->a[r->hi1 - 1] == ctx->b[r->hi2 - 1]) {
+        r->hi1--;
+        r->hi2--;
+    }
+}
+
+// Finds where a shortest edit script of the range crosses its middle, searching forward from
+// its start and backward from its end until the paths meet. Diagonal d holds points where
+// old line - new line = d. Once the search gets too costly, the point furthest along either
+// search is taken, which still splits the range but may not be minimal.
+// Range must be trimmed and both sides not empty.
+void myers_split(diff_ctx *ctx, const diff_range *r, int *out1, int *out2) {
+    const int *a = ctx->a, *b = ctx->b;
+    int *kvdf = ctx->kvdf, *kvdb = ctx->kvdb;
+    int off1 = r->lo1, lim1 = r->hi1, off2 = r->lo2, lim2 = r->hi2;
+    int dmin = off1 - lim2, dmax = lim1 - off2;
+    int fmid = off1 - off2, bmid = lim1 - lim2;
+    int odd = (fmid - bmid) & 1;
+    int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+
+    kvdf[fmid] = off1;
+    kvdb[bmid] = lim1;
+    for (int cost = 1;; cost++) {
+        if (fmin > dmin) {
+            kvdf[--fmin - 1] = -1;
+        } else {
+            fmin++;
+        }
+        if (fmax < dmax) {
+            kvdf[++fmax + 1] = -1;
+        } else {
+            fmax--;
+        }
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int i1 = kvdf[d - 1] >= kvdf[d + 1] ? kvdf[d - 1] + 1 : kvdf[d + 1];
+            int i2 = i1 - d;
+            while (i1 < lim1 && i2 < lim2 && a[i1] == b[i2]) {
+                i1++;
+                i2++;
+            }
+            kvdf[d] = i1;
+            if (odd && bmin <= d && d <= bmax && kvdb[d] <= i1) {
+                *out1 = i1;
+                *out2 = i2;
+                return;
+            }
+        }
+
+        if (bmin > dmin) {
+            kvdb[--bmin - 1] = INT32_MAX;
+        } else {
+            bmin++;
+        }
+        if (bmax < dmax) {
+            kvdb[++bmax + 1] = INT32_MAX;
+        } else {
+            bmax--;
+        }
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int i1 = kvdb[d - 1] < kvdb[d + 1] ? kvdb[d - 1] : kvdb[d + 1] - 1;
+            int i2 = i1 - d;
+            while (i1 > off1 && i2 > off2 && a[i1 - 1] == b[i2 - 1]) {
+                i1--;
+                i2--;
+            }
+            kvdb[d] = i1;
+            if (!odd && fmin <= d && d <= fmax && i1 <= kvdf[d]) {
+                *out1 = i1;
+                *out2 = i2;
+                return;
+            }
+        }
+
+        if (cost < ctx->max_cost) {
+            continue;
+        }
+        // furthest point, by lines consumed, reached from either end
+        long fbest = -1, bbest = INT32_MAX;
+        int fbest1 = off1, bbest1 = lim1;
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int i1 = kvdf[d] < lim1 ? kvdf[d] : lim1;
+            int i2 = i1 - d;
+            if (i2 > lim2) {
+                i1 = lim2 + d;
+                i2 = lim2;
+            }
+            if (fbest < i1 + i2) {
+                fbest = i1 + i2;
+                fbest1 = i1;
+            }
+        }
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int i1 = kvdb[d] > off1 ? kvdb[d] : off1;
+            int i2 = i1 - d;
+            if (i2 < off2) {
+                i1 = off2 + d;
+                i2 = off2;
+            }
+            if (i1 + i2 < bbest) {
+                bbest = i1 + i2;
+                bbest1 = i1;
+            }
+        }
+        if ((lim1 + lim2) - bbest < fbest - (off1 + off2)) {
+            *out1 = fbest1;
+            *out2 = fbest - fbest1;
+        } else {
+            *out1 = bbest1;
+            *out2 = bbest - bbest1;
+        }
+        return;
+    }
+}
+
+void myers_diff(diff_ctx *ctx, const diff_range *range) {
+    range_stack stack = { NULL, 0, 0 };
+    range_push(&stack, range->lo1, range->hi1, range->lo2, range->hi2);
+    while (stack.size > 0) {
+        diff_range r = stack.ranges[--stack.size];
+        trim_range(ctx, &r);
+        if (r.lo1 == r.hi1 || r.lo2 == r.hi2) {
+            mark_range(ctx, &r);
+            continue;
+        }
+
+        int s1, s2;
+        myers_split(ctx, &r, &s1, &s2);
+        if ((s1 == r.lo1 && s2 == r.lo2) || (s1 == r.hi1 && s2 == r.hi2)) {
+            mark_range(ctx, &r); // a split that does not shrink the range would never end
+            continue;
+        }
+        range_push(&stack, r.lo1, s1, r.lo2, s2);
+        range_push(&stack, s1, r.hi1, s2, r.hi2);
+    }
+    free(stack.ranges);
+}
+
+void histogram_diff(diff_ctx *ctx, const diff_range *range) {
+    const int *a = ctx->a, *b = ctx->b;
+    range_stack stack = { NULL, 0, 0 };
+    range_push(&stack, range->lo1, range->hi1, range->lo2, range->hi2);
+    while (stack.size > 0) {
+        diff_range r = stack.ranges[--stack.size];
+        trim_range(ctx, &r);
+        if (r.lo1 == r.hi1 || r.lo2 == r.hi2) {
+            mark_range(ctx, &r);
+            continue;
+        }
+        if (ctx->budget < 0) {
+            myers_diff(ctx, &r);
+            continue;
+        }
+        ctx->budget -= (r.hi1 - r.lo1) + (r.hi2 - r.lo2);
+
+        for (int i = r.hi1 - 1; i >= r.lo1; i--) {
+            ctx->next[i] = ctx->head[a[i]];
+            ctx->head[a[i]] = i;
+            ctx->count[a[i]]++;
+        }
+
+        // the common run around the rarest line, longest among equally rare ones
+        int best1 = 0, best2 = 0, best_len = 0, best_count = HISTOGRAM_MAX_CHAIN + 1;
+        for (int j = r.lo2; j < r.hi2;) {
+            int count = ctx->count[b[j]];
+            int j_next = j + 1;
+            if (count == 0 || count > best_count) {
+                j = j_next;
+                continue;
+            }
+            for (int i = ctx->head[b[j]]; i != -1; i = ctx->next[i]) {
+                int s1 = i, s2 = j, e1 = i + 1, e2 = j + 1;
+                int run_count = count;
+                while (s1 > r.lo1 && s2 > r.lo2 && a[s1 - 1] == b[s2 - 1]) {
+                    s1--;
+                    s2--;
+                    run_count = ctx->count[a[s1]] < run_count ? ctx->count[a[s1]] : run_count;
+                }
+                while (e1 < r.hi1 && e2 < r.hi2 && a[e1] == b[e2]) {
+                    run_count = ctx->count[a[e1]] < run_count ? ctx->count[a[e1]] : run_count;
+                    e1++;
+                    e2++;
+                }
+                if (run_count < best_count || (run_count == best_count && e1 - s1 > best_len)) {
+                    best1 = s1;
+                    best2 = s2;
+                    best_len = e1 - s1;
+                    best_count = run_count;
+                }
+                j_next = e2 > j_next ? e2 : j_next;
+            }
+            j = j_next;
+        }
+
+        for (int i = r.lo1; i < r.hi1; i++) {
+            ctx->head[a[i]] = -1;
+            ctx->count[a[i]] = 0;
+        }
+
+        if (best_len == 0) {
+            myers_diff(ctx, &r);
+            continue;
+        }
+        range_push(&stack, r.lo1, best1, r.lo2, best2);
+        range_push(&stack, best1 + best_len, r.hi1, best2 + best_len, r.hi2);
+    }
+    free(stack.ranges);
+}
+
+void add_line_change(line_diff *diff, int old_pos, int old_len, int new_pos, int new_len) {
+    if (diff->num_changes == diff->capacity) {
+        diff->capacity = diff->capacity ? diff->capacity * 2 : 16;
+        diff->changes = realloc(diff->changes, diff->capacity * sizeof(line_change));
+    }
+    line_change change = { old_pos, old_len, new_pos, new_len };
+    diff->changes[diff->num_changes++] = change;
+}
+
+int diff_lines(const char *old, size_t old_size, const char *new, size_t new_size, int algorithm, line_diff *out) {
+    memset(out, 0, sizeof(*out));
+    int n1 = out->num_old = split_lines(old, old_size, &out->old_lines);
+    int n2 = out->num_new = split_lines(new, new_size, &out->new_lines);
+
+    int *old_tokens = malloc((n1 + 1) * sizeof(int));
+    int *new_tokens = malloc((n2 + 1) * sizeof(int));
+    int num_tokens = intern_lines(out->old_lines, n1, out->new_lines, n2, old_tokens, new_tokens);
+
+    int prefix = 0, suffix = 0;
+    while (prefix < n1 && prefix < n2 && old_tokens[prefix] == new_tokens[prefix]) {
+        prefix++;
+    }
+    while (suffix < n1 - prefix && suffix < n2 - prefix && old_tokens[n1 - 1 - suffix] == new_tokens[n2 - 1 - suffix]) {
+        suffix++;
+    }
+
+    // lines missing from the other side can never match, so only the rest is searched
+    int *old_count = calloc(num_tokens + 1, sizeof(int));
+    int *new_count = calloc(num_tokens + 1, sizeof(int));
+    for (int i = prefix; i < n1 - suffix; i++) {
+        old_count[old_tokens[i]]++;
+    }
+    for (int i = prefix; i < n2 - suffix; i++) {
+        new_count[new_tokens[i]]++;
+    }
+
+    diff_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.old_changed = calloc(n1 + 1, 1);
+    ctx.new_changed = calloc(n2 + 1, 1);
+    int *a = malloc((n1 + 1) * sizeof(int)), *a_map = malloc((n1 + 1) * sizeof(int));
+    int *b = malloc((n2 + 1) * sizeof(int)), *b_map = malloc((n2 + 1) * sizeof(int));
+    int len1 = 0, len2 = 0;
+    for (int i = prefix; i < n1 - suffix; i++) {
+        if (new_count[old_tokens[i]] == 0) {
+            ctx.old_changed[i] = 1;
+        } else {
+            a_map[len1] = i;
+            a[len1++] = old_tokens[i];
+        }
+    }
+    for (int i = prefix; i < n2 - suffix; i++) {
+        if (old_count[new_tokens[i]] == 0) {
+            ctx.new_changed[i] = 1;
+        } else {
+            b_map[len2] = i;
+            b[len2++] = new_tokens[i];
+        }
+    }
+    ctx.a = a;
+    ctx.b = b;
+    ctx.a_map = a_map;
+    ctx.b_map = b_map;
+
+    // diagonals run from -len2 - 1 to len1 + 1
+    int *kv = malloc(2 * (len1 + len2 + 3) * sizeof(int));
+    ctx.kvdf = kv + len2 + 1;
+    ctx.kvdb = kv + (len1 + len2 + 3) + len2 + 1;
+    ctx.max_cost = MYERS_MIN_COST;
+    while ((long)ctx.max_cost * ctx.max_cost < (long)(len1 + len2 + 3)) {
+        ctx.max_cost *= 2;
+    }
+
+    diff_range all = { 0, len1, 0, len2 };
+    if (algorithm == LINE_DIFF_HISTOGRAM) {
+        ctx.head = malloc((num_tokens + 1) * sizeof(int));
+        memset(ctx.head, -1, (num_tokens + 1) * sizeof(int));
+        ctx.next = malloc((len1 + 1) * sizeof(int));
+        ctx.count = calloc(num_tokens + 1, sizeof(int));
+        ctx.budget = 32L * (len1 + len2) + 65536;
+        histogram_diff(&ctx, &all);
+    } else {
+        myers_diff(&ctx, &all);
+    }
+
+    // unchanged lines pair up in order, so changes lie between them
+    int i = 0, j = 0;
+    while (i < n1 || j < n2) {
+        if (i < n1 && j < n2 && !ctx.old_changed[i] && !ctx.new_changed[j]) {
+            i++;
+            j++;
+            continue;
+        }
+        int start1 = i, start2 = j;
+        while (i < n1 && (ctx.old_changed[i] || j == n2)) {
+            i++;
+        }
+        while (j < n2 && (ctx.new_changed[j] || i == n1)) {
+            j++;
+        }
+        add_line_change(out, start1, i - start1, start2, j - start2);
+    }
+
+    free(old_tokens);
+    free(new_tokens);
+    free(old_count);
+    free(new_count);
+    free(ctx.old_changed);
+    free(ctx.new_changed);
+    free(a);
+    free(a_map);
+    free(b);
+    free(b_map);
+    free(kv);
+    free(ctx.head);
+    free(ctx.next);
+    free(ctx.count);
+    return 0;
+}
+
+void print_hunk_range(int start, int count) {
+    if (count == 1) {
+        printf("%d", start + 1);
+    } else {
+        printf("%d,%d", count == 0 ? start : start + 1, count);
+    }
+}
+
+void print_diff_line(char prefix, const diff_line *line) {
+    putchar(prefix);
+    fwrite(line->start, 1, line->len, stdout);
+    if (line->len == 0 || line->start[line->len - 1] != '\n') {
+        printf("\n\\ No newline at end of file\n");
+    }
+}
+
+// @return 1 if line looks like the start of a function or section, as in git's default
+int is_func_line(const diff_line *line) {
+    char c = line->len > 0 ? line->start[0] : '\0';
+    return isalpha((unsigned char)c) || c == '_' || c == '$';
+}
+
+void print_unified_diff(const line_diff *diff, int context) {
+    const line_change *changes = diff->changes;
+    int func = -1, scanned = 0; // last function line before the hunk, lines searched for it
+    int k = 0;
+    while (k < diff->num_changes) {
+        int last = k;
+        while (last + 1 < diff->num_changes
+            && changes[last + 1].old_pos - (changes[last].old_pos + changes[last].old_len) <= 2 * context) {
+            last++;
+        }
+
+        // context lines are unchanged, so there are as many on both sides
+        int before = changes[k].old_pos < context ? changes[k].old_pos : context;
+        int old_end = changes[last].old_pos + changes[last].old_len;
+        int after = diff->num_old - old_end < context ? diff->num_old - old_end : context;
+        int old_start = changes[k].old_pos - before, new_start = changes[k].new_pos - before;
+        int old_count = old_end + after - old_start;
+        int new_count = changes[last].new_pos + changes[last].new_len + after - new_start;
+
+        printf("@@ -");
+        print_hunk_range(old_start, old_count);
+        printf(" +");
+        print_hunk_range(new_start, new_count);
+        printf(" @@");
+        for (; scanned < old_start; scanned++) {
+            if (is_func_line(&diff->old_lines[scanned])) {
+                func = scanned;
+            }
+        }
+        if (func >= 0) {
+            const diff_line *line = &diff->old_lines[func];
+            size_t len = line->len > 0 && line->start[line->len - 1] == '\n' ? line->len - 1 : line->len;
+            printf(" %.*s", (int)(len < DIFF_FUNC_LINE_MAX ? len : DIFF_FUNC_LINE_MAX), line->start);
+        }
+        printf("\n");
+
+        int i = old_start;
+        for (int c = k; c <= last; c++) {
+            for (; i < changes[c].old_pos; i++) {
+                print_diff_line(' ', &diff->old_lines[i]);
+            }
+            for (int n = 0; n < changes[c].old_len; n++) {
+                print_diff_line('-', &diff->old_lines[changes[c].old_pos + n]);
+            }
+            for (int n = 0; n < changes[c].new_len; n++) {
+                print_diff_line('+', &diff->new_lines[changes[c].new_pos + n]);
+            }
+            i = changes[c].old_pos + changes[c].old_len;
+        }
+        for (; i < old_end + after; i++) {
+            print_diff_line(' ', &diff->old_lines[i]);
+        }
+        k = last + 1;
+    }
+}
+
+void free_line_diff(line_diff *diff) {
+    free(diff->old_lines);
+    free(diff->new_lines);
+    free(diff->changes);
+    memset(diff, 0, sizeof(*diff));
+}
+
+int read_diff_file(const git_repo *repo, unsigned int mode, const char *hash, const char *name, diff_file *out) {
+    out->mode = mode;
+    out->hash[0] = '\0';
+    out->blob = NULL;
+    if (mode == 0) {
+        return 0;
+    }
+
+    if (name == NULL) {
+        snprintf(out->hash, OBJ_HASH_SIZE, "%s", hash);
+        out->blob = create_blob_from_disk(repo, out->hash);
+    } else {
+        fileinfo finfo;
+        fs_path_join(repo->root_path, name, finfo.path);
+        if (fs_getinfo(finfo.path, &finfo.stat) == 0 && (finfo.fptr = fs_fopen(finfo.path, "rb")) != NULL) {
+            out->mode = stat_mode_to_git(finfo.stat.fi_mode);
+            out->blob = create_blob_from_file(&finfo);
+            end_fileinfo(&finfo);
+        }
+        if (out->blob != NULL) {
+            snprintf(out->hash, OBJ_HASH_SIZE, "%s", out->blob->obj.hash);
+        }
+    }
+    if (out->blob == NULL) {
+        printf("ERROR: could not read %s\n", name != NULL ? name : hash);
+        return -1;
+    }
+    return 0;
+}
+
+void free_diff_file(diff_file *file) {
+    free_blob(file->blob);
+    file->blob = NULL;
+}
+
+// @param moved "rename" or "copy" if `new_path` came from `old_path`, NULL otherwise
+void print_paths_diff(const char *old_path, const char *new_path, const char *moved, int score,
+    const diff_file *old, const diff_file *new, const diff_options *options) {
+
+    printf("diff --git a/%s b/%s\n", old_path, new_path);
+    if (old->mode == 0) {
+        printf("new file mode %06o\n", new->mode);
+    } else if (new->mode == 0) {
+        printf("deleted file mode %06o\n", old->mode);
+    } else if (old->mode != new->mode) {
+        printf("old mode %06o\nnew mode %06o\n", old->mode, new->mode);
+    }
+    if (moved != NULL) {
+        printf("similarity index %d%%\n%s from %s\n%s to %s\n", score, moved, old_path, moved, new_path);
+    }
+    if (strcmp(old->hash, new->hash) == 0) {
+        return;
+    }
+    printf("index %.7s..%.7s", old->mode ? old->hash : "0000000000", new->mode ? new->hash : "0000000000");
+    if (old->mode != 0 && old->mode == new->mode) {
+        printf(" %06o", old->mode);
+    }
+    printf("\n");
+
+    size_t old_size = 0, new_size = 0;
+    const unsigned char *old_data = old->blob != NULL ? blob_contents(old->blob, &old_size) : NULL;
+    const unsigned char *new_data = new->blob != NULL ? blob_contents(new->blob, &new_size) : NULL;
+    if ((old_data != NULL && is_like_binary(old_data, old_size)) || (new_data != NULL && is_like_binary(new_data, new_size))) {
+        printf("Binary files %s%s and %s%s differ\n", old->mode ? "a/" : "", old->mode ? old_path : "/dev/null",
+            new->mode ? "b/" : "", new->mode ? new_path : "/dev/null");
+        return;
+    }
+    printf("--- %s%s\n", old->mode ? "a/" : "", old->mode ? old_path : "/dev/null");
+    printf("+++ %s%s\n", new->mode ? "b/" : "", new->mode ? new_path : "/dev/null");
+
+    line_diff diff;
+    diff_lines(old_data != NULL ? (const char *)old_data : "", old_size, new_data != NULL ? (const char *)new_data : "", new_size,
+        options->algorithm, &diff);
+    print_unified_diff(&diff, options->context);
+    free_line_diff(&diff);
+}
+
+void print_file_diff(const char *path, const diff_file *old, const diff_file *new, const diff_options *options) {
+    if (old->mode == new->mode && strcmp(old->hash, new->hash) == 0) {
+        return;
+    }
+    print_paths_diff(path, path, NULL, 0, old, new, options);
+}
+
+void print_moved_file_diff(const char *old_path, const char *new_path, int copied, int score,
+    const diff_file *old, const diff_file *new, const diff_options *options) {
+
+    print_paths_diff(old_path, new_path, copied ? "copy" : "rename", score, old, new, options);
+}
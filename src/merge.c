@@ -0,0 +1,555 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "linediff.h"
+#include "merge.h"
+
+typedef struct merge_buf {
+    char *data;
+    size_t size;
+    size_t capacity;
+} merge_buf;
+
+void merge_buf_append(merge_buf *buf, const char *data, size_t size) {
+    if (buf->size + size > buf->capacity) {
+        while (buf->size + size > buf->capacity) {
+            buf->capacity = buf->capacity ? buf->capacity * 2 : 4096;
+        }
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+// appends lines [lo, hi), which are contiguous in their buffer
+void merge_buf_append_lines(merge_buf *buf, const diff_line *lines, int lo, int hi) {
+    if (lo < hi) {
+        merge_buf_append(buf, lines[lo].start, lines[hi - 1].start + lines[hi - 1].len - lines[lo].start);
+    }
+}
+
+int same_diff_line(const diff_line *a, const diff_line *b) {
+    return a->len == b->len && memcmp(a->start, b->start, a->len) == 0;
+}
+
+// appends lines [lo, hi) inside conflict markers, ending the last one if it has no '\n'
+void merge_buf_append_side(merge_buf *buf, const diff_line *lines, int lo, int hi) {
+    merge_buf_append_lines(buf, lines, lo, hi);
+    if (lo < hi && lines[hi - 1].start[lines[hi - 1].len - 1] != '\n') {
+        merge_buf_append(buf, "\n", 1);
+    }
+}
+
+void merge_buf_append_marker(merge_buf *buf, char c, const char *label) {
+    char marker[MERGE_MARKER_SIZE + 1];
+    memset(marker, c, MERGE_MARKER_SIZE);
+    marker[MERGE_MARKER_SIZE] = '\0';
+    merge_buf_append(buf, marker, MERGE_MARKER_SIZE);
+    if (label != NULL) {
+        merge_buf_append(buf, " ", 1);
+        merge_buf_append(buf, label, strlen(label));
+    }
+    merge_buf_append(buf, "\n", 1);
+}
+
+// Appends ours [o_lo, o_hi) and theirs [t_lo, t_hi), which replace the same base lines.
+// Lines both sides start or end with are kept outside the markers.
+// @return 1 if a conflict hunk was written, 0 if both sides made the same change
+int merge_overlap(merge_buf *buf, const line_diff *ours, int o_lo, int o_hi, const line_diff *theirs, int t_lo, int t_hi,
+    const merge_options *options) {
+
+    const diff_line *o = ours->new_lines, *t = theirs->new_lines;
+    int start = 0;
+    while (o_lo + start < o_hi && t_lo + start < t_hi && same_diff_line(&o[o_lo + start], &t[t_lo + start])) {
+        start++;
+    }
+    int end = 0;
+    while (o_hi - end > o_lo + start && t_hi - end > t_lo + start && same_diff_line(&o[o_hi - end - 1], &t[t_hi - end - 1])) {
+        end++;
+    }
+    merge_buf_append_lines(buf, o, o_lo, o_lo + start);
+    int conflict = o_hi - o_lo != start + end || t_hi - t_lo != start + end;
+    if (conflict) {
+        merge_buf_append_marker(buf, '<', options->ours_label);
+        merge_buf_append_side(buf, o, o_lo + start, o_hi - end);
+        merge_buf_append_marker(buf, '=', NULL);
+        merge_buf_append_side(buf, t, t_lo + start, t_hi - end);
+        merge_buf_append_marker(buf, '>', options->theirs_label);
+    }
+    merge_buf_append_lines(buf, o, o_hi - end, o_hi);
+    return conflict;
+}
+
+int merge_contents(const char *base, size_t base_size, const char *ours, size_t ours_size,
+    const char *theirs, size_t theirs_size, const merge_options *options, char **out, size_t *out_size) {
+
+    line_diff a, b;
+    diff_lines(base, base_size, ours, ours_size, options->algorithm, &a);
+    diff_lines(base, base_size, theirs, theirs_size, options->algorithm, &b);
+
+    // changes of both sides are walked in base order, and changes that overlap or touch
+    // are grouped into one range of base that each side replaces
+    merge_buf buf = { NULL, 0, 0 };
+    int num_conflicts = 0, base_pos = 0, i = 0, j = 0;
+    long delta_a = 0, delta_b = 0; // lines added minus removed by each side before the group
+    while (i < a.num_changes || j < b.num_changes) {
+        int lo = i == a.num_changes ? b.changes[j].old_pos
+            : j == b.num_changes ? a.changes[i].old_pos
+            : a.changes[i].old_pos < b.changes[j].old_pos ? a.changes[i].old_pos : b.changes[j].old_pos;
+        int hi = lo, first_a = i, first_b = j;
+        for (int grew = 1; grew;) {
+            grew = 0;
+            for (; i < a.num_changes && a.changes[i].old_pos <= hi; i++, grew = 1) {
+                int end = a.changes[i].old_pos + a.changes[i].old_len;
+                hi = end > hi ? end : hi;
+            }
+            for (; j < b.num_changes && b.changes[j].old_pos <= hi; j++, grew = 1) {
+                int end = b.changes[j].old_pos + b.changes[j].old_len;
+                hi = end > hi ? end : hi;
+            }
+        }
+
+        // lines of each side replacing base [lo, hi)
+        int a_lo = lo + delta_a, a_hi = hi + delta_a, b_lo = lo + delta_b, b_hi = hi + delta_b;
+        if (i > first_a) {
+            const line_change *first = &a.changes[first_a], *last = &a.changes[i - 1];
+            a_lo = first->new_pos - (first->old_pos - lo);
+            a_hi = last->new_pos + last->new_len + (hi - (last->old_pos + last->old_len));
+            delta_a = a_hi - hi;
+        }
+        if (j > first_b) {
+            const line_change *first = &b.changes[first_b], *last = &b.changes[j - 1];
+            b_lo = first->new_pos - (first->old_pos - lo);
+            b_hi = last->new_pos + last->new_len + (hi - (last->old_pos + last->old_len));
+            delta_b = b_hi - hi;
+        }
+
+        merge_buf_append_lines(&buf, a.old_lines, base_pos, lo);
+        if (j == first_b) {
+            merge_buf_append_lines(&buf, a.new_lines, a_lo, a_hi);
+        } else if (i == first_a) {
+            merge_buf_append_lines(&buf, b.new_lines, b_lo, b_hi);
+        } else {
+            num_conflicts += merge_overlap(&buf, &a, a_lo, a_hi, &b, b_lo, b_hi, options);
+        }
+        base_pos = hi;
+    }
+    merge_buf_append_lines(&buf, a.old_lines, base_pos, a.num_old);
+
+    free_line_diff(&a);
+    free_line_diff(&b);
+    if (buf.data == NULL) {
+        buf.data = malloc(1);
+    }
+    *out = buf.data;
+    *out_size = buf.size;
+    return num_conflicts;
+}
+
+// one version of a path, `hash` is NULL if path is missing from it
+typedef struct merge_version {
+    unsigned int mode;
+    const char *hash;
+} merge_version;
+
+// entry of a merged folder's tree
+typedef struct merge_entry {
+    char *name;
+    int is_dir;
+    unsigned int mode;
+    obj_hash hash;
+    merge_version versions[3]; // of a file, for reporting a file/folder conflict
+    obj_hash version_hashes[3];
+} merge_entry;
+
+typedef struct merge_ctx {
+    const git_repo *repo;
+    const merge_options *options;
+    merge_result *out;
+} merge_ctx;
+
+int same_merge_version(merge_version a, merge_version b) {
+    if (a.hash == NULL || b.hash == NULL) {
+        return a.hash == b.hash;
+    }
+    return a.mode == b.mode && strcmp(a.hash, b.hash) == 0;
+}
+
+// @return 1 if both trees are empty or have the same hash
+int merge_same_tree(const char *a, const char *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+void merge_add_conflict(merge_result *out, const char *path, merge_conflict_kind kind, const merge_version *versions) {
+    if (out->num_conflicts == out->capacity) {
+        out->capacity = out->capacity ? out->capacity * 2 : 16;
+        out->conflicts = realloc(out->conflicts, out->capacity * sizeof(merge_conflict));
+    }
+    merge_conflict *conflict = &out->conflicts[out->num_conflicts++];
+    conflict->path = strdup(path);
+    conflict->kind = kind;
+    for (int k = 0; k < 3; k++) {
+        conflict->modes[k] = versions[k].hash != NULL ? versions[k].mode : 0;
+        snprintf(conflict->hashes[k], OBJ_HASH_SIZE, "%s", versions[k].hash != NULL ? versions[k].hash : "");
+    }
+}
+
+int is_regular_mode(unsigned int mode) {
+    return (mode & 0170000) == 0100000;
+}
+
+// @return blob's contents, "" of size 0 if `version` is missing, NULL if blob could not be read
+const unsigned char *merge_read_version(const git_repo *repo, merge_version version, git_obj_blob **blob, size_t *size) {
+    *blob = NULL;
+    *size = 0;
+    if (version.hash == NULL) {
+        return (const unsigned char *)"";
+    }
+    obj_hash hash;
+    snprintf(hash, OBJ_HASH_SIZE, "%s", version.hash);
+    if ((*blob = create_blob_from_disk(repo, hash)) == NULL) {
+        printf("ERROR: could not read blob %s\n", hash);
+        return NULL;
+    }
+    return blob_contents(*blob, size);
+}
+
+// Resolves a file both sides changed differently.
+// @param versions base, ours and theirs
+// @param mode, hash filled with the result's version, `hash` is "" if the result has no file
+// @return 0 on success, -1 if a blob could not be read or written
+int merge_file(merge_ctx *ctx, const char *path, const merge_version *versions, unsigned int *mode, obj_hash *hash) {
+    merge_version base = versions[0], ours = versions[1], theirs = versions[2];
+    if (ours.hash == NULL || theirs.hash == NULL) {
+        merge_version kept = ours.hash != NULL ? ours : theirs;
+        merge_add_conflict(ctx->out, path, MERGE_CONFLICT_MODIFY_DELETE, versions);
+        *mode = kept.mode;
+        snprintf(*hash, OBJ_HASH_SIZE, "%s", kept.hash);
+        return 0;
+    }
+    *mode = ours.mode;
+    snprintf(*hash, OBJ_HASH_SIZE, "%s", ours.hash);
+    if (!is_regular_mode(ours.mode) || !is_regular_mode(theirs.mode) || (base.hash != NULL && !is_regular_mode(base.mode))) {
+        merge_add_conflict(ctx->out, path, MERGE_CONFLICT_BINARY, versions);
+        return 0;
+    }
+
+    git_obj_blob *blobs[3];
+    size_t sizes[3];
+    const unsigned char *data[3];
+    int rc = 0;
+    for (int k = 0; k < 3; k++) {
+        data[k] = merge_read_version(ctx->repo, versions[k], &blobs[k], &sizes[k]);
+        rc |= data[k] == NULL ? -1 : 0;
+    }
+    if (rc == 0 && (is_like_binary(data[0], sizes[0]) || is_like_binary(data[1], sizes[1]) || is_like_binary(data[2], sizes[2]))) {
+        merge_add_conflict(ctx->out, path, MERGE_CONFLICT_BINARY, versions);
+    } else if (rc == 0) {
+        char *merged;
+        size_t merged_size;
+        int num_conflicts = merge_contents((const char *)data[0], sizes[0], (const char *)data[1], sizes[1],
+            (const char *)data[2], sizes[2], ctx->options, &merged, &merged_size);
+
+        git_obj obj;
+        create_git_obj((unsigned char *)merged, merged_size, O_TYPE_BLOB, &obj);
+        if (write_obj_to_disk(ctx->repo, obj.hash, obj.data, obj.size) != 0) {
+            rc = -1;
+        } else {
+            // a mode change on one side only is taken like a content change
+            *mode = base.hash != NULL && ours.mode == base.mode ? theirs.mode : ours.mode;
+            snprintf(*hash, OBJ_HASH_SIZE, "%s", obj.hash);
+            if (num_conflicts > 0) {
+                merge_add_conflict(ctx->out, path, base.hash != NULL ? MERGE_CONFLICT_CONTENT : MERGE_CONFLICT_ADD_ADD, versions);
+            }
+        }
+        free(obj.data);
+        free(merged);
+    }
+    for (int k = 0; k < 3; k++) {
+        free_blob(blobs[k]);
+    }
+    return rc;
+}
+
+int cmp_merge_entry_names(const void *a, const void *b) {
+    return strcmp((*(merge_entry * const *)a)->name, (*(merge_entry * const *)b)->name);
+}
+
+// Drops files that have a folder of the same name, reporting them.
+// @param prefix path of folder holding the entries, including trailing '/'
+void merge_file_directory(merge_ctx *ctx, const char *prefix, merge_entry *entries, int *num_entries) {
+    merge_entry **sorted = malloc(*num_entries * sizeof(merge_entry *));
+    int num_dirs = 0;
+    for (int i = 0; i < *num_entries; i++) {
+        sorted[i] = &entries[i];
+        num_dirs += entries[i].is_dir;
+    }
+    if (num_dirs == 0 || num_dirs == *num_entries) {
+        free(sorted);
+        return;
+    }
+
+    // a file and a folder of the same name sit next to each other by plain name
+    qsort(sorted, *num_entries, sizeof(merge_entry *), cmp_merge_entry_names);
+    char path[PATH_MAX];
+    for (int i = 1; i < *num_entries; i++) {
+        if (strcmp(sorted[i - 1]->name, sorted[i]->name) == 0) {
+            merge_entry *file = sorted[i - 1]->is_dir ? sorted[i] : sorted[i - 1];
+            snprintf(path, sizeof(path), "%s%s", prefix, file->name);
+            merge_add_conflict(ctx->out, path, MERGE_CONFLICT_FILE_DIRECTORY, file->versions);
+            free(file->name);
+            file->name = NULL;
+        }
+    }
+    free(sorted);
+
+    int kept = 0;
+    for (int i = 0; i < *num_entries; i++) {
+        if (entries[i].name != NULL) {
+            entries[kept++] = entries[i];
+        }
+    }
+    *num_entries = kept;
+}
+
+// Merges one folder, writing its tree and any merged subtrees.
+// @param hashes subtree of this folder in base, ours and theirs, NULL if missing
+// @param prefix path of folder including trailing '/', "" for root
+// @param out filled with hash of merged tree, "" if it is empty and not the root
+// @return 0 on success, -1 if an object could not be read or written
+int merge_folder(merge_ctx *ctx, const char **hashes, char *prefix, obj_hash *out) {
+    tree_iter iters[3];
+    tree_iter_entry cur[3];
+    int has[3];
+    int num_open = 0, rc = 0;
+    for (int i = 0; i < 3; i++) {
+        if (tree_iter_open(ctx->repo, hashes[i], &iters[i]) != 0) {
+            rc = -1;
+            break;
+        }
+        num_open++;
+        has[i] = tree_iter_next(&iters[i], &cur[i]);
+    }
+
+    size_t prefix_len = strlen(prefix);
+    merge_entry *entries = NULL;
+    int num_entries = 0, capacity = 0;
+    while (rc == 0) {
+        const char *key = NULL;
+        size_t key_len = 0;
+        int key_dir = 0;
+        for (int i = 0; i < 3; i++) {
+            if (has[i] == 1 && (key == NULL || tree_order_cmp(cur[i].name, cur[i].name_len, cur[i].type == TREE_OBJ,
+                key, key_len, key_dir) < 0)) {
+                key = cur[i].name;
+                key_len = cur[i].name_len;
+                key_dir = cur[i].type == TREE_OBJ;
+            }
+        }
+        if (key == NULL) {
+            break;
+        }
+        if (prefix_len + key_len + 2 > PATH_MAX) {
+            rc = -1;
+            break;
+        }
+        memcpy(prefix + prefix_len, key, key_len);
+        prefix[prefix_len + key_len] = '\0';
+
+        merge_version versions[3];
+        for (int i = 0; i < 3; i++) {
+            int matched = has[i] == 1 && cur[i].name_len == key_len && (cur[i].type == TREE_OBJ) == key_dir
+                && memcmp(cur[i].name, key, key_len) == 0;
+            versions[i].mode = matched ? cur[i].git_mode : 0;
+            versions[i].hash = matched ? cur[i].hash : NULL;
+        }
+
+        if (num_entries == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            entries = realloc(entries, capacity * sizeof(merge_entry));
+        }
+        merge_entry *entry = &entries[num_entries];
+        entry->is_dir = key_dir;
+        entry->hash[0] = '\0';
+
+        // a side that did not change a path leaves it to the other side
+        merge_version base = versions[0], ours = versions[1], theirs = versions[2];
+        const merge_version *taken = same_merge_version(ours, theirs) || same_merge_version(base, theirs) ? &versions[1]
+            : same_merge_version(base, ours) ? &versions[2] : NULL;
+        if (taken != NULL) {
+            entry->mode = taken->mode;
+            snprintf(entry->hash, OBJ_HASH_SIZE, "%s", taken->hash != NULL ? taken->hash : "");
+        } else if (key_dir) {
+            const char *sub_hashes[3] = { base.hash, ours.hash, theirs.hash };
+            entry->mode = GIT_MODE_DIR;
+            strcat(prefix, "/");
+            rc = merge_folder(ctx, sub_hashes, prefix, &entry->hash);
+        } else {
+            rc = merge_file(ctx, prefix, versions, &entry->mode, &entry->hash);
+        }
+
+        if (rc == 0 && entry->hash[0] != '\0') {
+            entry->name = strndup(key, key_len);
+            for (int i = 0; i < 3; i++) {
+                snprintf(entry->version_hashes[i], OBJ_HASH_SIZE, "%s", versions[i].hash != NULL ? versions[i].hash : "");
+                entry->versions[i].mode = versions[i].mode;
+                entry->versions[i].hash = versions[i].hash != NULL ? entry->version_hashes[i] : NULL;
+            }
+            num_entries++;
+        }
+        prefix[prefix_len] = '\0';
+
+        // versions point into the trees being walked, so iterators only move on afterwards
+        for (int i = 0; i < 3; i++) {
+            if (versions[i].hash != NULL) {
+                has[i] = tree_iter_next(&iters[i], &cur[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < num_open; i++) {
+        if (rc == 0 && has[i] == -1) {
+            printf("ERROR: could not parse tree %s\n", hashes[i]);
+            rc = -1;
+        }
+        tree_iter_close(&iters[i]);
+    }
+
+    if (rc == 0) {
+        merge_file_directory(ctx, prefix, entries, &num_entries);
+    }
+    (*out)[0] = '\0';
+    if (rc == 0 && (num_entries > 0 || prefix_len == 0)) {
+        size_t capacity = 256, used = 0;
+        unsigned char *content = malloc(capacity);
+        for (int i = 0; i < num_entries; i++) {
+            size_t line_max = TREE_ENTRY_LINE_FIXED + strlen(entries[i].name) + 2;
+            if (used + line_max > capacity) {
+                capacity = (used + line_max) * 2;
+                content = realloc(content, capacity);
+            }
+            used += snprintf((char *)content + used, capacity - used, "%06o %s %s %s\n", entries[i].mode,
+                entries[i].is_dir ? O_TYPE_TREE : O_TYPE_BLOB, entries[i].hash, entries[i].name);
+        }
+        git_obj obj;
+        create_git_obj(content, used, O_TYPE_TREE, &obj);
+        rc = write_obj_to_disk(ctx->repo, obj.hash, obj.data, obj.size);
+        snprintf(*out, OBJ_HASH_SIZE, "%s", obj.hash);
+        free(obj.data);
+        free(content);
+    }
+
+    for (int i = 0; i < num_entries; i++) {
+        free(entries[i].name);
+    }
+    free(entries);
+    return rc;
+}
+
+int cmp_merge_conflicts(const void *a, const void *b) {
+    return index_sort_cmp(((const merge_conflict *)a)->path, ((const merge_conflict *)b)->path);
+}
+
+int merge_trees(const git_repo *repo, const char *base, const char *ours, const char *theirs,
+    const merge_options *options, merge_result *out) {
+
+    out->tree[0] = '\0';
+    out->conflicts = NULL;
+    out->num_conflicts = 0;
+    out->capacity = 0;
+
+    merge_options defaults = { "ours", "theirs", LINE_DIFF_MYERS };
+    merge_ctx ctx = { repo, options != NULL ? options : &defaults, out };
+
+    // a side that changed nothing leaves the other side's tree as is
+    const char *taken = merge_same_tree(base, theirs) || merge_same_tree(ours, theirs) ? ours
+        : merge_same_tree(base, ours) ? theirs : NULL;
+    if (taken != NULL) {
+        snprintf(out->tree, OBJ_HASH_SIZE, "%s", taken);
+        return 0;
+    }
+
+    const char *trees[] = { base, ours, theirs };
+    char prefix[PATH_MAX] = "";
+    if (merge_folder(&ctx, trees, prefix, &out->tree) != 0) {
+        free_merge_result(out);
+        return -1;
+    }
+    if (out->num_conflicts > 1) {
+        qsort(out->conflicts, out->num_conflicts, sizeof(merge_conflict), cmp_merge_conflicts);
+    }
+    return out->num_conflicts > 0 ? 1 : 0;
+}
+
+void free_merge_result(merge_result *result) {
+    for (int i = 0; i < result->num_conflicts; i++) {
+        free(result->conflicts[i].path);
+    }
+    free(result->conflicts);
+    result->conflicts = NULL;
+    result->num_conflicts = 0;
+    result->capacity = 0;
+}
+
+void add_merge_conflicts_to_dc(git_dircache *dircache, const merge_result *result) {
+    int capacity = dircache->num_entries + 3 * result->num_conflicts + 1;
+    git_index_entry **entries = malloc(capacity * sizeof(git_index_entry *));
+    int num_entries = 0, i = 0;
+    for (int c = 0; c < result->num_conflicts; c++) {
+        const merge_conflict *conflict = &result->conflicts[c];
+        while (i < dircache->num_entries && index_sort_cmp(dircache->entries[i]->name, conflict->path) < 0) {
+            entries[num_entries++] = dircache->entries[i++];
+        }
+        while (i < dircache->num_entries && index_sort_cmp(dircache->entries[i]->name, conflict->path) == 0) {
+            free(dircache->entries[i++]);
+        }
+        invalidate_cached_trees(dircache, conflict->path);
+        size_t namelen = strlen(conflict->path);
+        for (int k = 0; k < 3; k++) {
+            if (conflict->modes[k] == 0) {
+                continue;
+            }
+            git_index_entry *entry = calloc(1, sizeof(*entry) + namelen + 1);
+            memcpy(entry->name, conflict->path, namelen + 1);
+            entry->namelen = namelen;
+            entry->git_mode = conflict->modes[k];
+            entry->unix_perm = conflict->modes[k] & 0777;
+            entry->stage_num = k + 1;
+            snprintf(entry->hash, OBJ_HASH_SIZE, "%s", conflict->hashes[k]);
+            entries[num_entries++] = entry;
+        }
+    }
+    while (i < dircache->num_entries) {
+        entries[num_entries++] = dircache->entries[i++];
+    }
+    free(dircache->entries);
+    dircache->entries = entries;
+    dircache->num_entries = num_entries;
+    dircache->capacity = capacity;
+}
+
+void print_merge_conflicts(const merge_result *result, const char *ours_label, const char *theirs_label) {
+    for (int i = 0; i < result->num_conflicts; i++) {
+        const merge_conflict *conflict = &result->conflicts[i];
+        if (conflict->kind == MERGE_CONFLICT_MODIFY_DELETE) {
+            printf("CONFLICT (modify/delete): %s deleted in %s and modified in %s.\n", conflict->path,
+                conflict->modes[1] == 0 ? ours_label : theirs_label, conflict->modes[1] == 0 ? theirs_label : ours_label);
+        } else if (conflict->kind == MERGE_CONFLICT_FILE_DIRECTORY) {
+            printf("CONFLICT (file/directory): directory in the way of %s from %s.\n", conflict->path,
+                conflict->modes[1] != 0 ? ours_label : theirs_label);
+        } else {
+            if (conflict->kind == MERGE_CONFLICT_BINARY) {
+                printf("warning: Cannot merge binary files: %s (%s vs. %s)\n", conflict->path, ours_label, theirs_label);
+            }
+            printf("CONFLICT (%s): Merge conflict in %s\n",
+                conflict->kind == MERGE_CONFLICT_ADD_ADD ? "add/add" : "content", conflict->path);
+        }
+    }
+}
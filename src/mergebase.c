@@ -0,0 +1,514 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "mergebase.h"
+
+#define MB_HASH_LEN 20
+
+#define MB_PARENT1 1
+#define MB_PARENT2 2
+#define MB_STALE 4
+#define MB_RESULT 8
+#define MB_SEEN 16
+
+// commit missing from commit-graph
+typedef struct mb_extra {
+    unsigned char hash[MB_HASH_LEN];
+    uint32_t *parents; // ids
+    int num_parents;
+    int parsed;
+    time_t timestamp;
+} mb_extra;
+
+typedef struct mb_ctx {
+    const git_repo *repo;
+    commit_graph *graph;
+    uint32_t num_graph; // ids below this are commit-graph positions, the rest index `extras`
+    uint8_t *slab; // flags by id
+    mb_extra *extras;
+    uint32_t num_extras;
+    uint32_t capacity;
+    uint32_t *table; // open addressing over extras, index + 1, 0 if empty
+    uint32_t table_size;
+    uint32_t *touched; // ids with flags set, cleared after each walk
+    uint32_t num_touched;
+    uint32_t touched_capacity;
+    uint32_t *heap;
+    uint32_t heap_size;
+    uint32_t heap_capacity;
+    uint32_t *parents_buf; // parents of last commit-graph commit asked for
+    int parents_capacity;
+} mb_ctx;
+
+void mb_init(mb_ctx *ctx, const git_repo *repo) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->repo = repo;
+    ctx->graph = commit_graph_open(repo);
+    ctx->num_graph = ctx->graph != NULL ? ctx->graph->num_commits : 0;
+    ctx->capacity = 64;
+    ctx->extras = malloc(ctx->capacity * sizeof(mb_extra));
+    ctx->slab = calloc(ctx->num_graph + ctx->capacity, 1);
+    ctx->table_size = 256;
+    ctx->table = calloc(ctx->table_size, sizeof(uint32_t));
+    ctx->parents_capacity = 8;
+    ctx->parents_buf = malloc(ctx->parents_capacity * sizeof(uint32_t));
+}
+
+void mb_free(mb_ctx *ctx) {
+    for (uint32_t i = 0; i < ctx->num_extras; i++) {
+        free(ctx->extras[i].parents);
+    }
+    if (ctx->graph != NULL) {
+        commit_graph_close(ctx->graph);
+    }
+    free(ctx->extras);
+    free(ctx->slab);
+    free(ctx->table);
+    free(ctx->touched);
+    free(ctx->heap);
+    free(ctx->parents_buf);
+}
+
+uint32_t mb_slot(const mb_ctx *ctx, const unsigned char *hash) {
+    uint32_t slot = (((uint32_t)hash[0] << 24) | (hash[1] << 16) | (hash[2] << 8) | hash[3]) & (ctx->table_size - 1);
+    while (ctx->table[slot] != 0 && memcmp(ctx->extras[ctx->table[slot] - 1].hash, hash, MB_HASH_LEN) != 0) {
+        slot = (slot + 1) & (ctx->table_size - 1);
+    }
+    return slot;
+}
+
+// @return id of commit, its commit-graph position if it is in it
+uint32_t mb_id(mb_ctx *ctx, const unsigned char *hash) {
+    uint32_t pos;
+    if (ctx->graph != NULL && commit_graph_find_bytes(ctx->graph, hash, &pos)) {
+        return pos;
+    }
+    uint32_t slot = mb_slot(ctx, hash);
+    if (ctx->table[slot] != 0) {
+        return ctx->num_graph + ctx->table[slot] - 1;
+    }
+
+    if (ctx->num_extras == ctx->capacity) {
+        ctx->capacity *= 2;
+        ctx->extras = realloc(ctx->extras, ctx->capacity * sizeof(mb_extra));
+        ctx->slab = realloc(ctx->slab, ctx->num_graph + ctx->capacity);
+        memset(ctx->slab + ctx->num_graph + ctx->num_extras, 0, ctx->capacity - ctx->num_extras);
+    }
+    mb_extra *extra = &ctx->extras[ctx->num_extras++];
+    memset(extra, 0, sizeof(*extra));
+    memcpy(extra->hash, hash, MB_HASH_LEN);
+    ctx->table[slot] = ctx->num_extras;
+
+    if (ctx->num_extras * 2 > ctx->table_size) {
+        free(ctx->table);
+        ctx->table_size *= 2;
+        ctx->table = calloc(ctx->table_size, sizeof(uint32_t));
+        for (uint32_t i = 0; i < ctx->num_extras; i++) {
+            ctx->table[mb_slot(ctx, ctx->extras[i].hash)] = i + 1;
+        }
+    }
+    return ctx->num_graph + ctx->num_extras - 1;
+}
+
+uint32_t mb_id_of(mb_ctx *ctx, const obj_hash hash) {
+    unsigned char raw[MB_HASH_LEN];
+    hash_to_bytes(hash, raw);
+    return mb_id(ctx, raw);
+}
+
+// reads commit file of a commit missing from commit-graph
+// @return 0 on success, -1 if it could not be read
+int mb_parse(mb_ctx *ctx, uint32_t id) {
+    if (id < ctx->num_graph || ctx->extras[id - ctx->num_graph].parsed) {
+        return 0;
+    }
+
+    obj_hash hash;
+    commit_info info;
+    hash_from_bytes(ctx->extras[id - ctx->num_graph].hash, &hash);
+    if (read_commit_info(ctx->repo, hash, &info) != 0) {
+        return -1;
+    }
+    uint32_t *parents = malloc((info.num_parents + 1) * sizeof(uint32_t));
+    for (int i = 0; i < info.num_parents; i++) {
+        parents[i] = mb_id_of(ctx, info.parents[i]);
+    }
+
+    mb_extra *extra = &ctx->extras[id - ctx->num_graph];
+    extra->parents = parents;
+    extra->num_parents = info.num_parents;
+    extra->timestamp = info.timestamp;
+    extra->parsed = 1;
+    free_commit_info(&info);
+    return 0;
+}
+
+uint32_t mb_generation(const mb_ctx *ctx, uint32_t id) {
+    return id < ctx->num_graph ? commit_graph_generation(ctx->graph, id) : GENERATION_INFINITY;
+}
+
+time_t mb_timestamp(const mb_ctx *ctx, uint32_t id) {
+    return id < ctx->num_graph ? commit_graph_timestamp(ctx->graph, id) : ctx->extras[id - ctx->num_graph].timestamp;
+}
+
+// @return number of parents of parsed commit, with `out` pointing to their ids until next call
+int mb_parents(mb_ctx *ctx, uint32_t id, const uint32_t **out) {
+    if (id >= ctx->num_graph) {
+        *out = ctx->extras[id - ctx->num_graph].parents;
+        return ctx->extras[id - ctx->num_graph].num_parents;
+    }
+    int num_parents = commit_graph_parents(ctx->graph, id, ctx->parents_buf, ctx->parents_capacity);
+    if (num_parents > ctx->parents_capacity) {
+        ctx->parents_capacity = num_parents;
+        ctx->parents_buf = realloc(ctx->parents_buf, num_parents * sizeof(uint32_t));
+        commit_graph_parents(ctx->graph, id, ctx->parents_buf, num_parents);
+    }
+    *out = ctx->parents_buf;
+    return num_parents;
+}
+
+void mb_mark(mb_ctx *ctx, uint32_t id, uint8_t flags) {
+    if (ctx->slab[id] == 0) {
+        if (ctx->num_touched == ctx->touched_capacity) {
+            ctx->touched_capacity = ctx->touched_capacity ? ctx->touched_capacity * 2 : 64;
+            ctx->touched = realloc(ctx->touched, ctx->touched_capacity * sizeof(uint32_t));
+        }
+        ctx->touched[ctx->num_touched++] = id;
+    }
+    ctx->slab[id] |= flags;
+}
+
+void mb_clear(mb_ctx *ctx) {
+    for (uint32_t i = 0; i < ctx->num_touched; i++) {
+        ctx->slab[ctx->touched[i]] = 0;
+    }
+    ctx->num_touched = 0;
+}
+
+// @return 1 if `a` is walked before `b`: higher generation first, commits missing from
+// commit-graph before all others, then newer commit time first
+int mb_before(const mb_ctx *ctx, uint32_t a, uint32_t b) {
+    uint32_t gen_a = mb_generation(ctx, a), gen_b = mb_generation(ctx, b);
+    if (gen_a != gen_b) {
+        return gen_a > gen_b;
+    }
+    return mb_timestamp(ctx, a) > mb_timestamp(ctx, b);
+}
+
+void mb_push(mb_ctx *ctx, uint32_t id) {
+    if (ctx->heap_size == ctx->heap_capacity) {
+        ctx->heap_capacity = ctx->heap_capacity ? ctx->heap_capacity * 2 : 64;
+        ctx->heap = realloc(ctx->heap, ctx->heap_capacity * sizeof(uint32_t));
+    }
+    uint32_t i = ctx->heap_size++;
+    while (i > 0 && mb_before(ctx, id, ctx->heap[(i - 1) / 2])) {
+        ctx->heap[i] = ctx->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ctx->heap[i] = id;
+}
+
+uint32_t mb_pop(mb_ctx *ctx) {
+    uint32_t top = ctx->heap[0];
+    uint32_t last = ctx->heap[--ctx->heap_size];
+    uint32_t i = 0;
+    while (2 * i + 1 < ctx->heap_size) {
+        uint32_t child = 2 * i + 1;
+        if (child + 1 < ctx->heap_size && mb_before(ctx, ctx->heap[child + 1], ctx->heap[child])) {
+            child++;
+        }
+        if (!mb_before(ctx, ctx->heap[child], last)) {
+            break;
+        }
+        ctx->heap[i] = ctx->heap[child];
+        i = child;
+    }
+    if (ctx->heap_size > 0) {
+        ctx->heap[i] = last;
+    }
+    return top;
+}
+
+int mb_queue_has_nonstale(const mb_ctx *ctx) {
+    for (uint32_t i = 0; i < ctx->heap_size; i++) {
+        if (!(ctx->slab[ctx->heap[i]] & MB_STALE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// @return 1 if `ancestor` is `id` or reachable from it, 0 if not, -1 on failure
+int mb_reaches(mb_ctx *ctx, uint32_t id, uint32_t ancestor) {
+    if (mb_parse(ctx, ancestor) != 0) {
+        return -1;
+    }
+    uint32_t gen = mb_generation(ctx, ancestor);
+    time_t timestamp = mb_timestamp(ctx, ancestor);
+
+    // commits that cannot reach `ancestor` are not walked through: those with a generation not
+    // above its own, or if it is missing from commit-graph, commits in commit-graph and ones
+    // older than it by more than COMMIT_CLOCK_SKEW
+    int rc = 0;
+    uint32_t num_stack = 0, capacity = 64;
+    uint32_t *stack = malloc(capacity * sizeof(uint32_t));
+    stack[num_stack++] = id;
+    mb_mark(ctx, id, MB_SEEN);
+    while (num_stack > 0 && rc == 0) {
+        uint32_t cur = stack[--num_stack];
+        if (cur == ancestor) {
+            rc = 1;
+            break;
+        }
+        if (mb_parse(ctx, cur) != 0) {
+            rc = -1;
+            break;
+        }
+        uint32_t cur_gen = mb_generation(ctx, cur);
+        if (gen != GENERATION_INFINITY ? cur_gen <= gen
+            : cur_gen != GENERATION_INFINITY || mb_timestamp(ctx, cur) + COMMIT_CLOCK_SKEW < timestamp) {
+            continue;
+        }
+
+        const uint32_t *parents;
+        int num_parents = mb_parents(ctx, cur, &parents);
+        for (int i = 0; i < num_parents; i++) {
+            if (ctx->slab[parents[i]] & MB_SEEN) {
+                continue;
+            }
+            mb_mark(ctx, parents[i], MB_SEEN);
+            if (num_stack == capacity) {
+                capacity *= 2;
+                stack = realloc(stack, capacity * sizeof(uint32_t));
+            }
+            stack[num_stack++] = parents[i];
+        }
+    }
+    free(stack);
+    mb_clear(ctx);
+    return rc;
+}
+
+// drops commits of `ids` that are an ancestor of another one of them, and sorts the rest newest first
+// @return number of commits left, -1 on failure
+int mb_remove_redundant(mb_ctx *ctx, uint32_t *ids, int num_ids) {
+    for (int i = 0; i < num_ids; i++) {
+        for (int j = i + 1; j < num_ids; j++) {
+            if (mb_before(ctx, ids[j], ids[i])) {
+                uint32_t tmp = ids[i];
+                ids[i] = ids[j];
+                ids[j] = tmp;
+            }
+        }
+    }
+
+    int num_unique = 0;
+    for (int i = 0; i < num_ids; i++) {
+        int dup = 0;
+        for (int j = 0; j < num_unique && !dup; j++) {
+            dup = ids[j] == ids[i];
+        }
+        if (!dup) {
+            ids[num_unique++] = ids[i];
+        }
+    }
+
+    uint8_t *redundant = calloc(num_unique + 1, 1);
+    for (int i = 0; i < num_unique; i++) {
+        for (int j = 0; j < num_unique && !redundant[i]; j++) {
+            if (j == i || redundant[j]) {
+                continue;
+            }
+            int rc = mb_reaches(ctx, ids[j], ids[i]);
+            if (rc == -1) {
+                free(redundant);
+                return -1;
+            }
+            redundant[i] = rc;
+        }
+    }
+
+    int num_left = 0;
+    for (int i = 0; i < num_unique; i++) {
+        if (!redundant[i]) {
+            ids[num_left++] = ids[i];
+        }
+    }
+    free(redundant);
+    return num_left;
+}
+
+// paints commits down from `one` and `twos`, appending merge bases to `out`
+// @return number of merge bases, -1 on failure
+int mb_paint(mb_ctx *ctx, uint32_t one, const uint32_t *twos, int num_twos, uint32_t **out) {
+    for (int i = 0; i < num_twos; i++) {
+        if (twos[i] == one) {
+            *out = malloc(sizeof(uint32_t));
+            (*out)[0] = one;
+            return 1;
+        }
+    }
+
+    int rc = 0;
+    if (mb_parse(ctx, one) != 0) {
+        return -1;
+    }
+    mb_mark(ctx, one, MB_PARENT1);
+    mb_push(ctx, one);
+    for (int i = 0; i < num_twos; i++) {
+        if (mb_parse(ctx, twos[i]) != 0) {
+            rc = -1;
+            break;
+        }
+        if (!(ctx->slab[twos[i]] & MB_PARENT2)) {
+            mb_mark(ctx, twos[i], MB_PARENT2);
+            mb_push(ctx, twos[i]);
+        }
+    }
+
+    int num_results = 0;
+    uint32_t *results = NULL;
+    while (rc == 0 && mb_queue_has_nonstale(ctx)) {
+        uint32_t id = mb_pop(ctx);
+        uint8_t flags = ctx->slab[id] & (MB_PARENT1 | MB_PARENT2 | MB_STALE);
+        if (flags == (MB_PARENT1 | MB_PARENT2)) {
+            if (!(ctx->slab[id] & MB_RESULT)) {
+                mb_mark(ctx, id, MB_RESULT);
+                results = realloc(results, (num_results + 1) * sizeof(uint32_t));
+                results[num_results++] = id;
+            }
+            flags |= MB_STALE;
+        }
+
+        const uint32_t *parents;
+        int num_parents = mb_parents(ctx, id, &parents);
+        for (int i = 0; i < num_parents; i++) {
+            uint32_t parent = parents[i];
+            if ((ctx->slab[parent] & flags) == flags) {
+                continue;
+            }
+            if (mb_parse(ctx, parent) != 0) {
+                rc = -1;
+                break;
+            }
+            mb_mark(ctx, parent, flags);
+            mb_push(ctx, parent);
+            // parsing may have moved extras, so parents of an extra are looked up again
+            num_parents = mb_parents(ctx, id, &parents);
+        }
+    }
+
+    // with commit times out of order, a base may have turned out to be below another one
+    int num_bases = 0;
+    for (int i = 0; i < num_results; i++) {
+        if (!(ctx->slab[results[i]] & MB_STALE)) {
+            results[num_bases++] = results[i];
+        }
+    }
+    ctx->heap_size = 0;
+    mb_clear(ctx);
+
+    if (rc == 0 && num_bases > 1) {
+        num_bases = mb_remove_redundant(ctx, results, num_bases);
+        rc = num_bases < 0 ? -1 : 0;
+    }
+    if (rc != 0) {
+        free(results);
+        return -1;
+    }
+    *out = results;
+    return num_bases;
+}
+
+void mb_fill_list(const mb_ctx *ctx, const uint32_t *ids, int num_ids, merge_base_list *out) {
+    out->bases = malloc((num_ids + 1) * sizeof(obj_hash));
+    out->num_bases = num_ids;
+    for (int i = 0; i < num_ids; i++) {
+        if (ids[i] < ctx->num_graph) {
+            commit_graph_hash(ctx->graph, ids[i], &out->bases[i]);
+        } else {
+            hash_from_bytes(ctx->extras[ids[i] - ctx->num_graph].hash, &out->bases[i]);
+        }
+    }
+}
+
+int find_merge_bases(const git_repo *repo, const obj_hash one, const obj_hash *twos, int num_twos, merge_base_list *out) {
+    mb_ctx ctx;
+    mb_init(&ctx, repo);
+    uint32_t one_id = mb_id_of(&ctx, one);
+    uint32_t *two_ids = malloc((num_twos + 1) * sizeof(uint32_t));
+    for (int i = 0; i < num_twos; i++) {
+        two_ids[i] = mb_id_of(&ctx, twos[i]);
+    }
+
+    uint32_t *bases = NULL;
+    int num_bases = mb_paint(&ctx, one_id, two_ids, num_twos, &bases);
+    if (num_bases >= 0) {
+        mb_fill_list(&ctx, bases, num_bases, out);
+    }
+
+    free(bases);
+    free(two_ids);
+    mb_free(&ctx);
+    return num_bases >= 0 ? 0 : -1;
+}
+
+int find_octopus_bases(const git_repo *repo, const obj_hash *commits, int num_commits, merge_base_list *out) {
+    mb_ctx ctx;
+    mb_init(&ctx, repo);
+
+    // bases of the first i commits, narrowed down by each next commit
+    int num_bases = num_commits > 0 ? 1 : 0;
+    uint32_t *bases = malloc(sizeof(uint32_t));
+    bases[0] = num_commits > 0 ? mb_id_of(&ctx, commits[0]) : 0;
+    for (int i = 1; i < num_commits && num_bases > 0; i++) {
+        uint32_t next = mb_id_of(&ctx, commits[i]);
+        uint32_t *next_bases = NULL;
+        int num_next = 0;
+        for (int j = 0; j < num_bases; j++) {
+            uint32_t *found = NULL;
+            int num_found = mb_paint(&ctx, bases[j], &next, 1, &found);
+            if (num_found < 0) {
+                num_next = -1;
+                break;
+            }
+            next_bases = realloc(next_bases, (num_next + num_found + 1) * sizeof(uint32_t));
+            memcpy(next_bases + num_next, found, num_found * sizeof(uint32_t));
+            num_next += num_found;
+            free(found);
+        }
+        if (num_next > 1) {
+            num_next = mb_remove_redundant(&ctx, next_bases, num_next);
+        }
+        free(bases);
+        bases = next_bases;
+        num_bases = num_next;
+    }
+
+    if (num_bases >= 0) {
+        mb_fill_list(&ctx, bases, num_bases, out);
+    }
+    free(bases);
+    mb_free(&ctx);
+    return num_bases >= 0 ? 0 : -1;
+}
+
+int is_ancestor(const git_repo *repo, const obj_hash ancestor, const obj_hash commit) {
+    mb_ctx ctx;
+    mb_init(&ctx, repo);
+    int rc = mb_reaches(&ctx, mb_id_of(&ctx, commit), mb_id_of(&ctx, ancestor));
+    mb_free(&ctx);
+    return rc;
+}
+
+void free_merge_bases(merge_base_list *list) {
+    free(list->bases);
+    list->bases = NULL;
+    list->num_bases = 0;
+}
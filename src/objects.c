@@ -1,14 +1,28 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <zlib.h>
+#include <stdatomic.h>
+
+#ifndef _WIN32
+    #include <setjmp.h>
+    #include <signal.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+#endif
 
 #include "repo.h"
 #include "filesystem.h"
 #include "objects.h"
 #include "filespec.h"
+#include "ignore.h"
+#include "threadpool.h"
 
 #define CRLF_LF_ON 1
 
@@ -50,79 +64,57 @@ void print_tree(git_obj_tree *tree) {
 }
 
 void hash_from_bytes(const unsigned char *bytes, obj_hash *out_hash) {
+    static const char digits[] = "0123456789abcdef";
     for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-        snprintf(*out_hash + (i << 1), OBJ_HASH_SIZE, "%02x", bytes[i]);
-    } 
-}
-
-void hash_to_bytes(const obj_hash hash, unsigned char *out_bytes) {
-    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-        char hex[3] = {hash[i << 1], hash[(i << 1) + 1], '\0'};
-        sscanf(hex, "%2hhx", &out_bytes[i]);
+        (*out_hash)[i << 1] = digits[bytes[i] >> 4];
+        (*out_hash)[(i << 1) + 1] = digits[bytes[i] & 0xf];
     }
+    (*out_hash)[SHA_DIGEST_LENGTH << 1] = '\0';
 }
 
-int is_like_binary(FILE *fptr) {
-    char peek[8000];
-    size_t n = fread(peek, 1, sizeof(peek), fptr);
-    fseek(fptr, 0, SEEK_SET);
-
-    for (size_t i = 0; i < n; i++)
-        if (peek[i] == 0) return 1;
-
+// @return value of hex digit, or 0 if not one
+unsigned char hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
     return 0;
 }
 
-size_t read_bytes_norm(unsigned char *buf, size_t buf_size, FILE *fptr, size_t *read) {
-    char c, next_c;
-    int is_binary = is_like_binary(fptr);
-    size_t i = 0;
-    size_t read_and_used = 0; 
-
-    if (is_binary || !CRLF_LF_ON) {
-        *read = fs_readbytes(buf, 1, buf_size, fptr);
-        return *read;
+void hash_to_bytes(const obj_hash hash, unsigned char *out_bytes) {
+    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        out_bytes[i] = (hex_value(hash[i << 1]) << 4) | hex_value(hash[(i << 1) + 1]);
     }
+}
 
-    while ((c = fgetc(fptr)) != EOF && i < buf_size) {
-        if (c == '\r') {
-            next_c = fgetc(fptr);
+#define BINARY_PEEK_SIZE 8000
 
-            if (next_c == EOF) {
-                *read = i + 1;
-                return read_and_used;
-            }
+int is_like_binary(const unsigned char *buf, size_t size) {
+    size_t n = size < BINARY_PEEK_SIZE ? size : BINARY_PEEK_SIZE;
+    return memchr(buf, 0, n) != NULL;
+}
 
-            i += 2;
-            if (next_c == '\n') {
-                buf[read_and_used++] = '\n'; 
-            } else {
-                buf[read_and_used++] = '\r';
-                buf[read_and_used++] = '\n';
-            }
-        } else {
-            i++;
-            buf[read_and_used++] = c;
-        }
+// converts CRLF to LF in place, lone CRs are kept
+// @return size of normalized contents
+size_t normalize_bytes(unsigned char *buf, size_t size) {
+    unsigned char *cr;
+    if (!CRLF_LF_ON || (cr = memchr(buf, '\r', size)) == NULL) {
+        return size;
     }
 
-    *read = i;
-    return read_and_used;
-}
-
-// ASSUME fptr points to an empty file
-size_t write_norm_bytes(unsigned char *buf, size_t buf_size, FILE *fptr) {
-    size_t i = 0;
-    char c;
-    while (i < buf_size) {
-        c = buf[i++];
-        if (CRLF_LF_ON && c == '\n') {
-            fputc('\r', fptr);
+    size_t out = cr - buf;
+    for (size_t i = out; i < size; i++) {
+        if (buf[i] == '\r' && i + 1 < size && buf[i + 1] == '\n') {
+            continue;
         }
-        fputc(c, fptr);
+        buf[out++] = buf[i];
     }
-
-    return i;
+    return out;
 }
 
 void hash_data(unsigned char *data, size_t size, obj_hash *o_hash) {
@@ -146,27 +138,117 @@ void create_git_obj(const unsigned char *file_contents, size_t size, const char
     hash_data(obj->data, obj->size, &(obj->hash));
 }
 
+git_obj_blob *create_blob_from_buffer(unsigned char *buf, size_t size) {
+    if (!is_like_binary(buf, size)) {
+        size = normalize_bytes(buf, size);
+    }
+
+    git_obj_blob *blob = malloc(sizeof(*blob));
+    create_git_obj(buf, size, O_TYPE_BLOB, &(blob->obj));
+    return blob;
+}
+
+#ifndef _WIN32
+
+// a file truncated while it is mapped raises SIGBUS on access past its new end.
+// readers of a mapping arm this thread's guard so the fault unwinds to them instead.
+static _Thread_local sigjmp_buf *map_guard = NULL;
+static pthread_once_t map_guard_once = PTHREAD_ONCE_INIT;
+
+void map_sigbus_handler(int sig) {
+    if (map_guard != NULL) {
+        siglongjmp(*map_guard, 1);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void install_map_guard() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = map_sigbus_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+// @return read-only sequential mapping of whole file, or NULL on failure
+unsigned char *map_file(int fd, size_t size) {
+    pthread_once(&map_guard_once, install_map_guard);
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    return map;
+}
+
+// Copies `len` bytes of a mapping from `pos` to `out`, converting CRLF to LF like
+// `normalize_bytes`. A CR ending the range is dropped if the byte after it is LF.
+// @return bytes written to `out`
+size_t normalize_map_range(const unsigned char *map, size_t size, size_t pos, size_t len, unsigned char *out) {
+    const unsigned char *in = map + pos, *end = in + len;
+    size_t written = 0;
+    while (in < end) {
+        const unsigned char *cr = memchr(in, '\r', end - in);
+        size_t run = (cr != NULL ? cr : end) - in;
+        memcpy(out + written, in, run);
+        written += run;
+        if (cr == NULL) {
+            break;
+        }
+        if (cr + 1 == map + size || cr[1] != '\n') {
+            out[written++] = '\r';
+        }
+        in = cr + 1;
+    }
+    return written;
+}
+
+// @return number of CRLF pairs whose CR is in the `len` bytes from `pos`, stopping at the first if `first_only`
+size_t count_map_crlf(const unsigned char *map, size_t size, size_t pos, size_t len, int first_only) {
+    const unsigned char *cr = map + pos, *end = cr + len;
+    size_t count = 0;
+    while ((cr = memchr(cr, '\r', end - cr)) != NULL) {
+        if (cr + 1 < map + size && cr[1] == '\n') {
+            count++;
+            if (first_only) {
+                break;
+            }
+        }
+        cr++;
+    }
+    return count;
+}
+
+#endif
+
 git_obj_blob *create_blob_from_file(const fileinfo *finfo) {
-    size_t read, filesize = finfo->stat.fi_size;
-    unsigned char *buf = malloc(filesize);
+    size_t filesize = finfo->stat.fi_size;
+    unsigned char *buf = malloc(filesize > 0 ? filesize : 1);
 
     git_obj_blob *blob = NULL;
-    size_t norm_size = read_bytes_norm(buf, filesize, finfo->fptr, &read);
-    if (read != filesize) {
-        goto cleanup;
+    if (fs_readbytes(buf, 1, filesize, finfo->fptr) == filesize) {
+        blob = create_blob_from_buffer(buf, filesize);
     }
 
-    blob = malloc(sizeof(*blob));
-    create_git_obj(buf, norm_size, O_TYPE_BLOB, &(blob->obj));
-
-cleanup:
     free(buf);
     return blob;
 }
 
+// writes to a temporary file first so readers and concurrent writers never see a partial object
 int write_compressed_data(const char *path, const unsigned char *data, size_t size) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s.tmpXXXXXX", path);
+
+    int fd;
     FILE *fptr;
-    if ((fptr = fs_fopen(path, "wb")) == NULL) {
+    if ((fd = mkstemp(tmp_path)) == -1) {
+        return -1;
+    }
+    if (fchmod(fd, OBJ_FILE_MODE) != 0 || (fptr = fdopen(fd, "wb")) == NULL) {
+        close(fd);
+        fs_remove(tmp_path);
         return -1;
     }
 
@@ -180,13 +262,18 @@ int write_compressed_data(const char *path, const unsigned char *data, size_t si
     written = fs_writebytes(buf, 1, buf_len, fptr);
 
 cleanup:
-    fs_fclose(fptr);
+    if (fs_fclose(fptr) != 0) {
+        written = 0;
+    }
     free(buf);
 
-    return (written == buf_len) ? 0 : -1;
+    if (written != buf_len || fs_rename(tmp_path, path) != 0) {
+        fs_remove(tmp_path);
+        return -1;
+    }
+    return 0;
 }
 
-// @return 0 if obj was successfully stored, -1 if unable to
 int write_obj_to_disk(const git_repo *repo, const obj_hash hash, const unsigned char *data, size_t size) {
     char path[PATH_MAX];
     int status = obj_store_path(repo, hash, path);
@@ -206,109 +293,304 @@ int write_blob_to_disk(const git_repo *repo, const git_obj_blob *blob) {
     return write_obj_to_disk(repo, blob->obj.hash, blob->obj.data, blob->obj.size);
 }
 
-size_t obj_uncompressed_size(const unsigned char *raw_bytes, size_t raw_size) {
-    size_t buf_size = raw_size < 256 ? raw_size : 256;
-    char header_buf[buf_size];
+#ifndef _WIN32
+
+#define STREAM_CHUNK (1 << 16)
 
-    size_t header_size;
+// hashes a blob and deflates the very same bytes into a temporary object file, if it has one
+typedef struct blob_stream {
+    EVP_MD_CTX *md;
     z_stream strm;
-    memset(&strm, 0, sizeof(strm));
-    strm.next_in = (Bytef *)raw_bytes;
-    strm.avail_in = raw_size;
-    strm.next_out = (Bytef *)header_buf;
-    strm.avail_out = buf_size;
-    if (inflateInit(&strm) != Z_OK) {
-        return 0;
+    FILE *fptr; // NULL if blob is only hashed
+    unsigned char in[STREAM_CHUNK]; // chunk of contents read once from the mapping
+    unsigned char out[STREAM_CHUNK];
+} blob_stream;
+
+// deflates `len` bytes of `in` into `fptr`
+// @return 0 on success, -1 on failure
+int deflate_to_file(z_stream *strm, const unsigned char *in, size_t len, int flush, unsigned char *out, FILE *fptr) {
+    strm->next_in = (Bytef *)in;
+    strm->avail_in = len;
+    do {
+        strm->next_out = out;
+        strm->avail_out = STREAM_CHUNK;
+        if (deflate(strm, flush) == Z_STREAM_ERROR) {
+            return -1;
+        }
+        size_t have = STREAM_CHUNK - strm->avail_out;
+        if (fs_writebytes(out, 1, have, fptr) != have) {
+            return -1;
+        }
+    } while (strm->avail_out == 0);
+    return 0;
+}
+
+// @return 0 on success, -1 on failure
+int blob_stream_update(blob_stream *bs, const unsigned char *data, size_t len, int flush) {
+    EVP_DigestUpdate(bs->md, data, len);
+    return bs->fptr == NULL ? 0 : deflate_to_file(&bs->strm, data, len, flush, bs->out, bs->fptr);
+}
+
+// starts over with `header`, dropping anything hashed or written so far
+// @return 0 on success, -1 on failure
+int blob_stream_start(blob_stream *bs, const char *header, size_t header_size) {
+    EVP_DigestInit_ex(bs->md, EVP_sha1(), NULL);
+    if (bs->fptr != NULL && (deflateReset(&bs->strm) != Z_OK || fseek(bs->fptr, 0, SEEK_SET) != 0
+        || ftruncate(fileno(bs->fptr), 0) != 0)) {
+        return -1;
     }
+    return blob_stream_update(bs, (const unsigned char *)header, header_size, Z_NO_FLUSH);
+}
 
-    int ret = inflate(&strm, Z_NO_FLUSH);
-    if (ret != Z_OK && ret != Z_STREAM_END) {
-        inflateEnd(&strm);
-        return 0;
+// Creates temporary object file in the objects folder, as the blob's name is only known
+// once it is hashed.
+// @return 0 on success, -1 on failure
+int blob_stream_open(blob_stream *bs, const git_repo *repo, char *tmp_path) {
+    int fd, len = snprintf(tmp_path, PATH_MAX, "%s/blob.tmpXXXXXX", repo->objects_path);
+    if (len < 0 || len >= PATH_MAX || (fd = mkstemp(tmp_path)) == -1) {
+        return -1;
     }
-    inflateEnd(&strm);
+    if (fchmod(fd, OBJ_FILE_MODE) != 0 || (bs->fptr = fdopen(fd, "wb")) == NULL) {
+        close(fd);
+        fs_remove(tmp_path);
+        return -1;
+    }
+    if (deflateInit(&bs->strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fs_fclose(bs->fptr);
+        bs->fptr = NULL;
+        fs_remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
 
-    int ok = 0;
-    for (header_size = 0; header_size < buf_size - strm.avail_out; header_size++) {
-        if (header_buf[header_size] == '\0') {
-            ok = 1;
-            break;
+// Moves temporary object file to where blob `hash` belongs, unless it is already stored
+// or `rc` is not 0, in which case it is removed.
+// @return 0 on success, -1 on failure
+int blob_stream_close(blob_stream *bs, const git_repo *repo, const char *tmp_path, int rc, const obj_hash hash) {
+    deflateEnd(&bs->strm);
+    if (fs_fclose(bs->fptr) != 0) {
+        rc = -1;
+    }
+
+    char path[PATH_MAX];
+    int status = rc == 0 ? obj_store_path(repo, hash, path) : -1;
+    if (status != 0 || fs_rename(tmp_path, path) != 0) {
+        fs_remove(tmp_path);
+        return status == 1 ? 0 : -1;
+    }
+    return 0;
+}
+
+int hash_blob_from_fd(const git_repo *repo, int fd, size_t size, obj_hash *out) {
+    unsigned char *map;
+    if ((map = map_file(fd, size)) == NULL) {
+        return -1;
+    }
+
+    // deflating in the pass that hashes means the stored object is made of the bytes that
+    // were hashed, even if the file changes while it is read
+    char tmp_path[PATH_MAX];
+    blob_stream *bs = malloc(sizeof(*bs));
+    memset(&bs->strm, 0, sizeof(bs->strm));
+    bs->fptr = NULL;
+    bs->md = EVP_MD_CTX_new();
+    if (repo != NULL && blob_stream_open(bs, repo, tmp_path) != 0) {
+        EVP_MD_CTX_free(bs->md);
+        free(bs);
+        munmap(map, size);
+        fprintf(stderr, "ERROR: could not create object file in: %s\n", repo->objects_path);
+        return -1;
+    }
+
+    volatile int rc = 0;
+    sigjmp_buf guard;
+    if (sigsetjmp(guard, 1) == 0) {
+        map_guard = &guard;
+
+        char header[64];
+        size_t header_size = snprintf(header, sizeof(header), "%s %llu", O_TYPE_BLOB, (unsigned long long)size) + 1;
+        // contents are taken as they are until a CRLF shows up, so most files are read once
+        int is_text = CRLF_LF_ON && !is_like_binary(map, size);
+        size_t pos = 0;
+        rc = blob_stream_start(bs, header, header_size);
+        for (; rc == 0 && pos < size; pos += STREAM_CHUNK) {
+            size_t len = size - pos < STREAM_CHUNK ? size - pos : STREAM_CHUNK;
+            if (is_text && count_map_crlf(map, size, pos, len, 1) > 0) {
+                break;
+            }
+            memcpy(bs->in, map + pos, len);
+            rc = blob_stream_update(bs, bs->in, len, Z_NO_FLUSH);
         }
+
+        // header holds the normalized size, so the blob starts over, one chunk at a time
+        if (rc == 0 && pos < size) {
+            size_t norm_size = size - count_map_crlf(map, size, pos, size - pos, 0), hashed = 0;
+            header_size = snprintf(header, sizeof(header), "%s %llu", O_TYPE_BLOB, (unsigned long long)norm_size) + 1;
+            rc = blob_stream_start(bs, header, header_size);
+            for (pos = 0; rc == 0 && pos < size; pos += STREAM_CHUNK) {
+                size_t len = size - pos < STREAM_CHUNK ? size - pos : STREAM_CHUNK;
+                len = normalize_map_range(map, size, pos, len, bs->in);
+                hashed += len;
+                rc = blob_stream_update(bs, bs->in, len, Z_NO_FLUSH);
+            }
+            // file changed after its CRLF pairs were counted, so contents no longer match the header
+            if (hashed != norm_size) {
+                rc = -1;
+            }
+        }
+
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        if (rc == 0 && (rc = blob_stream_update(bs, NULL, 0, Z_FINISH)) == 0) {
+            EVP_DigestFinal_ex(bs->md, digest, NULL);
+            hash_from_bytes(digest, out);
+        }
+    } else {
+        rc = -1;
     }
-    if (!ok) {
-        return 0;
+    map_guard = NULL;
+    munmap(map, size);
+
+    int res = rc;
+    if (bs->fptr != NULL) {
+        res = blob_stream_close(bs, repo, tmp_path, res, *out);
     }
+    EVP_MD_CTX_free(bs->md);
+    free(bs);
 
-    char *sep;
-    if ((sep = strchr(header_buf, ' ')) == NULL) {
-        return 0;
+    if (res == -1) {
+        fprintf(stderr, "ERROR: could not hash file, it may have been truncated while being read\n");
     }
-    *sep = '\0'; sep++;
+    return res;
+}
 
-    size_t size;
-    if (sscanf(sep, "%zu", &size) != 1) {
-        return 0;
+#else
+
+int hash_blob_from_fd(const git_repo *repo, int fd, size_t size, obj_hash *out) {
+    // files are not mapped, so they are read into a buffer instead
+    unsigned char *buf = malloc(size > 0 ? size : 1);
+    size_t done = 0;
+    while (done < size) {
+        int n = read(fd, buf + done, size - done);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    if (done != size) {
+        free(buf);
+        fprintf(stderr, "ERROR: could not hash file, it may have been truncated while being read\n");
+        return -1;
     }
-    size += header_size + 1;
 
-    return size;
+    git_obj_blob *blob = create_blob_from_buffer(buf, size);
+    free(buf);
+    snprintf(*out, OBJ_HASH_SIZE, "%s", blob->obj.hash);
+    int rc = repo != NULL ? write_blob_to_disk(repo, blob) : 0;
+    free_blob(blob);
+    return rc;
 }
 
-unsigned char *read_raw_data(const char *path, size_t *raw_size) {
-    size_t size;
-    FILE *fptr;
-    fs_statinfo statinfo;
+#endif
+
+#define OBJ_HEADER_MAX 64
+
+// Inflates object in one pass: the header is inflated first to learn the object's size,
+// then the rest goes straight into a buffer of that size.
+// @return malloc-ed object data, including header, or NULL if data is corrupted
+unsigned char *inflate_obj(const unsigned char *raw_bytes, size_t raw_size, size_t *size) {
+    unsigned char header_buf[OBJ_HEADER_MAX];
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    strm.next_in = (Bytef *)raw_bytes;
+    strm.avail_in = raw_size;
+    strm.next_out = header_buf;
+    strm.avail_out = OBJ_HEADER_MAX;
+    if (inflateInit(&strm) != Z_OK) {
+        return NULL;
+    }
+
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    size_t produced = OBJ_HEADER_MAX - strm.avail_out;
+    unsigned char *end = memchr(header_buf, '\0', produced);
+    unsigned char *sep = end != NULL ? memchr(header_buf, ' ', end - header_buf) : NULL;
+    if ((ret != Z_OK && ret != Z_STREAM_END) || sep == NULL) {
+        inflateEnd(&strm);
+        return NULL;
+    }
 
-    if (fs_getinfo(path, &statinfo) == -1) {
+    char *size_end;
+    size_t full_size = strtoull((char *)sep + 1, &size_end, 10) + (end - header_buf) + 1;
+    if ((unsigned char *)size_end != end || produced > full_size) {
+        inflateEnd(&strm);
         return NULL;
     }
 
-    size = statinfo.fi_size;
+    unsigned char *data = malloc(full_size + 1);
+    memcpy(data, header_buf, produced);
+    strm.next_out = data + produced;
+    strm.avail_out = full_size - produced;
+    if (ret != Z_STREAM_END) {
+        ret = inflate(&strm, Z_FINISH);
+    }
+    inflateEnd(&strm);
 
-    if ((fptr = fs_fopen(path, "rb")) == NULL) {
+    if (ret != Z_STREAM_END || strm.avail_out != 0) {
+        free(data);
         return NULL;
     }
+    *size = full_size;
+    return data;
+}
 
-    unsigned char *raw_buf = malloc(size);
-    size_t read = fread(raw_buf, 1, size, fptr);
-    if (read != size) {
-        free(raw_buf);
-        raw_buf = NULL;
+// reads whole file with one open, fstat and read
+unsigned char *read_raw_data(const char *path, size_t *raw_size) {
+    int fd;
+    struct stat st;
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
     }
 
-    fs_fclose(fptr);
+    size_t size = st.st_size, done = 0;
+    unsigned char *raw_buf = malloc(size + 1);
+    while (done < size) {
+        ssize_t res = read(fd, raw_buf + done, size - done);
+        if (res <= 0) {
+            break;
+        }
+        done += res;
+    }
+    close(fd);
 
+    if (done != size) {
+        free(raw_buf);
+        return NULL;
+    }
     *raw_size = size;
     return raw_buf;
 }
 
 unsigned char *create_obj_from_disk(const git_repo *repo, const obj_hash hash, size_t *size) {
     char path[PATH_MAX];
-    int status = obj_store_path(repo, hash, path);
+    obj_path(repo, hash, path);
     
-    size_t full_size, raw_size;
+    size_t raw_size;
     unsigned char *data, *raw_buf;
 
-    if (status != 1 || (raw_buf = read_raw_data(path, &raw_size)) == NULL) {
+    if ((raw_buf = read_raw_data(path, &raw_size)) == NULL) {
         printf("ERROR: could not get hash's file: %s\n", hash);
         return NULL;
     }
 
-    if ((full_size = obj_uncompressed_size(raw_buf, raw_size)) == 0) {
-        free(raw_buf);
-        printf("ERROR: could not get uncompressed size of hash: %s\n", hash);
-        return NULL;
-    }
-    
-    data = malloc(full_size);
-    if (uncompress(data, (uLongf *)(&full_size), (Bytef *)raw_buf, raw_size) != Z_OK) {
-        free(data);
-        free(raw_buf);
+    if ((data = inflate_obj(raw_buf, raw_size, size)) == NULL) {
         printf("ERROR: could not uncompress hash: %s\n", hash);
-        return NULL;
     }
-    
-    *size = full_size;
+
+    free(raw_buf);
     return data;
 }
 
@@ -345,43 +627,104 @@ git_obj_blob *create_blob_from_disk(const git_repo *repo, obj_hash hash) {
     return blob;
 }
 
+// @return 0 if all of `buf` was written, -1 otherwise
+int write_all(int fd, const unsigned char *buf, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, buf, size);
+        if (written <= 0) {
+            return -1;
+        }
+        buf += written;
+        size -= written;
+    }
+    return 0;
+}
+
+const unsigned char *blob_contents(const git_obj_blob *blob, size_t *size) {
+    const unsigned char *start = memchr(blob->obj.data, '\0', blob->obj.size);
+    if (start == NULL) {
+        return NULL;
+    }
+    start++;
+    *size = blob->obj.size - (start - blob->obj.data);
+    return start;
+}
+
+int write_blob_to_fd(int fd, const git_obj_blob *blob) {
+    size_t size;
+    const unsigned char *start = blob_contents(blob, &size);
+    if (start == NULL) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    if (CRLF_LF_ON && !is_like_binary(start, size)) {
+        size_t num_lf = 0;
+        for (const unsigned char *p = start; (p = memchr(p, '\n', start + size - p)) != NULL; p++) {
+            num_lf++;
+        }
+        unsigned char *buf = malloc(size + num_lf + 1);
+        size_t out = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (start[i] == '\n') {
+                buf[out++] = '\r';
+            }
+            buf[out++] = start[i];
+        }
+        int rc = write_all(fd, buf, out);
+        free(buf);
+        return rc;
+    }
+#endif
+    return write_all(fd, start, size);
+}
+
 int create_file_from_blob(const char *filepath, const git_obj_blob *blob) {
-    FILE *fptr;
-    if ((fptr = fs_fopen(filepath, "wb")) == NULL) {
+    int fd;
+    if ((fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
         perror("Error opening file");
         return -1;
     }
-    
-    unsigned char *start;
-    if ((start = (unsigned char *)strchr((char *)blob->obj.data, '\0')) == NULL) {
-        fs_fclose(fptr);
-        return 1;
-    }
-    start++;
 
-    size_t size = blob->obj.size - (start - blob->obj.data);
-    size_t written = write_norm_bytes(start, size, fptr);
-    fs_fclose(fptr);
-     
-    return written >= size ? 0 : 1;
+    int rc = write_blob_to_fd(fd, blob);
+    if (close(fd) != 0) {
+        rc = -1;
+    }
+    return rc == 0 ? 0 : 1;
 }
 
 void free_blob(git_obj_blob *blob) {
+    if (blob == NULL) {
+        return;
+    }
     free(blob->obj.data);
     free(blob);
 }
 
+int tree_order_cmp(const char *a, size_t a_len, int a_dir, const char *b, size_t b_len, int b_dir) {
+    size_t n = a_len < b_len ? a_len : b_len;
+    int res = memcmp(a, b, n);
+    if (res != 0) {
+        return res;
+    }
+    unsigned char ca = a_len > n ? a[n] : (a_dir ? '/' : '\0');
+    unsigned char cb = b_len > n ? b[n] : (b_dir ? '/' : '\0');
+    return (int)ca - (int)cb;
+}
+
 int cmp_tree_entries(const void *p1, const void *p2) {
     const git_tree_entry *te1 = *(const git_tree_entry * const *)p1;
     const git_tree_entry *te2 = *(const git_tree_entry * const *)p2;
     return strcmp(te1->name, te2->name);
 }
 
-// 6 (mode) + 4 (type) + 40 (hash) + PATH_MAX (name) + 4 (seperators)
-#define MAX_TREE_ENTRY_LINE 54 + PATH_MAX
-
 void hash_tree_full(git_obj_tree *tree) {
-    unsigned char *buf = malloc(tree->size * MAX_TREE_ENTRY_LINE);
+    size_t buf_size = 1;
+    for (int i = 0; i < tree->size; i++) {
+        buf_size += TREE_ENTRY_LINE_FIXED + strlen(tree->entries[i]->name);
+    }
+
+    unsigned char *buf = malloc(buf_size);
     size_t content_size = 0;
 
     for (int i = 0; i < tree->size; i++) {
@@ -392,9 +735,9 @@ void hash_tree_full(git_obj_tree *tree) {
         }
 
         git_obj obj = entry->u.tree->obj;
-        size_t line_size = snprintf((char *)buf + content_size, MAX_TREE_ENTRY_LINE, 
+        size_t line_size = snprintf((char *)buf + content_size, buf_size - content_size, 
             "%06o %s %s %s\n", entry->git_mode, obj.type, obj.hash, entry->name);
-        assert(line_size <= MAX_TREE_ENTRY_LINE);
+        assert(content_size + line_size < buf_size);
 
         content_size += line_size;
     }
@@ -428,6 +771,7 @@ void free_tree(git_obj_tree *tree) {
     for (int i = 0; i < tree->size; i++) {
         free_tree_entry(tree->entries[i]);
     }
+    free(tree->entries);
     free(tree->obj.data);
     free(tree);
 }
@@ -475,11 +819,13 @@ int tree_cmp(struct git_obj_tree *old, struct git_obj_tree *new, const char *pat
     return 0;
 }
 
+// @param shallow if 1, blobs and subtrees are stubs that only hold their hash
 int parse_tree_entries(
     const git_repo *repo, 
     const unsigned char *entries_buf, 
     size_t entries_buf_length, 
-    git_obj_tree *tree
+    git_obj_tree *tree,
+    int shallow
 ) {
     char *entries_copy = malloc(entries_buf_length + 1);
     memcpy(entries_copy, entries_buf, entries_buf_length);
@@ -490,29 +836,49 @@ int parse_tree_entries(
     int rc = 0;
     char *line = strtok_r(entries_copy, "\n", &saveptr_lines);
     while (line != NULL) {
-        char *saveptr_fields = NULL;
+        // "<mode> <type> <hash> <name>", name may contain spaces
+        char *type, *hash, *name;
+        if ((type = strchr(line, ' ')) == NULL || (hash = strchr(type + 1, ' ')) == NULL
+            || (name = strchr(hash + 1, ' ')) == NULL) {
+            rc = -1;
+            break;
+        }
+        *type++ = '\0';
+        *hash++ = '\0';
+        *name++ = '\0';
 
         git_tree_entry *entry = malloc(sizeof(*entry));
-        entry->git_mode = atoi(strtok_r(line, " ", &saveptr_fields));
-        char *type = strtok_r(NULL, " ", &saveptr_fields);
-        char *hash = strtok_r(NULL, " ", &saveptr_fields);
-        snprintf(entry->name, PATH_MAX, "%s", strtok_r(NULL, " ", &saveptr_fields));
+        entry->git_mode = strtoul(line, NULL, 8);
+        snprintf(entry->name, PATH_MAX, "%s", name);
 
         if (strcmp(type, O_TYPE_BLOB) == 0) {
             entry->type = BLOB_OBJ;
-            if ((entry->u.blob = create_blob_from_disk(repo, hash)) == NULL) {
+            if (shallow) {
+                entry->u.blob = calloc(1, sizeof(git_obj_blob));
+                entry->u.blob->obj.type = O_TYPE_BLOB;
+                snprintf(entry->u.blob->obj.hash, OBJ_HASH_SIZE, "%s", hash);
+            } else if ((entry->u.blob = create_blob_from_disk(repo, hash)) == NULL) {
                 free(entry);
                 rc = -1;
                 break;
             }
         } else if (strcmp(type, O_TYPE_TREE) == 0) {
             entry->type = TREE_OBJ;
-            if ((entry->u.tree = create_tree_from_disk(repo, hash)) == NULL) {
+            if (shallow) {
+                entry->u.tree = init_tree();
+                entry->u.tree->obj.type = O_TYPE_TREE;
+                entry->u.tree->obj.size = 0;
+                snprintf(entry->u.tree->obj.hash, OBJ_HASH_SIZE, "%s", hash);
+            } else if ((entry->u.tree = create_tree_from_disk(repo, hash)) == NULL) {
                 free(entry);
                 rc = -1;
                 break;
             }
-        } 
+        } else {
+            free(entry);
+            rc = -1;
+            break;
+        }
 
         if (add_tree_entry(entry, tree) != 0) {
             free_tree_entry(entry);
@@ -528,7 +894,7 @@ int parse_tree_entries(
     return rc;
 }
 
-git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash) {
+git_obj_tree *read_tree_from_disk(const git_repo *repo, const obj_hash hash, int shallow) {
     git_obj_tree *tree = init_tree();
 
     tree->obj.type = O_TYPE_TREE;
@@ -540,7 +906,6 @@ git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash) {
 
     if (!is_header_type_matches(tree->obj.data, O_TYPE_TREE)) {
         printf("ERROR: cannot create tree, %s is not a tree\n", hash);
-        free(tree->obj.data);
         free_tree(tree);
         return NULL;
     }
@@ -548,8 +913,8 @@ git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash) {
     int header_size = strlen((char *)tree->obj.data) + 1;
     int entries_buf_size = tree->obj.size - header_size;
 
-    if (parse_tree_entries(repo, tree->obj.data + header_size, entries_buf_size, tree) != 0) {
-        free(tree->obj.data);
+    if (parse_tree_entries(repo, tree->obj.data + header_size, entries_buf_size, tree, shallow) != 0) {
+        printf("ERROR: could not parse tree: %s\n", hash);
         free_tree(tree);
         return NULL;
     }
@@ -557,6 +922,96 @@ git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash) {
     return tree;
 }
 
+git_obj_tree *create_tree_from_disk(const git_repo *repo, obj_hash hash) {
+    return read_tree_from_disk(repo, hash, 0);
+}
+
+git_obj_tree *create_tree_from_disk_shallow(const git_repo *repo, const obj_hash hash) {
+    return read_tree_from_disk(repo, hash, 1);
+}
+
+int tree_iter_open(const git_repo *repo, const char *hash, tree_iter *out) {
+    out->data = NULL;
+    out->pos = out->end = NULL;
+    if (hash == NULL) {
+        return 0;
+    }
+
+    size_t size;
+    if ((out->data = create_obj_from_disk(repo, hash, &size)) == NULL) {
+        return -1;
+    }
+    if (!is_header_type_matches(out->data, O_TYPE_TREE)) {
+        printf("ERROR: %s is not a tree\n", hash);
+        tree_iter_close(out);
+        return -1;
+    }
+
+    out->pos = (const char *)out->data + strlen((char *)out->data) + 1;
+    out->end = (const char *)out->data + size;
+    return 0;
+}
+
+int tree_iter_next(tree_iter *iter, tree_iter_entry *out) {
+    if (iter->pos >= iter->end) {
+        return 0;
+    }
+
+    // "<mode> <type> <hash> <name>\n", name may contain spaces
+    const char *line = iter->pos;
+    const char *eol = memchr(line, '\n', iter->end - line);
+    eol = eol != NULL ? eol : iter->end;
+    const char *type = memchr(line, ' ', eol - line);
+    if (type == NULL || eol - type < 6 + OBJ_HASH_SIZE) {
+        return -1;
+    }
+    type++;
+
+    if (strncmp(type, O_TYPE_BLOB " ", 5) == 0) {
+        out->type = BLOB_OBJ;
+    } else if (strncmp(type, O_TYPE_TREE " ", 5) == 0) {
+        out->type = TREE_OBJ;
+    } else {
+        return -1;
+    }
+
+    out->git_mode = strtoul(line, NULL, 8);
+    memcpy(out->hash, type + 5, OBJ_HASH_SIZE - 1);
+    out->hash[OBJ_HASH_SIZE - 1] = '\0';
+    out->name = type + 5 + OBJ_HASH_SIZE;
+    out->name_len = eol - out->name;
+
+    iter->pos = eol + 1;
+    return 1;
+}
+
+void tree_iter_close(tree_iter *iter) {
+    free(iter->data);
+    iter->data = NULL;
+}
+
+int read_commit_tree(const git_repo *repo, const obj_hash commit_hash, obj_hash *tree_hash) {
+    size_t size;
+    unsigned char *data;
+    if ((data = create_obj_from_disk(repo, commit_hash, &size)) == NULL) {
+        return -1;
+    }
+
+    int rc = -1;
+    size_t header_size = strlen((char *)data) + 1;
+    const char *body = (const char *)data + header_size;
+    if (is_header_type_matches(data, O_TYPE_COMMIT) && size >= header_size + 5 + OBJ_HASH_SIZE - 1
+        && strncmp(body, "tree ", 5) == 0) {
+        snprintf(*tree_hash, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, body + 5);
+        rc = 0;
+    } else {
+        printf("ERROR: %s is not a commit\n", commit_hash);
+    }
+
+    free(data);
+    return rc;
+}
+
 int tree_find(const git_obj_tree *tree, obj_hash hash, git_tree_entry *obj, char *path) {
     (void)tree;
     (void)hash;
@@ -565,89 +1020,234 @@ int tree_find(const git_obj_tree *tree, obj_hash hash, git_tree_entry *obj, char
     return 0;
 }
 
-int delete_obj_from_disk(obj_hash hash) {
-    (void)hash;
+int delete_obj_from_disk(const git_repo *repo, const obj_hash hash) {
+    char path[PATH_MAX];
+    obj_path(repo, hash, path);
+    if (fs_remove(path) != 0 && errno != ENOENT) {
+        printf("ERROR: could not delete object %s\n", hash);
+        return -1;
+    }
     return 0;
 }
 
-int create_tree_entries(const git_repo *repo, DIR *dir, const char *folderpath, git_obj_tree *tree) {
-    int rc = 0;
-    fs_dirent *ent;
-    while ((ent = fs_readdir(dir, folderpath)) != NULL) {
-        if (strcmp(ent->de_name, ".") == 0 || strcmp(ent->de_name, "..") == 0) {
+// files hashed per task, so directories with many files are split across workers
+#define WALK_FILE_BATCH 32
+
+typedef struct tree_walk {
+    threadpool *pool;
+    const git_repo *repo; // NULL if walked folder is not inside repo, so nothing is ignored
+    atomic_int failed;
+} tree_walk;
+
+// open directory shared by the file batches hashing its entries
+typedef struct walk_dir {
+    tree_walk *walk;
+    fs_dir *dir;
+    git_obj_tree *tree;
+    atomic_int refs;
+} walk_dir;
+
+typedef struct walk_job {
+    tree_walk *walk;
+    walk_dir *wdir; // file batch only
+    char *path; // directory job only
+    git_obj_tree *tree;
+    int start;
+    int end;
+} walk_job;
+
+void walk_dir_release(walk_dir *wdir) {
+    if (atomic_fetch_sub(&wdir->refs, 1) == 1) {
+        fs_dir_close(wdir->dir);
+        free(wdir);
+    }
+}
+
+void walk_file_batch(void *arg) {
+    walk_job *job = arg;
+    walk_dir *wdir = job->wdir;
+
+    for (int i = job->start; i < job->end; i++) {
+        git_tree_entry *tree_ent = wdir->tree->entries[i];
+        if (tree_ent->type != BLOB_OBJ || atomic_load(&job->walk->failed)) {
             continue;
         }
 
-        git_tree_entry *tree_ent = malloc(sizeof(*tree_ent));
-        snprintf(tree_ent->name, PATH_MAX, "%s", ent->de_name);
-        tree_ent->git_mode = stat_mode_to_git(ent->de_mode);
+        fileinfo finfo;
+        if (fs_dir_getinfo(wdir->dir, tree_ent->name, &finfo.stat) != 0
+            || (finfo.fptr = fs_dir_fopen(wdir->dir, tree_ent->name, "rb")) == NULL) {
+            atomic_store(&job->walk->failed, 1);
+            continue;
+        }
 
-        if (ent->de_type == FS_ISFILE) {
-            fileinfo *finfo;
-            if ((finfo = start_fileinfo(repo, ent->de_path, "rb")) == NULL) {
-                free(tree_ent);
-                rc = -1;
-                break;
-            }
+        tree_ent->git_mode = stat_mode_to_git(finfo.stat.fi_mode);
+        if ((tree_ent->u.blob = create_blob_from_file(&finfo)) == NULL) {
+            atomic_store(&job->walk->failed, 1);
+        }
+        end_fileinfo(&finfo);
+    }
 
-            if ((tree_ent->u.blob = create_blob_from_file(finfo)) == NULL) {
-                end_fileinfo(finfo);
-                free(tree_ent);
-                rc = -1;
-                break;
-            }
+    walk_dir_release(wdir);
+    free(job);
+}
 
-            end_fileinfo(finfo);
-            tree_ent->type = BLOB_OBJ;
-        } else if (ent->de_type == FS_ISDIR) {
-            // NOTE: CANNOT just pass ent->de_path. 
-            // ent is a static struct which means ent->path will be overwritten by recursive call
-            char subpath[PATH_MAX];
-            snprintf(subpath, PATH_MAX, "%s", ent->de_path);
-            if ((tree_ent->u.tree = create_tree_from_path(repo, subpath)) == NULL) {
-                free(tree_ent);
+void walk_submit_dir(tree_walk *walk, char *path, git_obj_tree *tree);
+
+// lists a directory into `job->tree`, skipping ignored entries, then queues its subdirectories
+// and file batches
+void walk_dir_job(void *arg) {
+    walk_job *job = arg;
+    tree_walk *walk = job->walk;
+    git_obj_tree *tree = job->tree;
+
+    fs_dir *dir;
+    if (atomic_load(&walk->failed)) {
+        goto end;
+    }
+    if ((dir = fs_dir_open(job->path)) == NULL) {
+        printf("ERROR: could not open directory: %s\n", job->path);
+        atomic_store(&walk->failed, 1);
+        goto end;
+    }
+
+    fs_dirent ent;
+    char path[PATH_MAX], rel[PATH_MAX];
+    int num_files = 0;
+    while (fs_dir_next(dir, &ent) == 1) {
+        if (ent.de_type == FS_ISOTHER || strcmp(ent.de_name, GIT_FOLDER) == 0) {
+            continue;
+        }
+        if (walk->repo != NULL) {
+            fs_path_join(job->path, ent.de_name, path);
+            repo_rel_path(walk->repo, path, rel);
+            if (ignore_cache_check(walk->repo->ignores, rel, ent.de_type == FS_ISDIR)) {
                 continue;
             }
+        }
 
+        git_tree_entry *tree_ent = malloc(sizeof(*tree_ent));
+        memcpy(tree_ent->name, ent.de_name, ent.de_namelen + 1);
+        if (ent.de_type == FS_ISFILE) {
+            tree_ent->type = BLOB_OBJ;
+            tree_ent->u.blob = NULL;
+            num_files++;
+        } else {
             tree_ent->type = TREE_OBJ;
+            tree_ent->git_mode = GIT_MODE_DIR;
+            tree_ent->u.tree = init_tree();
         }
 
         if (add_tree_entry(tree_ent, tree) != 0) {
             free_tree_entry(tree_ent);
-            rc = -1;
+            atomic_store(&walk->failed, 1);
             break;
         }
     }
 
-    if (tree->size == 0) {
-        return -1;
+    // entries array is final from here on, workers only fill in their own slots
+    size_t path_len = strlen(job->path);
+    for (int i = 0; i < tree->size; i++) {
+        git_tree_entry *tree_ent = tree->entries[i];
+        if (tree_ent->type == TREE_OBJ) {
+            char *subpath = malloc(path_len + strlen(tree_ent->name) + 2);
+            sprintf(subpath, "%s/%s", job->path, tree_ent->name);
+            walk_submit_dir(walk, subpath, tree_ent->u.tree);
+        }
     }
 
-    if (rc == -1) {
-        free_tree(tree);
+    walk_dir *wdir = malloc(sizeof(*wdir));
+    wdir->walk = walk;
+    wdir->dir = dir;
+    wdir->tree = tree;
+    atomic_init(&wdir->refs, 1);
+
+    for (int start = 0; num_files > 0 && start < tree->size; start += WALK_FILE_BATCH) {
+        walk_job *batch = malloc(sizeof(*batch));
+        batch->walk = walk;
+        batch->wdir = wdir;
+        batch->path = NULL;
+        batch->tree = tree;
+        batch->start = start;
+        batch->end = start + WALK_FILE_BATCH < tree->size ? start + WALK_FILE_BATCH : tree->size;
+
+        atomic_fetch_add(&wdir->refs, 1);
+        threadpool_submit(walk->pool, walk_file_batch, batch);
     }
+    walk_dir_release(wdir);
 
-    return rc;
+end:
+    free(job->path);
+    free(job);
+}
+
+void walk_submit_dir(tree_walk *walk, char *path, git_obj_tree *tree) {
+    walk_job *job = malloc(sizeof(*job));
+    job->walk = walk;
+    job->wdir = NULL;
+    job->path = path;
+    job->tree = tree;
+    threadpool_submit(walk->pool, walk_dir_job, job);
+}
+
+// drops empty subtrees, then sorts and hashes bottom up so result does not depend on scheduling
+void walk_finish_tree(git_obj_tree *tree) {
+    int kept = 0;
+    for (int i = 0; i < tree->size; i++) {
+        git_tree_entry *tree_ent = tree->entries[i];
+        if (tree_ent->type == TREE_OBJ) {
+            walk_finish_tree(tree_ent->u.tree);
+            if (tree_ent->u.tree->size == 0) {
+                free_tree_entry(tree_ent);
+                continue;
+            }
+        }
+        tree->entries[kept++] = tree_ent;
+    }
+    tree->size = kept;
+
+    if (tree->size > 0) {
+        qsort(tree->entries, tree->size, sizeof(git_tree_entry *), cmp_tree_entries);
+        hash_tree_full(tree);
+    }
 }
 
 // technically not needed; trees are made from entries in index
 git_obj_tree *create_tree_from_path(const git_repo *repo, const char *folderpath) {
-    DIR *dir;
-    if ((dir = fs_opendir(folderpath)) == NULL) {
-        perror("could not open directory");
+    // ignore files are matched against absolute paths inside the repo
+    char abs_path[PATH_MAX];
+    if (fs_path_abs(folderpath, abs_path) != 0) {
+        printf("ERROR: could not find directory: %s\n", folderpath);
+        return NULL;
+    }
+
+    tree_walk walk;
+    atomic_init(&walk.failed, 0);
+    size_t root_len = strlen(repo->root_path);
+    int in_repo = strncmp(abs_path, repo->root_path, root_len) == 0 && (abs_path[root_len] == '\0' || abs_path[root_len] == '/');
+    walk.repo = in_repo ? repo : NULL;
+    if (in_repo) {
+        ignore_cache_refresh(repo->ignores);
+    }
+    if ((walk.pool = threadpool_create(0)) == NULL) {
         return NULL;
     }
 
     git_obj_tree *tree = init_tree();
-    int ok = create_tree_entries(repo, dir, folderpath, tree) == 0;
-    fs_closedir(dir);
-    if (!ok) {
+    walk_submit_dir(&walk, strdup(abs_path), tree);
+    threadpool_wait(walk.pool);
+    threadpool_destroy(walk.pool);
+
+    if (atomic_load(&walk.failed)) {
+        printf("ERROR: could not read files in: %s\n", folderpath);
+        free_tree(tree);
         return NULL;
     }
 
-    qsort(tree->entries, tree->size, sizeof(git_tree_entry *), cmp_tree_entries);
-    hash_tree_full(tree);
+    walk_finish_tree(tree);
+    if (tree->size == 0) {
+        free_tree(tree);
+        return NULL;
+    }
 
     return tree;
 }
-
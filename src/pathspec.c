@@ -0,0 +1,415 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "dircache.h"
+#include "ignore.h"
+#include "pathspec.h"
+
+#define PATHSPEC_GLOB_CHARS "*?["
+
+typedef struct pathspec_item {
+    const char *arg; // as given on command line
+    char *path; // relative to repo root, "" for root
+    size_t root_len; // for globs, length of leading folders without glob characters
+    int matched;
+} pathspec_item;
+
+typedef struct pathspec_walk {
+    const git_repo *repo;
+    const git_dircache *dircache;
+    ignore_cache *ignores;
+    pathspec_item **dirs; // folder arguments sorted by path
+    int num_dirs;
+    pathspec_item **globs;
+    int num_globs;
+    pathspec_list *out;
+    int capacity;
+} pathspec_walk;
+
+int pathspec_canonicalize(const git_repo *repo, const char *cwd, const char *arg, char *out) {
+    char abs[PATH_MAX];
+    int len = arg[0] == '/' ? snprintf(abs, PATH_MAX, "%s", arg) : snprintf(abs, PATH_MAX, "%s/%s", cwd, arg);
+    if (len >= PATH_MAX) {
+        return -1;
+    }
+
+    char norm[PATH_MAX];
+    size_t n = 0;
+    const char *p = abs;
+    while (*p != '\0') {
+        while (*p == '/') p++;
+        const char *end = strchr(p, '/');
+        size_t comp_len = end != NULL ? (size_t)(end - p) : strlen(p);
+
+        if (comp_len == 0 || (comp_len == 1 && p[0] == '.')) {
+            // nothing to add
+        } else if (comp_len == 2 && p[0] == '.' && p[1] == '.') {
+            while (n > 0 && norm[n - 1] != '/') n--;
+            if (n > 0) n--;
+        } else {
+            norm[n++] = '/';
+            memcpy(norm + n, p, comp_len);
+            n += comp_len;
+        }
+        p += comp_len;
+    }
+    norm[n] = '\0';
+
+    size_t root_len = strlen(repo->root_path);
+    if (strncmp(norm, repo->root_path, root_len) != 0 || (norm[root_len] != '\0' && norm[root_len] != '/')) {
+        return -1;
+    }
+
+    const char *rel = norm + root_len + (norm[root_len] == '/');
+    size_t git_len = strlen(GIT_FOLDER);
+    if (strncmp(rel, GIT_FOLDER, git_len) == 0 && (rel[git_len] == '\0' || rel[git_len] == '/')) {
+        return -1;
+    }
+
+    snprintf(out, PATH_MAX, "%s", rel);
+    return 0;
+}
+
+void pathspec_add(pathspec_list *out, int *capacity, const char *path) {
+    if (out->num_paths == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        out->paths = realloc(out->paths, *capacity * sizeof(char *));
+    }
+    out->paths[out->num_paths++] = strdup(path);
+}
+
+int pathspec_path_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void pathspec_sort_unique(pathspec_list *out) {
+    qsort(out->paths, out->num_paths, sizeof(char *), pathspec_path_cmp);
+
+    int n = 0;
+    for (int i = 0; i < out->num_paths; i++) {
+        if (n > 0 && strcmp(out->paths[n - 1], out->paths[i]) == 0) {
+            free(out->paths[i]);
+            continue;
+        }
+        out->paths[n++] = out->paths[i];
+    }
+    out->num_paths = n;
+}
+
+int pathspec_item_cmp(const void *a, const void *b) {
+    return strcmp((*(pathspec_item *const *)a)->path, (*(pathspec_item *const *)b)->path);
+}
+
+// @return 1 if a folder argument is `len` characters long and a prefix of `path`
+int pathspec_has_dir(const pathspec_walk *walk, const char *path, size_t len) {
+    int lo = 0, hi = walk->num_dirs;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const char *dir = walk->dirs[mid]->path;
+        int cmp = strncmp(dir, path, len);
+        if (cmp == 0) {
+            cmp = dir[len] != '\0';
+        }
+        if (cmp == 0) {
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+// @return 1 if any argument matches `path`, marks matching globs
+int pathspec_walk_match(pathspec_walk *walk, const char *path) {
+    int matched = 0;
+    for (size_t i = 0; !matched && walk->num_dirs > 0; i++) {
+        if (path[i] == '/' || path[i] == '\0') {
+            matched = pathspec_has_dir(walk, path, i);
+        }
+        if (path[i] == '\0') {
+            break;
+        }
+    }
+    if (!matched && walk->num_dirs > 0 && walk->dirs[0]->path[0] == '\0') {
+        matched = 1;
+    }
+
+    for (int i = 0; i < walk->num_globs; i++) {
+        if (fnmatch(walk->globs[i]->path, path, 0) == 0) {
+            walk->globs[i]->matched = 1;
+            matched = 1;
+        }
+    }
+    return matched;
+}
+
+// @return 1 if index has an entry under folder `path`
+int pathspec_index_has_dir(const git_dircache *dircache, const char *path, size_t len) {
+    if (dircache == NULL || len + 2 > PATH_MAX) {
+        return 0;
+    }
+    // siblings such as "dir-x" or "dir.c" sort between "dir" and "dir/...", so search from "dir/"
+    char prefix[PATH_MAX];
+    memcpy(prefix, path, len);
+    prefix[len] = '/';
+    prefix[len + 1] = '\0';
+    int pos = index_lower_bound(dircache, prefix);
+    return pos < dircache->num_entries && strncmp(dircache->entries[pos]->name, prefix, len + 1) == 0;
+}
+
+// @param rel folder relative to repo root, extended in place while recursing
+// @param ignored 1 if folder is ignored, so only tracked files under it are taken
+void pathspec_walk_dir(pathspec_walk *walk, char *rel, size_t len, int ignored) {
+    char abs[PATH_MAX];
+    if (len > 0) {
+        fs_path_join(walk->repo->root_path, rel, abs);
+    } else {
+        snprintf(abs, PATH_MAX, "%s", walk->repo->root_path);
+    }
+
+    fs_dir *dir;
+    if ((dir = fs_dir_open(abs)) == NULL) {
+        return;
+    }
+
+    fs_dirent ent;
+    while (fs_dir_next(dir, &ent) == 1) {
+        if (ent.de_type == FS_ISOTHER || strcmp(ent.de_name, GIT_FOLDER) == 0
+            || len + 1 + ent.de_namelen >= PATH_MAX) {
+            continue;
+        }
+
+        size_t sub_len = len;
+        if (len > 0) {
+            rel[sub_len++] = '/';
+        }
+        memcpy(rel + sub_len, ent.de_name, ent.de_namelen + 1);
+        sub_len += ent.de_namelen;
+
+        if (ent.de_type == FS_ISDIR) {
+            int sub_ignored = ignored || ignore_cache_check(walk->ignores, rel, 1);
+            if (!sub_ignored || pathspec_index_has_dir(walk->dircache, rel, sub_len)) {
+                pathspec_walk_dir(walk, rel, sub_len, sub_ignored);
+            }
+        } else if ((!ignored && !ignore_cache_check(walk->ignores, rel, 0))
+            || (walk->dircache != NULL && find_index_entry(walk->dircache, rel) != NULL)) {
+            if (pathspec_walk_match(walk, rel)) {
+                pathspec_add(walk->out, &walk->capacity, rel);
+            }
+        }
+        rel[len] = '\0';
+    }
+
+    fs_dir_close(dir);
+}
+
+// like strcmp, but '/' sorts before every other character, so a folder is directly followed
+// by everything under it, before siblings such as "a-b" that share its name as a prefix
+int pathspec_root_cmp(const void *a, const void *b) {
+    const unsigned char *x = *(const unsigned char *const *)a, *y = *(const unsigned char *const *)b;
+    while (*x != '\0' && *x == *y) {
+        x++;
+        y++;
+    }
+    int cx = *x == '/' ? 1 : *x, cy = *y == '/' ? 1 : *y;
+    return cx - cy;
+}
+
+// walks every folder argument and the leading folders of every glob. Roots are sorted so
+// each one only has to be compared with the last root kept, which drops duplicates and
+// roots under a kept one
+void pathspec_walk_roots(pathspec_walk *walk) {
+    int num_roots = walk->num_dirs + walk->num_globs;
+    char **roots = malloc((num_roots + 1) * sizeof(char *));
+    for (int i = 0; i < walk->num_dirs; i++) {
+        roots[i] = strdup(walk->dirs[i]->path);
+    }
+    for (int i = 0; i < walk->num_globs; i++) {
+        roots[walk->num_dirs + i] = strndup(walk->globs[i]->path, walk->globs[i]->root_len);
+    }
+    qsort(roots, num_roots, sizeof(char *), pathspec_root_cmp);
+
+    const char *prev = NULL;
+    for (int i = 0; i < num_roots; i++) {
+        size_t prev_len = prev != NULL ? strlen(prev) : 0;
+        int covered = prev != NULL && (prev_len == 0
+            || (strncmp(roots[i], prev, prev_len) == 0 && (roots[i][prev_len] == '/' || roots[i][prev_len] == '\0')));
+        if (!covered) {
+            char rel[PATH_MAX];
+            snprintf(rel, PATH_MAX, "%s", roots[i]);
+            pathspec_walk_dir(walk, rel, strlen(rel), 0);
+            prev = roots[i];
+        }
+    }
+
+    for (int i = 0; i < num_roots; i++) {
+        free(roots[i]);
+    }
+    free(roots);
+}
+
+// @return 0 on success, -1 if argument is outside of repo
+int pathspec_parse_item(const git_repo *repo, const char *cwd, const char *arg, pathspec_item *item) {
+    char path[PATH_MAX];
+    if (pathspec_canonicalize(repo, cwd, arg, path) != 0) {
+        printf("ERROR: file is not part of repo: %s\n", arg);
+        return -1;
+    }
+
+    item->arg = arg;
+    item->path = strdup(path);
+    item->matched = 0;
+    item->root_len = 0;
+
+    const char *glob = strpbrk(path, PATHSPEC_GLOB_CHARS);
+    if (glob != NULL) {
+        while (glob > path && glob[-1] != '/') glob--;
+        item->root_len = glob > path ? (size_t)(glob - path - 1) : 0;
+    }
+    return 0;
+}
+
+int pathspec_resolve_worktree(const git_repo *repo, const char *cwd, const git_dircache *dircache,
+    char **args, int num_args, pathspec_list *out) {
+
+    out->paths = NULL;
+    out->num_paths = 0;
+
+    pathspec_item *items = calloc(num_args, sizeof(pathspec_item));
+    pathspec_walk walk = { .repo = repo, .dircache = dircache, .out = out, .capacity = 0 };
+    walk.dirs = malloc(num_args * sizeof(pathspec_item *));
+    walk.globs = malloc(num_args * sizeof(pathspec_item *));
+    walk.ignores = repo->ignores;
+    ignore_cache_refresh(walk.ignores);
+
+    int rc = 0;
+    for (int i = 0; i < num_args && rc == 0; i++) {
+        pathspec_item *item = &items[i];
+        if (pathspec_parse_item(repo, cwd, args[i], item) != 0) {
+            rc = -1;
+            break;
+        }
+
+        if (strpbrk(item->path, PATHSPEC_GLOB_CHARS) != NULL) {
+            walk.globs[walk.num_globs++] = item;
+            continue;
+        }
+        // tracked files are taken as they are, bulk stat reports them if they are gone
+        if (dircache != NULL && find_index_entry(dircache, item->path) != NULL) {
+            pathspec_add(out, &walk.capacity, item->path);
+            continue;
+        }
+
+        char abs[PATH_MAX];
+        fs_statinfo stat;
+        if (item->path[0] != '\0') {
+            fs_path_join(repo->root_path, item->path, abs);
+        } else {
+            snprintf(abs, PATH_MAX, "%s", repo->root_path);
+        }
+        if (fs_getinfo(abs, &stat) != 0) {
+            printf("ERROR: could not find file: %s\n", args[i]);
+            rc = -1;
+        } else if (item->path[0] != '\0' && ignore_cache_check(walk.ignores, item->path, S_ISDIR(stat.fi_mode))) {
+            printf("NOTE: file is ignored: %s\n", args[i]);
+        } else if (S_ISDIR(stat.fi_mode)) {
+            walk.dirs[walk.num_dirs++] = item;
+        } else {
+            pathspec_add(out, &walk.capacity, item->path);
+        }
+    }
+
+    if (rc == 0 && walk.num_dirs + walk.num_globs > 0) {
+        qsort(walk.dirs, walk.num_dirs, sizeof(pathspec_item *), pathspec_item_cmp);
+        pathspec_walk_roots(&walk);
+
+        for (int i = 0; i < walk.num_globs; i++) {
+            if (!walk.globs[i]->matched) {
+                printf("ERROR: pathspec did not match any files: %s\n", walk.globs[i]->arg);
+                rc = -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_args; i++) {
+        free(items[i].path);
+    }
+    free(items);
+    free(walk.dirs);
+    free(walk.globs);
+
+    if (rc != 0) {
+        free_pathspec_list(out);
+        return -1;
+    }
+    pathspec_sort_unique(out);
+    return 0;
+}
+
+int pathspec_resolve_index(const git_repo *repo, const char *cwd, const git_dircache *dircache,
+    char **args, int num_args, pathspec_list *out) {
+
+    out->paths = NULL;
+    out->num_paths = 0;
+    int capacity = 0;
+
+    for (int i = 0; i < num_args; i++) {
+        pathspec_item item;
+        if (pathspec_parse_item(repo, cwd, args[i], &item) != 0) {
+            free_pathspec_list(out);
+            return -1;
+        }
+
+        int found = 0;
+        if (strpbrk(item.path, PATHSPEC_GLOB_CHARS) != NULL) {
+            for (int j = 0; j < dircache->num_entries; j++) {
+                if (fnmatch(item.path, dircache->entries[j]->name, 0) == 0) {
+                    pathspec_add(out, &capacity, dircache->entries[j]->name);
+                    found = 1;
+                }
+            }
+        } else {
+            // entries are sorted, so the file or everything under the folder is one run
+            size_t len = strlen(item.path);
+            for (int j = index_lower_bound(dircache, item.path); j < dircache->num_entries; j++) {
+                const char *name = dircache->entries[j]->name;
+                if (strncmp(name, item.path, len) != 0) {
+                    break;
+                }
+                // e.g. "a-b" sorts between "a" and "a/b"
+                if (len > 0 && name[len] != '\0' && name[len] != '/') {
+                    continue;
+                }
+                pathspec_add(out, &capacity, name);
+                found = 1;
+            }
+        }
+        free(item.path);
+
+        if (!found) {
+            printf("ERROR: could not find file in index: %s\n", args[i]);
+            free_pathspec_list(out);
+            return -1;
+        }
+    }
+
+    pathspec_sort_unique(out);
+    return 0;
+}
+
+void free_pathspec_list(pathspec_list *list) {
+    for (int i = 0; i < list->num_paths; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    list->paths = NULL;
+    list->num_paths = 0;
+}
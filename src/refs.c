@@ -0,0 +1,819 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "refs.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "remote.h"
+
+// @return 1 if `str` starts with a full lowercase hex hash
+int is_hash_str(const char *str) {
+    for (int i = 0; i < OBJ_HASH_SIZE - 1; i++) {
+        if (!isxdigit((unsigned char)str[i]) || isupper((unsigned char)str[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// reads first line of file at `path` without its line ending
+// @return 0 on success, -1 if file could not be read
+int read_ref_file(const char *path, char *line) {
+    FILE *fptr;
+    if ((fptr = fs_fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    if (fs_readline(line, PATH_MAX, fptr) == NULL) {
+        line[0] = '\0';
+    }
+    fs_fclose(fptr);
+
+    line[strcspn(line, "\r\n")] = '\0';
+    return 0;
+}
+
+// packed refs file, mapped
+typedef struct packed_refs {
+    char *map;
+    size_t size;
+    const char *start; // first record, after header
+    const char *end;
+} packed_refs;
+
+void packed_refs_path(const git_repo *repo, char *out) {
+    char git_folder[PATH_MAX];
+    fs_path_dirname(repo->head_path, git_folder);
+    fs_path_join(git_folder, PACKED_REFS_NAME, out);
+}
+
+// @return 0 if mapped, 1 if repo has no packed refs, -1 if they could not be read
+int packed_refs_open(const git_repo *repo, packed_refs *out) {
+    char path[PATH_MAX];
+    packed_refs_path(repo, path);
+    memset(out, 0, sizeof(*out));
+
+    int fd;
+    struct stat st;
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return errno == ENOENT ? 1 : -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    char *map;
+#ifndef _WIN32
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+    }
+#else
+    map = malloc(st.st_size);
+    if (read(fd, map, st.st_size) != (int)st.st_size) {
+        free(map);
+        map = NULL;
+    }
+#endif
+    close(fd);
+    if (map == NULL) {
+        printf("ERROR: could not read %s\n", path);
+        return -1;
+    }
+
+    out->map = map;
+    out->size = st.st_size;
+    out->start = map;
+    out->end = map + st.st_size;
+    while (out->start < out->end && *out->start == '#') {
+        const char *eol = memchr(out->start, '\n', out->end - out->start);
+        out->start = eol != NULL ? eol + 1 : out->end;
+    }
+    return 0;
+}
+
+void packed_refs_close(packed_refs *packed) {
+#ifndef _WIN32
+    munmap(packed->map, packed->size);
+#else
+    free(packed->map);
+#endif
+}
+
+// @return start of the record after `record`, skipping its peeled line
+const char *packed_refs_next(const packed_refs *packed, const char *record) {
+    do {
+        const char *eol = memchr(record, '\n', packed->end - record);
+        record = eol != NULL ? eol + 1 : packed->end;
+    } while (record < packed->end && *record == '^');
+    return record;
+}
+
+// Parses record, whose ref name starts OBJ_HASH_SIZE bytes in, after its hash and a space.
+// @param hash, peeled if not NULL, filled with hash and peeled hash, "" if there is none
+// @return length of ref name, -1 if record is malformed
+int packed_refs_parse(const packed_refs *packed, const char *record, obj_hash *hash, obj_hash *peeled) {
+    const char *eol = memchr(record, '\n', packed->end - record);
+    eol = eol != NULL ? eol : packed->end;
+    if (eol - record <= OBJ_HASH_SIZE || record[OBJ_HASH_SIZE - 1] != ' ' || !is_hash_str(record)) {
+        return -1;
+    }
+    if (hash != NULL) {
+        snprintf(*hash, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, record);
+    }
+    if (peeled != NULL) {
+        (*peeled)[0] = '\0';
+        if (packed->end - eol > OBJ_HASH_SIZE && eol[1] == '^' && is_hash_str(eol + 2)) {
+            snprintf(*peeled, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, eol + 2);
+        }
+    }
+    return eol - record - OBJ_HASH_SIZE;
+}
+
+// compares ref names in packed refs order, which is the order of `strcmp`
+int ref_name_cmp(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    return cmp != 0 ? cmp : (a_len > b_len) - (a_len < b_len);
+}
+
+// Binary searches records, moving back from the middle of a range to the record it falls in.
+// @return record of `ref_name`, NULL if it is not packed
+const char *packed_refs_find(const packed_refs *packed, const char *ref_name) {
+    size_t name_len = strlen(ref_name);
+    const char *lo = packed->start, *hi = packed->end;
+    while (lo < hi) {
+        const char *mid = lo + (hi - lo) / 2;
+        while (mid > lo && mid[-1] != '\n') {
+            mid--;
+        }
+        while (mid > lo && *mid == '^') {
+            mid--;
+            while (mid > lo && mid[-1] != '\n') {
+                mid--;
+            }
+        }
+
+        int len = packed_refs_parse(packed, mid, NULL, NULL);
+        if (len < 0) {
+            return NULL;
+        }
+        int cmp = ref_name_cmp(mid + OBJ_HASH_SIZE, len, ref_name, name_len);
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            lo = packed_refs_next(packed, mid);
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// @return 0 if found, 1 if ref is not packed, -1 if packed refs could not be read
+int read_packed_ref(const git_repo *repo, const char *ref_name, obj_hash *out) {
+    packed_refs packed;
+    int res = packed_refs_open(repo, &packed);
+    if (res != 0) {
+        return res;
+    }
+    const char *record = packed_refs_find(&packed, ref_name);
+    res = record != NULL && packed_refs_parse(&packed, record, out, NULL) >= 0 ? 0 : 1;
+    packed_refs_close(&packed);
+    return res;
+}
+
+int read_ref(const git_repo *repo, const char *ref_name, obj_hash *out) {
+    char git_folder[PATH_MAX], path[PATH_MAX], line[PATH_MAX];
+    fs_path_dirname(repo->head_path, git_folder);
+    fs_path_join(git_folder, ref_name, path);
+
+    if (read_ref_file(path, line) != 0) {
+        // only refs under refs folder are ever packed
+        if (strncmp(ref_name, REFS_NAME "/", strlen(REFS_NAME) + 1) == 0) {
+            return read_packed_ref(repo, ref_name, out);
+        }
+        return 1;
+    }
+    if (strlen(line) != OBJ_HASH_SIZE - 1 || !is_hash_str(line)) {
+        printf("ERROR: ref is not a valid hash: %s\n", ref_name);
+        return -1;
+    }
+
+    snprintf(*out, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, line);
+    return 0;
+}
+
+int resolve_head(const git_repo *repo, obj_hash *out, char *ref_name) {
+    char line[PATH_MAX];
+    if (read_ref_file(repo->head_path, line) != 0) {
+        printf("ERROR: could not read HEAD\n");
+        return -1;
+    }
+
+    // "refs: " was written by older versions of init
+    const char *target = NULL;
+    if (strncmp(line, HEAD_REF_PREFIX, strlen(HEAD_REF_PREFIX)) == 0) {
+        target = line + strlen(HEAD_REF_PREFIX);
+    } else if (strncmp(line, "refs: ", 6) == 0) {
+        target = line + 6;
+    }
+
+    if (target == NULL) {
+        if (ref_name != NULL) {
+            ref_name[0] = '\0';
+        }
+        if (strlen(line) != OBJ_HASH_SIZE - 1 || !is_hash_str(line)) {
+            printf("ERROR: HEAD is not a valid ref or hash\n");
+            return -1;
+        }
+        snprintf(*out, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, line);
+        return 0;
+    }
+
+    if (ref_name != NULL) {
+        snprintf(ref_name, PATH_MAX, "%s", target);
+    }
+    return read_ref(repo, target, out);
+}
+
+// creates missing folders between `base` and last component of `path`
+// @param path path starting with `base`
+int ref_make_parents(const char *base, const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, PATH_MAX, "%s", path);
+    for (char *p = dir + strlen(base) + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        if (fs_mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+// writes `content` to "<ref>.lock" and renames it over the ref
+// @param old_hash same as in `update_ref`
+int ref_write_locked(const git_repo *repo, const char *ref_name, const char *content, const char *old_hash) {
+    char git_folder[PATH_MAX], path[PATH_MAX], lock_path[PATH_MAX + 8];
+    fs_path_dirname(repo->head_path, git_folder);
+    fs_path_join(git_folder, ref_name, path);
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+
+    if (ref_make_parents(git_folder, path) != 0) {
+        printf("ERROR: could not create folders of ref: %s\n", ref_name);
+        return -1;
+    }
+
+    // the lock file doubles as the new ref, only one writer can create it
+    int fd;
+    if ((fd = open(lock_path, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1) {
+        printf("ERROR: could not lock ref, is another gordit process running? %s\n", lock_path);
+        return -1;
+    }
+
+    if (old_hash != NULL) {
+        obj_hash current;
+        int res = read_ref(repo, ref_name, &current);
+        if ((old_hash[0] == '\0' && res != 1) || (old_hash[0] != '\0' && (res != 0 || strcmp(current, old_hash) != 0))) {
+            printf("ERROR: ref was changed by another process: %s\n", ref_name);
+            close(fd);
+            fs_remove(lock_path);
+            return -1;
+        }
+    }
+
+    int len = strlen(content);
+    int failed = write(fd, content, len) != len;
+    failed |= fsync(fd) != 0;
+    failed |= close(fd) != 0;
+
+    if (failed || fs_rename(lock_path, path) != 0) {
+        printf("ERROR: could not write ref: %s\n", ref_name);
+        fs_remove(lock_path);
+        return -1;
+    }
+    return 0;
+}
+
+int update_ref(const git_repo *repo, const char *ref_name, const obj_hash new_hash, const char *old_hash) {
+    char line[OBJ_HASH_SIZE + 1];
+    snprintf(line, sizeof(line), "%s\n", new_hash);
+    return ref_write_locked(repo, ref_name, line, old_hash);
+}
+
+// takes lock of packed refs, which is also the new file while it is written
+// @return descriptor of lock file, -1 if it is locked
+int packed_refs_lock(const git_repo *repo, char *lock_path) {
+    char path[PATH_MAX];
+    packed_refs_path(repo, path);
+    snprintf(lock_path, PATH_MAX + 8, "%s.lock", path);
+    int fd;
+    if ((fd = open(lock_path, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1) {
+        printf("ERROR: could not lock packed refs, is another gordit process running? %s\n", lock_path);
+    }
+    return fd;
+}
+
+// writes `data` then `more` to lock file and renames it over packed refs
+// @return 0 on success, -1 otherwise
+int packed_refs_commit(const git_repo *repo, int fd, const char *lock_path, const char *data, size_t size,
+    const char *more, size_t more_size) {
+
+    char path[PATH_MAX];
+    packed_refs_path(repo, path);
+    int failed = write(fd, data, size) != (ssize_t)size;
+    failed |= more_size > 0 && write(fd, more, more_size) != (ssize_t)more_size;
+    failed |= fsync(fd) != 0;
+    failed |= close(fd) != 0;
+    if (failed || fs_rename(lock_path, path) != 0) {
+        printf("ERROR: could not write packed refs\n");
+        fs_remove(lock_path);
+        return -1;
+    }
+    return 0;
+}
+
+// rewrites packed refs without `ref_name`
+// @return 0 if removed or not packed, -1 on failure
+int delete_packed_ref(const git_repo *repo, const char *ref_name) {
+    packed_refs packed;
+    int res = packed_refs_open(repo, &packed);
+    if (res != 0) {
+        return res == 1 ? 0 : -1;
+    }
+    // most deleted refs were never packed, so the lock is only taken for ones that are
+    int found = packed_refs_find(&packed, ref_name) != NULL;
+    packed_refs_close(&packed);
+    if (!found) {
+        return 0;
+    }
+
+    char lock_path[PATH_MAX + 8];
+    int fd = packed_refs_lock(repo, lock_path);
+    if (fd == -1) {
+        return -1;
+    }
+    // read again, packed refs may have been rewritten before the lock was taken
+    const char *record;
+    if ((res = packed_refs_open(repo, &packed)) != 0 || (record = packed_refs_find(&packed, ref_name)) == NULL) {
+        close(fd);
+        fs_remove(lock_path);
+        if (res == 0) {
+            packed_refs_close(&packed);
+        }
+        return res == -1 ? -1 : 0;
+    }
+    const char *next = packed_refs_next(&packed, record);
+    res = packed_refs_commit(repo, fd, lock_path, packed.map, record - packed.map, next, packed.end - next);
+    packed_refs_close(&packed);
+    return res;
+}
+
+int delete_ref(const git_repo *repo, const char *ref_name) {
+    char git_folder[PATH_MAX], path[PATH_MAX];
+    fs_path_dirname(repo->head_path, git_folder);
+    fs_path_join(git_folder, ref_name, path);
+    if (strncmp(ref_name, REFS_NAME "/", strlen(REFS_NAME) + 1) == 0 && delete_packed_ref(repo, ref_name) != 0) {
+        printf("ERROR: could not remove packed ref: %s\n", ref_name);
+        return -1;
+    }
+    if (fs_remove(path) != 0 && errno != ENOENT) {
+        printf("ERROR: could not remove ref: %s\n", ref_name);
+        return -1;
+    }
+    return 0;
+}
+
+int set_head(const git_repo *repo, const char *ref_name, const obj_hash hash) {
+    char content[PATH_MAX + 16];
+    if (ref_name != NULL) {
+        snprintf(content, sizeof(content), HEAD_REF_PREFIX "%s\n", ref_name);
+    } else {
+        snprintf(content, sizeof(content), "%s\n", hash);
+    }
+    return ref_write_locked(repo, HEAD_NAME, content, NULL);
+}
+
+// @param name malloc-ed, owned by list from now on
+void ref_list_push(ref_list *list, char *name, const char *hash, const char *peeled) {
+    if (list->num_refs == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->refs = realloc(list->refs, list->capacity * sizeof(ref_entry));
+    }
+    list->refs[list->num_refs].name = name;
+    snprintf(list->refs[list->num_refs].hash, OBJ_HASH_SIZE, "%s", hash);
+    snprintf(list->refs[list->num_refs].peeled, OBJ_HASH_SIZE, "%s", peeled);
+    list->num_refs++;
+}
+
+// @param name path of `dir` relative to git folder, including trailing '/'
+int list_refs_dir(const git_repo *repo, fs_dir *dir, char *name, ref_list *out) {
+    char git_folder[PATH_MAX];
+    fs_path_dirname(repo->head_path, git_folder);
+    size_t name_len = strlen(name);
+    fs_dirent dirent;
+    int res;
+
+    while ((res = fs_dir_next(dir, &dirent)) == 1) {
+        if (name_len + dirent.de_namelen + 2 > PATH_MAX) {
+            continue;
+        }
+        memcpy(name + name_len, dirent.de_name, dirent.de_namelen + 1);
+
+        if (dirent.de_type == FS_ISDIR) {
+            fs_dir *sub;
+            if ((sub = fs_dir_openat(dir, dirent.de_name)) == NULL) {
+                res = -1;
+                break;
+            }
+            strcat(name, "/");
+            res = list_refs_dir(repo, sub, name, out);
+            fs_dir_close(sub);
+            if (res != 0) {
+                break;
+            }
+            continue;
+        }
+
+        // lock files of refs being updated
+        if (dirent.de_namelen > 5 && strcmp(dirent.de_name + dirent.de_namelen - 5, ".lock") == 0) {
+            continue;
+        }
+        // only the loose file is read, the packed ref it may override is not wanted here
+        char path[PATH_MAX], line[PATH_MAX];
+        fs_path_join(git_folder, name, path);
+        if (read_ref_file(path, line) != 0 || strlen(line) != OBJ_HASH_SIZE - 1 || !is_hash_str(line)) {
+            continue;
+        }
+        ref_list_push(out, strdup(name), line, "");
+    }
+
+    name[name_len] = '\0';
+    return res == -1 ? -1 : 0;
+}
+
+int cmp_ref_entry(const void *a, const void *b) {
+    return strcmp(((const ref_entry *)a)->name, ((const ref_entry *)b)->name);
+}
+
+// merges sorted loose refs in `out` with the packed refs they do not override, in one pass
+// @return 0 on success, -1 if packed refs are malformed
+int list_refs_merge_packed(const packed_refs *packed, ref_list *out) {
+    ref_list loose = *out;
+    out->refs = NULL;
+    out->num_refs = 0;
+    out->capacity = 0;
+
+    const char *record = packed->start;
+    int i = 0, res = 0;
+    obj_hash hash, peeled;
+    while (i < loose.num_refs || record < packed->end) {
+        int len = -1;
+        if (record < packed->end && (len = packed_refs_parse(packed, record, &hash, &peeled)) < 0) {
+            printf("ERROR: packed refs are malformed\n");
+            res = -1;
+            break;
+        }
+        int cmp = record >= packed->end ? -1 : i >= loose.num_refs ? 1 :
+            ref_name_cmp(loose.refs[i].name, strlen(loose.refs[i].name), record + OBJ_HASH_SIZE, len);
+        if (cmp <= 0) {
+            ref_list_push(out, loose.refs[i].name, loose.refs[i].hash, "");
+            i++;
+        } else {
+            ref_list_push(out, strndup(record + OBJ_HASH_SIZE, len), hash, peeled);
+        }
+        if (cmp >= 0) {
+            record = packed_refs_next(packed, record);
+        }
+    }
+
+    for (; i < loose.num_refs; i++) {
+        free(loose.refs[i].name);
+    }
+    free(loose.refs);
+    return res;
+}
+
+// @return 0 on success, -1 if refs folder could not be read
+int list_loose_refs(const git_repo *repo, ref_list *out) {
+    out->refs = NULL;
+    out->num_refs = 0;
+    out->capacity = 0;
+
+    fs_dir *dir;
+    if ((dir = fs_dir_open(repo->ref_path)) == NULL) {
+        printf("ERROR: could not read refs folder\n");
+        return -1;
+    }
+
+    char name[PATH_MAX] = REFS_NAME "/";
+    int rc = list_refs_dir(repo, dir, name, out);
+    fs_dir_close(dir);
+
+    if (out->num_refs > 0) {
+        qsort(out->refs, out->num_refs, sizeof(ref_entry), cmp_ref_entry);
+    }
+    return rc;
+}
+
+int list_refs(const git_repo *repo, ref_list *out) {
+    int rc = list_loose_refs(repo, out);
+    packed_refs packed;
+    int res = packed_refs_open(repo, &packed);
+    if (res == 0) {
+        if (list_refs_merge_packed(&packed, out) != 0) {
+            rc = -1;
+        }
+        packed_refs_close(&packed);
+    } else if (res == -1) {
+        rc = -1;
+    }
+    return rc;
+}
+
+// Follows annotated tags from `hash` to the object they point to.
+// @return 1 if `hash` is an annotated tag and `out` was filled, 0 if it is not, -1 if a tag
+// could not be read
+int peel_ref_hash(const git_repo *repo, const char *hash, obj_hash *out) {
+    obj_hash current;
+    snprintf(current, OBJ_HASH_SIZE, "%s", hash);
+    int is_tag = 0;
+    while (1) {
+        size_t size;
+        unsigned char *data = create_obj_from_disk(repo, current, &size);
+        if (data == NULL) {
+            return -1;
+        }
+        const char *header = (const char *)data;
+        const char *body = header + strlen(header) + 1;
+        if (strncmp(header, O_TYPE_TAG " ", strlen(O_TYPE_TAG) + 1) != 0) {
+            free(data);
+            break;
+        }
+        if ((size_t)(body - header) + 7 + OBJ_HASH_SIZE - 1 > size || strncmp(body, "object ", 7) != 0 || !is_hash_str(body + 7)) {
+            free(data);
+            return -1;
+        }
+        snprintf(current, OBJ_HASH_SIZE, "%.*s", OBJ_HASH_SIZE - 1, body + 7);
+        free(data);
+        is_tag = 1;
+    }
+    if (is_tag) {
+        memcpy(*out, current, OBJ_HASH_SIZE);
+    }
+    return is_tag;
+}
+
+int peel_ref_to_commit(const git_repo *repo, const ref_entry *ref, obj_hash *out) {
+    snprintf(*out, OBJ_HASH_SIZE, "%s", ref->peeled[0] != '\0' ? ref->peeled : ref->hash);
+    if (ref->peeled[0] == '\0' && peel_ref_hash(repo, *out, out) == -1) {
+        return -1;
+    }
+
+    size_t size;
+    unsigned char *data = create_obj_from_disk(repo, *out, &size);
+    if (data == NULL) {
+        return -1;
+    }
+    int is_commit = strncmp((const char *)data, O_TYPE_COMMIT " ", strlen(O_TYPE_COMMIT) + 1) == 0;
+    free(data);
+    return is_commit ? 0 : 1;
+}
+
+// removes a packed loose ref that still holds `hash`, and folders left empty below refs/<kind>/
+void remove_packed_loose_ref(const git_repo *repo, const char *ref_name, const char *hash) {
+    char git_folder[PATH_MAX], path[PATH_MAX], lock_path[PATH_MAX + 8], line[PATH_MAX];
+    fs_path_dirname(repo->head_path, git_folder);
+    fs_path_join(git_folder, ref_name, path);
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+
+    // a ref being updated keeps its loose file, which overrides the packed one
+    int fd;
+    if ((fd = open(lock_path, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1) {
+        return;
+    }
+    if (read_ref_file(path, line) == 0 && strcmp(line, hash) == 0) {
+        fs_remove(path);
+    }
+    close(fd);
+    fs_remove(lock_path);
+
+    const char *kind_end = strchr(ref_name + strlen(REFS_NAME) + 1, '/');
+    if (kind_end == NULL) {
+        return;
+    }
+    size_t keep_len = strlen(git_folder) + 1 + (kind_end - ref_name);
+    char dir[PATH_MAX];
+    fs_path_dirname(path, dir);
+    while (strlen(dir) > keep_len && fs_remove(dir) == 0) {
+        char parent[PATH_MAX];
+        fs_path_dirname(dir, parent);
+        snprintf(dir, PATH_MAX, "%s", parent);
+    }
+}
+
+int pack_refs(const git_repo *repo, int *num_packed) {
+    char lock_path[PATH_MAX + 8];
+    int fd = packed_refs_lock(repo, lock_path);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // loose refs on their own too, as only they are removed once packed
+    ref_list loose, refs;
+    if (list_loose_refs(repo, &loose) != 0) {
+        close(fd);
+        fs_remove(lock_path);
+        return -1;
+    }
+    if (list_refs(repo, &refs) != 0) {
+        free_ref_list(&loose);
+        close(fd);
+        fs_remove(lock_path);
+        return -1;
+    }
+
+    size_t size = strlen(PACKED_REFS_HEADER), capacity = size + 1;
+    for (int i = 0; i < refs.num_refs; i++) {
+        capacity += 2 * OBJ_HASH_SIZE + 1 + strlen(refs.refs[i].name) + 1;
+    }
+    char *data = malloc(capacity);
+    memcpy(data, PACKED_REFS_HEADER, size);
+    for (int i = 0; i < refs.num_refs; i++) {
+        ref_entry *ref = &refs.refs[i];
+        // only tags can be annotated, and packed ones were peeled when they were packed
+        if (strncmp(ref->name, REFS_NAME "/tags/", strlen(REFS_NAME) + 6) == 0 &&
+            loose.num_refs > 0 && bsearch(ref, loose.refs, loose.num_refs, sizeof(ref_entry), cmp_ref_entry) != NULL &&
+            peel_ref_hash(repo, ref->hash, &ref->peeled) != 1) {
+            ref->peeled[0] = '\0';
+        }
+        size += sprintf(data + size, "%s %s\n", ref->hash, ref->name);
+        if (ref->peeled[0] != '\0') {
+            size += sprintf(data + size, "^%s\n", ref->peeled);
+        }
+    }
+
+    int res = packed_refs_commit(repo, fd, lock_path, data, size, NULL, 0);
+    free(data);
+    for (int i = 0; res == 0 && i < loose.num_refs; i++) {
+        remove_packed_loose_ref(repo, loose.refs[i].name, loose.refs[i].hash);
+    }
+    if (num_packed != NULL) {
+        *num_packed = refs.num_refs;
+    }
+    free_ref_list(&loose);
+    free_ref_list(&refs);
+    return res;
+}
+
+void free_ref_list(ref_list *list) {
+    for (int i = 0; i < list->num_refs; i++) {
+        free(list->refs[i].name);
+    }
+    free(list->refs);
+    list->refs = NULL;
+    list->num_refs = 0;
+    list->capacity = 0;
+}
+
+// finds the one object whose hash starts with `prefix`
+// @return 0 if found, -1 if none or more than one match
+int resolve_abbrev(const git_repo *repo, const char *prefix, obj_hash *out) {
+    size_t len = strlen(prefix);
+    if (len < MIN_ABBREV_LEN || len > OBJ_HASH_SIZE - 1) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)prefix[i])) {
+            return -1;
+        }
+    }
+
+    char folder[3] = { tolower((unsigned char)prefix[0]), tolower((unsigned char)prefix[1]), '\0' };
+    char path[PATH_MAX];
+    fs_path_join(repo->objects_path, folder, path);
+
+    fs_dir *dir;
+    if ((dir = fs_dir_open(path)) == NULL) {
+        return -1;
+    }
+    int matches = 0;
+    fs_dirent dirent;
+    while (fs_dir_next(dir, &dirent) == 1) {
+        if (dirent.de_namelen == OBJ_HASH_SIZE - 3 && strncasecmp(dirent.de_name, prefix + 2, len - 2) == 0) {
+            if (matches++ == 0) {
+                snprintf(*out, OBJ_HASH_SIZE, "%s%s", folder, dirent.de_name);
+            }
+        }
+    }
+    fs_dir_close(dir);
+
+    if (matches > 1) {
+        printf("ERROR: short hash %s is ambiguous\n", prefix);
+    }
+    return matches == 1 ? 0 : -1;
+}
+
+int resolve_rev(const git_repo *repo, const char *rev, obj_hash *out) {
+    char name[PATH_MAX];
+    snprintf(name, PATH_MAX, "%s", rev);
+
+    // "~N" and "^" suffixes, applied after the base is found
+    int steps = 0;
+    char *suffix = strpbrk(name, "~^");
+    if (suffix != NULL) {
+        for (char *p = suffix; *p != '\0'; ) {
+            char *end;
+            long n = 1;
+            if (*p != '~' && *p != '^') {
+                return -1;
+            }
+            if (*p == '~' && isdigit((unsigned char)p[1])) {
+                n = strtol(p + 1, &end, 10);
+            } else if (*p == '^' && p[1] == '1') {
+                end = p + 2;
+            } else {
+                end = p + 1;
+            }
+            steps += n;
+            p = end;
+        }
+        *suffix = '\0';
+    }
+
+    int found = -1;
+    if (strcmp(name, HEAD_NAME) == 0) {
+        found = resolve_head(repo, out, NULL) == 0 ? 0 : -1;
+    } else {
+        const char *formats[] = { "%s", REFS_NAME "/%s", REFS_NAME "/tags/%s", REFS_NAME "/heads/%s",
+            REMOTES_REF_PREFIX "%s", REMOTES_REF_PREFIX "%s/HEAD" };
+        for (int i = 0; i < 6 && found != 0; i++) {
+            char ref_name[PATH_MAX + 16];
+            snprintf(ref_name, sizeof(ref_name), formats[i], name);
+            if (strncmp(ref_name, REFS_NAME "/", strlen(REFS_NAME) + 1) == 0) {
+                found = read_ref(repo, ref_name, out) == 0 ? 0 : -1;
+            }
+        }
+        if (found != 0) {
+            found = resolve_abbrev(repo, name, out);
+        }
+    }
+
+    commit_graph *graph = steps > 0 ? commit_graph_open(repo) : NULL;
+    for (int i = 0; found == 0 && i < steps; i++) {
+        commit_info info;
+        if (load_commit_info(repo, graph, *out, &info, NULL) != 0) {
+            found = -1;
+            break;
+        }
+        if (info.num_parents == 0) {
+            printf("ERROR: %s has no parent\n", *out);
+            found = -1;
+        } else {
+            memcpy(*out, info.parents[0], OBJ_HASH_SIZE);
+        }
+        free_commit_info(&info);
+    }
+    if (graph != NULL) {
+        commit_graph_close(graph);
+    }
+    return found;
+}
+
+int resolve_tree(const git_repo *repo, const char *rev, obj_hash *out) {
+    obj_hash hash;
+    if (resolve_rev(repo, rev, &hash) != 0) {
+        return -1;
+    }
+
+    size_t size;
+    unsigned char *data;
+    if ((data = create_obj_from_disk(repo, hash, &size)) == NULL) {
+        return -1;
+    }
+    int is_tree = strncmp((char *)data, O_TYPE_TREE " ", strlen(O_TYPE_TREE) + 1) == 0;
+    free(data);
+
+    if (is_tree) {
+        memcpy(*out, hash, OBJ_HASH_SIZE);
+        return 0;
+    }
+    return read_commit_tree(repo, hash, out);
+}
@@ -0,0 +1,72 @@
+#include <string.h>
+#include <stdio.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "remote.h"
+
+void remote_config_path(const git_repo *repo, char *out) {
+    char git_path[PATH_MAX];
+    fs_path_join(repo->root_path, GIT_FOLDER, git_path);
+    fs_path_join(git_path, CONFIG_NAME, out);
+}
+
+int add_remote(const git_repo *repo, const char *name, const char *url, const char *branch) {
+    char path[PATH_MAX];
+    remote_config_path(repo, path);
+    FILE *fptr = fs_fopen(path, "ab");
+    if (fptr == NULL) {
+        printf("ERROR: could not write %s\n", path);
+        return -1;
+    }
+
+    fprintf(fptr, "[remote \"%s\"]\n\turl = %s\n\tfetch = +refs/heads/*:" REMOTES_REF_PREFIX "%s/*\n", name, url, name);
+    if (branch != NULL) {
+        fprintf(fptr, "[branch \"%s\"]\n\tremote = %s\n\tmerge = refs/heads/%s\n", branch, name, branch);
+    }
+    return fs_fclose(fptr) == 0 ? 0 : -1;
+}
+
+int resolve_remote(const git_repo *repo, const char *remote, char *name, char *url) {
+    if (remote == NULL) {
+        remote = DEFAULT_REMOTE;
+    }
+    char path[PATH_MAX], line[PATH_MAX + 64], section[PATH_MAX] = "", abs_path[PATH_MAX] = "";
+    if (fs_path_abs(remote, abs_path) != 0) {
+        abs_path[0] = '\0';
+    }
+    name[0] = '\0';
+    url[0] = '\0';
+
+    remote_config_path(repo, path);
+    FILE *fptr = fs_fopen(path, "rb");
+    while (fptr != NULL && fs_readline(line, sizeof(line), fptr) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *value = line + strspn(line, " \t");
+        if (strncmp(line, "[remote \"", 9) == 0) {
+            snprintf(section, PATH_MAX, "%.*s", (int)strcspn(line + 9, "\""), line + 9);
+        } else if (line[0] == '[') {
+            section[0] = '\0';
+        } else if (section[0] != '\0' && strncmp(value, "url = ", 6) == 0 &&
+            (strcmp(section, remote) == 0 || strcmp(value + 6, abs_path) == 0)) {
+            snprintf(name, PATH_MAX, "%s", section);
+            snprintf(url, PATH_MAX, "%s", value + 6);
+            // a remote with this name wins over one with this path
+            if (strcmp(section, remote) == 0) {
+                break;
+            }
+        }
+    }
+    if (fptr != NULL) {
+        fs_fclose(fptr);
+    }
+
+    if (url[0] == '\0' && abs_path[0] != '\0') {
+        snprintf(url, PATH_MAX, "%s", abs_path);
+    }
+    if (url[0] == '\0') {
+        printf("ERROR: %s is not a remote or a path\n", remote);
+        return -1;
+    }
+    return 0;
+}
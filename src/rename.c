@@ -0,0 +1,476 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "treediff.h"
+#include "threadpool.h"
+#include "rename.h"
+
+// hashes in a MinHash signature, cut into bands of `MINHASH_ROWS`
+#define MINHASH_SIZE 64
+#define MINHASH_ROWS 2
+
+// chunk size of binary files, which have no lines to split on
+#define RENAME_CHUNK 64
+
+// every pair is scored when there are at most this many
+#define RENAME_EXHAUSTIVE_PAIRS 16384
+
+// most files of one band bucket compared with each added file
+#define RENAME_MAX_BUCKET 512
+
+// files sketched by one thread pool task
+#define SKETCH_TASK_SIZE 16
+
+typedef struct sketch_chunk {
+    uint64_t hash;
+    uint32_t bytes; // bytes of the file with this hash
+} sketch_chunk;
+
+typedef struct rename_file {
+    int change; // position in change list
+    const char *path;
+    const char *hash;
+    unsigned int mode;
+    int is_deleted; // 0 for the old side of a modified file
+    int used; // deleted file already taken by a rename, or added file matched
+    size_t size;
+    sketch_chunk *chunks; // sorted by hash, each hash once
+    int num_chunks;
+    uint64_t minhash[MINHASH_SIZE];
+} rename_file;
+
+typedef struct rename_pair {
+    int score;
+    int src, dst;
+    int same_name;
+} rename_pair;
+
+typedef struct sketch_task {
+    const git_repo *repo;
+    rename_file **files;
+    int num_files;
+    atomic_int *failed;
+} sketch_task;
+
+typedef struct band_key {
+    uint64_t key;
+    int src;
+} band_key;
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t chunk_hash(const unsigned char *s, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ s[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int cmp_chunks(const void *a, const void *b) {
+    uint64_t x = ((const sketch_chunk *)a)->hash, y = ((const sketch_chunk *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// fills file's chunks and signature from its contents
+void sketch_contents(rename_file *file, const unsigned char *data, size_t size) {
+    int binary = is_like_binary(data, size);
+    int capacity = 64, num_chunks = 0;
+    sketch_chunk *chunks = malloc(capacity * sizeof(sketch_chunk));
+    for (size_t pos = 0; pos < size;) {
+        size_t len;
+        if (binary) {
+            len = size - pos < RENAME_CHUNK ? size - pos : RENAME_CHUNK;
+        } else {
+            const unsigned char *eol = memchr(data + pos, '\n', size - pos);
+            len = eol != NULL ? (size_t)(eol - (data + pos)) + 1 : size - pos;
+        }
+        if (num_chunks == capacity) {
+            capacity *= 2;
+            chunks = realloc(chunks, capacity * sizeof(sketch_chunk));
+        }
+        chunks[num_chunks].hash = chunk_hash(data + pos, len);
+        chunks[num_chunks++].bytes = len;
+        pos += len;
+    }
+
+    // repeated chunks are counted by the bytes they cover
+    qsort(chunks, num_chunks, sizeof(sketch_chunk), cmp_chunks);
+    int out = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (out > 0 && chunks[out - 1].hash == chunks[i].hash) {
+            chunks[out - 1].bytes += chunks[i].bytes;
+        } else {
+            chunks[out++] = chunks[i];
+        }
+    }
+    file->chunks = chunks;
+    file->num_chunks = out;
+    file->size = size;
+
+    for (int k = 0; k < MINHASH_SIZE; k++) {
+        file->minhash[k] = UINT64_MAX;
+    }
+    for (int i = 0; i < out; i++) {
+        for (int k = 0; k < MINHASH_SIZE; k++) {
+            uint64_t h = mix64(chunks[i].hash + (uint64_t)(k + 1) * 0x9e3779b97f4a7c15ULL);
+            if (h < file->minhash[k]) {
+                file->minhash[k] = h;
+            }
+        }
+    }
+}
+
+void sketch_task_run(void *arg) {
+    sketch_task *task = arg;
+    for (int i = 0; i < task->num_files && !atomic_load(task->failed); i++) {
+        rename_file *file = task->files[i];
+        obj_hash hash;
+        snprintf(hash, OBJ_HASH_SIZE, "%s", file->hash);
+        git_obj_blob *blob = create_blob_from_disk(task->repo, hash);
+        size_t size;
+        const unsigned char *data = blob != NULL ? blob_contents(blob, &size) : NULL;
+        if (data == NULL) {
+            printf("ERROR: could not read blob %s\n", file->hash);
+            atomic_store(task->failed, 1);
+        } else {
+            sketch_contents(file, data, size);
+        }
+        free_blob(blob);
+    }
+    free(task);
+}
+
+// @return 0 on success, -1 if a blob could not be read
+int sketch_files(const git_repo *repo, rename_file **files, int num_files) {
+    atomic_int failed;
+    atomic_init(&failed, 0);
+    threadpool *pool = num_files > SKETCH_TASK_SIZE ? threadpool_create(0) : NULL;
+    for (int i = 0; i < num_files; i += SKETCH_TASK_SIZE) {
+        sketch_task *task = malloc(sizeof(*task));
+        task->repo = repo;
+        task->files = files + i;
+        task->num_files = num_files - i < SKETCH_TASK_SIZE ? num_files - i : SKETCH_TASK_SIZE;
+        task->failed = &failed;
+        if (pool != NULL) {
+            threadpool_submit(pool, sketch_task_run, task);
+        } else {
+            sketch_task_run(task);
+        }
+    }
+    if (pool != NULL) {
+        threadpool_destroy(pool);
+    }
+    return atomic_load(&failed) ? -1 : 0;
+}
+
+// @return percent of the larger file's bytes found in the other file
+int similarity_score(const rename_file *a, const rename_file *b) {
+    size_t common = 0;
+    int i = 0, j = 0;
+    while (i < a->num_chunks && j < b->num_chunks) {
+        if (a->chunks[i].hash < b->chunks[j].hash) {
+            i++;
+        } else if (a->chunks[i].hash > b->chunks[j].hash) {
+            j++;
+        } else {
+            common += a->chunks[i].bytes < b->chunks[j].bytes ? a->chunks[i].bytes : b->chunks[j].bytes;
+            i++;
+            j++;
+        }
+    }
+    size_t max_size = a->size > b->size ? a->size : b->size;
+    return max_size > 0 ? (int)(common * 100 / max_size) : 0;
+}
+
+const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+int cmp_sources_by_hash(const void *a, const void *b) {
+    const rename_file *x = *(rename_file * const *)a, *y = *(rename_file * const *)b;
+    int res = strcmp(x->hash, y->hash);
+    return res != 0 ? res : x->change - y->change;
+}
+
+int cmp_pairs(const void *a, const void *b) {
+    const rename_pair *x = a, *y = b;
+    if (x->score != y->score) {
+        return y->score - x->score;
+    }
+    if (x->same_name != y->same_name) {
+        return y->same_name - x->same_name;
+    }
+    return x->dst != y->dst ? x->dst - y->dst : x->src - y->src;
+}
+
+int cmp_band_keys(const void *a, const void *b) {
+    uint64_t x = ((const band_key *)a)->key, y = ((const band_key *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+int cmp_changes_by_path(const void *a, const void *b) {
+    return strcmp(((const tree_change *)a)->path, ((const tree_change *)b)->path);
+}
+
+uint64_t band_hash(const rename_file *file, int band) {
+    uint64_t key = mix64((uint64_t)band + 1);
+    for (int r = 0; r < MINHASH_ROWS; r++) {
+        key = mix64(key ^ file->minhash[band * MINHASH_ROWS + r]);
+    }
+    return key;
+}
+
+void add_pair(rename_pair **pairs, int *num_pairs, int *capacity, int score, int src, int dst, int same_name) {
+    if (*num_pairs == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *pairs = realloc(*pairs, *capacity * sizeof(rename_pair));
+    }
+    rename_pair pair = { score, src, dst, same_name };
+    (*pairs)[(*num_pairs)++] = pair;
+}
+
+// @return 1 if sizes alone rule out a score of `min_score`
+int sizes_too_different(size_t a, size_t b, int min_score) {
+    size_t min_size = a < b ? a : b, max_size = a > b ? a : b;
+    return min_size * 100 < max_size * (size_t)min_score;
+}
+
+// Scores added files against sources that share a band bucket, or all of them if there are few.
+// @param srcs, dsts sketched files, empty ones left out
+void find_similar_pairs(rename_file **srcs, int num_srcs, rename_file **dsts, int num_dsts, int min_score,
+    rename_pair **pairs, int *num_pairs, int *capacity) {
+
+    if ((long)num_srcs * num_dsts <= RENAME_EXHAUSTIVE_PAIRS) {
+        for (int d = 0; d < num_dsts; d++) {
+            for (int s = 0; s < num_srcs; s++) {
+                if (sizes_too_different(srcs[s]->size, dsts[d]->size, min_score)) {
+                    continue;
+                }
+                int score = similarity_score(srcs[s], dsts[d]);
+                if (score >= min_score) {
+                    add_pair(pairs, num_pairs, capacity, score, s, d, strcmp(base_name(srcs[s]->path), base_name(dsts[d]->path)) == 0);
+                }
+            }
+        }
+        return;
+    }
+
+    int num_bands = MINHASH_SIZE / MINHASH_ROWS;
+    band_key *keys = malloc((size_t)num_srcs * num_bands * sizeof(band_key));
+    for (int s = 0; s < num_srcs; s++) {
+        for (int band = 0; band < num_bands; band++) {
+            keys[s * num_bands + band].key = band_hash(srcs[s], band);
+            keys[s * num_bands + band].src = s;
+        }
+    }
+    size_t num_keys = (size_t)num_srcs * num_bands;
+    qsort(keys, num_keys, sizeof(band_key), cmp_band_keys);
+
+    int *seen = malloc(num_srcs * sizeof(int));
+    memset(seen, -1, num_srcs * sizeof(int));
+    for (int d = 0; d < num_dsts; d++) {
+        for (int band = 0; band < num_bands; band++) {
+            uint64_t key = band_hash(dsts[d], band);
+            size_t lo = 0, hi = num_keys;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (keys[mid].key < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            for (size_t k = lo; k < num_keys && k < lo + RENAME_MAX_BUCKET && keys[k].key == key; k++) {
+                int s = keys[k].src;
+                if (seen[s] == d || sizes_too_different(srcs[s]->size, dsts[d]->size, min_score)) {
+                    continue;
+                }
+                seen[s] = d;
+                int score = similarity_score(srcs[s], dsts[d]);
+                if (score >= min_score) {
+                    add_pair(pairs, num_pairs, capacity, score, s, d, strcmp(base_name(srcs[s]->path), base_name(dsts[d]->path)) == 0);
+                }
+            }
+        }
+    }
+    free(seen);
+    free(keys);
+}
+
+int detect_renames(const git_repo *repo, tree_change_list *changes, int min_score, int flags) {
+    int n = changes->num_changes;
+    rename_file *files = calloc(n + 1, sizeof(rename_file));
+    rename_file **srcs = malloc((n + 1) * sizeof(rename_file *));
+    rename_file **dsts = malloc((n + 1) * sizeof(rename_file *));
+    int num_srcs = 0, num_dsts = 0;
+    for (int i = 0; i < n; i++) {
+        tree_change *change = &changes->changes[i];
+        int is_dst = change->kind == TREE_ADDED;
+        int is_src = change->kind == TREE_DELETED || (change->kind == TREE_MODIFIED && (flags & RENAME_COPIES));
+        unsigned int mode = is_dst ? change->new_mode : change->old_mode;
+        if ((!is_dst && !is_src) || (mode & 0170000) == 0160000) {
+            continue; // gitlinks have no contents to compare
+        }
+        files[i].change = i;
+        files[i].path = change->path;
+        files[i].hash = is_dst ? change->new_hash : change->old_hash;
+        files[i].mode = mode;
+        files[i].is_deleted = change->kind == TREE_DELETED;
+        if (is_dst) {
+            dsts[num_dsts++] = &files[i];
+        } else {
+            srcs[num_srcs++] = &files[i];
+        }
+    }
+
+    // source of each added file, -1 if none
+    int *match = malloc((n + 1) * sizeof(int));
+    int *match_score = malloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        match[i] = -1;
+    }
+
+    // exact renames, preferring a deleted file of the same name, then any deleted file
+    qsort(srcs, num_srcs, sizeof(rename_file *), cmp_sources_by_hash);
+    for (int d = 0; d < num_dsts; d++) {
+        rename_file *dst = dsts[d];
+        int lo = 0, hi = num_srcs;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (strcmp(srcs[mid]->hash, dst->hash) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        rename_file *best = NULL;
+        int best_rank = 0;
+        for (int s = lo; s < num_srcs && strcmp(srcs[s]->hash, dst->hash) == 0; s++) {
+            int free_rename = srcs[s]->is_deleted && !srcs[s]->used;
+            int rank = free_rename ? 2 + (strcmp(base_name(srcs[s]->path), base_name(dst->path)) == 0) : 1;
+            if ((free_rename || (flags & RENAME_COPIES)) && rank > best_rank) {
+                best = srcs[s];
+                best_rank = rank;
+            }
+        }
+        if (best != NULL) {
+            best->used |= best->is_deleted;
+            dst->used = 1;
+            match[dst->change] = best->change;
+            match_score[dst->change] = 100;
+        }
+    }
+
+    // inexact matches among the rest, renames only take deleted files still free
+    int num_left_srcs = 0, num_left_dsts = 0, num_sketch = 0;
+    rename_file **sketch = malloc((num_srcs + num_dsts + 1) * sizeof(rename_file *));
+    for (int s = 0; s < num_srcs; s++) {
+        if (!srcs[s]->used || (flags & RENAME_COPIES)) {
+            srcs[num_left_srcs++] = srcs[s];
+        }
+    }
+    for (int d = 0; d < num_dsts; d++) {
+        if (!dsts[d]->used) {
+            dsts[num_left_dsts++] = dsts[d];
+        }
+    }
+    if (num_left_srcs > 0 && num_left_dsts > 0) {
+        for (int s = 0; s < num_left_srcs; s++) {
+            sketch[num_sketch++] = srcs[s];
+        }
+        for (int d = 0; d < num_left_dsts; d++) {
+            sketch[num_sketch++] = dsts[d];
+        }
+    }
+
+    int rc = sketch_files(repo, sketch, num_sketch);
+    if (rc == 0 && num_sketch > 0) {
+        // empty files are only ever renamed exactly
+        int num_s = 0, num_d = 0;
+        for (int s = 0; s < num_left_srcs; s++) {
+            if (srcs[s]->size > 0) {
+                srcs[num_s++] = srcs[s];
+            }
+        }
+        for (int d = 0; d < num_left_dsts; d++) {
+            if (dsts[d]->size > 0) {
+                dsts[num_d++] = dsts[d];
+            }
+        }
+
+        rename_pair *pairs = NULL;
+        int num_pairs = 0, capacity = 0;
+        find_similar_pairs(srcs, num_s, dsts, num_d, min_score, &pairs, &num_pairs, &capacity);
+        qsort(pairs, num_pairs, sizeof(rename_pair), cmp_pairs);
+        for (int p = 0; p < num_pairs; p++) {
+            rename_file *src = srcs[pairs[p].src], *dst = dsts[pairs[p].dst];
+            if (dst->used || (src->used && !(flags & RENAME_COPIES)) || (!src->is_deleted && !(flags & RENAME_COPIES))) {
+                continue;
+            }
+            src->used |= src->is_deleted;
+            dst->used = 1;
+            match[dst->change] = src->change;
+            match_score[dst->change] = pairs[p].score;
+        }
+        free(pairs);
+    }
+
+    int num_found = 0;
+    if (rc == 0) {
+        // the first match of a deleted file is its rename, later ones are copies
+        char *renamed = calloc(n + 1, 1);
+        for (int i = 0; i < n; i++) {
+            if (match[i] < 0) {
+                continue;
+            }
+            tree_change *dst = &changes->changes[i];
+            const tree_change *src = &changes->changes[match[i]];
+            dst->kind = src->kind == TREE_DELETED && !renamed[match[i]] ? TREE_RENAMED : TREE_COPIED;
+            if (dst->kind == TREE_RENAMED) {
+                renamed[match[i]] = 1;
+            }
+            dst->old_path = strdup(src->path);
+            dst->old_mode = src->old_mode;
+            memcpy(dst->old_hash, src->old_hash, OBJ_HASH_SIZE);
+            dst->score = match_score[i];
+            num_found++;
+        }
+
+        int out = 0;
+        for (int i = 0; i < n; i++) {
+            if (renamed[i]) {
+                free(changes->changes[i].path);
+            } else {
+                changes->changes[out++] = changes->changes[i];
+            }
+        }
+        changes->num_changes = out;
+        qsort(changes->changes, out, sizeof(tree_change), cmp_changes_by_path);
+        free(renamed);
+    }
+
+    for (int i = 0; i < n; i++) {
+        free(files[i].chunks);
+    }
+    free(files);
+    free(srcs);
+    free(dsts);
+    free(sketch);
+    free(match);
+    free(match_score);
+    return rc == 0 ? num_found : -1;
+}
@@ -0,0 +1,97 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "commit.h"
+#include "merge.h"
+#include "linediff.h"
+#include "replay.h"
+
+int replay_commits(const git_repo *repo, const obj_hash onto, const obj_hash *commits, int num_commits,
+    const merge_options *options, replay_result *out) {
+
+    memset(out, 0, sizeof(*out));
+    out->stopped = -1;
+    snprintf(out->tip, OBJ_HASH_SIZE, "%s", onto);
+
+    obj_hash tip_tree;
+    if (read_commit_tree(repo, onto, &tip_tree) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < num_commits; i++) {
+        commit_info info;
+        if (read_commit_info(repo, commits[i], &info) != 0) {
+            return -1;
+        }
+        if (info.num_parents > 1) {
+            printf("NOTE: skipping merge commit %.7s\n", commits[i]);
+            out->num_skipped++;
+            free_commit_info(&info);
+            continue;
+        }
+
+        // already on top of the tip, nothing to rewrite
+        if (info.num_parents == 1 && strcmp(info.parents[0], out->tip) == 0) {
+            snprintf(out->tip, OBJ_HASH_SIZE, "%s", commits[i]);
+            snprintf(tip_tree, OBJ_HASH_SIZE, "%s", info.tree);
+            out->num_replayed++;
+            free_commit_info(&info);
+            continue;
+        }
+
+        // conflicts are labelled with the commit being replayed, unless a label is given
+        merge_options commit_options = { "HEAD", NULL, LINE_DIFF_MYERS };
+        char label[8];
+        if (options != NULL) {
+            commit_options = *options;
+        }
+        if (commit_options.theirs_label == NULL) {
+            snprintf(label, sizeof(label), "%.7s", commits[i]);
+            commit_options.theirs_label = label;
+        }
+
+        obj_hash parent_tree;
+        if (info.num_parents == 1 && read_commit_tree(repo, info.parents[0], &parent_tree) != 0) {
+            free_commit_info(&info);
+            return -1;
+        }
+        merge_result result;
+        int rc = merge_trees(repo, info.num_parents == 1 ? parent_tree : NULL, tip_tree, info.tree, &commit_options, &result);
+        if (rc != 0) {
+            free_commit_info(&info);
+            if (rc == 1) {
+                out->stopped = i;
+                out->conflict = result;
+            }
+            return rc;
+        }
+
+        // commits that were empty to begin with are kept, like git does
+        int was_empty = info.num_parents == 1 && strcmp(parent_tree, info.tree) == 0;
+        if (strcmp(result.tree, tip_tree) == 0 && !was_empty) {
+            printf("NOTE: skipping %.7s, its changes are already in the tip\n", commits[i]);
+            out->num_skipped++;
+        } else {
+            obj_hash parent, commit;
+            snprintf(parent, OBJ_HASH_SIZE, "%s", out->tip);
+            if (write_commit_copy(repo, result.tree, &parent, 1, commits[i], &commit) != 0) {
+                free_merge_result(&result);
+                free_commit_info(&info);
+                return -1;
+            }
+            snprintf(out->tip, OBJ_HASH_SIZE, "%s", commit);
+            snprintf(tip_tree, OBJ_HASH_SIZE, "%s", result.tree);
+            out->num_replayed++;
+        }
+        free_merge_result(&result);
+        free_commit_info(&info);
+    }
+    return 0;
+}
+
+void free_replay_result(replay_result *result) {
+    free_merge_result(&result->conflict);
+}
@@ -5,6 +5,8 @@
 #include "filesystem.h"
 #include "objects.h"
 #include "repo.h"
+#include "refs.h"
+#include "ignore.h"
 
 // NOTE: only supports files and folders. symlinks and gitlinks just return 0.
 unsigned int stat_mode_to_git(unsigned int st_mode) {
@@ -25,20 +27,14 @@ unsigned int git_mode_to_stat(unsigned int git_mode) {
 // Walks up `path` until it finds a directory with git folder. Fills `repo_root` with that directory path. 
 // @returns 1 on successful find and 0 if unsuccessful.
 int git_find_root(const char *path, char *repo_root) {
-    DIR *dir;
-    if ((dir = fs_opendir(path)) == NULL) {
-        return 0;
-    }
+    char git_folder_path[PATH_MAX];
+    fs_statinfo info;
+    fs_path_join(path, GIT_FOLDER, git_folder_path);
 
-    fs_dirent *ent;
-    while ((ent = fs_readdir(dir, path)) != NULL) {
-        if (strcmp(ent->de_name, GIT_FOLDER) == 0) {
-            snprintf(repo_root, PATH_MAX, "%s", path);
-            fs_closedir(dir);
-            return 1;
-        }
+    if (fs_getinfo(git_folder_path, &info) == 0 && S_ISDIR(info.fi_mode)) {
+        snprintf(repo_root, PATH_MAX, "%s", path);
+        return 1;
     }
-    fs_closedir(dir);
 
     char parent[PATH_MAX];
     fs_path_dirname(path, parent);
@@ -50,26 +46,30 @@ int git_find_root(const char *path, char *repo_root) {
 }
 
 int git_init_repo(const char *cwd) {
-    char head_path[PATH_MAX];
+    char head_path[PATH_MAX], git_path[PATH_MAX], objs_path[PATH_MAX], refs_path[PATH_MAX], heads_path[PATH_MAX];
     fs_path_join(cwd, HEAD_PATH, head_path);
+    fs_path_join(cwd, GIT_FOLDER, git_path);
+    fs_path_join(cwd, OBJS_FOLDER, objs_path);
+    fs_path_join(cwd, REFS_FOLDER, refs_path);
+    fs_path_join(refs_path, "heads", heads_path);
 
     if (fs_file_exists(head_path) == 1) {
         return 1;
     }
 
-    if (fs_mkdir(GIT_FOLDER, 0700) == -1 ||
-        fs_mkdir(OBJS_FOLDER, 0700) == -1 ||
-        fs_mkdir(REFS_FOLDER, 0700) == -1) {
+    if (fs_mkdir(git_path, 0700) == -1 ||
+        fs_mkdir(objs_path, 0700) == -1 ||
+        fs_mkdir(refs_path, 0700) == -1 ||
+        fs_mkdir(heads_path, 0700) == -1) {
         return -1;
     }
 
     FILE *fptr;
-    if ((fptr = fs_fopen(HEAD_PATH, "wb")) == NULL) {
+    if ((fptr = fs_fopen(head_path, "wb")) == NULL) {
         return -1;
     }
 
-    // TODO: make seperate HEAD and refs initialization function
-    fprintf(fptr, "refs: refs/heads/main");
+    fprintf(fptr, "%s%s\n", HEAD_REF_PREFIX, DEFAULT_BRANCH_REF);
     fs_fclose(fptr);
    
     return 0;
@@ -91,11 +91,20 @@ const git_repo *get_working_repo(const char *cwd) {
     fs_path_join(git_folder_path, OBJS_NAME, repo->objects_path);
     fs_path_join(git_folder_path, INDEX_NAME, repo->index_path);
     fs_path_join(git_folder_path, HEAD_NAME, repo->head_path);
+    repo->ignores = ignore_cache_create(repo);
 
     return repo;
 }
 
-int obj_store_path(const git_repo *repo, const obj_hash hash, char *out) {
+void free_repo(const git_repo *repo) {
+    if (repo == NULL) {
+        return;
+    }
+    ignore_cache_free(repo->ignores);
+    free((void *)repo);
+}
+
+void obj_path(const git_repo *repo, const obj_hash hash, char *out) {
     char path2[OBJ_HASH_SIZE + 1];
 
     for (size_t i = OBJ_HASH_SIZE; i > 2; --i) {
@@ -105,8 +114,13 @@ int obj_store_path(const git_repo *repo, const obj_hash hash, char *out) {
     path2[1] = hash[1];
     path2[2] = '/';
     fs_path_join(repo->objects_path, path2, out);
-    
-    if (fs_file_exists(out)) {
+}
+
+int obj_store_path(const git_repo *repo, const obj_hash hash, char *out) {
+    obj_path(repo, hash, out);
+
+    // an object written again is touched, so gc keeps it as recent even if it was unreachable
+    if (fs_touch(out) == 0 || fs_file_exists(out)) {
         return 1;
     }
     
@@ -0,0 +1,417 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "treediff.h"
+#include "revwalk.h"
+
+#define WALK_HASH_LEN 20
+#define WALK_NO_POS 0xffffffff
+
+#define NODE_PARSED 1
+#define NODE_QUEUED 2 // has been in walk heap
+#define NODE_HIDDEN 4 // reachable from a hidden commit
+
+typedef struct walk_node {
+    unsigned char hash[WALK_HASH_LEN];
+    unsigned char tree[WALK_HASH_LEN];
+    uint32_t graph_pos;
+    uint32_t generation; // GENERATION_INFINITY if not in commit-graph and not computed
+    time_t timestamp;
+    uint32_t *parents; // node indexes
+    int num_parents;
+    int flags;
+} walk_node;
+
+typedef struct walk_heap {
+    uint32_t *items;
+    uint32_t size;
+    uint32_t capacity;
+    int by_generation; // otherwise by commit time only
+} walk_heap;
+
+struct revwalk {
+    const git_repo *repo;
+    commit_graph *graph;
+    revwalk_order order;
+    int first_parent;
+    walk_node *nodes;
+    uint32_t num_nodes;
+    uint32_t capacity;
+    uint32_t *table; // open addressing, node index + 1, 0 if empty
+    uint32_t table_size;
+    walk_heap queue;
+    walk_heap hidden;
+    char *path;
+    bloom_key path_key;
+};
+
+// @return 1 if node `a` comes out of heap before `b`
+int heap_before(const revwalk *walk, const walk_heap *heap, uint32_t a, uint32_t b) {
+    const walk_node *na = &walk->nodes[a], *nb = &walk->nodes[b];
+    if (heap->by_generation && na->generation != nb->generation) {
+        return na->generation > nb->generation;
+    }
+    return na->timestamp > nb->timestamp;
+}
+
+void heap_push(revwalk *walk, walk_heap *heap, uint32_t idx) {
+    if (heap->size == heap->capacity) {
+        heap->capacity = heap->capacity ? heap->capacity * 2 : 64;
+        heap->items = realloc(heap->items, heap->capacity * sizeof(uint32_t));
+    }
+    uint32_t i = heap->size++;
+    while (i > 0 && heap_before(walk, heap, idx, heap->items[(i - 1) / 2])) {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i] = idx;
+}
+
+uint32_t heap_pop(revwalk *walk, walk_heap *heap) {
+    uint32_t top = heap->items[0];
+    uint32_t last = heap->items[--heap->size];
+    uint32_t i = 0;
+    while (2 * i + 1 < heap->size) {
+        uint32_t child = 2 * i + 1;
+        if (child + 1 < heap->size && heap_before(walk, heap, heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+        if (!heap_before(walk, heap, heap->items[child], last)) {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->size > 0) {
+        heap->items[i] = last;
+    }
+    return top;
+}
+
+uint32_t walk_slot(const revwalk *walk, const unsigned char *hash) {
+    uint32_t slot = (((uint32_t)hash[0] << 24) | (hash[1] << 16) | (hash[2] << 8) | hash[3]) & (walk->table_size - 1);
+    while (walk->table[slot] != 0 && memcmp(walk->nodes[walk->table[slot] - 1].hash, hash, WALK_HASH_LEN) != 0) {
+        slot = (slot + 1) & (walk->table_size - 1);
+    }
+    return slot;
+}
+
+// @return index of node for commit, added unparsed if it is new
+uint32_t walk_get_node(revwalk *walk, const unsigned char *hash) {
+    uint32_t slot = walk_slot(walk, hash);
+    if (walk->table[slot] != 0) {
+        return walk->table[slot] - 1;
+    }
+
+    if (walk->num_nodes == walk->capacity) {
+        walk->capacity *= 2;
+        walk->nodes = realloc(walk->nodes, walk->capacity * sizeof(walk_node));
+    }
+    uint32_t idx = walk->num_nodes++;
+    walk_node *node = &walk->nodes[idx];
+    memset(node, 0, sizeof(*node));
+    memcpy(node->hash, hash, WALK_HASH_LEN);
+    node->graph_pos = WALK_NO_POS;
+    node->generation = GENERATION_INFINITY;
+    walk->table[slot] = idx + 1;
+
+    if (walk->num_nodes * 2 > walk->table_size) {
+        free(walk->table);
+        walk->table_size *= 2;
+        walk->table = calloc(walk->table_size, sizeof(uint32_t));
+        for (uint32_t i = 0; i < walk->num_nodes; i++) {
+            walk->table[walk_slot(walk, walk->nodes[i].hash)] = i + 1;
+        }
+    }
+    return idx;
+}
+
+// reads parents, tree, time and generation of node, from commit-graph if it is there
+// @return 0 on success, -1 if commit could not be read
+int walk_parse(revwalk *walk, uint32_t idx) {
+    if (walk->nodes[idx].flags & NODE_PARSED) {
+        return 0;
+    }
+
+    uint32_t pos;
+    if (walk->graph != NULL && commit_graph_find_bytes(walk->graph, walk->nodes[idx].hash, &pos)) {
+        uint32_t parent_pos[2];
+        int num_parents = commit_graph_parents(walk->graph, pos, parent_pos, 2);
+        uint32_t *extra = NULL;
+        if (num_parents > 2) {
+            extra = malloc(num_parents * sizeof(uint32_t));
+            commit_graph_parents(walk->graph, pos, extra, num_parents);
+        }
+
+        uint32_t *parents = malloc((num_parents + 1) * sizeof(uint32_t));
+        for (int i = 0; i < num_parents; i++) {
+            parents[i] = walk_get_node(walk, commit_graph_hash_bytes(walk->graph, extra != NULL ? extra[i] : parent_pos[i]));
+        }
+        free(extra);
+
+        walk_node *node = &walk->nodes[idx];
+        obj_hash tree;
+        commit_graph_tree(walk->graph, pos, &tree);
+        hash_to_bytes(tree, node->tree);
+        node->graph_pos = pos;
+        node->generation = commit_graph_generation(walk->graph, pos);
+        node->timestamp = commit_graph_timestamp(walk->graph, pos);
+        node->parents = parents;
+        node->num_parents = num_parents;
+        node->flags |= NODE_PARSED;
+        return 0;
+    }
+
+    obj_hash hash;
+    commit_info info;
+    hash_from_bytes(walk->nodes[idx].hash, &hash);
+    if (read_commit_info(walk->repo, hash, &info) != 0) {
+        return -1;
+    }
+
+    uint32_t *parents = malloc((info.num_parents + 1) * sizeof(uint32_t));
+    for (int i = 0; i < info.num_parents; i++) {
+        unsigned char raw[WALK_HASH_LEN];
+        hash_to_bytes(info.parents[i], raw);
+        parents[i] = walk_get_node(walk, raw);
+    }
+
+    walk_node *node = &walk->nodes[idx];
+    hash_to_bytes(info.tree, node->tree);
+    node->timestamp = info.timestamp;
+    node->parents = parents;
+    node->num_parents = info.num_parents;
+    node->flags |= NODE_PARSED;
+    free_commit_info(&info);
+    return 0;
+}
+
+// computes generation of a commit missing from commit-graph from its parents
+// @return 0 on success, -1 if a commit could not be read
+int walk_generation(revwalk *walk, uint32_t idx) {
+    if (walk->nodes[idx].generation != GENERATION_INFINITY) {
+        return 0;
+    }
+
+    uint32_t num_stack = 0, capacity = 64;
+    uint32_t *stack = malloc(capacity * sizeof(uint32_t));
+    stack[num_stack++] = idx;
+    while (num_stack > 0) {
+        uint32_t top = stack[num_stack - 1];
+        if (walk->nodes[top].generation != GENERATION_INFINITY) {
+            num_stack--;
+            continue;
+        }
+        if (walk_parse(walk, top) != 0) {
+            free(stack);
+            return -1;
+        }
+
+        walk_node *node = &walk->nodes[top];
+        uint32_t max_gen = 0;
+        int pending = 0;
+        for (int i = 0; i < node->num_parents; i++) {
+            const walk_node *parent = &walk->nodes[node->parents[i]];
+            if (parent->generation == GENERATION_INFINITY) {
+                if (num_stack == capacity) {
+                    capacity *= 2;
+                    stack = realloc(stack, capacity * sizeof(uint32_t));
+                }
+                stack[num_stack++] = node->parents[i];
+                pending = 1;
+            } else if (parent->generation > max_gen) {
+                max_gen = parent->generation;
+            }
+        }
+        if (!pending) {
+            node->generation = max_gen + 1;
+            num_stack--;
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+// prepares node to be put in a heap
+// @return 0 on success, -1 if commit could not be read
+int walk_prepare(revwalk *walk, uint32_t idx) {
+    if (walk_parse(walk, idx) != 0) {
+        return -1;
+    }
+    if (walk->order == REVWALK_TOPO_ORDER) {
+        return walk_generation(walk, idx);
+    }
+    return 0;
+}
+
+// @return 1 if hidden commit `hidden` may be a descendant of `idx`
+int walk_may_reach(const revwalk *walk, uint32_t hidden, uint32_t idx) {
+    const walk_node *h = &walk->nodes[hidden], *n = &walk->nodes[idx];
+    if (h->generation != GENERATION_INFINITY && n->generation != GENERATION_INFINITY) {
+        return h->generation > n->generation;
+    }
+    // commit-graph holds all ancestors of its commits, so a commit in it cannot reach one outside
+    if (h->generation != GENERATION_INFINITY) {
+        return 0;
+    }
+    if (n->generation != GENERATION_INFINITY) {
+        return 1;
+    }
+    return h->timestamp + COMMIT_CLOCK_SKEW >= n->timestamp;
+}
+
+revwalk *revwalk_create(const git_repo *repo, revwalk_order order, int first_parent) {
+    revwalk *walk = calloc(1, sizeof(*walk));
+    walk->repo = repo;
+    walk->graph = commit_graph_open(repo);
+    walk->order = order;
+    walk->first_parent = first_parent;
+    walk->capacity = 256;
+    walk->nodes = malloc(walk->capacity * sizeof(walk_node));
+    walk->table_size = 1024;
+    walk->table = calloc(walk->table_size, sizeof(uint32_t));
+    walk->queue.by_generation = order == REVWALK_TOPO_ORDER;
+    walk->hidden.by_generation = 1;
+    return walk;
+}
+
+// @return index of node for `hash`, or -1 if it is not a commit
+int64_t walk_start(revwalk *walk, const obj_hash hash) {
+    unsigned char raw[WALK_HASH_LEN];
+    hash_to_bytes(hash, raw);
+    uint32_t idx = walk_get_node(walk, raw);
+    if (walk_prepare(walk, idx) != 0) {
+        return -1;
+    }
+    return idx;
+}
+
+int revwalk_push(revwalk *walk, const obj_hash hash) {
+    int64_t idx = walk_start(walk, hash);
+    if (idx == -1) {
+        return -1;
+    }
+    if (!(walk->nodes[idx].flags & NODE_QUEUED)) {
+        walk->nodes[idx].flags |= NODE_QUEUED;
+        heap_push(walk, &walk->queue, idx);
+    }
+    return 0;
+}
+
+int revwalk_hide(revwalk *walk, const obj_hash hash) {
+    int64_t idx = walk_start(walk, hash);
+    if (idx == -1) {
+        return -1;
+    }
+    if (!(walk->nodes[idx].flags & NODE_HIDDEN)) {
+        walk->nodes[idx].flags |= NODE_HIDDEN;
+        heap_push(walk, &walk->hidden, idx);
+    }
+    return 0;
+}
+
+void revwalk_limit_path(revwalk *walk, const char *path) {
+    free(walk->path);
+    walk->path = strdup(path);
+    bloom_key_init(&walk->path_key, path);
+}
+
+// @return 1 if commit changed limited path against its first parent, 0 if not, -1 on failure
+int walk_changes_path(revwalk *walk, uint32_t idx) {
+    const walk_node *node = &walk->nodes[idx];
+    if (node->graph_pos != WALK_NO_POS && walk->graph->bloom_size > 0
+        && !commit_graph_bloom_maybe(walk->graph, node->graph_pos, &walk->path_key)) {
+        return 0;
+    }
+
+    obj_hash tree, parent_tree;
+    hash_from_bytes(node->tree, &tree);
+    if (node->num_parents > 0) {
+        hash_from_bytes(walk->nodes[node->parents[0]].tree, &parent_tree);
+    }
+
+    tree_change_list changes;
+    int rc = diff_trees(walk->repo, node->num_parents > 0 ? parent_tree : NULL, tree, walk->path, &changes);
+    if (rc == 0) {
+        rc = changes.num_changes > 0;
+    }
+    free_tree_changes(&changes);
+    return rc;
+}
+
+int revwalk_next(revwalk *walk, obj_hash *out, time_t *timestamp) {
+    while (walk->queue.size > 0) {
+        uint32_t idx = walk->queue.items[0];
+
+        // hidden commits that may be descendants of next commit go first
+        while (walk->hidden.size > 0 && walk_may_reach(walk, walk->hidden.items[0], idx)) {
+            // every parent is hidden, also in first-parent mode, which only limits what is shown
+            uint32_t hidden = heap_pop(walk, &walk->hidden);
+            for (int i = 0; i < walk->nodes[hidden].num_parents; i++) {
+                uint32_t parent = walk->nodes[hidden].parents[i];
+                if (walk_prepare(walk, parent) != 0) {
+                    return -1;
+                }
+                if (!(walk->nodes[parent].flags & NODE_HIDDEN)) {
+                    walk->nodes[parent].flags |= NODE_HIDDEN;
+                    heap_push(walk, &walk->hidden, parent);
+                }
+            }
+        }
+
+        idx = heap_pop(walk, &walk->queue);
+        if (walk->nodes[idx].flags & NODE_HIDDEN) {
+            continue;
+        }
+
+        int num_parents = walk->first_parent && walk->nodes[idx].num_parents > 0 ? 1 : walk->nodes[idx].num_parents;
+        for (int i = 0; i < num_parents; i++) {
+            uint32_t parent = walk->nodes[idx].parents[i];
+            if (walk_prepare(walk, parent) != 0) {
+                return -1;
+            }
+            if (!(walk->nodes[parent].flags & NODE_QUEUED)) {
+                walk->nodes[parent].flags |= NODE_QUEUED;
+                heap_push(walk, &walk->queue, parent);
+            }
+        }
+
+        if (walk->path != NULL) {
+            int changed = walk_changes_path(walk, idx);
+            if (changed == -1) {
+                return -1;
+            }
+            if (!changed) {
+                continue;
+            }
+        }
+
+        hash_from_bytes(walk->nodes[idx].hash, out);
+        if (timestamp != NULL) {
+            *timestamp = walk->nodes[idx].timestamp;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+void revwalk_free(revwalk *walk) {
+    for (uint32_t i = 0; i < walk->num_nodes; i++) {
+        free(walk->nodes[i].parents);
+    }
+    if (walk->graph != NULL) {
+        commit_graph_close(walk->graph);
+    }
+    free(walk->nodes);
+    free(walk->table);
+    free(walk->queue.items);
+    free(walk->hidden.items);
+    free(walk->path);
+    free(walk);
+}
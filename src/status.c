@@ -0,0 +1,433 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "filesystem.h"
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "bulkio.h"
+#include "fsmonitor.h"
+#include "ignore.h"
+#include "refs.h"
+#include "status.h"
+
+typedef struct status_ctx {
+    const git_repo *repo;
+    const git_dircache *dircache;
+    const index_tree *itree;
+    status_list *out;
+} status_ctx;
+
+// takes ownership of `path`
+void status_add(status_list *list, char *path, status_kind kind) {
+    if (list->num_changes == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->changes = realloc(list->changes, list->capacity * sizeof(status_change));
+    }
+    list->changes[list->num_changes].path = path;
+    list->changes[list->num_changes].kind = kind;
+    list->num_changes++;
+}
+
+char *status_join(const char *prefix, size_t prefix_len, const char *name, const char *suffix) {
+    size_t name_len = strlen(name), suffix_len = strlen(suffix);
+    char *path = malloc(prefix_len + name_len + suffix_len + 1);
+    memcpy(path, prefix, prefix_len);
+    memcpy(path + prefix_len, name, name_len);
+    memcpy(path + prefix_len + name_len, suffix, suffix_len + 1);
+    return path;
+}
+
+// lists every blob under a tree of HEAD
+// @param prefix path of tree including trailing '/'
+int status_list_head_tree(status_ctx *ctx, const char *prefix, const obj_hash hash, status_kind kind) {
+    git_obj_tree *tree;
+    if ((tree = create_tree_from_disk_shallow(ctx->repo, hash)) == NULL) {
+        return -1;
+    }
+
+    int rc = 0;
+    size_t prefix_len = strlen(prefix);
+    for (int i = 0; i < tree->size && rc == 0; i++) {
+        git_tree_entry *entry = tree->entries[i];
+        if (entry->type == TREE_OBJ) {
+            char *sub = status_join(prefix, prefix_len, entry->name, "/");
+            rc = status_list_head_tree(ctx, sub, entry->u.tree->obj.hash, kind);
+            free(sub);
+        } else {
+            status_add(ctx->out, status_join(prefix, prefix_len, entry->name, ""), kind);
+        }
+    }
+
+    free_tree(tree);
+    return rc;
+}
+
+void status_list_index_range(status_ctx *ctx, int lo, int hi, status_kind kind) {
+    for (int i = lo; i < hi; i++) {
+        if (ctx->dircache->entries[i]->stage_num == 0) {
+            status_add(ctx->out, strdup(ctx->dircache->entries[i]->name), kind);
+        }
+    }
+}
+
+// diffs index tree node `k` against a tree of HEAD, only reading HEAD trees whose hash differs
+// @param head_hash NULL if HEAD has no tree at this path
+int status_diff_node(status_ctx *ctx, int k, const char *head_hash) {
+    const index_tree_node *node = &ctx->itree->nodes[k];
+    if (head_hash != NULL && strcmp(node->hash, head_hash) == 0) {
+        return 0;
+    }
+
+    git_obj_tree *head = NULL;
+    if (head_hash != NULL && (head = create_tree_from_disk_shallow(ctx->repo, head_hash)) == NULL) {
+        return -1;
+    }
+
+    const char *prefix = node->prefix_len > 0 ? ctx->dircache->entries[node->lo]->name : "";
+    int i = node->lo, child = k + 1, h = 0, rc = 0;
+    int head_size = head != NULL ? head->size : 0;
+
+    while (rc == 0 && (i < node->hi || h < head_size)) {
+        const git_index_entry *entry = i < node->hi ? ctx->dircache->entries[i] : NULL;
+        const char *name = NULL, *slash = NULL;
+        size_t name_len = 0;
+        if (entry != NULL) {
+            name = entry->name + node->prefix_len;
+            slash = strchr(name, '/');
+            if (slash == NULL && entry->stage_num != 0) {
+                i++;
+                continue;
+            }
+            name_len = slash != NULL ? (size_t)(slash - name) : strlen(name);
+        }
+
+        git_tree_entry *head_entry = h < head_size ? head->entries[h] : NULL;
+        int cmp = entry == NULL ? 1 : head_entry == NULL ? -1
+            : tree_order_cmp(name, name_len, slash != NULL,
+                head_entry->name, strlen(head_entry->name), head_entry->type == TREE_OBJ);
+
+        const index_tree_node *sub = slash != NULL ? &ctx->itree->nodes[child] : NULL;
+        if (cmp < 0) {
+            if (sub != NULL) {
+                status_list_index_range(ctx, sub->lo, sub->hi, STATUS_ADDED);
+            } else {
+                status_add(ctx->out, strdup(entry->name), STATUS_ADDED);
+            }
+        } else if (cmp > 0) {
+            if (head_entry->type == TREE_OBJ) {
+                char *sub_prefix = status_join(prefix, node->prefix_len, head_entry->name, "/");
+                rc = status_list_head_tree(ctx, sub_prefix, head_entry->u.tree->obj.hash, STATUS_DELETED);
+                free(sub_prefix);
+            } else {
+                status_add(ctx->out, status_join(prefix, node->prefix_len, head_entry->name, ""), STATUS_DELETED);
+            }
+        } else if (sub != NULL) {
+            rc = status_diff_node(ctx, child, head_entry->u.tree->obj.hash);
+        } else if (strcmp(entry->hash, head_entry->u.blob->obj.hash) != 0 || (unsigned int)entry->git_mode != head_entry->git_mode) {
+            status_add(ctx->out, strdup(entry->name), STATUS_MODIFIED);
+        }
+
+        if (cmp <= 0) {
+            if (sub != NULL) {
+                i = sub->hi;
+                child = sub->end;
+            } else {
+                i++;
+            }
+        }
+        if (cmp >= 0) {
+            h++;
+        }
+    }
+
+    if (head != NULL) {
+        free_tree(head);
+    }
+    return rc;
+}
+
+int status_staged(const git_repo *repo, const git_dircache *dircache, git_status *st) {
+    obj_hash commit_hash, tree_hash;
+    int head_rc = resolve_head(repo, &commit_hash, st->branch);
+    if (head_rc == -1 || (head_rc == 0 && read_commit_tree(repo, commit_hash, &tree_hash) != 0)) {
+        return -1;
+    }
+
+    index_tree itree;
+    hash_index_trees(dircache, &itree);
+    if (itree.num_hashed > 0 && dircache->trees != NULL) {
+        st->index_refreshed = 1;
+    }
+    status_ctx ctx = { repo, dircache, &itree, &st->staged };
+    int rc = status_diff_node(&ctx, 0, head_rc == 0 ? tree_hash : NULL);
+    free_index_tree(&itree);
+    return rc;
+}
+
+int cmp_status_path(const void *key, const void *change) {
+    return strcmp(key, ((const status_change *)change)->path);
+}
+
+// lists paths in merge conflict, dropping them from `staged`, where they look deleted
+void status_unmerged(const git_dircache *dircache, git_status *st) {
+    for (int i = 0; i < dircache->num_entries; i++) {
+        const git_index_entry *entry = dircache->entries[i];
+        if (entry->stage_num != 0 && (i == 0 || strcmp(dircache->entries[i - 1]->name, entry->name) != 0)) {
+            status_add(&st->unmerged, strdup(entry->name), STATUS_UNMERGED);
+        }
+    }
+    if (st->unmerged.num_changes == 0) {
+        return;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < st->staged.num_changes; i++) {
+        status_change *change = &st->staged.changes[i];
+        if (bsearch(change->path, st->unmerged.changes, st->unmerged.num_changes, sizeof(status_change), cmp_status_path) != NULL) {
+            free(change->path);
+        } else {
+            st->staged.changes[kept++] = *change;
+        }
+    }
+    st->staged.num_changes = kept;
+}
+
+int status_unstaged(const git_repo *repo, git_dircache *dircache, git_status *st) {
+    int fsm_active = fsmonitor_refresh_dircache(repo, dircache);
+
+    bulk_file *files = calloc(dircache->num_entries + 1, sizeof(bulk_file));
+    git_index_entry **entries = malloc((dircache->num_entries + 1) * sizeof(git_index_entry *));
+    int num_files = 0;
+    for (int i = 0; i < dircache->num_entries; i++) {
+        git_index_entry *entry = dircache->entries[i];
+        if (entry->stage_num != 0 || (fsm_active && entry->fsm_valid)) {
+            continue;
+        }
+        files[num_files].name = entry->name;
+        entries[num_files++] = entry;
+    }
+
+    bulk_stat_files(repo, files, num_files);
+
+    // kind of change of each file, -1 if unchanged, so changes are listed in index order
+    int *kinds = malloc((num_files + 1) * sizeof(int));
+    int *dirty = malloc((num_files + 1) * sizeof(int));
+    int num_dirty = 0;
+    for (int i = 0; i < num_files; i++) {
+        git_index_entry *entry = entries[i];
+        const fs_statinfo *stat = &files[i].stat;
+        kinds[i] = -1;
+
+        if (files[i].status != 0 || S_ISDIR(stat->fi_mode)) {
+            kinds[i] = STATUS_DELETED;
+        } else if (entry->info.fi_size != stat->fi_size || (unsigned int)entry->git_mode != stat_mode_to_git(stat->fi_mode)) {
+            kinds[i] = STATUS_MODIFIED;
+        } else if (!is_entry_clean(dircache, entry, stat)) {
+            // includes files changed in the same second the index was written
+            files[num_dirty] = files[i];
+            dirty[num_dirty++] = i;
+        } else if (fsm_active) {
+            // any later change is reported past the token just recorded, so the next status
+            // can skip this file without an lstat
+            entry->fsm_valid = 1;
+            st->index_refreshed = 1;
+        }
+    }
+
+    // only stat-dirty files are read, hashed in parallel
+    bulk_hash_files(repo, files, num_dirty, 0);
+
+    time_t now = time(NULL);
+    for (int d = 0; d < num_dirty; d++) {
+        git_index_entry *entry = entries[dirty[d]];
+        if (files[d].status != 0 || strcmp(files[d].hash, entry->hash) != 0) {
+            kinds[dirty[d]] = STATUS_MODIFIED;
+            // a file changed in the same second its entry was recorded would look clean once
+            // the index is written again, so its stat info must no longer match
+            entry->info.fi_mtime = 0;
+        } else if (files[d].stat.fi_mtime < now) {
+            entry->info = files[d].stat;
+            entry->fsm_valid = fsm_active;
+            st->index_refreshed = 1;
+        }
+    }
+
+    for (int i = 0; i < num_files; i++) {
+        if (kinds[i] != -1) {
+            status_add(&st->unstaged, strdup(entries[i]->name), kinds[i]);
+        }
+    }
+
+    free(kinds);
+    free(dirty);
+    free(files);
+    free(entries);
+    return 0;
+}
+
+// @return 1 if index has an entry under folder `prefix`, which includes its trailing '/'
+int status_index_has_dir(const git_dircache *dircache, const char *prefix, size_t prefix_len) {
+    int pos = index_lower_bound(dircache, prefix);
+    return pos < dircache->num_entries && strncmp(dircache->entries[pos]->name, prefix, prefix_len) == 0;
+}
+
+// @return 1 if folder `name` of `parent` holds a file that is not ignored, at any depth
+// @param rel path of folder relative to repo root, including trailing '/', extended in place while recursing
+int status_dir_has_file(const git_repo *repo, const fs_dir *parent, const char *name, char *rel, size_t len) {
+    fs_dir *dir;
+    if ((dir = fs_dir_openat(parent, name)) == NULL) {
+        return 0;
+    }
+
+    int found = 0;
+    fs_dirent ent;
+    while (!found && fs_dir_next(dir, &ent) == 1) {
+        if (ent.de_type == FS_ISOTHER || strcmp(ent.de_name, GIT_FOLDER) == 0
+            || len + ent.de_namelen + 2 >= PATH_MAX) {
+            continue;
+        }
+
+        memcpy(rel + len, ent.de_name, ent.de_namelen + 1);
+        if (ent.de_type == FS_ISDIR) {
+            if (!ignore_cache_check(repo->ignores, rel, 1)) {
+                rel[len + ent.de_namelen] = '/';
+                rel[len + ent.de_namelen + 1] = '\0';
+                found = status_dir_has_file(repo, dir, ent.de_name, rel, len + ent.de_namelen + 1);
+            }
+        } else {
+            found = !ignore_cache_check(repo->ignores, rel, 0);
+        }
+        rel[len] = '\0';
+    }
+
+    fs_dir_close(dir);
+    return found;
+}
+
+// Lists untracked files of an open folder. Tracked files are only looked up in the index, and
+// folders holding no tracked files are listed once, after reading them up to their first file.
+// @param rel path of folder relative to repo root, including trailing '/' or "" for root,
+// extended in place while recursing
+void status_walk_untracked(status_ctx *ctx, fs_dir *dir, char *rel, size_t len) {
+    fs_dirent ent;
+    while (fs_dir_next(dir, &ent) == 1) {
+        if (ent.de_type == FS_ISOTHER || strcmp(ent.de_name, GIT_FOLDER) == 0
+            || len + ent.de_namelen + 2 >= PATH_MAX) {
+            continue;
+        }
+
+        memcpy(rel + len, ent.de_name, ent.de_namelen + 1);
+        size_t sub_len = len + ent.de_namelen;
+        if (ent.de_type != FS_ISDIR) {
+            if (find_index_entry(ctx->dircache, rel) == NULL && !ignore_cache_check(ctx->repo->ignores, rel, 0)) {
+                status_add(ctx->out, strdup(rel), STATUS_UNTRACKED);
+            }
+        } else if (!ignore_cache_check(ctx->repo->ignores, rel, 1)) {
+            rel[sub_len++] = '/';
+            rel[sub_len] = '\0';
+            fs_dir *sub;
+            if (!status_index_has_dir(ctx->dircache, rel, sub_len)) {
+                if (status_dir_has_file(ctx->repo, dir, ent.de_name, rel, sub_len)) {
+                    status_add(ctx->out, strdup(rel), STATUS_UNTRACKED);
+                }
+            } else if ((sub = fs_dir_openat(dir, ent.de_name)) != NULL) {
+                status_walk_untracked(ctx, sub, rel, sub_len);
+                fs_dir_close(sub);
+            }
+        }
+        rel[len] = '\0';
+    }
+}
+
+int cmp_status_change(const void *a, const void *b) {
+    return strcmp(((const status_change *)a)->path, ((const status_change *)b)->path);
+}
+
+int status_untracked(const git_repo *repo, const git_dircache *dircache, git_status *st) {
+    fs_dir *root;
+    if ((root = fs_dir_open(repo->root_path)) == NULL) {
+        printf("ERROR: could not open directory: %s\n", repo->root_path);
+        return -1;
+    }
+
+    ignore_cache_refresh(repo->ignores);
+    char rel[PATH_MAX] = "";
+    status_ctx ctx = { repo, dircache, NULL, &st->untracked };
+    status_walk_untracked(&ctx, root, rel, 0);
+    fs_dir_close(root);
+
+    qsort(st->untracked.changes, st->untracked.num_changes, sizeof(status_change), cmp_status_change);
+    return 0;
+}
+
+int collect_status(const git_repo *repo, git_dircache *dircache, git_status *out) {
+    memset(out, 0, sizeof(*out));
+
+    if (status_staged(repo, dircache, out) != 0
+        || status_unstaged(repo, dircache, out) != 0
+        || status_untracked(repo, dircache, out) != 0) {
+        free_status(out);
+        return -1;
+    }
+    status_unmerged(dircache, out);
+    return 0;
+}
+
+void print_status_list(const char *title, const status_list *list) {
+    if (list->num_changes == 0) {
+        return;
+    }
+
+    printf("%s:\n", title);
+    for (int i = 0; i < list->num_changes; i++) {
+        const status_change *change = &list->changes[i];
+        if (change->kind == STATUS_UNTRACKED) {
+            printf("\t%s\n", change->path);
+            continue;
+        }
+        const char *label = change->kind == STATUS_ADDED ? "new file:"
+            : change->kind == STATUS_MODIFIED ? "modified:"
+            : change->kind == STATUS_UNMERGED ? "unmerged:" : "deleted:";
+        printf("\t%-12s%s\n", label, change->path);
+    }
+    printf("\n");
+}
+
+void print_status(const git_status *st) {
+    const char *heads = "refs/heads/";
+    if (st->branch[0] == '\0') {
+        printf("HEAD detached\n");
+    } else {
+        printf("On branch %s\n", strncmp(st->branch, heads, strlen(heads)) == 0
+            ? st->branch + strlen(heads) : st->branch);
+    }
+
+    print_status_list("Changes to be committed", &st->staged);
+    print_status_list("Unmerged paths", &st->unmerged);
+    print_status_list("Changes not staged for commit", &st->unstaged);
+    print_status_list("Untracked files", &st->untracked);
+
+    if (st->staged.num_changes + st->unmerged.num_changes + st->unstaged.num_changes + st->untracked.num_changes == 0) {
+        printf("nothing to commit, working tree clean\n");
+    }
+}
+
+void free_status_list(status_list *list) {
+    for (int i = 0; i < list->num_changes; i++) {
+        free(list->changes[i].path);
+    }
+    free(list->changes);
+    list->changes = NULL;
+    list->num_changes = 0;
+    list->capacity = 0;
+}
+
+void free_status(git_status *st) {
+    free_status_list(&st->staged);
+    free_status_list(&st->unstaged);
+    free_status_list(&st->untracked);
+    free_status_list(&st->unmerged);
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+typedef struct tp_task {
+    tp_task_fn fn;
+    void *arg;
+} tp_task;
+
+// owner pushes and pops at `tail`, thieves take from `head`
+typedef struct tp_deque {
+    pthread_mutex_t lock;
+    tp_task *tasks;
+    int head;
+    int tail;
+    int capacity;
+} tp_deque;
+
+typedef struct tp_worker {
+    threadpool *pool;
+    pthread_t thread;
+    int id;
+} tp_worker;
+
+struct threadpool {
+    int num_threads; // workers actually started
+    int num_deques; // fixed before workers start, deques of workers that failed to start are stolen from
+    tp_worker *workers;
+    tp_deque *deques;
+
+    atomic_int queued;  // tasks sitting in deques
+    atomic_int pending; // tasks queued or running
+    atomic_uint next_deque; // round robin target for submits from outside the pool
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    int shutdown;
+};
+
+static _Thread_local int tp_current_id = -1;
+static _Thread_local threadpool *tp_current_pool = NULL;
+
+void tp_deque_push(tp_deque *dq, tp_task task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->capacity) {
+        int live = dq->tail - dq->head;
+        if (dq->head > 0 && live < dq->capacity / 2) {
+            memmove(dq->tasks, dq->tasks + dq->head, live * sizeof(tp_task));
+        } else {
+            dq->capacity *= 2;
+            tp_task *tmp = malloc(dq->capacity * sizeof(tp_task));
+            memcpy(tmp, dq->tasks + dq->head, live * sizeof(tp_task));
+            free(dq->tasks);
+            dq->tasks = tmp;
+        }
+        dq->head = 0;
+        dq->tail = live;
+    }
+    dq->tasks[dq->tail++] = task;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+// @return 1 if a task was taken, 0 if deque is empty
+int tp_deque_take(tp_deque *dq, tp_task *out, int from_tail) {
+    int ok = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *out = from_tail ? dq->tasks[--dq->tail] : dq->tasks[dq->head++];
+        if (dq->head == dq->tail) {
+            dq->head = dq->tail = 0;
+        }
+        ok = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+int tp_find_task(threadpool *pool, int id, tp_task *out) {
+    if (tp_deque_take(&pool->deques[id], out, 1)) {
+        return 1;
+    }
+    for (int i = 1; i < pool->num_deques; i++) {
+        int victim = (id + i) % pool->num_deques;
+        if (tp_deque_take(&pool->deques[victim], out, 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void *tp_worker_main(void *arg) {
+    tp_worker *worker = arg;
+    threadpool *pool = worker->pool;
+    tp_current_id = worker->id;
+    tp_current_pool = pool;
+
+    for (;;) {
+        tp_task task;
+        if (tp_find_task(pool, worker->id, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.fn(task.arg);
+
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->done_cond);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        int stop = pool->shutdown && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+threadpool *threadpool_create(int num_threads) {
+    if (num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    threadpool *pool = malloc(sizeof(*pool));
+    pool->num_threads = 0;
+    pool->num_deques = num_threads;
+    pool->workers = calloc(num_threads, sizeof(tp_worker));
+    pool->deques = calloc(num_threads, sizeof(tp_deque));
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->next_deque, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->shutdown = 0;
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].capacity = 64;
+        pool->deques[i].tasks = malloc(64 * sizeof(tp_task));
+    }
+
+    // deques must all exist before any worker starts stealing
+    for (int i = 0; i < num_threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, tp_worker_main, &pool->workers[i]) != 0) {
+            perror("could not create worker thread");
+            break;
+        }
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void threadpool_submit(threadpool *pool, tp_task_fn fn, void *arg) {
+    tp_task task = { fn, arg };
+    int id = (tp_current_pool == pool) ? tp_current_id
+        : (int)(atomic_fetch_add(&pool->next_deque, 1) % pool->num_deques);
+
+    atomic_fetch_add(&pool->pending, 1);
+    tp_deque_push(&pool->deques[id], task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_wait(threadpool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_destroy(threadpool *pool) {
+    threadpool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < pool->num_deques; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
+
+int threadpool_size(const threadpool *pool) {
+    return pool->num_threads;
+}
+
+int threadpool_worker_id(void) {
+    return tp_current_id;
+}
@@ -0,0 +1,171 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "repo.h"
+#include "filesystem.h"
+#include "objects.h"
+#include "threadpool.h"
+#include "transfer.h"
+
+typedef struct transfer_task {
+    const git_repo *src;
+    const git_repo *dest;
+    const obj_hash *hashes;
+    int num_hashes;
+    atomic_int *linked, *copied, *existing, *failed;
+} transfer_task;
+
+// size of reads and writes when copying a file
+#define TRANSFER_COPY_CHUNK (1 << 16)
+
+// writes all of `buf`, continuing after short writes
+// @return 0 on success, -1 otherwise
+int transfer_write_all(int fd, const unsigned char *buf, size_t size) {
+    while (size > 0) {
+        ssize_t res = write(fd, buf, size);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return -1;
+        }
+        buf += res;
+        size -= res;
+    }
+    return 0;
+}
+
+// copies file a chunk at a time into a temporary file next to `dest_path`, then moves it there
+// @param mode permissions of the copy
+// @return 0 on success, -1 otherwise
+int transfer_copy_file(const char *src_path, const char *dest_path, mode_t mode) {
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd == -1) {
+        return -1;
+    }
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s.tmpXXXXXX", dest_path);
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        close(src_fd);
+        return -1;
+    }
+
+    unsigned char buf[TRANSFER_COPY_CHUNK];
+    int rc = fchmod(fd, mode) == 0 ? 0 : -1;
+    while (rc == 0) {
+        ssize_t len = read(src_fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            rc = len == 0 ? 0 : -1;
+            break;
+        }
+        rc = transfer_write_all(fd, buf, len);
+    }
+    close(src_fd);
+
+    if (close(fd) != 0 || rc != 0 || fs_rename(tmp_path, dest_path) != 0) {
+        fs_remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// @param mode permissions of the file if it has to be copied
+// @return 1 if linked, 0 if copied, 2 if `dest_path` was created by someone else first, -1 on failure
+int transfer_file(const char *src_path, const char *dest_path, mode_t mode) {
+    // folder is only created once a link into it fails, so most objects cost a single link
+    int res = link(src_path, dest_path);
+    if (res != 0 && errno == ENOENT) {
+        char parent_path[PATH_MAX];
+        fs_path_dirname(dest_path, parent_path);
+        fs_mkdir(parent_path, 0700);
+        res = link(src_path, dest_path);
+    }
+    if (res == 0) {
+        return 1;
+    } else if (errno == EEXIST) {
+        return 2;
+    }
+    // other filesystem, or links not supported or allowed
+    return transfer_copy_file(src_path, dest_path, mode);
+}
+
+void transfer_task_run(void *arg) {
+    transfer_task *task = arg;
+    char src_path[PATH_MAX], dest_path[PATH_MAX];
+
+    for (int i = 0; i < task->num_hashes; i++) {
+        obj_path(task->src, task->hashes[i], src_path);
+        obj_path(task->dest, task->hashes[i], dest_path);
+        int res = transfer_file(src_path, dest_path, OBJ_FILE_MODE);
+        if (res == 1) {
+            atomic_fetch_add(task->linked, 1);
+        } else if (res == 0) {
+            atomic_fetch_add(task->copied, 1);
+        } else if (res == 2) {
+            atomic_fetch_add(task->existing, 1);
+        } else {
+            printf("ERROR: could not transfer object %s\n", task->hashes[i]);
+            atomic_fetch_add(task->failed, 1);
+        }
+    }
+}
+
+int transfer_objects(const git_repo *src, const git_repo *dest, const obj_hash *hashes, int num_hashes, transfer_stats *stats) {
+    atomic_int linked, copied, existing, failed;
+    atomic_init(&linked, 0);
+    atomic_init(&copied, 0);
+    atomic_init(&existing, 0);
+    atomic_init(&failed, 0);
+
+    int num_tasks = (num_hashes + TRANSFER_CHUNK - 1) / TRANSFER_CHUNK;
+    if (num_tasks > 0) {
+        threadpool *pool = threadpool_create(0);
+        if (pool == NULL) {
+            return -1;
+        }
+        transfer_task *tasks = calloc(num_tasks, sizeof(transfer_task));
+        for (int t = 0; t < num_tasks; t++) {
+            int start = t * TRANSFER_CHUNK;
+            tasks[t] = (transfer_task){ src, dest, hashes + start,
+                num_hashes - start < TRANSFER_CHUNK ? num_hashes - start : TRANSFER_CHUNK,
+                &linked, &copied, &existing, &failed };
+            threadpool_submit(pool, transfer_task_run, &tasks[t]);
+        }
+        threadpool_destroy(pool);
+        free(tasks);
+    }
+
+    if (stats != NULL) {
+        stats->linked = atomic_load(&linked);
+        stats->copied = atomic_load(&copied);
+        stats->existing = atomic_load(&existing);
+        stats->failed = atomic_load(&failed);
+    }
+    return atomic_load(&failed) > 0 ? -1 : 0;
+}
+
+int transfer_objects_file(const git_repo *src, const git_repo *dest, const char *name) {
+    char src_path[PATH_MAX], dest_path[PATH_MAX];
+    fs_path_join(src->objects_path, name, src_path);
+    fs_path_join(dest->objects_path, name, dest_path);
+    fs_statinfo stat;
+    if (fs_getinfo(src_path, &stat) != 0) {
+        return 1;
+    }
+
+    // a stale file of `dest` would stop the link
+    if (fs_file_exists(dest_path) && fs_remove(dest_path) != 0) {
+        return -1;
+    }
+    return transfer_file(src_path, dest_path, stat.fi_mode & 0777) == -1 ? -1 : 0;
+}
@@ -0,0 +1,313 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "unpack.h"
+#include "bulkio.h"
+#include "status.h"
+#include "treediff.h"
+
+typedef struct diff_ctx {
+    const git_repo *repo;
+    const char *limit;
+    size_t limit_len;
+    tree_change_list *out;
+} diff_ctx;
+
+void tree_change_push(tree_change_list *list, const char *path, tree_change_kind kind,
+    unsigned int old_mode, const char *old_hash, unsigned int new_mode, const char *new_hash) {
+
+    if (list->num_changes == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->changes = realloc(list->changes, list->capacity * sizeof(tree_change));
+    }
+    tree_change *change = &list->changes[list->num_changes++];
+    change->path = strdup(path);
+    change->old_path = NULL;
+    change->kind = kind;
+    change->score = 0;
+    change->old_mode = old_mode;
+    change->new_mode = new_mode;
+    snprintf(change->old_hash, OBJ_HASH_SIZE, "%s", old_hash != NULL ? old_hash : "");
+    snprintf(change->new_hash, OBJ_HASH_SIZE, "%s", new_hash != NULL ? new_hash : "");
+}
+
+void tree_change_add(tree_change_list *list, const char *path, tree_change_kind kind,
+    const tree_iter_entry *old_entry, const tree_iter_entry *new_entry) {
+
+    tree_change_push(list, path, kind, old_entry != NULL ? old_entry->git_mode : 0, old_entry != NULL ? old_entry->hash : NULL,
+        new_entry != NULL ? new_entry->git_mode : 0, new_entry != NULL ? new_entry->hash : NULL);
+}
+
+// @return 1 if path should be listed, 2 if it is a folder leading to limit, 0 if outside limit
+int diff_in_limit(const diff_ctx *ctx, const char *path, int is_dir) {
+    if (ctx->limit == NULL) {
+        return 1;
+    }
+    size_t len = strlen(path);
+    if (len >= ctx->limit_len && strncmp(path, ctx->limit, ctx->limit_len) == 0
+        && (len == ctx->limit_len || path[ctx->limit_len] == '/')) {
+        return 1;
+    }
+    if (is_dir && len < ctx->limit_len && strncmp(path, ctx->limit, len) == 0 && ctx->limit[len] == '/') {
+        return 2;
+    }
+    return 0;
+}
+
+int diff_tree_level(diff_ctx *ctx, const char *old_hash, const char *new_hash, char *prefix);
+
+// diffs one pair of entries with the same name, either may be NULL
+int diff_entries(diff_ctx *ctx, const tree_iter_entry *old_entry, const tree_iter_entry *new_entry, char *prefix) {
+    size_t prefix_len = strlen(prefix);
+    const tree_iter_entry *any = old_entry != NULL ? old_entry : new_entry;
+    if (prefix_len + any->name_len + 2 > PATH_MAX) {
+        return -1;
+    }
+    memcpy(prefix + prefix_len, any->name, any->name_len);
+    prefix[prefix_len + any->name_len] = '\0';
+
+    int rc = 0;
+    int old_dir = old_entry != NULL && old_entry->type == TREE_OBJ;
+    int new_dir = new_entry != NULL && new_entry->type == TREE_OBJ;
+
+    if (old_entry != NULL && new_entry != NULL && old_entry->git_mode == new_entry->git_mode
+        && strcmp(old_entry->hash, new_entry->hash) == 0) {
+        // same blob or same subtree
+    } else if (old_dir || new_dir) {
+        int in_limit = diff_in_limit(ctx, prefix, 1);
+        if (in_limit != 0) {
+            // blob replaced by folder or the other way around
+            if (old_entry != NULL && !old_dir && in_limit == 1) {
+                tree_change_add(ctx->out, prefix, TREE_DELETED, old_entry, NULL);
+            }
+            strcat(prefix, "/");
+            rc = diff_tree_level(ctx, old_dir ? old_entry->hash : NULL, new_dir ? new_entry->hash : NULL, prefix);
+            prefix[prefix_len + any->name_len] = '\0';
+            if (rc == 0 && new_entry != NULL && !new_dir && in_limit == 1) {
+                tree_change_add(ctx->out, prefix, TREE_ADDED, NULL, new_entry);
+            }
+        }
+    } else if (diff_in_limit(ctx, prefix, 0) == 1) {
+        if (old_entry == NULL) {
+            tree_change_add(ctx->out, prefix, TREE_ADDED, NULL, new_entry);
+        } else if (new_entry == NULL) {
+            tree_change_add(ctx->out, prefix, TREE_DELETED, old_entry, NULL);
+        } else {
+            tree_change_add(ctx->out, prefix, TREE_MODIFIED, old_entry, new_entry);
+        }
+    }
+
+    prefix[prefix_len] = '\0';
+    return rc;
+}
+
+// @param prefix path of trees including trailing '/', "" for root
+int diff_tree_level(diff_ctx *ctx, const char *old_hash, const char *new_hash, char *prefix) {
+    tree_iter old_iter, new_iter;
+    if (tree_iter_open(ctx->repo, old_hash, &old_iter) != 0) {
+        return -1;
+    }
+    if (tree_iter_open(ctx->repo, new_hash, &new_iter) != 0) {
+        tree_iter_close(&old_iter);
+        return -1;
+    }
+
+    tree_iter_entry old_entry, new_entry;
+    int has_old = tree_iter_next(&old_iter, &old_entry);
+    int has_new = tree_iter_next(&new_iter, &new_entry);
+    int rc = 0;
+    while (rc == 0 && has_old >= 0 && has_new >= 0 && (has_old || has_new)) {
+        int res;
+        if (!has_old) {
+            res = 1;
+        } else if (!has_new) {
+            res = -1;
+        } else if (old_entry.name_len == new_entry.name_len && memcmp(old_entry.name, new_entry.name, old_entry.name_len) == 0) {
+            // a blob and a folder of the same name are diffed as a pair when they meet
+            res = 0;
+        } else {
+            res = tree_order_cmp(old_entry.name, old_entry.name_len, old_entry.type == TREE_OBJ,
+                new_entry.name, new_entry.name_len, new_entry.type == TREE_OBJ);
+        }
+
+        if (res == 0) {
+            rc = diff_entries(ctx, &old_entry, &new_entry, prefix);
+            has_old = tree_iter_next(&old_iter, &old_entry);
+            has_new = tree_iter_next(&new_iter, &new_entry);
+        } else if (res < 0) {
+            rc = diff_entries(ctx, &old_entry, NULL, prefix);
+            has_old = tree_iter_next(&old_iter, &old_entry);
+        } else {
+            rc = diff_entries(ctx, NULL, &new_entry, prefix);
+            has_new = tree_iter_next(&new_iter, &new_entry);
+        }
+    }
+    if (has_old < 0 || has_new < 0) {
+        printf("ERROR: could not parse tree while diffing\n");
+        rc = -1;
+    }
+
+    tree_iter_close(&old_iter);
+    tree_iter_close(&new_iter);
+    return rc;
+}
+
+int diff_trees(const git_repo *repo, const char *old_tree, const char *new_tree, const char *limit, tree_change_list *out) {
+    out->changes = NULL;
+    out->num_changes = 0;
+    out->capacity = 0;
+    if (old_tree != NULL && new_tree != NULL && strcmp(old_tree, new_tree) == 0) {
+        return 0;
+    }
+
+    diff_ctx ctx = { repo, limit, limit != NULL ? strlen(limit) : 0, out };
+    char prefix[PATH_MAX] = "";
+    return diff_tree_level(&ctx, old_tree, new_tree, prefix);
+}
+
+int diff_tree_index(const git_repo *repo, const char *tree, const git_dircache *index, tree_change_list *out) {
+    out->changes = NULL;
+    out->num_changes = 0;
+    out->capacity = 0;
+
+    git_dircache empty = { 0 }, flat;
+    const char *trees[] = { tree };
+    if (unpack_trees(repo, &empty, trees, 1, &flat) != 0) {
+        return -1;
+    }
+
+    // both sides are sorted in index order
+    int i = 0, j = 0;
+    while (i < flat.num_entries || j < index->num_entries) {
+        const git_index_entry *old = i < flat.num_entries ? flat.entries[i] : NULL;
+        const git_index_entry *new = j < index->num_entries ? index->entries[j] : NULL;
+        int cmp = old == NULL ? 1 : new == NULL ? -1 : index_sort_cmp(old->name, new->name);
+
+        if (cmp >= 0 && new->stage_num != 0) {
+            while (j < index->num_entries && strcmp(index->entries[j]->name, new->name) == 0) {
+                j++;
+            }
+            i += cmp == 0;
+            continue;
+        }
+        if (cmp < 0) {
+            tree_change_push(out, old->name, TREE_DELETED, old->git_mode, old->hash, 0, NULL);
+        } else if (cmp > 0) {
+            tree_change_push(out, new->name, TREE_ADDED, 0, NULL, new->git_mode, new->hash);
+        } else if (old->git_mode != new->git_mode || strcmp(old->hash, new->hash) != 0) {
+            tree_change_push(out, new->name, TREE_MODIFIED, old->git_mode, old->hash, new->git_mode, new->hash);
+        }
+        i += cmp <= 0;
+        j += cmp >= 0;
+    }
+
+    clear_dircache(&flat);
+    return 0;
+}
+
+// pushes the change between two versions of a path, if any
+// @param old_hash, new_hash NULL if missing on that side
+void tree_change_push_versions(tree_change_list *list, const char *path,
+    unsigned int old_mode, const char *old_hash, unsigned int new_mode, const char *new_hash) {
+
+    if (old_hash == NULL && new_hash != NULL) {
+        tree_change_push(list, path, TREE_ADDED, 0, NULL, new_mode, new_hash);
+    } else if (old_hash != NULL && new_hash == NULL) {
+        tree_change_push(list, path, TREE_DELETED, old_mode, old_hash, 0, NULL);
+    } else if (old_hash != NULL && (old_mode != new_mode || strcmp(old_hash, new_hash) != 0)) {
+        tree_change_push(list, path, TREE_MODIFIED, old_mode, old_hash, new_mode, new_hash);
+    }
+}
+
+int diff_tree_worktree(const git_repo *repo, const char *tree, git_dircache *index, tree_change_list *out, int *index_refreshed) {
+    out->changes = NULL;
+    out->num_changes = 0;
+    out->capacity = 0;
+
+    git_status st;
+    memset(&st, 0, sizeof(st));
+    if (status_unstaged(repo, index, &st) != 0) {
+        free_status(&st);
+        return -1;
+    }
+    *index_refreshed = st.index_refreshed;
+
+    // only files that differ from their entry are read, the rest still hold the entry's blob
+    const status_list *unstaged = &st.unstaged;
+    bulk_file *files = calloc(unstaged->num_changes + 1, sizeof(bulk_file));
+    int num_files = 0;
+    for (int k = 0; k < unstaged->num_changes; k++) {
+        if (unstaged->changes[k].kind == STATUS_MODIFIED) {
+            files[num_files++].name = unstaged->changes[k].path;
+        }
+    }
+    bulk_stat_files(repo, files, num_files);
+    bulk_hash_files(repo, files, num_files, 0);
+
+    git_dircache empty = { 0 }, flat;
+    const char *trees[] = { tree };
+    if (unpack_trees(repo, &empty, trees, 1, &flat) != 0) {
+        free(files);
+        free_status(&st);
+        return -1;
+    }
+
+    // the tree, the index and the changed files are all sorted in index order
+    int i = 0, j = 0, k = 0, f = 0;
+    while (i < flat.num_entries || j < index->num_entries) {
+        const git_index_entry *old = i < flat.num_entries ? flat.entries[i] : NULL;
+        const git_index_entry *new = j < index->num_entries ? index->entries[j] : NULL;
+        int cmp = old == NULL ? 1 : new == NULL ? -1 : index_sort_cmp(old->name, new->name);
+
+        if (cmp >= 0 && new->stage_num != 0) {
+            while (j < index->num_entries && strcmp(index->entries[j]->name, new->name) == 0) {
+                j++;
+            }
+            i += cmp == 0;
+            continue;
+        }
+        if (cmp < 0) {
+            tree_change_push(out, old->name, TREE_DELETED, old->git_mode, old->hash, 0, NULL);
+            i++;
+            continue;
+        }
+
+        unsigned int mode = new->git_mode;
+        const char *hash = new->hash;
+        while (k < unstaged->num_changes && strcmp(unstaged->changes[k].path, new->name) < 0) {
+            k++;
+        }
+        if (k < unstaged->num_changes && strcmp(unstaged->changes[k].path, new->name) == 0) {
+            if (unstaged->changes[k].kind == STATUS_MODIFIED && files[f].status == 0) {
+                mode = stat_mode_to_git(files[f].stat.fi_mode);
+                hash = files[f].hash;
+            } else {
+                hash = NULL; // deleted, or gone before it could be read
+            }
+            f += unstaged->changes[k].kind == STATUS_MODIFIED;
+        }
+        tree_change_push_versions(out, new->name, cmp == 0 ? old->git_mode : 0, cmp == 0 ? old->hash : NULL, mode, hash);
+        i += cmp == 0;
+        j++;
+    }
+
+    clear_dircache(&flat);
+    free(files);
+    free_status(&st);
+    return 0;
+}
+
+void free_tree_changes(tree_change_list *list) {
+    for (int i = 0; i < list->num_changes; i++) {
+        free(list->changes[i].path);
+        free(list->changes[i].old_path);
+    }
+    free(list->changes);
+    list->changes = NULL;
+    list->num_changes = 0;
+    list->capacity = 0;
+}
@@ -0,0 +1,348 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "repo.h"
+#include "objects.h"
+#include "dircache.h"
+#include "unpack.h"
+
+typedef struct unpack_ctx {
+    const git_repo *repo;
+    const git_dircache *index;
+    int num_trees;
+    index_tree itree; // trees of the index, only for one tree
+    git_dircache *out;
+    int num_errors;
+    const git_index_entry *df_file; // last file reported as being in the way of a folder
+} unpack_ctx;
+
+// one version of a path, `hash` is NULL if path is missing from it
+typedef struct unpack_version {
+    unsigned int mode;
+    const char *hash;
+} unpack_version;
+
+int same_version(unpack_version a, unpack_version b) {
+    if (a.hash == NULL || b.hash == NULL) {
+        return a.hash == b.hash;
+    }
+    return a.mode == b.mode && strcmp(a.hash, b.hash) == 0;
+}
+
+// @return 1 if both subtrees are missing or have the same hash
+int same_subtree(const char *a, const char *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+void unpack_add(unpack_ctx *ctx, git_index_entry *entry) {
+    git_dircache *out = ctx->out;
+    if (out->num_entries == out->capacity) {
+        out->capacity = out->capacity ? out->capacity * 2 : 64;
+        out->entries = realloc(out->entries, out->capacity * sizeof(git_index_entry *));
+    }
+    out->entries[out->num_entries++] = entry;
+}
+
+// In a merge, a file on one side and a folder of the same name on the other can not both go
+// in the index. Paths are added in sorted order, so a file in the way of `path` is already
+// in `out`. Each such file is reported once.
+void unpack_check_parents(unpack_ctx *ctx, const char *path) {
+    if (ctx->num_trees != UNPACK_MAX_TREES) {
+        return;
+    }
+    char parent[PATH_MAX];
+    for (const char *slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        snprintf(parent, PATH_MAX, "%.*s", (int)(slash - path), path);
+        const git_index_entry *file = find_index_entry(ctx->out, parent);
+        if (file != NULL) {
+            if (file != ctx->df_file) {
+                printf("error: CONFLICT (file/directory): %s is a file on one side and a folder on the other\n", parent);
+                ctx->df_file = file;
+                ctx->num_errors++;
+            }
+            return;
+        }
+    }
+}
+
+// copies index entries [lo, hi), keeping their stat info
+void unpack_keep_index(unpack_ctx *ctx, int lo, int hi) {
+    // entries of a kept folder share their parents, so checking the first one is enough
+    if (lo < hi) {
+        unpack_check_parents(ctx, ctx->index->entries[lo]->name);
+    }
+    for (int i = lo; i < hi; i++) {
+        const git_index_entry *entry = ctx->index->entries[i];
+        size_t size = sizeof(*entry) + entry->namelen + 1;
+        git_index_entry *copy = malloc(size);
+        memcpy(copy, entry, size);
+        unpack_add(ctx, copy);
+    }
+}
+
+// adds entry for a tree's version of a path, with no stat info so the file is rehashed
+void unpack_add_version(unpack_ctx *ctx, const char *path, unpack_version version, int stage) {
+    if (version.hash == NULL) {
+        return;
+    }
+    unpack_check_parents(ctx, path);
+    size_t namelen = strlen(path);
+    git_index_entry *entry = calloc(1, sizeof(*entry) + namelen + 1);
+    memcpy(entry->name, path, namelen + 1);
+    entry->namelen = namelen;
+    entry->git_mode = version.mode;
+    entry->unix_perm = version.mode & 0777;
+    entry->stage_num = stage;
+    snprintf(entry->hash, OBJ_HASH_SIZE, "%s", version.hash);
+    unpack_add(ctx, entry);
+}
+
+// decides one path from its version in each tree and its index entries [lo, hi)
+void unpack_path(unpack_ctx *ctx, const char *path, const unpack_version *trees, int lo, int hi) {
+    unpack_version index = { 0, NULL };
+    if (hi - lo == 1 && ctx->index->entries[lo]->stage_num == 0) {
+        index.mode = ctx->index->entries[lo]->git_mode;
+        index.hash = ctx->index->entries[lo]->hash;
+    }
+
+    if (ctx->num_trees == 1) {
+        if (same_version(index, trees[0])) {
+            unpack_keep_index(ctx, lo, hi);
+        } else {
+            unpack_add_version(ctx, path, trees[0], 0);
+        }
+        return;
+    }
+
+    if (ctx->num_trees == 2) {
+        unpack_version current = trees[0], target = trees[1];
+        if (same_version(current, target) || same_version(index, target)) {
+            unpack_keep_index(ctx, lo, hi);
+        } else if (same_version(index, current)) {
+            unpack_add_version(ctx, path, target, 0);
+        } else {
+            printf("error: your staged changes to %s would be lost\n", path);
+            ctx->num_errors++;
+        }
+        return;
+    }
+
+    unpack_version base = trees[0], ours = trees[1], theirs = trees[2];
+    if (same_version(ours, theirs) || same_version(base, theirs)) {
+        // their side did not change the path, staged changes to it stay
+        unpack_keep_index(ctx, lo, hi);
+    } else if (!same_version(index, ours)) {
+        printf("error: entry %s not uptodate, cannot merge\n", path);
+        ctx->num_errors++;
+    } else if (same_version(base, ours)) {
+        unpack_add_version(ctx, path, theirs, 0);
+    } else {
+        unpack_add_version(ctx, path, base, 1);
+        unpack_add_version(ctx, path, ours, 2);
+        unpack_add_version(ctx, path, theirs, 3);
+    }
+}
+
+// @return 1 if every path under a folder keeps its index entries, given the folder's
+// subtree in each tree and the index's tree node for it (-1 if none)
+int unpack_keeps_folder(const unpack_ctx *ctx, const char **hashes, int lo, int hi, int node) {
+    if (ctx->num_trees == 1) {
+        if (node < 0 || hashes[0] == NULL || strcmp(hashes[0], ctx->itree.nodes[node].hash) != 0) {
+            return 0;
+        }
+        // conflicts are left out of index trees, so they must still be replaced
+        for (int i = lo; i < hi; i++) {
+            if (ctx->index->entries[i]->stage_num != 0) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (ctx->num_trees == 2) {
+        return same_subtree(hashes[0], hashes[1]);
+    }
+    return same_subtree(hashes[1], hashes[2]) || same_subtree(hashes[0], hashes[2]);
+}
+
+// @param hashes subtree of this folder in each tree, NULL if tree does not have it
+// @param prefix path of folder including trailing '/', "" for root
+// @param lo, hi index entries under folder
+// @param node index tree node of folder, -1 if none or not computed
+// @return 0 on success, -1 if a tree could not be read
+int unpack_folder(unpack_ctx *ctx, const char **hashes, char *prefix, int lo, int hi, int node) {
+    int num_trees = ctx->num_trees;
+    tree_iter iters[UNPACK_MAX_TREES];
+    tree_iter_entry cur[UNPACK_MAX_TREES];
+    int has[UNPACK_MAX_TREES];
+    int num_open = 0, rc = 0;
+    for (int i = 0; i < num_trees && rc == 0; i++) {
+        if (tree_iter_open(ctx->repo, hashes[i], &iters[i]) != 0) {
+            rc = -1;
+            break;
+        }
+        num_open++;
+        has[i] = tree_iter_next(&iters[i], &cur[i]);
+    }
+
+    size_t prefix_len = strlen(prefix);
+    int pos = lo;
+    int child = node >= 0 ? node + 1 : -1;
+    while (rc == 0) {
+        // smallest name among the trees' next entries and the index's next path
+        const char *key = NULL;
+        size_t key_len = 0;
+        int key_dir = 0;
+        for (int i = 0; i < num_trees; i++) {
+            if (has[i] == 1 && (key == NULL || tree_order_cmp(cur[i].name, cur[i].name_len, cur[i].type == TREE_OBJ,
+                key, key_len, key_dir) < 0)) {
+                key = cur[i].name;
+                key_len = cur[i].name_len;
+                key_dir = cur[i].type == TREE_OBJ;
+            }
+        }
+        const char *index_name = NULL;
+        size_t index_len = 0;
+        int index_dir = 0;
+        if (pos < hi) {
+            index_name = ctx->index->entries[pos]->name + prefix_len;
+            const char *slash = strchr(index_name, '/');
+            index_len = slash != NULL ? (size_t)(slash - index_name) : strlen(index_name);
+            index_dir = slash != NULL;
+            if (key == NULL || tree_order_cmp(index_name, index_len, index_dir, key, key_len, key_dir) < 0) {
+                key = index_name;
+                key_len = index_len;
+                key_dir = index_dir;
+            }
+        }
+        if (key == NULL) {
+            break;
+        }
+        if (prefix_len + key_len + 2 > PATH_MAX) {
+            rc = -1;
+            break;
+        }
+        memcpy(prefix + prefix_len, key, key_len);
+        prefix[prefix_len + key_len] = '\0';
+
+        // versions of this name, the index ones are [pos, index_hi)
+        int matched[UNPACK_MAX_TREES];
+        for (int i = 0; i < num_trees; i++) {
+            matched[i] = has[i] == 1 && cur[i].name_len == key_len && (cur[i].type == TREE_OBJ) == key_dir
+                && memcmp(cur[i].name, key, key_len) == 0;
+        }
+        int index_hi = pos;
+        if (index_name != NULL && index_len == key_len && index_dir == key_dir && memcmp(index_name, key, key_len) == 0) {
+            if (key_dir) {
+                // every path under "<folder>/" sorts before "<folder>0"
+                strcat(prefix, "0");
+                index_hi = index_lower_bound(ctx->index, prefix);
+                prefix[prefix_len + key_len] = '\0';
+            } else {
+                while (index_hi < hi && strcmp(ctx->index->entries[index_hi]->name, prefix) == 0) {
+                    index_hi++;
+                }
+            }
+        }
+
+        if (key_dir) {
+            const char *sub_hashes[UNPACK_MAX_TREES];
+            for (int i = 0; i < num_trees; i++) {
+                sub_hashes[i] = matched[i] ? cur[i].hash : NULL;
+            }
+            int sub_node = -1;
+            if (child >= 0 && index_hi > pos) {
+                while (child < ctx->itree.nodes[node].end && ctx->itree.nodes[child].lo < pos) {
+                    child = ctx->itree.nodes[child].end;
+                }
+                if (child < ctx->itree.nodes[node].end && ctx->itree.nodes[child].lo == pos) {
+                    sub_node = child;
+                }
+            }
+
+            if (unpack_keeps_folder(ctx, sub_hashes, pos, index_hi, sub_node)) {
+                unpack_keep_index(ctx, pos, index_hi);
+            } else {
+                strcat(prefix, "/");
+                rc = unpack_folder(ctx, sub_hashes, prefix, pos, index_hi, sub_node);
+            }
+        } else {
+            unpack_version versions[UNPACK_MAX_TREES];
+            for (int i = 0; i < num_trees; i++) {
+                versions[i].mode = matched[i] ? cur[i].git_mode : 0;
+                versions[i].hash = matched[i] ? cur[i].hash : NULL;
+            }
+            unpack_path(ctx, prefix, versions, pos, index_hi);
+        }
+        prefix[prefix_len] = '\0';
+
+        for (int i = 0; i < num_trees; i++) {
+            if (matched[i]) {
+                has[i] = tree_iter_next(&iters[i], &cur[i]);
+            }
+        }
+        pos = index_hi;
+    }
+
+    for (int i = 0; i < num_open; i++) {
+        if (rc == 0 && has[i] == -1) {
+            printf("ERROR: could not parse tree %s\n", hashes[i]);
+            rc = -1;
+        }
+        tree_iter_close(&iters[i]);
+    }
+    return rc;
+}
+
+int unpack_trees(const git_repo *repo, const git_dircache *index, const char **trees, int num_trees, git_dircache *out) {
+    if (num_trees < 1 || num_trees > UNPACK_MAX_TREES) {
+        return -1;
+    }
+
+    // merges need a resolved index to start from
+    if (num_trees > 1) {
+        int unmerged = 0;
+        for (int i = 0; i < index->num_entries; i++) {
+            if (index->entries[i]->stage_num != 0 && (i == 0 || strcmp(index->entries[i - 1]->name, index->entries[i]->name) != 0)) {
+                printf("error: %s needs merge\n", index->entries[i]->name);
+                unmerged++;
+            }
+        }
+        if (unmerged > 0) {
+            printf("error: you need to resolve your current index first\n");
+            return 1;
+        }
+    }
+
+    out->num_entries = 0;
+    out->capacity = 0;
+    out->entries = NULL;
+    snprintf(out->fsmonitor_token, FSMONITOR_TOKEN_SIZE, "%s", index->fsmonitor_token);
+    out->index_mtime = index->index_mtime;
+    out->trees = NULL;
+
+    unpack_ctx ctx = { repo, index, num_trees, { NULL, 0, 0, 0 }, out, 0, NULL };
+    if (num_trees == 1) {
+        hash_index_trees(index, &ctx.itree);
+    }
+
+    char prefix[PATH_MAX] = "";
+    int rc = unpack_folder(&ctx, trees, prefix, 0, index->num_entries, num_trees == 1 ? 0 : -1);
+    if (rc == 0 && ctx.num_errors > 0) {
+        rc = 1;
+    }
+    free_index_tree(&ctx.itree);
+
+    if (rc != 0) {
+        clear_dircache(out);
+        return rc;
+    }
+    if (out->entries == NULL) {
+        out->capacity = 1;
+        out->entries = calloc(1, sizeof(git_index_entry *));
+    }
+    return 0;
+}
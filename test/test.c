@@ -9,6 +9,28 @@
 #include "objects.h"
 #include "dircache.h"
 #include "filespec.h"
+#include "bulkio.h"
+#include "ignore.h"
+#include "pathspec.h"
+#include "refs.h"
+#include "commit.h"
+#include "commitgraph.h"
+#include "treediff.h"
+#include "revwalk.h"
+#include "mergebase.h"
+#include "unpack.h"
+#include "checkout.h"
+#include "linediff.h"
+#include "rename.h"
+#include "merge.h"
+#include "replay.h"
+#include "gc.h"
+#include "ewah.h"
+#include "bitmap.h"
+#include "fsck.h"
+#include "clone.h"
+#include "fetch.h"
+#include "remote.h"
 
 #define ASSERT_STREQ(act, exp) \
     if (strcmp(exp, act) != 0) { \
@@ -112,6 +134,26 @@ void test_objects(const git_repo *repo) {
     printf("hash of blob: %s\n", hash);
 
     assert(write_blob_to_disk(repo, blob) == 0);
+    char obj_file[PATH_MAX];
+    fs_statinfo obj_stat;
+    obj_path(repo, hash, obj_file);
+    assert(fs_getinfo(obj_file, &obj_stat) == 0 && (obj_stat.fi_mode & 0777) == OBJ_FILE_MODE);
+
+    // a file that cannot be stat-ed fails alone, the rest of the batch is still hashed
+    bulk_file files[3] = { { .name = "notes.md" }, { .name = "build/missing.c" }, { .name = "notes.md" } };
+    assert(bulk_stat_files(repo, files, 3) == 1);
+    assert(files[0].status == 0 && files[1].status == -1 && files[2].status == 0);
+    assert(bulk_hash_files(repo, files, 3, 0) == 0);
+    ASSERT_STREQ(files[0].hash, hash)
+    ASSERT_STREQ(files[2].hash, hash)
+#ifndef _WIN32
+    // a symlink is stat-ed itself, not as the file it points to
+    fs_remove("build/link.md");
+    assert(symlink("../notes.md", "build/link.md") == 0);
+    bulk_file link = { .name = "build/link.md" };
+    assert(bulk_stat_files(repo, &link, 1) == 0 && S_ISLNK(link.stat.fi_mode));
+    fs_remove("build/link.md");
+#endif
     
     blob2 = create_blob_from_disk(repo, hash);
     assert(blob2 != NULL);
@@ -122,6 +164,77 @@ void test_objects(const git_repo *repo) {
     assert(fs_file_exists("build/notes.md") == 1);
     printf("================BLOB TESTS PASSED=============\n");
 
+#ifndef _WIN32
+    // large files are hashed from a mapping and must match the buffered hash
+    size_t big_size = BLOB_MMAP_THRESHOLD + 123;
+    unsigned char *big = malloc(big_size);
+    for (size_t i = 0; i < big_size; i++) {
+        big[i] = (i % 61 == 60) ? '\n' : 'a' + i % 26;
+    }
+    FILE *big_fptr = fs_fopen("build/big.txt", "wb+");
+    assert(big_fptr != NULL);
+    assert(fs_writebytes(big, 1, big_size, big_fptr) == big_size);
+    fflush(big_fptr);
+
+    obj_hash big_hash;
+    git_obj_blob *big_blob = create_blob_from_buffer(big, big_size);
+    assert(hash_blob_from_fd(repo, fileno(big_fptr), big_size, &big_hash) == 0);
+    ASSERT_STREQ(big_hash, big_blob->obj.hash)
+    git_obj_blob *big_blob2 = create_blob_from_disk(repo, big_hash);
+    assert(big_blob2 != NULL);
+    assert(big_blob2->obj.size == big_blob->obj.size);
+    free_blob(big_blob2);
+
+    // hashing it again finds the object stored, and its temporary file is removed
+    assert(hash_blob_from_fd(repo, fileno(big_fptr), big_size, &big_hash) == 0);
+    ASSERT_STREQ(big_hash, big_blob->obj.hash)
+    fs_dir *objs_dir = fs_dir_open(repo->objects_path);
+    fs_dirent objs_ent;
+    assert(objs_dir != NULL);
+    while (fs_dir_next(objs_dir, &objs_ent) == 1) {
+        assert(strncmp(objs_ent.de_name, "blob.tmp", 8) != 0);
+    }
+    fs_dir_close(objs_dir);
+
+    // CRLF text is normalized from the mapping, including a pair split between two chunks
+    for (size_t i = 0; i < big_size; i++) {
+        big[i] = (i % 61 == 60) ? '\n' : (i % 61 == 59) ? '\r' : 'a' + i % 26;
+    }
+    big[(1 << 16) - 1] = '\r';
+    big[1 << 16] = '\n';
+    assert(fseek(big_fptr, 0, SEEK_SET) == 0);
+    assert(fs_writebytes(big, 1, big_size, big_fptr) == big_size);
+    fflush(big_fptr);
+    fileinfo big_info = { .fptr = big_fptr };
+    assert(fs_getinfo("build/big.txt", &big_info.stat) == 0);
+    assert(fseek(big_fptr, 0, SEEK_SET) == 0);
+    git_obj_blob *crlf_blob = create_blob_from_file(&big_info);
+    assert(crlf_blob != NULL);
+    assert(hash_blob_from_fd(repo, fileno(big_fptr), big_size, &big_hash) == 0);
+    git_obj_blob *crlf_blob2 = create_blob_from_buffer(big, big_size);
+    assert(crlf_blob2->obj.size < big_blob->obj.size);
+    ASSERT_STREQ(big_hash, crlf_blob2->obj.hash)
+    ASSERT_STREQ(crlf_blob->obj.hash, crlf_blob2->obj.hash)
+    free_blob(crlf_blob);
+    free_blob(crlf_blob2);
+    crlf_blob = create_blob_from_disk(repo, big_hash);
+    assert(crlf_blob != NULL);
+    ASSERT_STREQ(crlf_blob->obj.hash, big_hash)
+    free_blob(crlf_blob);
+
+    // shrinking a file while it is mapped fails instead of crashing, every time
+    for (int round = 0; round < 2; round++) {
+        assert(ftruncate(fileno(big_fptr), 0) == 0);
+        assert(hash_blob_from_fd(NULL, fileno(big_fptr), big_size, &big_hash) == -1);
+        assert(create_blob_from_file(&big_info) == NULL);
+        assert(ftruncate(fileno(big_fptr), big_size) == 0);
+    }
+    fs_fclose(big_fptr);
+    free_blob(big_blob);
+    free(big);
+    printf("================MAPPED BLOB TESTS PASSED=============\n");
+#endif
+
     char path2[] = "./include";
     git_obj_tree *tree, *tree2;
 
@@ -144,6 +257,27 @@ void test_objects(const git_repo *repo) {
     free_blob(blob);
     free_blob(blob2);
     free_tree(tree);
+
+    // walking a folder into a tree skips ignored files and fails on folders it cannot open
+    const char *walk_files[][2] = {
+        { "build/walk/" GIT_IGNORE_NAME, "skipped.log" },
+        { "build/walk/skipped.log", "log\n" },
+        { "build/walk/kept.md", "kept\n" },
+    };
+    fs_mkdir("build/walk", 0755);
+    for (int i = 0; i < 3; i++) {
+        FILE *fptr = fopen(walk_files[i][0], "w");
+        assert(fptr != NULL);
+        fputs(walk_files[i][1], fptr);
+        fclose(fptr);
+    }
+    tree = create_tree_from_path(repo, "build/walk");
+    assert(tree != NULL && tree->size == 2);
+    for (int i = 0; i < tree->size; i++) {
+        assert(strcmp(tree->entries[i]->name, "skipped.log") != 0);
+    }
+    free_tree(tree);
+    assert(create_tree_from_path(repo, "build/walk/missing") == NULL);
     printf("================TREE TESTS PASSED=============\n");
     // fs_remove("build/notes.md");
 }
@@ -182,6 +316,1478 @@ void test_index(const git_repo * repo) {
     printf("================INDEX TESTS PASSED=============\n");
 }
 
+void write_test_file(const char *path, const char *contents) {
+    FILE *fptr = fs_fopen(path, "w");
+    assert(fptr != NULL);
+    fputs(contents, fptr);
+    fs_fclose(fptr);
+}
+
+#define TEST_IGNORE_RULES "# comment\n*.log\n!keep.log\n/top.txt\nout/\ndocs/**/*.html\nsub/exact.c\n[ab]?.tmp\n"
+
+void test_ignore(const git_repo *repo) {
+    fs_mkdir("build/ign", 0755);
+    fs_mkdir("build/ign/sub", 0755);
+    write_test_file("build/ign/" GIT_IGNORE_NAME, TEST_IGNORE_RULES);
+    write_test_file("build/ign/sub/" GIT_IGNORE_NAME, "!*.log\nvendor/**\n*a*a*a*a*a*a*a*a*a*b.c\n");
+
+    ignore_cache *cache = ignore_cache_create(repo);
+    assert(ignore_cache_check(cache, "build/ign/a.log", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/deep/x/a.log", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/keep.log", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/sub/a.log", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/top.txt", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/deep/top.txt", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/out", 1) == 1);
+    assert(ignore_cache_check(cache, "build/ign/out", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/x/out/file.c", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/docs/index.html", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/docs/a/b/index.html", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/docs/index.htm", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/sub/exact.c", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/x/sub/exact.c", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/a1.tmp", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/c1.tmp", 0) == 0);
+    assert(ignore_cache_check(cache, "build/ign/sub/vendor/lib/x.c", 0) == 1);
+    assert(ignore_cache_check(cache, "build/ign/sub/vendor", 1) == 0);
+    assert(ignore_cache_check(cache, "build/ign/notes.md", 0) == 0);
+
+    // globs that would make a backtracking matcher try every split still finish at once
+    char long_name[PATH_MAX];
+    int n = snprintf(long_name, sizeof(long_name), "build/ign/sub/");
+    memset(long_name + n, 'a', 200);
+    snprintf(long_name + n + 200, sizeof(long_name) - n - 200, ".c");
+    assert(ignore_cache_check(cache, long_name, 0) == 0);
+    snprintf(long_name + n + 200, sizeof(long_name) - n - 200, "b.c");
+    assert(ignore_cache_check(cache, long_name, 0) == 1);
+    ignore_cache_free(cache);
+
+    // ignore files edited after they were compiled are read again
+    char log_path[PATH_MAX];
+    fs_path_join(repo->root_path, "build/ign/a.log", log_path);
+    ignore_cache_refresh(repo->ignores);
+    assert(is_file_ignored(repo, log_path) == 1);
+    write_test_file("build/ign/" GIT_IGNORE_NAME, "*.tmp\n");
+    ignore_cache_refresh(repo->ignores);
+    assert(is_file_ignored(repo, log_path) == 0);
+    write_test_file("build/ign/" GIT_IGNORE_NAME, TEST_IGNORE_RULES);
+    ignore_cache_refresh(repo->ignores);
+    assert(is_file_ignored(repo, log_path) == 1);
+    printf("================IGNORE TESTS PASSED=============\n");
+}
+
+void test_pathspec(const git_repo *repo) {
+    char cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+
+    write_test_file("build/ign/b.c", "b");
+    write_test_file("build/ign/sub/a.c", "a");
+    write_test_file("build/ign/sub/x.log", "x");
+    write_test_file("build/ign/y.log", "y");
+
+    pathspec_list spec;
+    char *args[] = { "build/ign/sub/", "./build/../build/ign/*.c", "build/ign/b.c", "build/ign/y.log" };
+    assert(pathspec_resolve_worktree(repo, cwd, NULL, args, 4, &spec) == 0);
+    assert(spec.num_paths == 4);
+    ASSERT_STREQ(spec.paths[0], "build/ign/b.c")
+    ASSERT_STREQ(spec.paths[1], "build/ign/sub/.gorditignore")
+    ASSERT_STREQ(spec.paths[2], "build/ign/sub/a.c")
+    ASSERT_STREQ(spec.paths[3], "build/ign/sub/x.log")
+    free_pathspec_list(&spec);
+
+    // tracked files under an ignored folder are kept, even with a sibling sorting before "out/"
+    fs_mkdir("build/ign/out", 0755);
+    write_test_file("build/ign/out/t.c", "t");
+    write_test_file("build/ign/out-x.c", "x");
+    git_dircache *dircache = create_dircache(repo);
+    char *tracked[] = { "build/ign/out-x.c", "build/ign/out/t.c" };
+    assert(add_files_to_dc(repo, dircache, tracked, 2) == 0);
+    char *dir_args[] = { "build/ign/" };
+    assert(pathspec_resolve_worktree(repo, cwd, dircache, dir_args, 1, &spec) == 0);
+    int has_tracked = 0;
+    for (int i = 0; i < spec.num_paths; i++) {
+        has_tracked |= strcmp(spec.paths[i], "build/ign/out/t.c") == 0;
+    }
+    assert(has_tracked);
+    free_pathspec_list(&spec);
+    free_dircache(dircache);
+
+    // a folder given again under a sibling that sorts between them is only walked once
+    fs_mkdir("build/ign/sub-x", 0755);
+    write_test_file("build/ign/sub-x/s.c", "s");
+    char *nested_args[] = { "build/ign/sub/", "build/ign/sub-x", "build/ign/sub", "build/ign/sub/." };
+    assert(pathspec_resolve_worktree(repo, cwd, NULL, nested_args, 4, &spec) == 0);
+    assert(spec.num_paths == 4);
+    ASSERT_STREQ(spec.paths[0], "build/ign/sub-x/s.c")
+    ASSERT_STREQ(spec.paths[3], "build/ign/sub/x.log")
+    free_pathspec_list(&spec);
+
+    // paths given from a subfolder, as `log -- <path>` takes them
+    char sub_cwd[PATH_MAX], rel[PATH_MAX];
+    fs_path_join(repo->root_path, "build/ign", sub_cwd);
+    assert(pathspec_canonicalize(repo, sub_cwd, "./sub/", rel) == 0);
+    ASSERT_STREQ(rel, "build/ign/sub")
+    assert(pathspec_canonicalize(repo, sub_cwd, "../..", rel) == 0);
+    ASSERT_STREQ(rel, "")
+    assert(pathspec_canonicalize(repo, sub_cwd, "../../" GIT_FOLDER, rel) == -1);
+
+    char *bad_args[] = { "build/ign/*.none" };
+    assert(pathspec_resolve_worktree(repo, cwd, NULL, bad_args, 1, &spec) == -1);
+    char *outside_args[] = { "../.." };
+    assert(pathspec_resolve_worktree(repo, cwd, NULL, outside_args, 1, &spec) == -1);
+    printf("================PATHSPEC TESTS PASSED=============\n");
+}
+
+void test_commit(const git_repo *repo) {
+    git_dircache *dircache = create_dircache(repo);
+    char *names[] = { "build/ign/b.c", "build/ign/sub/a.c", "build/ign/y.log" };
+    assert(add_files_to_dc(repo, dircache, names, 3) == 0);
+
+    index_tree itree;
+    hash_index_trees(dircache, &itree);
+    git_obj_tree *tree = build_tree_from_index(dircache);
+    ASSERT_STREQ(itree.nodes[0].hash, tree->obj.hash)
+    free_tree(tree);
+
+    obj_hash first, head, tree_hash;
+    assert(commit_index(repo, dircache, "first", &first) == 0);
+    assert(resolve_head(repo, &head, NULL) == 0);
+    ASSERT_STREQ(head, first)
+    assert(read_commit_tree(repo, first, &tree_hash) == 0);
+    ASSERT_STREQ(tree_hash, itree.nodes[0].hash)
+    assert(commit_index(repo, dircache, "same tree", &head) == 1);
+
+    // only the changed path is rewritten, other trees are reused from parent
+    write_test_file("build/ign/sub/a.c", "changed");
+    char *changed[] = { "build/ign/sub/a.c" };
+    assert(add_files_to_dc(repo, dircache, changed, 1) == 0);
+
+    // only folders holding the changed entry are hashed again, the rest come from the tree cache
+    index_tree cached;
+    hash_index_trees(dircache, &cached);
+    assert(cached.num_hashed == 4);
+    tree = build_tree_from_index(dircache);
+    ASSERT_STREQ(cached.nodes[0].hash, tree->obj.hash)
+    free_tree(tree);
+
+    // tree ids are kept in the index file, without changing the test repo's index
+    git_repo cache_repo = *repo;
+    int len = snprintf(cache_repo.index_path, PATH_MAX, "%s.trees", repo->index_path);
+    assert(len < PATH_MAX);
+    assert(write_index(&cache_repo, dircache) == 0);
+    git_dircache *reread = create_dircache(&cache_repo);
+    index_tree again;
+    hash_index_trees(reread, &again);
+    assert(again.num_hashed == 0 && again.num_nodes == cached.num_nodes);
+    ASSERT_STREQ(again.nodes[0].hash, cached.nodes[0].hash)
+    free_index_tree(&again);
+    free_index_tree(&cached);
+    free_dircache(reread);
+    fs_remove(cache_repo.index_path);
+    obj_hash second;
+    assert(commit_index(repo, dircache, "second", &second) == 0);
+    assert(resolve_head(repo, &head, NULL) == 0);
+    ASSERT_STREQ(head, second)
+    assert(update_ref(repo, DEFAULT_BRANCH_REF, first, first) == -1);
+
+    free_index_tree(&itree);
+    free_dircache(dircache);
+    printf("================COMMIT TESTS PASSED=============\n");
+}
+
+void test_commit_graph(const git_repo *repo) {
+    assert(write_commit_graph(repo) == 0);
+    commit_graph *graph = commit_graph_open(repo);
+    assert(graph != NULL);
+
+    obj_hash head, hash;
+    uint32_t pos, parent_pos;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(commit_graph_find(graph, head, &pos) == 1);
+    commit_graph_hash(graph, pos, &hash);
+    ASSERT_STREQ(hash, head)
+
+    commit_info from_disk, from_graph;
+    uint32_t generation;
+    assert(read_commit_info(repo, head, &from_disk) == 0);
+    assert(load_commit_info(repo, graph, head, &from_graph, &generation) == 0);
+    ASSERT_STREQ(from_graph.tree, from_disk.tree)
+    assert(from_graph.timestamp == from_disk.timestamp);
+    assert(from_graph.num_parents == 1 && from_disk.num_parents == 1);
+    ASSERT_STREQ(from_graph.parents[0], from_disk.parents[0])
+    assert(generation == 2);
+
+    assert(commit_graph_parents(graph, pos, &parent_pos, 1) == 1);
+    assert(commit_graph_generation(graph, parent_pos) == 1);
+    assert(commit_graph_parents(graph, parent_pos, NULL, 0) == 0);
+
+    // head only changed build/ign/sub/a.c against its parent
+    bloom_key key;
+    bloom_key_init(&key, "build/ign/sub/a.c");
+    assert(commit_graph_bloom_maybe(graph, pos, &key) == 1);
+    bloom_key_init(&key, "build/ign/sub");
+    assert(commit_graph_bloom_maybe(graph, pos, &key) == 1);
+    bloom_key_init(&key, "build");
+    assert(commit_graph_bloom_maybe(graph, pos, &key) == 1);
+    bloom_key_init(&key, "build/ign/b.c");
+    assert(commit_graph_bloom_maybe(graph, pos, &key) == 0);
+    assert(commit_graph_bloom_maybe(graph, parent_pos, &key) == 1);
+
+    tree_change_list changes;
+    assert(diff_trees(repo, from_disk.tree, from_graph.tree, NULL, &changes) == 0);
+    assert(changes.num_changes == 0);
+    obj_hash parent_tree;
+    commit_graph_tree(graph, parent_pos, &parent_tree);
+    assert(diff_trees(repo, parent_tree, from_disk.tree, NULL, &changes) == 0);
+    assert(changes.num_changes == 1 && changes.changes[0].kind == TREE_MODIFIED);
+    ASSERT_STREQ(changes.changes[0].path, "build/ign/sub/a.c")
+    free_tree_changes(&changes);
+    assert(diff_trees(repo, parent_tree, from_disk.tree, "build/ign/b.c", &changes) == 0);
+    assert(changes.num_changes == 0);
+    assert(diff_trees(repo, NULL, from_disk.tree, "build/ign/sub", &changes) == 0);
+    assert(changes.num_changes == 1 && changes.changes[0].kind == TREE_ADDED);
+    free_tree_changes(&changes);
+    free_commit_info(&from_disk);
+    free_commit_info(&from_graph);
+    commit_graph_close(graph);
+
+    // rewriting copies commits from the current graph
+    assert(write_commit_graph(repo) == 0);
+    printf("================COMMIT GRAPH TESTS PASSED=============\n");
+}
+
+// writes commit of `tree` with any number of parents
+void test_make_commit(const git_repo *repo, const obj_hash tree, obj_hash *parents, int num_parents, time_t when, obj_hash *out) {
+    char content[1024];
+    size_t used = snprintf(content, sizeof(content), "tree %s\n", tree);
+    for (int i = 0; i < num_parents; i++) {
+        used += snprintf(content + used, sizeof(content) - used, "parent %s\n", parents[i]);
+    }
+    used += snprintf(content + used, sizeof(content) - used,
+        "author t <t@t> %lld +0000\ncommitter t <t@t> %lld +0000\n\nmerge test\n", (long long)when, (long long)when);
+
+    git_obj obj;
+    create_git_obj((unsigned char *)content, used, O_TYPE_COMMIT, &obj);
+    assert(write_obj_to_disk(repo, obj.hash, obj.data, obj.size) == 0);
+    snprintf(*out, OBJ_HASH_SIZE, "%s", obj.hash);
+    free(obj.data);
+}
+
+void test_revwalk(const git_repo *repo) {
+    obj_hash head, parent, hash;
+    commit_info info;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_info(repo, head, &info) == 0);
+    snprintf(parent, OBJ_HASH_SIZE, "%s", info.parents[0]);
+    free_commit_info(&info);
+
+    assert(resolve_rev(repo, "HEAD", &hash) == 0);
+    ASSERT_STREQ(hash, head)
+    assert(resolve_rev(repo, "main~1", &hash) == 0);
+    ASSERT_STREQ(hash, parent)
+    assert(resolve_rev(repo, "HEAD^", &hash) == 0);
+    ASSERT_STREQ(hash, parent)
+    char abbrev[8];
+    snprintf(abbrev, sizeof(abbrev), "%.7s", parent);
+    assert(resolve_rev(repo, abbrev, &hash) == 0);
+    ASSERT_STREQ(hash, parent)
+    assert(resolve_rev(repo, "HEAD~2", &hash) == -1);
+    assert(resolve_rev(repo, "nosuchref", &hash) == -1);
+
+    for (int order = REVWALK_DATE_ORDER; order <= REVWALK_TOPO_ORDER; order++) {
+        revwalk *walk = revwalk_create(repo, order, 0);
+        assert(revwalk_push(walk, head) == 0);
+        assert(revwalk_next(walk, &hash, NULL) == 1);
+        ASSERT_STREQ(hash, head)
+        assert(revwalk_next(walk, &hash, NULL) == 1);
+        ASSERT_STREQ(hash, parent)
+        assert(revwalk_next(walk, &hash, NULL) == 0);
+        revwalk_free(walk);
+    }
+
+    // parent..head
+    revwalk *walk = revwalk_create(repo, REVWALK_DATE_ORDER, 1);
+    assert(revwalk_hide(walk, parent) == 0);
+    assert(revwalk_push(walk, head) == 0);
+    assert(revwalk_next(walk, &hash, NULL) == 1);
+    ASSERT_STREQ(hash, head)
+    assert(revwalk_next(walk, &hash, NULL) == 0);
+    revwalk_free(walk);
+
+    // only the root commit added build/ign/b.c
+    walk = revwalk_create(repo, REVWALK_DATE_ORDER, 0);
+    revwalk_limit_path(walk, "build/ign/b.c");
+    assert(revwalk_push(walk, head) == 0);
+    assert(revwalk_next(walk, &hash, NULL) == 1);
+    ASSERT_STREQ(hash, parent)
+    assert(revwalk_next(walk, &hash, NULL) == 0);
+    revwalk_free(walk);
+
+    walk = revwalk_create(repo, REVWALK_DATE_ORDER, 0);
+    revwalk_limit_path(walk, "build/ign/sub");
+    assert(revwalk_push(walk, head) == 0);
+    assert(revwalk_next(walk, &hash, NULL) == 1);
+    ASSERT_STREQ(hash, head)
+    assert(revwalk_next(walk, &hash, NULL) == 1);
+    assert(revwalk_next(walk, &hash, NULL) == 0);
+    revwalk_free(walk);
+
+    // first parents only limit what is shown, a hidden merge still hides its second parent
+    obj_hash tree, side, main, merge, tip;
+    assert(read_commit_tree(repo, head, &tree) == 0);
+    time_t now = time(NULL);
+    test_make_commit(repo, tree, &parent, 1, now + 1, &side);
+    test_make_commit(repo, tree, &parent, 1, now + 2, &main);
+    obj_hash merge_parents[2];
+    snprintf(merge_parents[0], OBJ_HASH_SIZE, "%s", main);
+    snprintf(merge_parents[1], OBJ_HASH_SIZE, "%s", side);
+    test_make_commit(repo, tree, merge_parents, 2, now + 3, &merge);
+    test_make_commit(repo, tree, &side, 1, now + 4, &tip);
+    walk = revwalk_create(repo, REVWALK_DATE_ORDER, 1);
+    assert(revwalk_hide(walk, merge) == 0);
+    assert(revwalk_push(walk, tip) == 0);
+    assert(revwalk_next(walk, &hash, NULL) == 1);
+    ASSERT_STREQ(hash, tip)
+    assert(revwalk_next(walk, &hash, NULL) == 0);
+    revwalk_free(walk);
+    printf("================REVWALK TESTS PASSED=============\n");
+}
+
+void test_merge_base(const git_repo *repo) {
+    obj_hash head, parent;
+    commit_info info;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_info(repo, head, &info) == 0);
+    snprintf(parent, OBJ_HASH_SIZE, "%s", info.parents[0]);
+
+    // both are in commit-graph
+    assert(is_ancestor(repo, parent, head) == 1);
+    assert(is_ancestor(repo, head, parent) == 0);
+    assert(is_ancestor(repo, head, head) == 1);
+    merge_base_list bases;
+    assert(find_merge_bases(repo, head, &parent, 1, &bases) == 0);
+    assert(bases.num_bases == 1);
+    ASSERT_STREQ(bases.bases[0], parent)
+    free_merge_bases(&bases);
+
+    // criss-cross: a2 and b2 both merge a1 and b1, which branch off head
+    obj_hash a1, b1, a2, b2, c, pair[2];
+    test_make_commit(repo, info.tree, &head, 1, 2000000000, &a1);
+    test_make_commit(repo, info.tree, &head, 1, 2000000001, &b1);
+    memcpy(pair[0], a1, OBJ_HASH_SIZE);
+    memcpy(pair[1], b1, OBJ_HASH_SIZE);
+    test_make_commit(repo, info.tree, pair, 2, 2000000002, &a2);
+    test_make_commit(repo, info.tree, pair, 2, 2000000003, &b2);
+    test_make_commit(repo, info.tree, &a1, 1, 2000000004, &c);
+    free_commit_info(&info);
+
+    assert(find_merge_bases(repo, a2, &b2, 1, &bases) == 0);
+    assert(bases.num_bases == 2);
+    ASSERT_STREQ(bases.bases[0], b1)
+    ASSERT_STREQ(bases.bases[1], a1)
+    free_merge_bases(&bases);
+
+    assert(find_merge_bases(repo, c, &b1, 1, &bases) == 0);
+    assert(bases.num_bases == 1);
+    ASSERT_STREQ(bases.bases[0], head)
+    free_merge_bases(&bases);
+
+    obj_hash octopus[3];
+    memcpy(octopus[0], a2, OBJ_HASH_SIZE);
+    memcpy(octopus[1], b2, OBJ_HASH_SIZE);
+    memcpy(octopus[2], c, OBJ_HASH_SIZE);
+    assert(find_octopus_bases(repo, octopus, 3, &bases) == 0);
+    assert(bases.num_bases == 1);
+    ASSERT_STREQ(bases.bases[0], a1)
+    free_merge_bases(&bases);
+
+    assert(is_ancestor(repo, parent, a2) == 1);
+    assert(is_ancestor(repo, a1, b2) == 1);
+    assert(is_ancestor(repo, c, b2) == 0);
+    assert(is_ancestor(repo, a2, parent) == 0);
+    printf("================MERGE BASE TESTS PASSED=============\n");
+}
+
+void assert_file_contents(const char *path, const char *contents) {
+    char buf[256] = "";
+    FILE *fptr = fs_fopen(path, "rb");
+    assert(fptr != NULL);
+    buf[fs_readbytes(buf, 1, sizeof(buf) - 1, fptr)] = '\0';
+    fs_fclose(fptr);
+    ASSERT_STREQ(buf, contents)
+}
+
+// @return hash of the tree the index would commit
+void index_root_hash(git_dircache *dircache, obj_hash *out) {
+    index_tree itree;
+    assert(hash_index_trees(dircache, &itree) == 0);
+    snprintf(*out, OBJ_HASH_SIZE, "%s", itree.nodes[0].hash);
+    free_index_tree(&itree);
+}
+
+void test_checkout(const git_repo *repo) {
+    obj_hash head, parent, head_tree, parent_tree, hash;
+    commit_info info;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_info(repo, head, &info) == 0);
+    snprintf(parent, OBJ_HASH_SIZE, "%s", info.parents[0]);
+    snprintf(head_tree, OBJ_HASH_SIZE, "%s", info.tree);
+    free_commit_info(&info);
+    assert(read_commit_tree(repo, parent, &parent_tree) == 0);
+
+    // index file was never written, untracked files already holding head's blobs can be replaced
+    git_dircache *dircache = create_dircache(repo);
+    checkout_stats stats;
+    assert(checkout_tree(repo, dircache, NULL, head_tree, 0, &stats) == 0);
+    assert(stats.written == 3 && stats.removed == 0);
+
+    assert(checkout_tree(repo, dircache, head_tree, parent_tree, 0, &stats) == 0);
+    assert(stats.written == 1 && stats.removed == 0 && stats.failed == 0);
+    index_root_hash(dircache, &hash);
+    ASSERT_STREQ(hash, parent_tree)
+    git_index_entry *entry = find_index_entry(dircache, "build/ign/sub/a.c");
+    fs_statinfo stat;
+    assert(fs_getinfo("build/ign/sub/a.c", &stat) == 0);
+    assert(entry->info.fi_size == stat.fi_size && entry->info.fi_mtime == stat.fi_mtime);
+
+    // local changes are not overwritten unless forced
+    write_test_file("build/ign/sub/a.c", "dirty");
+    assert(checkout_tree(repo, dircache, parent_tree, head_tree, 0, &stats) == 1);
+    assert_file_contents("build/ign/sub/a.c", "dirty");
+    assert(checkout_tree(repo, dircache, parent_tree, head_tree, CHECKOUT_FORCE, &stats) == 0);
+    assert_file_contents("build/ign/sub/a.c", "changed");
+    index_root_hash(dircache, &hash);
+    ASSERT_STREQ(hash, head_tree)
+
+    // a tree with one more file in a new folder
+    fs_mkdir("build/ign/new", 0755);
+    write_test_file("build/ign/new/n.c", "new file");
+    char *names[] = { "build/ign/new/n.c" };
+    assert(add_files_to_dc(repo, dircache, names, 1) == 0);
+    index_tree itree;
+    hash_index_trees(dircache, &itree);
+    assert(write_index_trees(repo, dircache, &itree, head_tree) == 0);
+    obj_hash new_tree;
+    snprintf(new_tree, OBJ_HASH_SIZE, "%s", itree.nodes[0].hash);
+    free_index_tree(&itree);
+
+    // staged files stay when switching between trees without them, until forced
+    assert(checkout_tree(repo, dircache, head_tree, head_tree, 0, &stats) == 0);
+    assert(stats.written == 0 && stats.removed == 0);
+    assert(find_index_entry(dircache, "build/ign/new/n.c") != NULL);
+    assert(checkout_tree(repo, dircache, head_tree, head_tree, CHECKOUT_FORCE, &stats) == 0);
+    assert(stats.written == 0 && stats.removed == 1);
+    assert(!fs_file_exists("build/ign/new"));
+    assert(checkout_tree(repo, dircache, head_tree, new_tree, 0, &stats) == 0);
+    assert(stats.written == 1 && stats.removed == 0);
+    assert_file_contents("build/ign/new/n.c", "new file");
+    assert(checkout_tree(repo, dircache, new_tree, head_tree, 0, &stats) == 0);
+    assert(stats.written == 0 && stats.removed == 1);
+
+    // untracked files in the way are not overwritten
+    fs_mkdir("build/ign/new", 0755);
+    write_test_file("build/ign/new/n.c", "untracked");
+    assert(checkout_tree(repo, dircache, head_tree, new_tree, 0, &stats) == 1);
+    assert_file_contents("build/ign/new/n.c", "untracked");
+    fs_remove("build/ign/new/n.c");
+    fs_remove("build/ign/new");
+
+    // so is an untracked file where a folder has to be made, before anything is written
+    write_test_file("build/ign/new", "untracked");
+    assert(checkout_tree(repo, dircache, head_tree, new_tree, 0, &stats) == 1);
+    assert(stats.written == 0 && stats.removed == 0);
+    assert_file_contents("build/ign/new", "untracked");
+    fs_remove("build/ign/new");
+
+    free_dircache(dircache);
+    printf("================CHECKOUT TESTS PASSED=============\n");
+}
+
+// writes a tree that is `base_tree` with file `path` holding `contents`
+void test_make_tree(const git_repo *repo, const obj_hash base_tree, const char *path, const char *contents, obj_hash *out) {
+    git_obj blob;
+    create_git_obj((const unsigned char *)contents, strlen(contents), O_TYPE_BLOB, &blob);
+    assert(write_obj_to_disk(repo, blob.hash, blob.data, blob.size) == 0);
+
+    git_dircache empty = { 0 }, tree;
+    const char *trees[] = { base_tree };
+    assert(unpack_trees(repo, &empty, trees, 1, &tree) == 0);
+    git_index_entry *entry = find_index_entry(&tree, path);
+    assert(entry != NULL);
+    snprintf(entry->hash, OBJ_HASH_SIZE, "%s", blob.hash);
+    free(blob.data);
+
+    index_tree itree;
+    assert(hash_index_trees(&tree, &itree) == 0);
+    assert(write_index_trees(repo, &tree, &itree, base_tree) == 0);
+    snprintf(*out, OBJ_HASH_SIZE, "%s", itree.nodes[0].hash);
+    free_index_tree(&itree);
+    clear_dircache(&tree);
+}
+
+void test_read_tree(const git_repo *repo) {
+    obj_hash head, head_tree, parent_tree, theirs_tree, hash;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_tree(repo, head, &head_tree) == 0);
+    assert(resolve_rev(repo, "HEAD^", &hash) == 0);
+    assert(read_commit_tree(repo, hash, &parent_tree) == 0);
+    assert(resolve_tree(repo, "HEAD", &hash) == 0);
+    ASSERT_STREQ(hash, head_tree)
+
+    git_dircache *dircache = create_dircache(repo);
+    assert(checkout_tree(repo, dircache, NULL, head_tree, CHECKOUT_FORCE, NULL) == 0);
+
+    // a commit against the working tree: clean files take their entry's blob, edited ones are hashed
+    tree_change_list changes;
+    int refreshed;
+    assert(diff_tree_worktree(repo, parent_tree, dircache, &changes, &refreshed) == 0);
+    assert(changes.num_changes == 1 && changes.changes[0].kind == TREE_MODIFIED);
+    ASSERT_STREQ(changes.changes[0].path, "build/ign/sub/a.c")
+    ASSERT_STREQ(changes.changes[0].new_hash, find_index_entry(dircache, "build/ign/sub/a.c")->hash)
+    free_tree_changes(&changes);
+    write_test_file("build/ign/b.c", "edited");
+    write_test_file("build/ign/sub/a.c", "a");
+    assert(diff_tree_worktree(repo, parent_tree, dircache, &changes, &refreshed) == 0);
+    assert(changes.num_changes == 1);
+    ASSERT_STREQ(changes.changes[0].path, "build/ign/b.c")
+    git_obj edited;
+    create_git_obj((const unsigned char *)"edited", 6, O_TYPE_BLOB, &edited);
+    ASSERT_STREQ(changes.changes[0].new_hash, edited.hash)
+    free(edited.data);
+    free_tree_changes(&changes);
+    assert(checkout_tree(repo, dircache, NULL, head_tree, CHECKOUT_FORCE, NULL) == 0);
+
+    // one tree: entries already holding its blobs keep their stat info
+    git_dircache out;
+    const char *trees[UNPACK_MAX_TREES] = { head_tree };
+    assert(unpack_trees(repo, dircache, trees, 1, &out) == 0);
+    assert(out.num_entries == dircache->num_entries);
+    for (int i = 0; i < out.num_entries; i++) {
+        ASSERT_STREQ(out.entries[i]->name, dircache->entries[i]->name)
+        assert(memcmp(&out.entries[i]->info, &dircache->entries[i]->info, sizeof(fs_statinfo)) == 0);
+    }
+    clear_dircache(&out);
+
+    // two trees: staged changes to paths both trees agree on are kept
+    git_index_entry *staged = find_index_entry(dircache, "build/ign/b.c");
+    snprintf(staged->hash, OBJ_HASH_SIZE, "%s", find_index_entry(dircache, "build/ign/y.log")->hash);
+    invalidate_cached_trees(dircache, staged->name);
+    trees[0] = head_tree;
+    trees[1] = parent_tree;
+    assert(unpack_trees(repo, dircache, trees, 2, &out) == 0);
+    ASSERT_STREQ(find_index_entry(&out, "build/ign/b.c")->hash, staged->hash)
+    index_root_hash(&out, &hash);
+    assert(strcmp(hash, parent_tree) != 0);
+    clear_dircache(&out);
+
+    // ...but not to paths the switch changes
+    git_index_entry *changed = find_index_entry(dircache, "build/ign/sub/a.c");
+    obj_hash saved;
+    snprintf(saved, OBJ_HASH_SIZE, "%s", changed->hash);
+    snprintf(changed->hash, OBJ_HASH_SIZE, "%s", staged->hash);
+    invalidate_cached_trees(dircache, changed->name);
+    assert(unpack_trees(repo, dircache, trees, 2, &out) == 1);
+    snprintf(changed->hash, OBJ_HASH_SIZE, "%s", saved);
+    invalidate_cached_trees(dircache, changed->name);
+    assert(checkout_tree(repo, dircache, NULL, head_tree, CHECKOUT_FORCE, NULL) == 0);
+
+    // three trees: a change on their side only is taken
+    test_make_tree(repo, parent_tree, "build/ign/b.c", "theirs", &theirs_tree);
+    trees[0] = parent_tree;
+    trees[1] = head_tree;
+    trees[2] = theirs_tree;
+    assert(unpack_trees(repo, dircache, trees, 3, &out) == 0);
+    ASSERT_STREQ(find_index_entry(&out, "build/ign/sub/a.c")->hash, find_index_entry(dircache, "build/ign/sub/a.c")->hash)
+    git_obj blob;
+    create_git_obj((const unsigned char *)"theirs", 6, O_TYPE_BLOB, &blob);
+    ASSERT_STREQ(find_index_entry(&out, "build/ign/b.c")->hash, blob.hash)
+    free(blob.data);
+    for (int i = 0; i < out.num_entries; i++) {
+        assert(out.entries[i]->stage_num == 0);
+    }
+    clear_dircache(&out);
+
+    // ...and a change on both sides is a conflict with all three versions
+    test_make_tree(repo, parent_tree, "build/ign/sub/a.c", "theirs", &theirs_tree);
+    assert(unpack_trees(repo, dircache, trees, 3, &out) == 0);
+    int pos = index_lower_bound(&out, "build/ign/sub/a.c");
+    assert(pos + 3 <= out.num_entries);
+    for (int stage = 1; stage <= 3; stage++) {
+        ASSERT_STREQ(out.entries[pos + stage - 1]->name, "build/ign/sub/a.c")
+        assert(out.entries[pos + stage - 1]->stage_num == stage);
+    }
+    ASSERT_STREQ(out.entries[pos + 1]->hash, find_index_entry(dircache, "build/ign/sub/a.c")->hash)
+
+    // a merge cannot start from an index with conflicts
+    const char *two[] = { head_tree, head_tree };
+    git_dircache again;
+    assert(unpack_trees(repo, &out, two, 2, &again) == 1);
+    clear_dircache(&out);
+
+    // a file added on our side and a folder of the same name on theirs is a conflict
+    obj_hash ours_tree;
+    index_tree itree;
+    char *df_file[] = { "build/ign/df" }, *df_folder[] = { "build/ign/df/f" };
+    write_test_file("build/ign/df", "ours");
+    assert(add_files_to_dc(repo, dircache, df_file, 1) == 0);
+    assert(hash_index_trees(dircache, &itree) == 0 && write_index_trees(repo, dircache, &itree, head_tree) == 0);
+    snprintf(ours_tree, OBJ_HASH_SIZE, "%s", itree.nodes[0].hash);
+    free_index_tree(&itree);
+    fs_remove("build/ign/df");
+
+    git_dircache empty = { 0 }, base;
+    trees[0] = parent_tree;
+    assert(unpack_trees(repo, &empty, trees, 1, &base) == 0);
+    fs_mkdir("build/ign/df", 0755);
+    write_test_file("build/ign/df/f", "theirs");
+    assert(add_files_to_dc(repo, &base, df_folder, 1) == 0);
+    assert(hash_index_trees(&base, &itree) == 0 && write_index_trees(repo, &base, &itree, parent_tree) == 0);
+    snprintf(theirs_tree, OBJ_HASH_SIZE, "%s", itree.nodes[0].hash);
+    free_index_tree(&itree);
+    clear_dircache(&base);
+    fs_remove("build/ign/df/f");
+    fs_remove("build/ign/df");
+
+    trees[1] = ours_tree;
+    trees[2] = theirs_tree;
+    assert(unpack_trees(repo, dircache, trees, 3, &out) == 1);
+    // ...but not when their side only replaced a file we left alone
+    trees[0] = ours_tree;
+    trees[1] = ours_tree;
+    assert(unpack_trees(repo, dircache, trees, 3, &out) == 0);
+    assert(find_index_entry(&out, "build/ign/df") == NULL && find_index_entry(&out, "build/ign/df/f") != NULL);
+    clear_dircache(&out);
+    assert(remove_files_from_dc(dircache, df_file, 1) == 1);
+
+    free_dircache(dircache);
+    printf("================READ TREE TESTS PASSED=============\n");
+}
+
+// checks that removing and adding the changed lines turns the old side into the new side
+// @return number of lines removed or added
+int assert_diff_applies(const line_diff *diff) {
+    int i = 0, j = 0, cost = 0;
+    for (int c = 0; c <= diff->num_changes; c++) {
+        int old_pos = c < diff->num_changes ? diff->changes[c].old_pos : diff->num_old;
+        int new_pos = c < diff->num_changes ? diff->changes[c].new_pos : diff->num_new;
+        assert(old_pos - i == new_pos - j);
+        for (; i < old_pos; i++, j++) {
+            assert(diff->old_lines[i].len == diff->new_lines[j].len);
+            assert(memcmp(diff->old_lines[i].start, diff->new_lines[j].start, diff->old_lines[i].len) == 0);
+        }
+        if (c < diff->num_changes) {
+            assert(diff->changes[c].old_len + diff->changes[c].new_len > 0);
+            i += diff->changes[c].old_len;
+            j += diff->changes[c].new_len;
+            cost += diff->changes[c].old_len + diff->changes[c].new_len;
+        }
+    }
+    return cost;
+}
+
+// @return buffer of `num_lines` lines picked at random from a few
+char *random_lines(int num_lines, size_t *size) {
+    const char *picks[] = { "a\n", "b\n", "c\n", "{\n", "}\n", "\n" };
+    char *buf = malloc(num_lines * 2 + 1);
+    *size = 0;
+    for (int i = 0; i < num_lines; i++) {
+        const char *line = picks[rand() % 6];
+        memcpy(buf + *size, line, strlen(line));
+        *size += strlen(line);
+    }
+    return buf;
+}
+
+void test_line_diff() {
+    line_diff diff;
+    const char *old = "a\nb\nc\n", *new = "a\nx\nc\n";
+    for (int algorithm = LINE_DIFF_MYERS; algorithm <= LINE_DIFF_HISTOGRAM; algorithm++) {
+        assert(diff_lines(old, strlen(old), new, strlen(new), algorithm, &diff) == 0);
+        assert(diff.num_changes == 1);
+        assert(diff.changes[0].old_pos == 1 && diff.changes[0].old_len == 1);
+        assert(diff.changes[0].new_pos == 1 && diff.changes[0].new_len == 1);
+        free_line_diff(&diff);
+    }
+
+    // a last line without '\n' differs from the same line with one
+    assert(diff_lines("a\nb", 3, "a\nb\n", 4, LINE_DIFF_MYERS, &diff) == 0);
+    assert(diff.num_old == 2 && diff.num_changes == 1 && diff.changes[0].old_pos == 1);
+    free_line_diff(&diff);
+    assert(diff_lines("", 0, old, strlen(old), LINE_DIFF_HISTOGRAM, &diff) == 0);
+    assert(diff.num_changes == 1 && diff.changes[0].old_len == 0 && diff.changes[0].new_len == 3);
+    free_line_diff(&diff);
+
+    // Myers scripts are as short as possible, histogram ones only need to be valid
+    srand(7);
+    for (int round = 0; round < 200; round++) {
+        size_t size1, size2;
+        int n1 = rand() % 40, n2 = rand() % 40;
+        char *buf1 = random_lines(n1, &size1), *buf2 = random_lines(n2, &size2);
+
+        int lcs[41][41];
+        diff_line *lines1, *lines2;
+        assert(diff_lines(buf1, size1, buf2, size2, LINE_DIFF_MYERS, &diff) == 0);
+        lines1 = diff.old_lines;
+        lines2 = diff.new_lines;
+        for (int i = n1; i >= 0; i--) {
+            for (int j = n2; j >= 0; j--) {
+                if (i == n1 || j == n2) {
+                    lcs[i][j] = 0;
+                } else if (lines1[i].len == lines2[j].len && memcmp(lines1[i].start, lines2[j].start, lines1[i].len) == 0) {
+                    lcs[i][j] = lcs[i + 1][j + 1] + 1;
+                } else {
+                    lcs[i][j] = lcs[i + 1][j] > lcs[i][j + 1] ? lcs[i + 1][j] : lcs[i][j + 1];
+                }
+            }
+        }
+        assert(assert_diff_applies(&diff) == n1 + n2 - 2 * lcs[0][0]);
+        free_line_diff(&diff);
+
+        assert(diff_lines(buf1, size1, buf2, size2, LINE_DIFF_HISTOGRAM, &diff) == 0);
+        assert_diff_applies(&diff);
+        free_line_diff(&diff);
+        free(buf1);
+        free(buf2);
+    }
+
+    // large inputs with little in common stay fast, a quadratic search would take minutes
+    size_t big1, big2;
+    char *buf1 = random_lines(200000, &big1), *buf2 = random_lines(200000, &big2);
+    for (int algorithm = LINE_DIFF_MYERS; algorithm <= LINE_DIFF_HISTOGRAM; algorithm++) {
+        clock_t start = clock();
+        assert(diff_lines(buf1, big1, buf2, big2, algorithm, &diff) == 0);
+        assert_diff_applies(&diff);
+        assert((clock() - start) / CLOCKS_PER_SEC < 10);
+        free_line_diff(&diff);
+    }
+    free(buf1);
+    free(buf2);
+
+    printf("================LINE DIFF TESTS PASSED=============\n");
+}
+
+void test_write_blob(const git_repo *repo, const char *contents, obj_hash *out) {
+    git_obj blob;
+    create_git_obj((const unsigned char *)contents, strlen(contents), O_TYPE_BLOB, &blob);
+    assert(write_obj_to_disk(repo, blob.hash, blob.data, blob.size) == 0);
+    snprintf(*out, OBJ_HASH_SIZE, "%s", blob.hash);
+    free(blob.data);
+}
+
+// `num_lines` numbered lines of file `id`, line `edit` replaced if not -1
+char *test_file_lines(int id, int num_lines, int edit) {
+    char *buf = malloc(num_lines * 48 + 1);
+    size_t size = 0;
+    for (int i = 0; i < num_lines; i++) {
+        size += sprintf(buf + size, i == edit ? "edited line %d\n" : "file %d has line number %d\n", id, i);
+    }
+    return buf;
+}
+
+tree_change *find_tree_change(tree_change_list *changes, const char *path) {
+    for (int i = 0; i < changes->num_changes; i++) {
+        if (strcmp(changes->changes[i].path, path) == 0) {
+            return &changes->changes[i];
+        }
+    }
+    return NULL;
+}
+
+void test_renames(const git_repo *repo) {
+    obj_hash same, old_text, new_text, gone, other, modified_old, modified_new;
+    char *buf;
+    test_write_blob(repo, buf = test_file_lines(1, 20, -1), &same);
+    free(buf);
+    test_write_blob(repo, buf = test_file_lines(2, 20, -1), &old_text);
+    free(buf);
+    test_write_blob(repo, buf = test_file_lines(2, 20, 7), &new_text);
+    free(buf);
+    test_write_blob(repo, buf = test_file_lines(3, 20, -1), &gone);
+    free(buf);
+    test_write_blob(repo, "nothing in common\n", &other);
+    test_write_blob(repo, buf = test_file_lines(4, 20, -1), &modified_old);
+    free(buf);
+    test_write_blob(repo, buf = test_file_lines(4, 20, 0), &modified_new);
+    free(buf);
+
+    for (int flags = 0; flags <= RENAME_COPIES; flags++) {
+        tree_change_list changes = { NULL, 0, 0 };
+        tree_change_push(&changes, "a/same.c", TREE_DELETED, 0100644, same, 0, NULL);
+        tree_change_push(&changes, "b/same.c", TREE_ADDED, 0, NULL, 0100644, same);
+        tree_change_push(&changes, "c/copy.c", TREE_ADDED, 0, NULL, 0100644, same);
+        tree_change_push(&changes, "edited.txt", TREE_ADDED, 0, NULL, 0100644, new_text);
+        tree_change_push(&changes, "gone.txt", TREE_DELETED, 0100644, gone, 0, NULL);
+        tree_change_push(&changes, "modified.txt", TREE_MODIFIED, 0100644, modified_old, 0100644, modified_new);
+        tree_change_push(&changes, "modified2.txt", TREE_ADDED, 0, NULL, 0100644, modified_old);
+        tree_change_push(&changes, "original.txt", TREE_DELETED, 0100644, old_text, 0, NULL);
+        tree_change_push(&changes, "other.txt", TREE_ADDED, 0, NULL, 0100644, other);
+
+        // copies are only found with RENAME_COPIES
+        assert(detect_renames(repo, &changes, RENAME_DEFAULT_SCORE, flags) == (flags ? 4 : 2));
+        assert(changes.num_changes == 7);
+        tree_change *change = find_tree_change(&changes, "b/same.c");
+        assert(change->kind == TREE_RENAMED && change->score == 100);
+        ASSERT_STREQ(change->old_path, "a/same.c")
+        assert(find_tree_change(&changes, "a/same.c") == NULL);
+
+        change = find_tree_change(&changes, "edited.txt");
+        assert(change->kind == TREE_RENAMED && change->score >= 90 && change->score < 100);
+        ASSERT_STREQ(change->old_path, "original.txt")
+        ASSERT_STREQ(change->old_hash, old_text)
+        ASSERT_STREQ(change->new_hash, new_text)
+
+        // dissimilar files are left alone
+        assert(find_tree_change(&changes, "gone.txt")->kind == TREE_DELETED);
+        assert(find_tree_change(&changes, "other.txt")->kind == TREE_ADDED);
+
+        change = find_tree_change(&changes, "c/copy.c");
+        assert(change->kind == (flags ? TREE_COPIED : TREE_ADDED));
+        change = find_tree_change(&changes, "modified2.txt");
+        assert(change->kind == (flags ? TREE_COPIED : TREE_ADDED));
+        if (flags) {
+            ASSERT_STREQ(change->old_path, "modified.txt")
+        }
+        for (int i = 1; i < changes.num_changes; i++) {
+            assert(strcmp(changes.changes[i - 1].path, changes.changes[i].path) < 0);
+        }
+        free_tree_changes(&changes);
+    }
+
+    // a large folder move goes through band buckets instead of comparing every pair
+    int num_files = 400;
+    tree_change_list changes = { NULL, 0, 0 };
+    for (int i = 0; i < num_files; i++) {
+        obj_hash old_hash, new_hash;
+        char path[64];
+        test_write_blob(repo, buf = test_file_lines(100 + i, 30, -1), &old_hash);
+        free(buf);
+        test_write_blob(repo, buf = test_file_lines(100 + i, 30, i % 30), &new_hash);
+        free(buf);
+        sprintf(path, "moved/file%d", i);
+        tree_change_push(&changes, path, TREE_ADDED, 0, NULL, 0100644, new_hash);
+        sprintf(path, "src/file%d", i);
+        tree_change_push(&changes, path, TREE_DELETED, 0100644, old_hash, 0, NULL);
+    }
+    clock_t start = clock();
+    assert(detect_renames(repo, &changes, RENAME_DEFAULT_SCORE, 0) == num_files);
+    assert((clock() - start) / CLOCKS_PER_SEC < 10);
+    assert(changes.num_changes == num_files);
+    for (int i = 0; i < changes.num_changes; i++) {
+        const tree_change *change = &changes.changes[i];
+        assert(change->kind == TREE_RENAMED);
+        assert(strcmp(change->old_path + strlen("src/"), change->path + strlen("moved/")) == 0);
+    }
+    free_tree_changes(&changes);
+
+    printf("================RENAME TESTS PASSED=============\n");
+}
+
+// @return malloc-ed contents of `path` in `tree`
+char *test_read_tree_file(const git_repo *repo, const char *tree, const char *path) {
+    git_dircache empty = { 0 }, flat;
+    const char *trees[] = { tree };
+    assert(unpack_trees(repo, &empty, trees, 1, &flat) == 0);
+    git_index_entry *entry = find_index_entry(&flat, path);
+    assert(entry != NULL);
+    git_obj_blob *blob = create_blob_from_disk(repo, entry->hash);
+    assert(blob != NULL);
+    size_t size;
+    const unsigned char *data = blob_contents(blob, &size);
+    char *contents = malloc(size + 1);
+    memcpy(contents, data, size);
+    contents[size] = '\0';
+    free_blob(blob);
+    clear_dircache(&flat);
+    return contents;
+}
+
+void assert_merged(const char *base, const char *ours, const char *theirs, const char *expected, int num_conflicts) {
+    merge_options options = { "ours", "theirs", LINE_DIFF_MYERS };
+    char *out;
+    size_t size;
+    assert(merge_contents(base, strlen(base), ours, strlen(ours), theirs, strlen(theirs), &options, &out, &size) == num_conflicts);
+    assert(size == strlen(expected) && memcmp(out, expected, size) == 0);
+    free(out);
+}
+
+void test_merge(const git_repo *repo) {
+    // changes apart are both taken, the same change on both sides is taken once
+    assert_merged("a\nb\nc\nd\ne\n", "A\nb\nc\nd\ne\n", "a\nb\nc\nd\nE\n", "A\nb\nc\nd\nE\n", 0);
+    assert_merged("a\nb\nc\n", "a\nx\nc\n", "a\nx\nc\n", "a\nx\nc\n", 0);
+    assert_merged("a\n", "a\nb\n", "a\n", "a\nb\n", 0);
+
+    // overlapping changes conflict, with lines both sides share kept outside the markers
+    assert_merged("a\nb\nc\n", "a\nx\ny\nc\n", "a\nx\nz\nc\n",
+        "a\nx\n<<<<<<< ours\ny\n=======\nz\n>>>>>>> theirs\nc\n", 1);
+    assert_merged("a\nb", "a\nc", "a\nd", "a\n<<<<<<< ours\nc\n=======\nd\n>>>>>>> theirs\n", 1);
+    assert_merged("", "x\n", "y\n", "<<<<<<< ours\nx\n=======\ny\n>>>>>>> theirs\n", 1);
+
+    obj_hash head, head_tree, ours, theirs, conflicting, tmp;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_tree(repo, head, &head_tree) == 0);
+    git_dircache *before = create_dircache(repo);
+    char worktree_before[256] = "";
+    FILE *fptr = fs_fopen("build/ign/b.c", "rb");
+    assert(fptr != NULL);
+    worktree_before[fs_readbytes(worktree_before, 1, sizeof(worktree_before) - 1, fptr)] = '\0';
+    fs_fclose(fptr);
+
+    const char *base_text = "one\ntwo\nthree\nfour\nfive\nsix\n";
+    test_make_tree(repo, head_tree, "build/ign/b.c", base_text, &tmp);
+    obj_hash base;
+    snprintf(base, OBJ_HASH_SIZE, "%s", tmp);
+    test_make_tree(repo, base, "build/ign/b.c", "ONE\ntwo\nthree\nfour\nfive\nsix\n", &ours);
+    test_make_tree(repo, base, "build/ign/b.c", "one\ntwo\nthree\nfour\nfive\nSIX\n", &tmp);
+    test_make_tree(repo, tmp, "build/ign/y.log", "theirs log\n", &theirs);
+
+    // clean merge: both files are merged into a new tree
+    merge_result result;
+    assert(merge_trees(repo, base, ours, theirs, NULL, &result) == 0);
+    assert(result.num_conflicts == 0);
+    char *merged = test_read_tree_file(repo, result.tree, "build/ign/b.c");
+    ASSERT_STREQ(merged, "ONE\ntwo\nthree\nfour\nfive\nSIX\n")
+    free(merged);
+    merged = test_read_tree_file(repo, result.tree, "build/ign/y.log");
+    ASSERT_STREQ(merged, "theirs log\n")
+    free(merged);
+    free_merge_result(&result);
+
+    // a side that changed nothing gives the other side's tree
+    assert(merge_trees(repo, base, base, theirs, NULL, &result) == 0);
+    ASSERT_STREQ(result.tree, theirs)
+    free_merge_result(&result);
+
+    // conflict: the result holds markers, the conflict keeps all three versions
+    test_make_tree(repo, base, "build/ign/b.c", "one\ntwo\nthree\nfour\nfive\nsix\nTHEIRS\n", &tmp);
+    test_make_tree(repo, ours, "build/ign/b.c", "ONE\ntwo\nthree\nfour\nfive\nsix\nOURS\n", &conflicting);
+    merge_options options = { "HEAD", "topic", LINE_DIFF_HISTOGRAM };
+    assert(merge_trees(repo, base, conflicting, tmp, &options, &result) == 1);
+    assert(result.num_conflicts == 1);
+    assert(result.conflicts[0].kind == MERGE_CONFLICT_CONTENT);
+    ASSERT_STREQ(result.conflicts[0].path, "build/ign/b.c")
+    assert(result.conflicts[0].modes[0] != 0 && result.conflicts[0].modes[1] != 0 && result.conflicts[0].modes[2] != 0);
+    merged = test_read_tree_file(repo, result.tree, "build/ign/b.c");
+    ASSERT_STREQ(merged, "ONE\ntwo\nthree\nfour\nfive\nsix\n<<<<<<< HEAD\nOURS\n=======\nTHEIRS\n>>>>>>> topic\n")
+    free(merged);
+
+    // conflicts become stages 1-3 in an index
+    git_dircache *dircache = create_dircache(repo);
+    add_merge_conflicts_to_dc(dircache, &result);
+    git_index_entry *entry = find_index_entry(dircache, "build/ign/b.c");
+    assert(entry != NULL && entry->stage_num == 1);
+    int pos = index_lower_bound(dircache, "build/ign/b.c");
+    assert(pos + 2 < dircache->num_entries && dircache->entries[pos + 2]->stage_num == 3);
+    free_dircache(dircache);
+    free_merge_result(&result);
+
+    // merges leave the index and working tree alone
+    git_dircache *after = create_dircache(repo);
+    assert(after->num_entries == before->num_entries);
+    for (int i = 0; i < after->num_entries; i++) {
+        ASSERT_STREQ(after->entries[i]->hash, before->entries[i]->hash)
+    }
+    assert_file_contents("build/ign/b.c", worktree_before);
+    free_dircache(before);
+    free_dircache(after);
+
+    printf("================MERGE TESTS PASSED=============\n");
+}
+
+void test_replay(const git_repo *repo) {
+    obj_hash head, head_tree, tmp, base_tree, upstream_tree, base, upstream;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_tree(repo, head, &head_tree) == 0);
+    test_make_tree(repo, head_tree, "build/ign/b.c", "one\ntwo\nthree\nfour\nfive\nsix\n", &base_tree);
+    test_make_tree(repo, base_tree, "build/ign/b.c", "ONE\ntwo\nthree\nfour\nfive\nsix\n", &upstream_tree);
+    test_make_commit(repo, base_tree, &head, 1, 2100000000, &base);
+    test_make_commit(repo, upstream_tree, &base, 1, 2100000001, &upstream);
+
+    // topic: two commits on top of base
+    obj_hash topic[3], topic_tree;
+    test_make_tree(repo, base_tree, "build/ign/b.c", "one\ntwo\nthree\nfour\nfive\nSIX\n", &topic_tree);
+    test_make_commit(repo, topic_tree, &base, 1, 2100000002, &topic[0]);
+    test_make_tree(repo, topic_tree, "build/ign/y.log", "topic log\n", &tmp);
+    test_make_commit(repo, tmp, &topic[0], 1, 2100000003, &topic[1]);
+
+    replay_result result;
+    assert(replay_commits(repo, upstream, topic, 2, NULL, &result) == 0);
+    assert(result.num_replayed == 2 && result.num_skipped == 0 && result.stopped == -1);
+    commit_info info;
+    assert(read_commit_info(repo, result.tip, &info) == 0);
+    assert(info.num_parents == 1);
+    char *contents = test_read_tree_file(repo, info.tree, "build/ign/b.c");
+    ASSERT_STREQ(contents, "ONE\ntwo\nthree\nfour\nfive\nSIX\n")
+    free(contents);
+    contents = test_read_tree_file(repo, info.tree, "build/ign/y.log");
+    ASSERT_STREQ(contents, "topic log\n")
+    free(contents);
+    free_commit_info(&info);
+
+    // a commit whose changes are already in the tip is skipped
+    obj_hash tip;
+    snprintf(tip, OBJ_HASH_SIZE, "%s", result.tip);
+    free_replay_result(&result);
+    assert(replay_commits(repo, tip, topic, 1, NULL, &result) == 0);
+    assert(result.num_replayed == 0 && result.num_skipped == 1);
+    ASSERT_STREQ(result.tip, tip)
+    free_replay_result(&result);
+
+    // ...but a commit that was empty to begin with is kept
+    obj_hash empty, tip_tree;
+    test_make_commit(repo, topic_tree, &topic[0], 1, 2100000005, &empty);
+    assert(replay_commits(repo, tip, &empty, 1, NULL, &result) == 0);
+    assert(result.num_replayed == 1 && result.num_skipped == 0);
+    assert(strcmp(result.tip, tip) != 0 && read_commit_tree(repo, result.tip, &tmp) == 0);
+    assert(read_commit_tree(repo, tip, &tip_tree) == 0 && strcmp(tmp, tip_tree) == 0);
+    free_replay_result(&result);
+
+    // replay stops at a conflict, keeping the commits before it
+    test_make_tree(repo, base_tree, "build/ign/b.c", "1\ntwo\nthree\nfour\nfive\nsix\n", &tmp);
+    test_make_commit(repo, tmp, &topic[0], 1, 2100000004, &topic[2]);
+    obj_hash picks[2];
+    snprintf(picks[0], OBJ_HASH_SIZE, "%s", topic[0]);
+    snprintf(picks[1], OBJ_HASH_SIZE, "%s", topic[2]);
+    assert(replay_commits(repo, upstream, picks, 2, NULL, &result) == 1);
+    assert(result.stopped == 1 && result.num_replayed == 1);
+    assert(result.conflict.num_conflicts == 1);
+    ASSERT_STREQ(result.conflict.conflicts[0].path, "build/ign/b.c")
+    free_replay_result(&result);
+
+    // a long chain is replayed in memory, folder by folder
+    int num_commits = 200;
+    obj_hash *chain = malloc(num_commits * sizeof(obj_hash));
+    obj_hash parent, chain_tree;
+    snprintf(parent, OBJ_HASH_SIZE, "%s", base);
+    snprintf(chain_tree, OBJ_HASH_SIZE, "%s", base_tree);
+    for (int i = 0; i < num_commits; i++) {
+        char text[128];
+        snprintf(text, sizeof(text), "one\ntwo\nthree\nfour\nfive\nsix %d\n", i);
+        test_make_tree(repo, chain_tree, "build/ign/b.c", text, &tmp);
+        snprintf(chain_tree, OBJ_HASH_SIZE, "%s", tmp);
+        test_make_commit(repo, chain_tree, &parent, 1, 2100000100 + i, &chain[i]);
+        snprintf(parent, OBJ_HASH_SIZE, "%s", chain[i]);
+    }
+    clock_t start = clock();
+    assert(replay_commits(repo, upstream, chain, num_commits, NULL, &result) == 0);
+    assert(clock() - start < CLOCKS_PER_SEC);
+    assert(result.num_replayed == num_commits);
+    assert(read_commit_tree(repo, result.tip, &tmp) == 0);
+    contents = test_read_tree_file(repo, tmp, "build/ign/b.c");
+    ASSERT_STREQ(contents, "ONE\ntwo\nthree\nfour\nfive\nsix 199\n")
+    free(contents);
+    free_replay_result(&result);
+    free(chain);
+
+    printf("================REPLAY TESTS PASSED=============\n");
+}
+
+void test_gc(const git_repo *repo) {
+    obj_hash head, head_tree, dead;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_tree(repo, head, &head_tree) == 0);
+    test_write_blob(repo, "unreachable after gc test\n", &dead);
+
+    // marking reaches commits, trees and blobs from refs, but not loose blobs
+    loose_objects objects;
+    assert(list_loose_objects(repo, &objects) == 0);
+    for (int i = 1; i < objects.num_objects; i++) {
+        assert(strcmp(objects.objects[i - 1].hash, objects.objects[i].hash) < 0);
+    }
+    reach_word *bits = calloc(REACH_WORDS(objects.num_objects), sizeof(reach_word));
+    assert(mark_reachable_objects(repo, &objects, bits) == 0);
+    int pos = find_loose_object(&objects, head);
+    assert(pos >= 0 && is_reachable(bits, pos));
+    pos = find_loose_object(&objects, head_tree);
+    assert(pos >= 0 && is_reachable(bits, pos));
+    pos = find_loose_object(&objects, dead);
+    assert(pos >= 0 && !is_reachable(bits, pos));
+    assert(find_loose_object(&objects, "zz") == -1);
+    free(bits);
+    free_loose_objects(&objects);
+
+    // objects within the grace period are kept
+    gc_stats stats;
+    assert(gc_prune(repo, 0, &stats) == 0);
+    assert(stats.num_pruned == 0 && stats.num_recent > 0);
+    assert(stats.num_reachable + stats.num_recent == stats.num_objects);
+    char path[PATH_MAX];
+    obj_path(repo, dead, path);
+    assert(fs_file_exists(path));
+
+    // past it, every unreachable object goes and everything reachable stays
+    int num_reachable = stats.num_reachable;
+    assert(gc_prune(repo, time(NULL) + 60, &stats) == 0);
+    assert(stats.num_reachable == num_reachable && stats.num_pruned > 0 && stats.num_recent == 0);
+    assert(!fs_file_exists(path));
+    assert(gc_prune(repo, time(NULL) + 60, &stats) == 0);
+    assert(stats.num_objects == num_reachable && stats.num_pruned == 0);
+    git_dircache *dircache = create_dircache(repo);
+    for (int i = 0; i < dircache->num_entries; i++) {
+        obj_path(repo, dircache->entries[i]->hash, path);
+        assert(fs_file_exists(path));
+    }
+    free_dircache(dircache);
+    git_obj_tree *tree = create_tree_from_disk(repo, head_tree);
+    assert(tree != NULL);
+    free_tree(tree);
+
+    printf("================GC TESTS PASSED=============\n");
+}
+
+void test_bitmaps(const git_repo *repo) {
+    // clean runs of zeros and ones, literals, and a trailing zero run that is left out
+    uint64_t plain[200] = { 0 }, decoded[200] = { 0 };
+    for (int i = 10; i < 100; i++) {
+        plain[i] = ~(uint64_t)0;
+    }
+    plain[3] = 0x8000000000000001ULL;
+    plain[100] = 0x1234;
+    plain[150] = 1;
+    unsigned char *data;
+    size_t size = ewah_encode(plain, 200, &data);
+    assert(size > 0 && size < 200 * 8 && size % 8 == 0);
+    assert(ewah_or_into(data, size, decoded, 200) == 0);
+    assert(memcmp(plain, decoded, sizeof(plain)) == 0);
+    assert(ewah_or_into(data, size, decoded, 120) == -1);
+    free(data);
+
+    // marking without bitmaps, then with them, finds the same objects
+    loose_objects objects;
+    assert(list_loose_objects(repo, &objects) == 0);
+    reach_word *walked = calloc(REACH_WORDS(objects.num_objects), sizeof(reach_word));
+    reach_word *from_bitmaps = calloc(REACH_WORDS(objects.num_objects), sizeof(reach_word));
+    assert(mark_reachable_objects(repo, &objects, walked) == 0);
+    assert(write_reach_bitmaps(repo) == 0);
+    assert(mark_reachable_objects(repo, &objects, from_bitmaps) == 0);
+    for (int i = 0; i < objects.num_objects; i++) {
+        assert(is_reachable(walked, i) == is_reachable(from_bitmaps, i));
+    }
+
+    // HEAD's bitmap holds its commit, its parent and its tree
+    obj_hash head, head_tree;
+    commit_info info;
+    assert(resolve_head(repo, &head, NULL) == 0);
+    assert(read_commit_tree(repo, head, &head_tree) == 0);
+    assert(read_commit_info(repo, head, &info) == 0 && info.num_parents == 1);
+    reach_bitmaps *bitmaps = reach_bitmaps_open(repo);
+    assert(bitmaps != NULL && reach_bitmaps_has(bitmaps, head));
+    assert(!reach_bitmaps_has(bitmaps, head_tree));
+    uint64_t *bits = calloc((bitmaps->num_objects + 63) / 64, sizeof(uint64_t));
+    assert(reach_bitmaps_or(bitmaps, head, bits) == 1);
+    int64_t positions[3] = { reach_bitmaps_find(bitmaps, head), reach_bitmaps_find(bitmaps, info.parents[0]),
+        reach_bitmaps_find(bitmaps, head_tree) };
+    for (int i = 0; i < 3; i++) {
+        assert(positions[i] >= 0 && (bits[positions[i] / 64] >> (positions[i] % 64)) & 1);
+    }
+    free(bits);
+    free_commit_info(&info);
+    reach_bitmaps_close(bitmaps);
+
+    free(walked);
+    free(from_bitmaps);
+    free_loose_objects(&objects);
+    printf("================BITMAP TESTS PASSED=============\n");
+}
+
+void test_fsck(const git_repo *repo) {
+    // every object gc and bitmap tests left behind is reachable and intact
+    fsck_stats stats;
+    assert(fsck_objects(repo, &stats) == 0);
+    assert(stats.num_objects > 0 && stats.num_corrupt == 0 && stats.num_missing == 0);
+    assert(stats.num_bad_type == 0 && stats.num_dangling == 0);
+
+    // a commit using a blob as its tree, with a parent that is not stored
+    obj_hash blob, commit;
+    char contents[256];
+    test_write_blob(repo, "fsck test blob\n", &blob);
+    snprintf(contents, sizeof(contents), "tree %s\nparent %040d\n\nbroken commit\n", blob, 1);
+    git_obj obj;
+    create_git_obj((const unsigned char *)contents, strlen(contents), O_TYPE_COMMIT, &obj);
+    assert(write_obj_to_disk(repo, obj.hash, obj.data, obj.size) == 0);
+    snprintf(commit, OBJ_HASH_SIZE, "%s", obj.hash);
+    free(obj.data);
+    assert(fsck_objects(repo, &stats) == 1);
+    assert(stats.num_missing == 1 && stats.num_bad_type == 1 && stats.num_dangling == 1);
+    assert(stats.num_corrupt == 0);
+
+    // contents that no longer inflate
+    char path[PATH_MAX];
+    obj_path(repo, blob, path);
+    assert(delete_obj_from_disk(repo, blob) == 0);
+    FILE *file = fopen(path, "wb");
+    assert(file != NULL);
+    fputs("not zlib data", file);
+    fclose(file);
+    assert(fsck_objects(repo, &stats) == 1);
+    assert(stats.num_corrupt == 1 && stats.num_bad_type == 0);
+
+    // a header that claims more bytes than inflate
+    assert(delete_obj_from_disk(repo, blob) == 0);
+    create_git_obj((const unsigned char *)"fsck test blob\n", 15, O_TYPE_BLOB, &obj);
+    obj.data[5] = '9';
+    assert(write_obj_to_disk(repo, blob, obj.data, obj.size) == 0);
+    free(obj.data);
+    assert(fsck_objects(repo, &stats) == 1);
+    assert(stats.num_corrupt == 1 && stats.num_bad_type == 0);
+
+    assert(delete_obj_from_disk(repo, blob) == 0);
+    assert(delete_obj_from_disk(repo, commit) == 0);
+    assert(fsck_objects(repo, &stats) == 0);
+    printf("================FSCK TESTS PASSED=============\n");
+}
+
+// removes folder and everything in it
+void test_remove_dir(const char *path) {
+    fs_dir *dir = fs_dir_open(path);
+    assert(dir != NULL);
+    fs_dirent entry;
+    char entry_path[PATH_MAX];
+    while (fs_dir_next(dir, &entry) == 1) {
+        fs_path_join(path, entry.de_name, entry_path);
+        if (entry.de_type == FS_ISDIR) {
+            test_remove_dir(entry_path);
+        } else {
+            assert(fs_remove(entry_path) == 0);
+        }
+    }
+    fs_dir_close(dir);
+    assert(fs_remove(path) == 0);
+}
+
+void test_clone(const git_repo *repo) {
+    char dest_path[] = "/tmp/gordit_clone_XXXXXX";
+    assert(mkdtemp(dest_path) != NULL);
+
+    // every object is linked or copied, branches become remote-tracking refs
+    clone_stats stats;
+    assert(clone_repo(repo->root_path, dest_path, &stats) == 0);
+    assert(stats.num_objects > 0 && stats.objects.linked + stats.objects.copied == stats.num_objects);
+    assert(stats.objects.failed == 0 && stats.num_refs > 0 && stats.checkout.written > 0);
+    const git_repo *dest = get_working_repo(dest_path);
+    assert(dest != NULL);
+
+    obj_hash head, cloned_head, tracking;
+    char head_ref[PATH_MAX], cloned_ref[PATH_MAX], name[PATH_MAX];
+    assert(resolve_head(repo, &head, head_ref) == 0);
+    assert(resolve_head(dest, &cloned_head, cloned_ref) == 0);
+    ASSERT_STREQ(cloned_head, head);
+    ASSERT_STREQ(cloned_ref, head_ref);
+    if (head_ref[0] != '\0') {
+        int len = snprintf(name, PATH_MAX, REMOTES_REF_PREFIX DEFAULT_REMOTE "/%s", head_ref + strlen("refs/heads/"));
+        assert(len < PATH_MAX);
+        assert(read_ref(dest, name, &tracking) == 0);
+        ASSERT_STREQ(tracking, head);
+    }
+
+    // linked objects share the source's file
+    char src_obj[PATH_MAX], dest_obj[PATH_MAX];
+    fs_statinfo src_info, dest_info;
+    obj_path(repo, head, src_obj);
+    obj_path(dest, head, dest_obj);
+    assert(fs_getinfo(src_obj, &src_info) == 0 && fs_getinfo(dest_obj, &dest_info) == 0);
+    assert(stats.objects.linked == 0 || src_info.fi_ino == dest_info.fi_ino);
+
+    // checked out tree matches HEAD, with nothing left to stage
+    fsck_stats fsck;
+    assert(fsck_objects(dest, &fsck) == 0 && fsck.num_objects == stats.num_objects);
+    git_dircache *dircache = create_dircache(dest);
+    assert(dircache != NULL && dircache->num_entries == stats.checkout.written);
+    char file_path[PATH_MAX];
+    fs_path_join(dest_path, dircache->entries[0]->name, file_path);
+    assert(fs_file_exists(file_path));
+    free_dircache(dircache);
+
+    // each repo checks paths against its own ignore files
+    char ignore_path[PATH_MAX];
+    fs_path_join(dest_path, GIT_IGNORE_NAME, ignore_path);
+    write_test_file(ignore_path, "*.tmp\n");
+    ignore_cache_refresh(dest->ignores);
+    fs_path_join(dest_path, "x.tmp", file_path);
+    assert(is_file_ignored(dest, file_path) == 1);
+    fs_path_join(repo->root_path, "x.tmp", file_path);
+    assert(is_file_ignored(repo, file_path) == 0);
+
+    // only into empty folders
+    assert(clone_repo(repo->root_path, dest_path, NULL) == 1);
+    assert(clone_repo(dest_path, "/nonexistent/gordit/clone", NULL) != 0);
+
+    free_repo(dest);
+    test_remove_dir(dest_path);
+    printf("================CLONE TESTS PASSED=============\n");
+}
+
+void test_fetch(const git_repo *repo) {
+    char upstream_path[] = "/tmp/gordit_upstream_XXXXXX", local_path[] = "/tmp/gordit_fetch_XXXXXX";
+    assert(mkdtemp(upstream_path) != NULL && mkdtemp(local_path) != NULL);
+    assert(clone_repo(repo->root_path, upstream_path, NULL) == 0);
+    assert(clone_repo(upstream_path, local_path, NULL) == 0);
+    const git_repo *upstream = get_working_repo(upstream_path), *local = get_working_repo(local_path);
+    assert(upstream != NULL && local != NULL);
+
+    // a fresh clone has every tip already
+    fetch_stats stats;
+    assert(fetch_remote(local, NULL, &stats) == 0);
+    assert(stats.num_wants == 0 && stats.num_common > 0 && stats.num_objects == 0 && stats.num_refs == 0);
+
+    // a new branch upstream, one commit changing one file
+    obj_hash head, head_tree, tree, commit, tracking;
+    assert(resolve_head(upstream, &head, NULL) == 0);
+    assert(read_commit_tree(upstream, head, &head_tree) == 0);
+    git_dircache *dircache = create_dircache(upstream);
+    test_make_tree(upstream, head_tree, dircache->entries[0]->name, "fetched contents\n", &tree);
+    free_dircache(dircache);
+    test_make_commit(upstream, tree, &head, 1, time(NULL), &commit);
+    assert(update_ref(upstream, HEADS_REF_PREFIX "fetched", commit, "") == 0);
+
+    // only the commit, the trees on the file's path and the blob are sent. Subtrees off that
+    // path are found in the receiver through the remote's bitmap of the shared tip
+    assert(write_reach_bitmaps(upstream) == 0);
+    assert(fetch_remote(local, NULL, &stats) == 0);
+    assert(stats.num_wants == 1 && stats.num_commits == 1 && stats.num_objects >= 3 && stats.num_known > 0);
+    assert(stats.objects.linked + stats.objects.copied == stats.num_objects && stats.num_refs == 1);
+    assert(read_ref(local, REMOTES_REF_PREFIX DEFAULT_REMOTE "/fetched", &tracking) == 0);
+    ASSERT_STREQ(tracking, commit);
+    obj_hash resolved;
+    assert(resolve_rev(local, DEFAULT_REMOTE "/fetched", &resolved) == 0);
+    ASSERT_STREQ(resolved, commit);
+    assert(resolve_rev(local, DEFAULT_REMOTE, &resolved) == -1);
+    assert(update_ref(local, REMOTES_REF_PREFIX DEFAULT_REMOTE "/HEAD", commit, "") == 0);
+    assert(resolve_rev(local, DEFAULT_REMOTE, &resolved) == 0);
+    ASSERT_STREQ(resolved, commit);
+    fsck_stats fsck;
+    assert(fsck_objects(local, &fsck) == 0 && fsck.num_dangling == 0);
+
+    // the remote is found by its path too, and there is nothing left to send
+    assert(fetch_remote(local, upstream_path, &stats) == 0);
+    assert(stats.num_wants == 0 && stats.num_objects == 0 && stats.num_refs == 0);
+    assert(fetch_remote(local, "no-such-remote", &stats) == 1);
+
+    // a fetch that failed half way left only the commit of a new branch behind, so its trees
+    // and blob are still sent, before the ref is moved to it
+    assert(read_commit_tree(upstream, commit, &head_tree) == 0);
+    dircache = create_dircache(upstream);
+    test_make_tree(upstream, head_tree, dircache->entries[0]->name, "partly fetched contents\n", &tree);
+    free_dircache(dircache);
+    test_make_commit(upstream, tree, &commit, 1, time(NULL), &head);
+    assert(update_ref(upstream, HEADS_REF_PREFIX "partial", head, "") == 0);
+    size_t size;
+    unsigned char *data = create_obj_from_disk(upstream, head, &size);
+    assert(data != NULL && write_obj_to_disk(local, head, data, size) == 0);
+    free(data);
+    assert(fetch_remote(local, NULL, &stats) == 0);
+    assert(stats.num_wants == 0 && stats.num_commits == 0 && stats.num_objects >= 2 && stats.num_refs == 1);
+    assert(stats.objects.linked + stats.objects.copied == stats.num_objects);
+    assert(read_ref(local, REMOTES_REF_PREFIX DEFAULT_REMOTE "/partial", &tracking) == 0);
+    ASSERT_STREQ(tracking, head);
+    assert(fsck_objects(local, &fsck) == 0 && fsck.num_dangling == 0 && fsck.num_missing == 0);
+
+    free_repo(upstream);
+    free_repo(local);
+    test_remove_dir(upstream_path);
+    test_remove_dir(local_path);
+    printf("================FETCH TESTS PASSED=============\n");
+}
+
+void test_packed_refs(const git_repo *repo) {
+    char clone_path[] = "/tmp/gordit_packed_XXXXXX";
+    assert(mkdtemp(clone_path) != NULL);
+    assert(clone_repo(repo->root_path, clone_path, NULL) == 0);
+    const git_repo *local = get_working_repo(clone_path);
+    assert(local != NULL);
+
+    // many lightweight tags and one annotated tag
+    obj_hash head, head_tree, hash, tag;
+    char name[PATH_MAX], contents[512];
+    assert(resolve_head(local, &head, NULL) == 0);
+    assert(read_commit_tree(local, head, &head_tree) == 0);
+    for (int i = 0; i < 300; i++) {
+        snprintf(name, PATH_MAX, TAGS_REF_PREFIX "t%03d", i);
+        assert(update_ref(local, name, head, "") == 0);
+    }
+    snprintf(contents, sizeof(contents), "object %s\ntype commit\ntag v1\ntagger t <t@t> 0 +0000\n\nannotated\n", head);
+    git_obj obj;
+    create_git_obj((const unsigned char *)contents, strlen(contents), O_TYPE_TAG, &obj);
+    assert(write_obj_to_disk(local, obj.hash, obj.data, obj.size) == 0);
+    snprintf(tag, OBJ_HASH_SIZE, "%s", obj.hash);
+    free(obj.data);
+    assert(update_ref(local, TAGS_REF_PREFIX "v1", tag, "") == 0);
+
+    // packing keeps every ref and removes the loose files
+    ref_list before, after;
+    int num_packed;
+    assert(list_refs(local, &before) == 0);
+    assert(pack_refs(local, &num_packed) == 0 && num_packed == before.num_refs);
+    assert(list_refs(local, &after) == 0 && after.num_refs == before.num_refs);
+    for (int i = 0; i < after.num_refs; i++) {
+        ASSERT_STREQ(after.refs[i].name, before.refs[i].name);
+        ASSERT_STREQ(after.refs[i].hash, before.refs[i].hash);
+        if (strcmp(after.refs[i].name, TAGS_REF_PREFIX "v1") == 0) {
+            ASSERT_STREQ(after.refs[i].peeled, head);
+        } else {
+            assert(after.refs[i].peeled[0] == '\0');
+        }
+    }
+    free_ref_list(&after);
+    char git_folder[PATH_MAX], path[PATH_MAX];
+    fs_path_dirname(local->head_path, git_folder);
+    fs_path_join(git_folder, TAGS_REF_PREFIX "t000", path);
+    assert(!fs_file_exists(path));
+
+    // packed refs are found by binary search, first, last and missing ones included
+    assert(read_ref(local, TAGS_REF_PREFIX "t000", &hash) == 0);
+    ASSERT_STREQ(hash, head);
+    assert(read_ref(local, TAGS_REF_PREFIX "v1", &hash) == 0);
+    ASSERT_STREQ(hash, tag);
+    assert(read_ref(local, before.refs[0].name, &hash) == 0);
+    assert(read_ref(local, TAGS_REF_PREFIX "t15", &hash) == 1);
+    assert(read_ref(local, TAGS_REF_PREFIX "zzz", &hash) == 1);
+    assert(read_ref(local, "refs/a", &hash) == 1);
+    assert(resolve_rev(local, "t150", &hash) == 0);
+    ASSERT_STREQ(hash, head);
+
+    // a loose ref overrides its packed one, deleting removes it from packed refs
+    assert(update_ref(local, TAGS_REF_PREFIX "t010", head_tree, head) == 0);
+    assert(read_ref(local, TAGS_REF_PREFIX "t010", &hash) == 0);
+    ASSERT_STREQ(hash, head_tree);
+    assert(delete_ref(local, TAGS_REF_PREFIX "t020") == 0);
+    assert(read_ref(local, TAGS_REF_PREFIX "t020", &hash) == 1);
+    assert(update_ref(local, TAGS_REF_PREFIX "t020", head, "") == 0);
+    assert(delete_ref(local, TAGS_REF_PREFIX "t020") == 0);
+    assert(list_refs(local, &after) == 0 && after.num_refs == before.num_refs - 1);
+    for (int i = 0; i < after.num_refs; i++) {
+        assert(strcmp(after.refs[i].name, TAGS_REF_PREFIX "t020") != 0);
+        assert(i == 0 || strcmp(after.refs[i - 1].name, after.refs[i].name) < 0);
+    }
+    free_ref_list(&after);
+
+    // packing again folds the override in
+    assert(pack_refs(local, &num_packed) == 0 && num_packed == before.num_refs - 1);
+    fs_path_join(git_folder, TAGS_REF_PREFIX "t010", path);
+    assert(!fs_file_exists(path));
+    assert(read_ref(local, TAGS_REF_PREFIX "t010", &hash) == 0);
+    ASSERT_STREQ(hash, head_tree);
+
+    // the commit-graph takes packed and loose annotated tags at their commit and skips the tag to a tree
+    assert(update_ref(local, TAGS_REF_PREFIX "v2", tag, "") == 0);
+    assert(write_commit_graph(local) == 0);
+    commit_graph *graph = commit_graph_open(local);
+    uint32_t pos;
+    assert(graph != NULL && commit_graph_find(graph, head, &pos) == 1);
+    assert(commit_graph_find(graph, tag, &pos) == 0);
+    commit_graph_close(graph);
+
+    // so do reachability bitmaps
+    assert(write_reach_bitmaps(local) == 0);
+    reach_bitmaps *bitmaps = reach_bitmaps_open(local);
+    assert(bitmaps != NULL && reach_bitmaps_has(bitmaps, head));
+    reach_bitmaps_close(bitmaps);
+
+    free_ref_list(&before);
+    free_repo(local);
+    test_remove_dir(clone_path);
+    printf("================PACKED REFS TESTS PASSED=============\n");
+}
+
 int main() {
     char cwd[PATH_MAX];
     if (getcwd(cwd, sizeof(cwd)) == NULL) {
@@ -195,8 +1801,26 @@ int main() {
     test_filesystem();
     test_objects(repo);
     test_index(repo);
+    test_ignore(repo);
+    test_pathspec(repo);
+    test_commit(repo);
+    test_commit_graph(repo);
+    test_revwalk(repo);
+    test_merge_base(repo);
+    test_checkout(repo);
+    test_read_tree(repo);
+    test_line_diff();
+    test_renames(repo);
+    test_merge(repo);
+    test_replay(repo);
+    test_gc(repo);
+    test_bitmaps(repo);
+    test_fsck(repo);
+    test_clone(repo);
+    test_fetch(repo);
+    test_packed_refs(repo);
 
-    free((void *)repo);
+    free_repo(repo);
     printf("Success! All tests passed!\n");
     return 0;
 }
\ No newline at end of file